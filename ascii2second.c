@@ -0,0 +1,61 @@
+/*
+ * ascii2second
+ *     Convert the ASCII second ZR intermediate file to the binary second
+ *     intermediate file (see second_bin.h).
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "second_bin.h"
+
+/**********************************************************************/
+/*                                                                    */
+/*                               usage                                */
+/*                                                                    */
+/**********************************************************************/
+void usage(char *prog)
+{
+  fprintf(stderr, "Usage (%s): Convert the ASCII second ZR intermediate file\n"
+		  "\t to the binary format.\n", PROG_VERSION);
+  fprintf(stderr, "\t %s ascii_file binary_file\n", prog);
+  fprintf(stderr, "\t where:\n"
+		  "\t  ascii_file  '-': stdin.\n");
+  exit(-1);
+} /* usage */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             main                                   */
+/*                                                                    */
+/**********************************************************************/
+int main (int ac, char **av)
+{
+  char *infile, *outfile;
+  second_bin_t *sb;
+  FILE *fp = stdin;
+  int rc = 0;
+
+  if (ac == 3) {
+	infile = av[1];
+	outfile = av[2];
+  }
+  else usage(av[0]);
+
+  if (strcmp(infile, "-") != 0 && (fp = fopen(infile, "r")) == NULL) {
+	perror(infile);
+	exit(-1);
+  }
+  if ((sb = second_bin_create(outfile)) == NULL) exit(-1);
+  if (second_bin_add_ascii(sb, fp) < 0) {
+	fprintf(stderr, "%s: Failed to read the second intermediate file.\n",
+			infile);
+	rc = -1;
+  }
+  if (fp != stdin) fclose(fp);
+  if (second_bin_close(sb) < 0) rc = -1;
+  if (rc < 0) unlink(outfile);
+  exit(rc);
+}
@@ -0,0 +1,44 @@
+/*
+ * ascii2zr_histo
+ *     Convert the ASCII Z-R histogram file to the binary Z-R histogram
+ *     file (see zr_utils.h).
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "zr_utils.h"
+
+
+/**********************************************************************/
+/*                                                                    */
+/*                               usage                                */
+/*                                                                    */
+/**********************************************************************/
+void usage(char *prog)
+{
+  fprintf(stderr, "Usage (%s): Convert the ASCII Z-R histogram file to the binary\n"
+		  "\t format.\n", PROG_VERSION);
+  fprintf(stderr, "\t %s ascii_histo_file binary_histo_file\n", prog);
+  exit(-1);
+} /* usage */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             main                                   */
+/*                                                                    */
+/**********************************************************************/
+int main (int ac, char **av)
+{
+  ZR_histo *histo;
+  int rc;
+
+  if (ac != 3) usage(av[0]);
+  if ((histo = read_zr_histo(av[1])) == NULL) exit(-1);
+  if ((rc = write_zr_histo_bin(histo, av[2])) < 0)
+	unlink(av[2]);
+  free_zr_histo(histo);
+  exit(rc < 0 ? -1 : 0);
+}
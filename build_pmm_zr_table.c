@@ -12,6 +12,25 @@
 
 	 Options:
 	     -v:               Verbose
+	     -j nthreads:      Build the tables of the (range, raintype) pairs
+	                       with nthreads threads.
+	     -U:               Update: build outFile only if the histograms
+	                       changed since it was built (build_zr_histo -U).
+	                       outFile.sum holds a checksum of those they were
+	                       built from.
+	     -b nreplicates:   Bootstrap: after the tables, append the
+	                       percentiles (-p) of the R of each Z over
+	                       nreplicates tables built from resamples, with
+	                       replacement, of the entries of the histograms.
+	     -S sampleFile:    The sample file of inFile (build_zr_histo -S),
+	                       required by -b.
+	     -g:               -b: Resample the gauge-days, not the entries,
+	                       as the entries of a gauge and day are not
+	                       independent.
+	     -p pct,...:       -b: Percentiles (nearest rank), up to 9.
+	                       Default: 5,50,95.
+	     -s seed:          -b: Seed of the resampling (default: 1).  The
+	                       bands depend on the seed only, not on -j.
 
 	 inFile:   ZR_histograms
 	 outFile:  ZR_tables.
@@ -33,13 +52,75 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <math.h>
 
 #include "zr_utils.h"
 
 
 #define MAX_RANGE_INTERVALS 10
 #define MAX_RANGE 150.0         /* km */
+#define MAX_THREADS 32
 
+/* The PMM of the histogram pairs (cells) of a collection: cell i is
+	 pair [irange][irtype], i = irange*nrtype + irtype, as in HISTO_CUBE.
+	 The CDFs of all the cells are kept in one buffer for each axis, and
+	 the buffers are reused from one collection to the next of the same
+	 shape.
+*/
+typedef struct {
+	long ncells;
+	int nZbins, nRbins;
+	double *cdf_z;       /* [ncells * nZbins] */
+	double *cdf_r;       /* [ncells * nRbins] */
+	long *nz, *nr;       /* [ncells] Number of Z, R observations. */
+} Pmm;
+
+/* A thread's run of cells, [cell0, cell1). */
+typedef struct {
+	pthread_t thread;
+	int joinable;
+	Pmm *pmm;
+	ZR_histo *histo;
+	float *r;            /* Z-R vectors of the collection, one per cell. */
+	long cell0, cell1;
+	long failed;         /* First cell with an empty histogram; -1: none. */
+} Pmm_run;
+
+/* The bootstrap (-b): the bins of each unit resampled, an entry of the
+	 sample file or the entries of a gauge-day, and the Z-R vectors of
+	 each replicate.
+*/
+#define MAX_PERCENTILES 9
+#define NO_R -32767          /* R bin of a Z without R. */
+typedef struct {
+	int nreplicates;
+	unsigned long long seed;
+	int by_day;               /* Units: 0, the entries; 1, gauge-days. */
+	int nrange, nrtype, nZbins, nRbins;
+	int nunits;
+	long *unit_z, *unit_r;    /* [nunits+1] The bins of unit u are
+															 z_bin[unit_z[u]..unit_z[u+1]-1] and
+															 r_bin[unit_r[u]..unit_r[u+1]-1]. */
+	int *z_bin, *r_bin;       /* Bins in HISTO_CUBE(z), HISTO_CUBE(r). */
+	short *band;              /* [nreplicates][ncells * nZbins] R bins of
+															 the Z-R vectors; NO_R: none. */
+} Bootstrap;
+
+/* A record of the sample file, and its unit (new_bootstrap). */
+typedef struct {
+	long long key;
+	int rec;
+} Boot_key;
+
+/* A thread's replicates: first, first+step, ... */
+typedef struct {
+	pthread_t thread;
+	int joinable;
+	Bootstrap *boot;
+	int first, step;
+	int rc;
+} Boot_run;
 
 
 
@@ -49,101 +130,233 @@ int verbose=0;
 /*
  * Functions defined in this file.
  */
-float *zr_via_pmm(int zbin[], int nZbins, int rbin[], int nRbins);
-Zr_table *build_pmm_zr_tables(ZR_histo *histo);
+Pmm *new_pmm(long ncells, int nZbins, int nRbins);
+void free_pmm(Pmm *pmm);
+void pmm_cdfs(int *cube, long ncells, int nbins, double *cdf, long *total);
+void zr_via_pmm(double *cdf_z, int nZbins, double *cdf_r, int nRbins,
+								float *r);
+long pmm_cells(Pmm *pmm, ZR_histo *histo, long cell0, long cell1, float *r);
+void *pmm_run(void *arg);
+void free_pmm_zr_tables(Zr_table *zr);
+Zr_table *build_pmm_zr_tables(ZR_histo *histo, int nthreads);
+int compare_keys(const void *a, const void *b);
+int compare_shorts(const void *a, const void *b);
+Bootstrap *new_bootstrap(ZR_sample *sample, int nreplicates, int by_day,
+												 unsigned long long seed);
+void free_bootstrap(Bootstrap *boot);
+unsigned long long splitmix64(unsigned long long *state);
+void *boot_run(void *arg);
+int run_bootstrap(Bootstrap *boot, int nthreads);
+int write_zr_bands(Zr_table *zr, Bootstrap *boot, float *pct, int npct,
+									 char *outfile);
 void usage();
 /* int main(int argc, char **argv) */
 
 
 
+/*************************************************************/
+/*                                                           */
+/*                          new_pmm                          */
+/*                                                           */
+/*************************************************************/
+Pmm *new_pmm(long ncells, int nZbins, int nRbins)
+{
+	/* Returns the PMM buffers of 'ncells' pairs of histograms of
+		 'nZbins' and 'nRbins'; NULL, if failure.
+	*/
+	Pmm *pmm;
+
+	if ((pmm = (Pmm *)calloc(1, sizeof(Pmm))) == NULL) return(NULL);
+	pmm->ncells = ncells;
+	pmm->nZbins = nZbins;
+	pmm->nRbins = nRbins;
+	pmm->cdf_z = (double *)malloc(ncells * nZbins * sizeof(double));
+	pmm->cdf_r = (double *)malloc(ncells * nRbins * sizeof(double));
+	pmm->nz = (long *)malloc(ncells * sizeof(long));
+	pmm->nr = (long *)malloc(ncells * sizeof(long));
+	if (pmm->cdf_z == NULL || pmm->cdf_r == NULL || pmm->nz == NULL ||
+			pmm->nr == NULL)
+	{
+		free_pmm(pmm);
+		return(NULL);
+	}
+	return(pmm);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                          free_pmm                         */
+/*                                                           */
+/*************************************************************/
+void free_pmm(Pmm *pmm)
+{
+	if (pmm == NULL) return;
+	free(pmm->cdf_z);
+	free(pmm->cdf_r);
+	free(pmm->nz);
+	free(pmm->nr);
+	free(pmm);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                          pmm_cdfs                         */
+/*                                                           */
+/*************************************************************/
+void pmm_cdfs(int *cube, long ncells, int nbins, double *cdf, long *total)
+{
+	/* For each of the 'ncells' histograms of 'nbins' in 'cube' (one after
+		 the other, as in HISTO_CUBE), sets its cumulative distribution
+		 function in 'cdf' (same layout), normalized to 1, and its number
+		 of observations in 'total'.  The cdf of an empty histogram is
+		 left as counts (0).
+
+		 Counts are summed as integers, so the last bin of a cdf is 1
+		 exactly, and equal fractions of two cdfs compare equal.
+	*/
+	long icell, sum;
+	int ibin;
+	int *bin;
+	double *c;
+
+	for (icell=0; icell<ncells; icell++)
+	{
+		bin = cube + icell * nbins;
+		c = cdf + icell * nbins;
+		for (sum=0, ibin=0; ibin<nbins; ibin++)
+		{
+			sum += bin[ibin];
+			c[ibin] = (double) sum;
+		}
+		total[icell] = sum;
+		if (sum == 0) continue;
+		for (ibin=0; ibin<nbins; ibin++)
+			c[ibin] /= (double) sum;
+	}
+}
+
 /*************************************************************/
 /*                                                           */
 /*                       zr_via_pmm                          */
 /*                                                           */
 /*************************************************************/
-float *zr_via_pmm(int zbin[], int nZbins, int rbin[], int nRbins)
+void zr_via_pmm(double *cdf_z, int nZbins, double *cdf_r, int nRbins,
+								float *r)
 {
-	/* Given a histogram of radar reflectivity values Z, and a histogram
-		 of raingauge rainrate values R, creates a Z-R vector using
+	/* Given the cumulative distribution functions (cdf) of radar
+		 reflectivity values Z, and of raingauge rainrate values R
+		 (pmm_cdfs; neither empty), creates a Z-R vector using
 		 the Window_Probability_Matching_Method.
 
-		 Uses each histogram to generate a cumulative distribution
-		 function (cdf).
-
 		 For each Z value (there are 'nZbins' such values),
 		 determines the corresponding gauge rainrate value R by matching
 		 the two cdfs; ie,
 
 		 if cdf(Z[j]) = cdf(R[k]) , then Z[j] is paired with R[k].
 
-		 Returns:
-		   a Z-R vector; ie, a vector containing 'nZbins' rainrate values.
-			 NULL, if failure.
+		 Both cdfs are monotone, so one sweep of each does: the R of a Z
+		 is searched from that of the Z below it.
+
+		 Sets 'r', a vector of 'nZbins' rainrate values; -32767.0 above the
+		 highest Z observed.
 	*/
 	int ir, iz;
-	float *r;
-	float *cdf_z;        /* CDF vector for Z */
-	float *cdf_r;        /* CDF vector for R */
-	
 
-	/* Allocate and initialize a vector of R values. */
-	r = (float *)calloc(nZbins, sizeof(float));
 	for (iz=0; iz<nZbins; iz++)
 	  r[iz] = -32767.0;
 
-	/* Create a cdf(Z), using the Z_histogram. */
-	cdf_z = (float *) calloc(nZbins, sizeof(float));
-	cdf_z[0] = (float) zbin[0];
-	for (iz=1; iz<nZbins; iz++)
-		cdf_z[iz] = cdf_z[iz-1] + zbin[iz];
-	/* cdf_z[nZbins-1] contains the total number of Z observations.
-		 It better be non-zero. */
-	if (cdf_z[nZbins-1] == 0.0)
-	{
-		fprintf(stderr, "zr_via_pmm(): Empty Z_histogram.\n");
-		return(NULL);
-	}
-	if (verbose)
-	  fprintf(stderr, "Total number of Z values: %d\n", (int)cdf_z[nZbins-1]);
-	/* Normalize cdf(Z). */
-	for (iz=0; iz<nZbins; iz++)
-	  cdf_z[iz] = cdf_z[iz] / cdf_z[nZbins-1];
-
-	/* Create a cdf(R), using the R_histogram. */
-	cdf_r = (float *) calloc(nRbins, sizeof(float));
-	cdf_r[0] = (float) rbin[0];
-	for (ir=1; ir<nRbins; ir++)
-		cdf_r[ir] = cdf_r[ir-1] + rbin[ir];
-	/* cdf_r[nRbins-1] contains the total number of R observations.
-	   It better be non-zero. */
-	if (cdf_r[nRbins-1] == 0.0)
-	{
-		fprintf(stderr, "zr_via_pmm(): Empty R_histogram.\n");
-		return(NULL);
-	}
-	if (verbose)
-		fprintf(stderr, "Total number of R values: %d\n", (int)cdf_r[nRbins-1]);
-	/* Normalize cdf(R). */
-	for (ir=0; ir<nRbins; ir++)
-	  cdf_r[ir] = cdf_r[ir] / cdf_r[nRbins-1];
-
 	/* Now, loop to match each Z with an R... */
 	ir = 0;
 	for (iz=0; iz<nZbins; iz++)  /* For each Z value... */
 	{
 		/* Search for the minimum R such that cdf(R) >= cdf(Z) */
-		while (cdf_r[ir] < cdf_z[iz])
+		while (cdf_r[ir] < cdf_z[iz] && ir < nRbins-1)
 		  ir++;
 		r[iz] = (float)(ir) / RRATE_SCALE;  /* Store the R in the Z-R vector. */
 		/* If no higher Z values were observed, we're finished. */
-		if (cdf_z[iz] == cdf_z[nZbins-1]) break;
+		if (cdf_z[iz] == 1.0) break;
 	} /* end for (iz=0... */
-	/*
-	 * Free the CDF vectors, and exit.
-	 */
-	free(cdf_z);
-	free(cdf_r);
-	return(r);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                          pmm_cells                        */
+/*                                                           */
+/*************************************************************/
+long pmm_cells(Pmm *pmm, ZR_histo *histo, long cell0, long cell1, float *r)
+{
+	/* Sets the Z-R vectors of the cells 'cell0' to 'cell1'-1 of 'histo',
+		 in 'r' (nZbins per cell, as in HISTO_CUBE), with the buffers of
+		 'pmm'.  Threads may work on separate runs of cells of one 'pmm'.
+		 The Z-R vector of a cell with an empty Z or R histogram is all
+		 -32767.0.
+
+		 Returns:
+		   -1, if successful.
+		   The first cell with an empty Z or R histogram, else.
+	*/
+	int nZbins = histo->nZbins, nRbins = histo->nRbins, iz;
+	long icell, failed = -1;
+
+	pmm_cdfs(HISTO_CUBE(histo->z) + cell0 * nZbins, cell1 - cell0, nZbins,
+					 pmm->cdf_z + cell0 * nZbins, pmm->nz + cell0);
+	pmm_cdfs(HISTO_CUBE(histo->r) + cell0 * nRbins, cell1 - cell0, nRbins,
+					 pmm->cdf_r + cell0 * nRbins, pmm->nr + cell0);
+	for (icell=cell0; icell<cell1; icell++)
+	{
+		if (pmm->nz[icell] == 0 || pmm->nr[icell] == 0)
+		{
+			for (iz=0; iz<nZbins; iz++)
+				r[icell * nZbins + iz] = -32767.0;
+			if (failed < 0) failed = icell;
+			continue;
+		}
+		zr_via_pmm(pmm->cdf_z + icell * nZbins, nZbins,
+							 pmm->cdf_r + icell * nRbins, nRbins, r + icell * nZbins);
+	}
+	return(failed);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                          pmm_run                          */
+/*                                                           */
+/*************************************************************/
+void *pmm_run(void *arg)
+{
+	/* Thread: pmm_cells() of a Pmm_run. */
+	Pmm_run *run = (Pmm_run *)arg;
+
+	run->failed = pmm_cells(run->pmm, run->histo, run->cell0, run->cell1,
+													run->r);
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                     free_pmm_zr_tables                    */
+/*                                                           */
+/*************************************************************/
+void free_pmm_zr_tables(Zr_table *zr)
+{
+	/* Frees the Z-R tables of build_pmm_zr_tables(), also partly built. */
+	int irange, irtype;
+
+	if (zr == NULL) return;
+	if (zr->rain_type_str != NULL)
+		for (irtype=0; irtype<zr->nrtype; irtype++)
+			free(zr->rain_type_str[irtype]);
+	free(zr->rain_type_str);
+	free(zr->range_interval);
+	if (zr->r != NULL)
+	{
+		if (zr->r[0] != NULL)
+			free(zr->r[0][0]);  /* All the Z-R vectors, if allocated. */
+		for (irange=0; irange<zr->nrange; irange++)
+			free(zr->r[irange]);
+		free(zr->r);
+	}
+	free(zr);
 }
 
 /*************************************************************/
@@ -151,16 +364,21 @@ float *zr_via_pmm(int zbin[], int nZbins, int rbin[], int nRbins)
 /*                       build_pmm_zr_tables                 */
 /*                                                           */
 /*************************************************************/
-Zr_table *build_pmm_zr_tables(ZR_histo *histo)
+Zr_table *build_pmm_zr_tables(ZR_histo *histo, int nthreads)
 {
-	/* Builds Z-R tables, using the histograms.
+	/* Builds Z-R tables, using the histograms.  The (range, raintype)
+		 pairs of histograms are split in runs among 'nthreads' threads.
 
 		 Returns:
 		     A filled 'Zr_table' structure, if success.
 				 NULL, if failure.
   */
-	int irange, irtype;
+	int irange, irtype, i;
+	long ncells, icell, failed;
 	Zr_table *zr;
+	Pmm *pmm;
+	Pmm_run run[MAX_THREADS];
+	float *r;
 
 	/*
 	 * Create a Zr_table structure, and initialize it using info
@@ -182,36 +400,419 @@ Zr_table *build_pmm_zr_tables(ZR_histo *histo)
 	
 	/* Copy the raintype strings from the histogram to the ZR_table. */
 	zr->rain_type_str = (char **)calloc(histo->nrtype, sizeof(char *));
-	if (zr->rain_type_str == NULL) return(NULL);
+	if (zr->rain_type_str == NULL) goto failed;
 	for (irtype=0; irtype<histo->nrtype; irtype++)
 	  zr->rain_type_str[irtype] = (char *)strdup(histo->rain_type_str[irtype]);
 
 	/* Copy range intervals from the histogram to the ZR_table. */
 	zr->range_interval = (float *)calloc(histo->nrange, sizeof(float));
-	if (zr->range_interval == NULL) return(NULL);
+	if (zr->range_interval == NULL) goto failed;
 	for (irange=0; irange<histo->nrange; irange++)
 	  zr->range_interval[irange] = histo->range_interval[irange];
 
-	/* For each range interval and raintype class, construct a Z-R
-		 vector from the Z_ and R_histograms using the Probability Matching
-		 Method. */
+	/* The Z-R vectors, one block in (range, raintype) order. */
 	zr->r = (float ***)calloc(zr->nrange, sizeof(float **));
-	if (zr->r == NULL) return(NULL);
+	if (zr->r == NULL) goto failed;
 	for (irange=0; irange<zr->nrange; irange++)
 	{
 		zr->r[irange] = (float **)calloc(zr->nrtype, sizeof(float *));
-		if (zr->r[irange] == NULL) return(NULL);
+		if (zr->r[irange] == NULL) goto failed;
+	}
+	ncells = (long)zr->nrange * zr->nrtype;
+	if ((r = (float *)calloc(ncells * zr->ndbz, sizeof(float))) == NULL)
+		goto failed;
+	for (irange=0; irange<zr->nrange; irange++)
 	  for (irtype=0; irtype<zr->nrtype; irtype++)
+		  zr->r[irange][irtype] = r + (irange * zr->nrtype + irtype) * zr->ndbz;
+
+	/* For each range interval and raintype class, construct a Z-R
+		 vector from the Z_ and R_histograms using the Probability Matching
+		 Method. */
+	if ((pmm = new_pmm(ncells, histo->nZbins, histo->nRbins)) == NULL)
+		goto failed;
+	if (nthreads > ncells) nthreads = ncells;
+	for (i=0; i<nthreads; i++)
+	{
+		run[i].pmm = pmm;
+		run[i].histo = histo;
+		run[i].r = r;
+		run[i].cell0 = ncells * i / nthreads;
+		run[i].cell1 = ncells * (i+1) / nthreads;
+		run[i].joinable = i > 0 &&
+			pthread_create(&run[i].thread, NULL, pmm_run, &run[i]) == 0;
+	}
+	/* The first run, and those without a thread, are done here. */
+	for (i=0; i<nthreads; i++)
+		if (!run[i].joinable) pmm_run(&run[i]);
+	for (i=1; i<nthreads; i++)
+		if (run[i].joinable) pthread_join(run[i].thread, NULL);
+
+	/* Report the cells in order, up to the first empty histogram. */
+	failed = -1;
+	for (i=0; i<nthreads && failed < 0; i++)
+		failed = run[i].failed;
+	for (icell=0; icell<ncells; icell++)
+	{
+		if (verbose && pmm->nz[icell] != 0)
 		{
-			/* Construct a Z-R vector from this pair of Z_ and R_histograms.*/
-		  zr->r[irange][irtype] =
-			    (float *) zr_via_pmm(histo->z[irange][irtype], histo->nZbins,
-															 histo->r[irange][irtype], histo->nRbins);
-			if (zr->r[irange][irtype] == NULL) return(NULL);
-		} /* end for (irtype=0... */
-	} /* end for (irange=0... */
+			fprintf(stderr, "Total number of Z values: %ld\n", pmm->nz[icell]);
+			if (pmm->nr[icell] != 0)
+				fprintf(stderr, "Total number of R values: %ld\n", pmm->nr[icell]);
+		}
+		if (icell == failed)
+		{
+			if (pmm->nz[icell] == 0)
+				fprintf(stderr, "zr_via_pmm(): Empty Z_histogram.\n");
+			else
+				fprintf(stderr, "zr_via_pmm(): Empty R_histogram.\n");
+			break;
+		}
+	}
+	free_pmm(pmm);
+	if (failed >= 0) goto failed;
 
 	return(zr);
+
+ failed:
+	free_pmm_zr_tables(zr);
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                compare_keys, compare_shorts               */
+/*                                                           */
+/*************************************************************/
+int compare_keys(const void *a, const void *b)
+{
+	/* qsort(): Boot_keys by key, then record, so that the units, and
+		 their bins, are in the same order on every host. */
+	const Boot_key *ka = (const Boot_key *)a, *kb = (const Boot_key *)b;
+
+	if (ka->key != kb->key) return(ka->key < kb->key ? -1 : 1);
+	return(ka->rec - kb->rec);
+}
+
+int compare_shorts(const void *a, const void *b)
+{
+	return(*(const short *)a - *(const short *)b);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       new_bootstrap                       */
+/*                                                           */
+/*************************************************************/
+Bootstrap *new_bootstrap(ZR_sample *sample, int nreplicates, int by_day,
+												 unsigned long long seed)
+{
+	/* Sets up the bootstrap of 'nreplicates' replicates of the entries
+		 of 'sample', resampled one by one, or by gauge-day if 'by_day'.
+		 The bins of each unit are listed once, as indices in the
+		 histogram collections, so that a replicate is a run of
+		 increments.
+
+		 Returns NULL, if failure.
+	*/
+	Bootstrap *boot;
+	Boot_key *order = NULL;
+	ZR_sample_rec *rec;
+	long *zstart = NULL, nz, nr;
+	int i, j, u;
+
+	if ((boot = (Bootstrap *)calloc(1, sizeof(Bootstrap))) == NULL)
+	{
+		perror("new_bootstrap");
+		return(NULL);
+	}
+	boot->nreplicates = nreplicates;
+	boot->seed = seed;
+	boot->by_day = by_day;
+	boot->nrange = sample->nrange;
+	boot->nrtype = sample->nrtype;
+	boot->nZbins = sample->nZbins;
+	boot->nRbins = sample->nRbins;
+
+	/*
+	 * The entries in unit order: by gauge and day, or as in the file.
+	 */
+	order = (Boot_key *)malloc((sample->nrecs + 1) * sizeof(Boot_key));
+	zstart = (long *)malloc((sample->nrecs + 1) * sizeof(long));
+	if (order == NULL || zstart == NULL) goto failed;
+	for (i=0, nz=0; i<sample->nrecs; i++)
+	{
+		rec = &sample->rec[i];
+		order[i].key = by_day ?
+			((long long)rec->gauge << 32) | (unsigned int)rec->day : i;
+		order[i].rec = i;
+		zstart[i] = nz;
+		nz += rec->nz;
+	}
+	if (by_day)
+		qsort(order, sample->nrecs, sizeof(Boot_key), compare_keys);
+
+	boot->unit_z = (long *)malloc((sample->nrecs + 1) * sizeof(long));
+	boot->unit_r = (long *)malloc((sample->nrecs + 1) * sizeof(long));
+	boot->z_bin = (int *)malloc((sample->nzbins + 1) * sizeof(int));
+	boot->r_bin = (int *)malloc((sample->nrecs + 1) * sizeof(int));
+	if (boot->unit_z == NULL || boot->unit_r == NULL ||
+			boot->z_bin == NULL || boot->r_bin == NULL)
+		goto failed;
+	for (i=0, u=0, nz=0, nr=0; i<sample->nrecs; i++)
+	{
+		if (i == 0 || order[i].key != order[i-1].key)
+		{
+			boot->unit_z[u] = nz;
+			boot->unit_r[u] = nr;
+			u++;
+		}
+		rec = &sample->rec[order[i].rec];
+		for (j=0; j<rec->nz; j++)
+			boot->z_bin[nz++] = rec->cell * sample->nZbins +
+				sample->zbin[zstart[order[i].rec] + j];
+		if (rec->rbin >= 0)
+			boot->r_bin[nr++] = rec->cell * sample->nRbins + rec->rbin;
+	}
+	boot->unit_z[u] = nz;
+	boot->unit_r[u] = nr;
+	boot->nunits = u;
+	free(order);
+	free(zstart);
+
+	boot->band = (short *)malloc((long)nreplicates * boot->nrange *
+															 boot->nrtype * boot->nZbins * sizeof(short));
+	if (boot->band == NULL)
+	{
+		perror("new_bootstrap");
+		free_bootstrap(boot);
+		return(NULL);
+	}
+	return(boot);
+
+ failed:
+	perror("new_bootstrap");
+	free(order);
+	free(zstart);
+	free_bootstrap(boot);
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       free_bootstrap                      */
+/*                                                           */
+/*************************************************************/
+void free_bootstrap(Bootstrap *boot)
+{
+	if (boot == NULL) return;
+	free(boot->unit_z);
+	free(boot->unit_r);
+	free(boot->z_bin);
+	free(boot->r_bin);
+	free(boot->band);
+	free(boot);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        splitmix64                         */
+/*                                                           */
+/*************************************************************/
+unsigned long long splitmix64(unsigned long long *state)
+{
+	/* The next number of the SplitMix64 generator of '*state'. */
+	unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return(z ^ (z >> 31));
+}
+
+/*************************************************************/
+/*                                                           */
+/*                          boot_run                         */
+/*                                                           */
+/*************************************************************/
+void *boot_run(void *arg)
+{
+	/* Thread: build the replicates of a Boot_run.  Each has the
+		 histograms of 'nunits' units drawn with replacement, and their
+		 Z-R vectors by pmm_cells(), in the thread's own buffers.  The
+		 draws of replicate i are from a generator seeded with the seed
+		 and i, so they do not depend on the threads.
+	*/
+	Boot_run *run = (Boot_run *)arg;
+	Bootstrap *boot = run->boot;
+	ZR_histo rep;
+	Pmm *pmm = NULL;
+	float *r = NULL;
+	unsigned long long state;
+	long ncells, nz, nr, k, u, i;
+	int irep, *z_cube, *r_cube;
+	short *band;
+
+	run->rc = -1;
+	memset(&rep, 0, sizeof(rep));
+	rep.nrange = boot->nrange;
+	rep.nrtype = boot->nrtype;
+	rep.nZbins = boot->nZbins;
+	rep.nRbins = boot->nRbins;
+	ncells = (long)rep.nrange * rep.nrtype;
+	nz = ncells * rep.nZbins;
+	nr = ncells * rep.nRbins;
+	rep.z = new_histogram_vectors(rep.nrange, rep.nrtype, rep.nZbins);
+	rep.r = new_histogram_vectors(rep.nrange, rep.nrtype, rep.nRbins);
+	pmm = new_pmm(ncells, rep.nZbins, rep.nRbins);
+	r = (float *)malloc(nz * sizeof(float));
+	if (rep.z == NULL || rep.r == NULL || pmm == NULL || r == NULL)
+	{
+		perror("boot_run");
+		goto done;
+	}
+	z_cube = HISTO_CUBE(rep.z);
+	r_cube = HISTO_CUBE(rep.r);
+
+	for (irep=run->first; irep<boot->nreplicates; irep+=run->step)
+	{
+		state = boot->seed ^ ((unsigned long long)(irep + 1) * 0xD1B54A32D192ED03ULL);
+		memset(z_cube, 0, nz * sizeof(int));
+		memset(r_cube, 0, nr * sizeof(int));
+		for (k=0; k<boot->nunits; k++)
+		{
+			/* Unit u: uniform in [0, nunits), from the high 32 bits. */
+			u = (long)(((splitmix64(&state) >> 32) * (unsigned long long)boot->nunits)
+								 >> 32);
+			for (i=boot->unit_z[u]; i<boot->unit_z[u+1]; i++)
+				z_cube[boot->z_bin[i]]++;
+			for (i=boot->unit_r[u]; i<boot->unit_r[u+1]; i++)
+				r_cube[boot->r_bin[i]]++;
+		}
+		pmm_cells(pmm, &rep, 0, ncells, r);
+		band = boot->band + irep * nz;
+		for (i=0; i<nz; i++)
+			band[i] = r[i] < 0.0 ? NO_R : (short)(r[i] * RRATE_SCALE + 0.5);
+	}
+	run->rc = 1;
+
+ done:
+	free_histogram_vectors(rep.z);
+	free_histogram_vectors(rep.r);
+	free_pmm(pmm);
+	free(r);
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       run_bootstrap                       */
+/*                                                           */
+/*************************************************************/
+int run_bootstrap(Bootstrap *boot, int nthreads)
+{
+	/* Builds the replicates of 'boot' with 'nthreads' threads, each
+		 taking every nthreads'th replicate.
+		 Returns 1 if successful; -1, else.
+	*/
+	Boot_run run[MAX_THREADS];
+	int i, rc = 1;
+
+	if (nthreads > boot->nreplicates) nthreads = boot->nreplicates;
+	for (i=0; i<nthreads; i++)
+	{
+		run[i].boot = boot;
+		run[i].first = i;
+		run[i].step = nthreads;
+		run[i].joinable = i > 0 &&
+			pthread_create(&run[i].thread, NULL, boot_run, &run[i]) == 0;
+	}
+	/* The first replicates, and those without a thread, are done here. */
+	for (i=0; i<nthreads; i++)
+		if (!run[i].joinable) boot_run(&run[i]);
+	for (i=0; i<nthreads; i++)
+	{
+		if (run[i].joinable) pthread_join(run[i].thread, NULL);
+		if (run[i].rc < 0) rc = -1;
+	}
+	return(rc);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       write_zr_bands                      */
+/*                                                           */
+/*************************************************************/
+int write_zr_bands(Zr_table *zr, Bootstrap *boot, float *pct, int npct,
+									 char *outfile)
+{
+	/* Append the bootstrap section to the Z-R tables 'outfile': for
+		 each table, the 'npct' percentiles 'pct' of the R of each Z over
+		 the replicates of 'boot'.  A percentile is that of the
+		 replicates with an R for the Z (nearest rank); -32767.0 if none.
+		 read_ZR() reads the tables only, and stops before it.
+		 Returns 0 if successful; -1, else (as write_ZR).
+	*/
+	FILE *fp;
+	short *v;
+	long nz, col;
+	int irange, irtype, idbz, irep, n, ip, k;
+
+	if ((fp = fopen(outfile, "a")) == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n", outfile);
+		return(-1);
+	}
+	if ((v = (short *)malloc(boot->nreplicates * sizeof(short))) == NULL)
+	{
+		perror(outfile);
+		fclose(fp);
+		return(-1);
+	}
+	nz = (long)boot->nrange * boot->nrtype * boot->nZbins;
+	fprintf(fp, "ZR_BOOTSTRAP_SECTION\n");
+	fprintf(fp, "replicates                    %d\n", boot->nreplicates);
+	fprintf(fp, "resampled units               %d %s\n", boot->nunits,
+					boot->by_day ? "gauge-days" : "entries");
+	fprintf(fp, "seed                          %llu\n", boot->seed);
+	fprintf(fp, "percentiles                  ");
+	for (ip=0; ip<npct; ip++)
+		fprintf(fp, " %.1f", pct[ip]);
+	fprintf(fp, "\n");
+	for (irtype=0; irtype<zr->nrtype; irtype++)
+	{
+		for (irange=0; irange<zr->nrange; irange++)
+		{
+			fprintf(fp, "\nZR_BAND_HEADER\n");
+			fprintf(fp, "raintype                      %s\n", zr->rain_type_str[irtype]);
+			fprintf(fp, "range(km)                     %.2f\n",
+							zr->range_interval[irange]);
+			fprintf(fp, "ZR_BAND\n");
+			for (idbz=0; idbz<zr->ndbz; idbz++)
+			{
+				col = ((long)irange * zr->nrtype + irtype) * zr->ndbz + idbz;
+				for (irep=0, n=0; irep<boot->nreplicates; irep++)
+					if (boot->band[irep * nz + col] != NO_R)
+						v[n++] = boot->band[irep * nz + col];
+				qsort(v, n, sizeof(short), compare_shorts);
+				fprintf(fp, "%5.1f", zr->dbz_low + idbz*zr->dbz_res);
+				for (ip=0; ip<npct; ip++)
+				{
+					/* Nearest rank: the smallest with >= pct% at or below it. */
+					k = (int)ceil(pct[ip] / 100.0 * n) - 1;
+					if (k < 0) k = 0;
+					fprintf(fp, "  %.1f", n == 0 ? -32767.0 : v[k] / RRATE_SCALE);
+				}
+				fprintf(fp, "\n");
+			}
+			fprintf(fp, "\n");
+		}
+	}
+	free(v);
+	if (fclose(fp) != 0)
+	{
+		perror(outfile);
+		return(-1);
+	}
+	return(0);
 }
 
 /**********************************************************************/
@@ -238,6 +839,15 @@ void usage()
 	fprintf(stderr, "  build_pmm_zr_table [options] inFile outFile\n");
 	fprintf(stderr, "\nOptions:\n");
 	fprintf(stderr, "  -v:               Verbose\n");
+	fprintf(stderr, "  -j nthreads:      Build the tables with nthreads threads.\n");
+	fprintf(stderr, "  -U:               Build outFile only if the histograms of inFile changed\n");
+	fprintf(stderr, "                    since it was built (checksum in outFile.sum).\n");
+	fprintf(stderr, "  -b nreplicates:   Append the percentiles of the R of each Z over\n");
+	fprintf(stderr, "                    nreplicates bootstrap replicates of the entries.\n");
+	fprintf(stderr, "  -S sampleFile:    The sample file of inFile (build_zr_histo -S); for -b.\n");
+	fprintf(stderr, "  -g:               -b: Resample gauge-days, not entries.\n");
+	fprintf(stderr, "  -p pct,...:       -b: Percentiles. Default: 5,50,95.\n");
+	fprintf(stderr, "  -s seed:          -b: Seed of the resampling. Default: 1.\n");
 
 	fprintf(stderr, "\ninFile:  ZR_histogram file\n");
 	fprintf(stderr, "outFile:   output Z-R tables.\n");
@@ -258,9 +868,21 @@ extern int getopt(int argc, char * const argv[], const char *optstring);
 int main(int argc, char **argv)
 {
 	char infile[128], outfile[128];
+	char sum_file[140], tmp_file[150];
+	char *sample_file = NULL, *pcts = "5,50,95", *p, *q;
 	int c;
 	ZR_histo *histo;
 	Zr_table *zr;
+	ZR_sample *sample;
+	Bootstrap *boot = NULL;
+	int update = 0;
+	int nthreads = 1;
+	int nreplicates = 0, by_day = 0, npct;
+	unsigned long long seed = 1;
+	float pct[MAX_PERCENTILES];
+	unsigned int sum = 0, old_sum;
+	FILE *fp;
+	extern char *optarg;
 	extern int optind;
 
 	signal(SIGINT, handler);
@@ -276,13 +898,44 @@ int main(int argc, char **argv)
 	memset(outfile, '\0', sizeof(outfile));
 
 	/* Read options from command line. */
-	while ((c=getopt(argc, argv, "v")) != EOF)
+	while ((c=getopt(argc, argv, "vj:Ub:S:gp:s:")) != EOF)
 	{
 		switch (c)
 		{
 		case 'v':
 			verbose = 1;
 			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			if (nthreads < 1 || nthreads > MAX_THREADS)
+			{
+				fprintf(stderr, "\nnthreads (-j) must be 1 to %d.\n\n", MAX_THREADS);
+				usage();
+			}
+			break;
+		case 'U':
+			update = 1;
+			break;
+		case 'b':
+			nreplicates = atoi(optarg);
+			if (nreplicates < 1)
+			{
+				fprintf(stderr, "\nnreplicates (-b) must be 1 or more.\n\n");
+				usage();
+			}
+			break;
+		case 'S':
+			sample_file = optarg;
+			break;
+		case 'g':
+			by_day = 1;
+			break;
+		case 'p':
+			pcts = optarg;
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 10);
+			break;
 		default:  /* Unknown/illegal option */
 			fprintf(stderr, "\n");
 			exit(-1);
@@ -298,6 +951,30 @@ int main(int argc, char **argv)
 	}
 	strncpy(infile, argv[argc-2], 127);
 	strncpy(outfile, argv[argc-1], 127);
+	if (nreplicates > 0 && sample_file == NULL)
+	{
+		fprintf(stderr, "\n-b needs the sample file (-S).\n\n");
+		usage();
+	}
+	if (nreplicates > 0 && update)
+	{
+		fprintf(stderr, "\n-b can't be used with -U.\n\n");
+		usage();
+	}
+	/* The percentiles of -p. */
+	for (npct=0, p=pcts; npct<MAX_PERCENTILES; p++)
+	{
+		pct[npct] = (float)strtod(p, &q);
+		if (q == p || pct[npct] <= 0.0 || pct[npct] > 100.0) break;
+		npct++;
+		if (*(p = q) != ',') break;
+	}
+	if (npct == 0 || *p != '\0')
+	{
+		fprintf(stderr, "\nInvalid percentiles (-p): %s; 1 to %d of (0, 100], comma separated.\n\n",
+						pcts, MAX_PERCENTILES);
+		usage();
+	}
 
 	if (verbose)
 	{
@@ -311,15 +988,76 @@ int main(int argc, char **argv)
 	 * Read the Z-R histograms from infile.
 	 */
 	histo = (ZR_histo *) read_zr_histo(infile);
+	if (histo == NULL) exit(-1);
+	/*
+	 * -b: The units to resample, from the sample file of the histograms.
+	 */
+	if (nreplicates > 0)
+	{
+		if ((sample = read_zr_sample(sample_file)) == NULL) exit(-1);
+		if (sample->nrange != histo->nrange || sample->nrtype != histo->nrtype ||
+				sample->nZbins != histo->nZbins || sample->nRbins != histo->nRbins)
+		{
+			fprintf(stderr, "%s is not a sample file of the histograms of %s.\n",
+							sample_file, infile);
+			exit(-1);
+		}
+		boot = new_bootstrap(sample, nreplicates, by_day, seed);
+		free_zr_sample(sample);
+		if (boot == NULL) exit(-1);
+		if (verbose)
+			fprintf(stderr, "Bootstrap: %d replicates of %d %s.\n", nreplicates,
+							boot->nunits, by_day ? "gauge-days" : "entries");
+		if (run_bootstrap(boot, nthreads) < 0) exit(-1);
+	}
+	/*
+	 * -U: Nothing to do if outFile was built from the same histograms.
+	 */
+	if (update)
+	{
+		sum = zr_histo_checksum(histo);
+		sprintf(sum_file, "%s.sum", outfile);
+		if (access(outfile, F_OK) == 0 && (fp = fopen(sum_file, "r")) != NULL)
+		{
+			c = fscanf(fp, "%x", &old_sum);
+			fclose(fp);
+			if (c == 1 && old_sum == sum)
+			{
+				if (verbose) fprintf(stderr, "%s is up to date.\n", outfile);
+				exit(0);
+			}
+		}
+	}
 	/*
 	 * Build Z-R tables using the Z-R histograms.
 	 */
-	zr = (Zr_table *)build_pmm_zr_tables(histo);
+	zr = (Zr_table *)build_pmm_zr_tables(histo, nthreads);
+	free_zr_histo(histo);
 	if (zr == NULL) exit(-1);
 
   /* Write the Z-R tables to a disk file. */
 	if (verbose) fprintf(stderr, "Writing Z-R tables to file: %s\n", outfile);
-	write_ZR(zr, outfile);
+	c = write_ZR(zr, outfile);
+	if (c >= 0 && boot != NULL)
+		c = write_zr_bands(zr, boot, pct, npct, outfile);
+	free_pmm_zr_tables(zr);
+	free_bootstrap(boot);
+	if (c < 0) exit(-1);
+	sprintf(sum_file, "%s.sum", outfile);
+	if (!update)
+		unlink(sum_file);  /* It is no longer that of outFile. */
+	else
+	{
+		/* Replaced by rename(), so it is never that of other tables. */
+		sprintf(tmp_file, "%s.tmp", sum_file);
+		if ((fp = fopen(tmp_file, "w")) == NULL ||
+				fprintf(fp, "%08x\n", sum) < 0 || fclose(fp) != 0 ||
+				rename(tmp_file, sum_file) != 0)
+		{
+			perror(sum_file);
+			exit(-1);
+		}
+	}
 
 	exit(0);
 }
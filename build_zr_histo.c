@@ -10,7 +10,7 @@
 
 	 Usage:
 
-	   build_zr_histo [options] inFile outFile
+	   build_zr_histo [options] [inFile...] outFile
 
 	 Options:
 	  -v:               verbose
@@ -21,8 +21,44 @@
                       (Default: range-dependant)
     -t <mins>:        temporal gauge window interval. (Default: 10 minutes)
     -r <r1,r2,.,150>: range intervals (km) for Z-R tables
-
-	 inFile:  2nd_zr_intermediate_file from 'merge_radarNgauge_data'
+    -B:               write outFile in the binary histogram format
+                      (see zr_utils.h)
+    -l <list_file>:   also read the inFiles named in list_file
+    -j <nthreads>:    read each inFile in nthreads blocks, in
+                      parallel.  Each thread adds its block's entries
+                      to its own histograms; these are then added in
+                      order.  The output is that of -j 1.
+    -G <grid>:        build the histograms of every window
+                      configuration of grid, e.g.,
+                      "h=0:1.5:3.0,t=6:10,o=0:2", in one pass over
+                      the inFiles.  Fields c, h, t, o and d are as
+                      the options (c and d: 0 or 1); the others are
+                      from the options.  Each is written to
+                      outFile.<suffix>; e.g., outFile.h1.5t10o2.
+    -D <cubeFile>:    also write the histograms of each day to
+                      cubeFile, as running sums (see zr_utils.h);
+                      zr_histo_query gives those of any range of
+                      days from it.  With -G, cubeFile.<suffix>.
+    -S <sampleFile>:  also write each entry added to the histograms,
+                      with its gauge, day and bins, to sampleFile
+                      (see zr_utils.h), for build_pmm_zr_table -b.
+                      With -G, sampleFile.<suffix>.
+    -U:               update outFile: read only the inFiles not yet in
+                      its histograms, and add their histograms to
+                      them.  outFile.parts lists the inFiles added
+                      (full path, size and modification time) and a
+                      hash of the options, which must not change.
+                      Without new inFiles, outFile is left as is, so
+                      its tables need not be rebuilt.  The new
+                      outFiles are written to outFile.tmp, and the new
+                      parts list to outFile.parts.new, the journal,
+                      before any is replaced; a rerun after a crash
+                      finishes the replacing.
+
+	 inFile:  2nd_zr_intermediate_file from 'merge_radarNgauge_data',
+	          ASCII or binary (merge_radarNgauge_data -B).  The
+	          histograms of several inFiles are added, as by
+	          merge_zr_histo.
 	 outFile: output Z-R histograms.
 
   -----------------------------------------------------------------
@@ -42,12 +78,23 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <pthread.h>
 
+#include "zr.h"
 #include "zr_utils.h"
+#include "second_bin.h"
+#include "line_reader.h"
 
 
 #define MAX_RANGE_INTERVALS 10
 #define MAX_RANGE 150.0         /* km */
+#define ARRAY_SIZE 64            /* Initial window cells and gauge rates */
+#define MAX_THREADS 32
+#define MAX_WINDOWS 64           /* Window configurations (-G) */
 
 
 
@@ -77,17 +124,152 @@ typedef struct
 } Window;
 
 
+/* What the entries of the intermediate_file are added to. */
+typedef struct
+{
+	ZR_histo *histo;
+	Window *window;
+	/* Array of raintype indices; ie, irtype[raintype] gives the index
+	   into the histograms for a specific raintype, where raintypes are
+		 defined in the intermediate_file. */
+	int irtype[32];
+	int temporalWindow_start; /* Starting index of the temporal gauge
+															 window used to build the R_histogram. */
+	int temporalWindow_end;   /* Ending index of temporal gauge window */
+	int window_rtype;         /* Raintype of the last window with valid
+															 Z values. */
+	int rtype_known;          /* 0: No window with valid Z values yet in
+															 this block (-j); window_rtype is that of
+															 the previous block. */
+	int *pending;             /* If !rtype_known, the R_histogram bins
+															 (irange, bin, day triples) to add for
+															 the previous block's window_rtype. */
+	int npending, pending_len;
+	/* range_start[k]: the first range interval that ends at or after k km.
+		 The interval of a gauge_range in [k, k+1) is the first from there
+		 that ends at or after it. */
+	int range_start[(int)MAX_RANGE + 1];
+	ZR_histo_days *days;      /* -D: the histograms of each day too;
+															 NULL, else. */
+	ZR_sample *sample;        /* -S: the entries too; NULL, else. */
+} HistoInput;
+
+
+/* What the header of an intermediate_file says of its entries. */
+typedef struct
+{
+	int nrtype;               /* 2: DUAL, 1: UNIFORM; 0: unknown */
+	int nrain_types;
+	int rain_type[32];        /* Raintype values (> 0) in the file, ... */
+	char rain_type_str[32][32]; /* ... and their descriptive strings. */
+	int fileWindow;           /* Length (minutes) of the gauge window used to
+															 create the 2nd_intermediate file. */
+} FileHeader;
+
+
+/* The valid values of one entry (VOS_gauge window) */
+typedef struct
+{
+	float gauge_range;
+	/*
+	 * Radar affiliated variables
+	 */
+	int radar_says_rain;  /* 1, if a valid Z in spatial window,
+													 0, else. */
+	int nvalid_cells;
+	WindowCell *cell;      /* Array of triplets (rtype, z, height) */
+	int cell_len;          /* Allocated */
+	/*
+	 * Raingauge affiliated variables
+	 */
+	int gauge_says_rain;   /* 1, if a positive rainrate in temporal window,
+														0, else. */
+	int nvalid_gauge_rates;
+	float *gauge_rate;
+	int rate_len;          /* Allocated */
+	long day;              /* UT day of the VOS (ZR_HISTO_DAY) */
+	int gauge;             /* -S: index in the gauges of the sample */
+} Entry;
+
+
+
+/* A block of consecutive entries, read by one thread (-j) into its own
+	 histograms. */
+typedef struct
+{
+	pthread_t thread;
+	int joinable;
+	HistoInput *in;           /* Of each window configuration, ... */
+	ZR_histo *histo;          /* ... with the header of the file's, and own
+															 histograms. */
+	int nin;
+	line_reader_t file;       /* ASCII infile: a copy of its reader. */
+	second_bin_t *sb;         /* NULL: ASCII infile. */
+	long start, end;          /* Offsets in infile, or rows of sb. */
+	long nbad;                /* Entry lines that could not be parsed */
+	int rc;
+} Block;
+
+
+
+/* An inFile in the histograms of -U (<outFile>.parts) */
+typedef struct
+{
+	long size;                /* When it was added */
+	long mtime;
+	char *path;               /* Full path */
+} Part;
+
+
 
-/* Global variable */
+/* Global variables */
 int verbose=0;
+int nthreads=1;             /* -j */
 
 /*
  * Functions defined in this file.
  */
 int index_of_range(float range_interval[], int nrange, float gauge_range);
-ZR_histo *read_intermediate_file(ZR_histo *histo, char *infile,
-																 Window *window);
-ZR_histo *build_ZR_histo(char *infile, float *r, int nrange, Window *window);
+void init_range_start(HistoInput *in);
+int range_index(HistoInput *in, float gauge_range);
+void start_entry(Entry *entry, float gauge_range);
+void free_entry(Entry *entry);
+int add_window_cell(HistoInput *in, Entry *entry, int j, int ncells,
+										float cell_height, int rtype, float z);
+int add_gauge_rate(HistoInput *in, Entry *entry, int j, float g_rate);
+int add_entry(HistoInput *in, Entry *entry);
+int add_rec(HistoInput *in, int nin, Entry *entry, second_bin_rec_t *rec,
+						char *net, int net_len, char *id, int id_len);
+int read_binary_entries(HistoInput *in, int nin, second_bin_t *sb,
+												long start, long end);
+int read_ascii_entries(HistoInput *in, int nin, line_reader_t *file,
+											 long end, long *nbad);
+int read_blocks(HistoInput *in, int nin, line_reader_t *file,
+								second_bin_t *sb, long *nbad);
+int start_window(HistoInput *in, ZR_histo *histo, Window *window,
+								 FileHeader *hdr);
+int read_intermediate_file(ZR_histo **histo, char *infile, Window *window,
+													 int nwindows, ZR_histo_days **days,
+													 ZR_sample **samples);
+int same_site_and_rain_types(ZR_histo *histo1, ZR_histo *histo2);
+ZR_histo *new_zr_histo(float *r, int nrange);
+void free_zr_histos(ZR_histo **histo, int n);
+ZR_histo **build_zr_histograms(char **infile, int ninfiles, float *r,
+															 int nrange, Window *window, int nwindows,
+															 ZR_histo_days **days, ZR_sample **samples);
+int window_grid(char *grid, Window *base, Window *window, char **suffix);
+unsigned int run_config_hash(float *r, int nrange, Window *window,
+														 int nwindows);
+int read_parts(char *fname, unsigned int hash, Part **part, int *nparts);
+int write_parts(char *fname, unsigned int hash, Part *part, int nparts);
+int new_parts(char **infile, int ninfiles, Part **part, int *nparts);
+int out_name(char *name, char *file, char *suffix);
+int sync_file(char *fname);
+int finish_update(char *outfile, char **suffix, int nwindows,
+									char *journal_file, char *parts_file);
+int recover_update(char *outfile, char **suffix, int nwindows,
+									 unsigned int hash, char *journal_file, char *parts_file);
+int add_stored_histograms(ZR_histo *histo, char *histo_file);
 void usage();
 /* int main(int argc, char **argv) */
 
@@ -120,73 +302,771 @@ int index_of_range(float range_interval[], int nrange, float gauge_range)
 	return(-1);
 }
 
+/*************************************************************/
+/*                                                           */
+/*                      init_range_start                     */
+/*                                                           */
+/*************************************************************/
+void init_range_start(HistoInput *in)
+{
+	/* Fill in the table of the first range interval of each km. */
+	ZR_histo *histo = in->histo;
+	int k, j;
+
+	for (k=0, j=0; k<=(int)MAX_RANGE; k++)
+	{
+		while (j < histo->nrange-1 && histo->range_interval[j] < k) j++;
+		in->range_start[k] = j;
+	}
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        range_index                        */
+/*                                                           */
+/*************************************************************/
+int range_index(HistoInput *in, float gauge_range)
+{
+	/* index_of_range(), starting from the table entry of gauge_range's km.
+		 Returns -1 if error.
+	*/
+	ZR_histo *histo = in->histo;
+	int j;
+
+	if (gauge_range >= 0.0 && gauge_range <= MAX_RANGE)
+	{
+		for (j=in->range_start[(int)gauge_range]; j<histo->nrange; j++)
+			if (gauge_range <= histo->range_interval[j]) return(j);
+	}
+	return(index_of_range(histo->range_interval, histo->nrange, gauge_range));
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        start_entry                        */
+/*                                                           */
+/*************************************************************/
+void start_entry(Entry *entry, float gauge_range)
+{
+	entry->gauge_range = gauge_range;
+	entry->radar_says_rain = 0;
+	entry->nvalid_cells = 0;
+	entry->gauge_says_rain = 0;     /* 1 if a positive gauge rate */
+	entry->nvalid_gauge_rates = 0;  /* Number of positive gauge rates */
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        free_entry                         */
+/*                                                           */
+/*************************************************************/
+void free_entry(Entry *entry)
+{
+	free(entry->cell);
+	free(entry->gauge_rate);
+	memset(entry, 0, sizeof(Entry));
+}
+
+/*************************************************************/
+/*                                                           */
+/*                      add_window_cell                      */
+/*                                                           */
+/*************************************************************/
+int add_window_cell(HistoInput *in, Entry *entry, int j, int ncells,
+										float cell_height, int rtype, float z)
+{
+	/* Add the pair of values (raintype, Z) of window cell j (of 'ncells')
+		 at 'cell_height' to the entry, if they are valid and wanted.
+		 Returns -1 if out of memory; 1, else.
+	*/
+	Window *window = in->window;
+	ZR_histo *histo = in->histo;
+	float gauge_range = entry->gauge_range;
+	WindowCell *more;
+
+	/*
+	 * If only the center window cell is desired, discard all
+	 * other cells.
+	 */
+	if (window->cell_over_gauge_only)
+		if (j != (int)ncells/2) return(1);
+	/*
+	 * If this cell isn't from the desired window_height, discard it.
+	 */
+	if ( (window->height == 1.5) && (cell_height != 1.5) ) return(1);
+	else if ( (window->height == 3.0) && (cell_height != 3.0) ) return(1);
+	else if (window->height == 0.0) /* Range-dependant window height. */
+	{
+		/* If gauge_range < 100.0 , ignore data from 2nd carpi. */
+		if ((gauge_range < 100.0) && (cell_height == 3.0)) return(1);
+	}
+	/* If gauge_range >= 100.0 , no valid data in lowest carpi. */
+	if ( (gauge_range >= 100.0) && (cell_height == 1.5) ) return(1);
+
+	/*
+	 * Check for valid raintype.
+	 */
+	if (rtype == -1) return(1);  /* Discard missing/bad data */
+	if (rtype == 0) return(1);   /* No echo ??? */
+	if ( (rtype > 0) && (z > -15.0) ) entry->radar_says_rain = 1;
+
+	/*
+	 * Check for valid Z value.
+	 */
+	if (z < histo->z_low) z = histo->z_low;
+	if (z > histo->z_hi)  z = histo->z_hi;
+	/*
+	 * Save the triplet (rtype, z, height) in 'cell[]' array.
+	 */
+	if (entry->nvalid_cells == entry->cell_len)
+	{
+		entry->cell_len = entry->cell_len ? 2 * entry->cell_len : ARRAY_SIZE;
+		more = (WindowCell *)realloc(entry->cell,
+																 entry->cell_len * sizeof(WindowCell));
+		if (more == NULL)
+		{
+			perror("add_window_cell");
+			return(-1);
+		}
+		entry->cell = more;
+	}
+	entry->cell[entry->nvalid_cells].rtype = rtype;
+	entry->cell[entry->nvalid_cells].z = z;
+	entry->cell[entry->nvalid_cells].height = cell_height;
+	entry->nvalid_cells++;
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       add_gauge_rate                      */
+/*                                                           */
+/*************************************************************/
+int add_gauge_rate(HistoInput *in, Entry *entry, int j, float g_rate)
+{
+	/* Store gauge rate j of the entry if it is non-negative and recorded
+		 within the temporal gauge window.
+		 Returns -1 if out of memory; 1, else.
+	*/
+	float *more;
+
+	/* Discard gauge reading if outside temporal window. */
+	if ( (j < in->temporalWindow_start) || (j > in->temporalWindow_end) )
+		return(1);
+	if (g_rate >= 0.0)  /* Discard negative gauge readings. */
+	{
+		if (entry->nvalid_gauge_rates == entry->rate_len)
+		{
+			entry->rate_len = entry->rate_len ? 2 * entry->rate_len : ARRAY_SIZE;
+			more = (float *)realloc(entry->gauge_rate,
+															entry->rate_len * sizeof(float));
+			if (more == NULL)
+			{
+				perror("add_gauge_rate");
+				return(-1);
+			}
+			entry->gauge_rate = more;
+		}
+		entry->gauge_rate[entry->nvalid_gauge_rates] = g_rate;
+		if (g_rate > 0.0) entry->gauge_says_rain = 1;
+		entry->nvalid_gauge_rates++;
+	} /* end if if (g_rate >= 0.0) */
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                         add_entry                         */
+/*                                                           */
+/*************************************************************/
+int add_entry(HistoInput *in, Entry *entry)
+{
+	/*
+	1. If valid radar Z values exist, they are added to the
+		 appropriate Z_histogram, determined by gauge_range and raintype,
+		 and the gauge R values are added to the appropriate R_histogram.
+	2. If valid gauge rates exist, they are averaged over a temporal window,
+	   and the average added to the appropriate R_histogram.
+	3. If the entries are sampled (-S), the entry is added to the sample
+	   with those bins.
+	   Returns -1 if error; 1, else.
+	*/
+	ZR_histo *histo = in->histo;
+	int j, irange, bin, nrtype1, nrtype2, day = 0;
+	int *zhisto, *dayhisto, *more, *zbin = NULL;
+	ZR_sample_rec *srec = NULL;
+	float gauge_avg;
+
+/*	
+fprintf(stderr, "nvalid_cells:%d  nvalid_gauge_rates:%d\n", entry->nvalid_cells,
+						entry->nvalid_gauge_rates);
+*/
+	/* If both radar and gauge report no rain, discard this input line. */
+	if ( (!entry->radar_says_rain) && (!entry->gauge_says_rain) )
+		return(1);
+	/* Discard it also if the gauge is in no range interval. */
+	if ((irange = range_index(in, entry->gauge_range)) < 0)
+		return(1);
+	/* The histograms of the entry's day (-D). */
+	if (in->days && (day = zr_histo_day(in->days, entry->day)) < 0)
+		return(-1);
+	/* The entry in the sample (-S); its histograms and R bin are set
+		 below. */
+	if (in->sample)
+	{
+		if (add_zr_sample_rec(in->sample, entry->gauge, entry->day,
+													-1 - irange, -1, entry->nvalid_cells, &zbin) < 0)
+			return(-1);
+		srec = &in->sample->rec[in->sample->nrecs - 1];
+	}
+
+	if (entry->nvalid_cells > 0)  /* Any valid Z values? */
+	{
+
+		/*
+		 The radar-derived raintypes are not in general the same for all the
+		 cells in a VOS_gauge window. Do a majority-rules-decision to
+		 establish the overall raintype 'window_rtype' to characterize this
+		 window.
+		 */
+		if (histo->nrtype == 1)  /* UNIFORM Regime */
+		{
+			in->window_rtype = 1;
+		}
+		else if (histo->nrtype == 2)  /* DUAL Regime: Stratiform and Convective */
+		{
+			nrtype1 = nrtype2 = 0;
+			for (j=0; j<entry->nvalid_cells; j++)
+			{
+				if (entry->cell[j].rtype == 1) nrtype1++;
+				else if (entry->cell[j].rtype == 2) nrtype2++;
+				else fprintf(stderr, "Unknown raintype:%d in cell.\n", entry->cell[j].rtype);
+			}
+			if (nrtype1 > nrtype2) in->window_rtype = 1;
+			else in->window_rtype = 2;
+		} /* end else if (histo->nrtype == 2) */
+		else
+		{
+			fprintf(stderr, "Can't accomodate %d raintypes.\n", histo->nrtype);
+			return(-1);
+		}
+		in->rtype_known = 1;
+
+		/* Add the radar Z values from array 'cell[]' to the appropriate 
+			 Z_histogram. */
+		zhisto = histo->z[irange][in->irtype[in->window_rtype]];
+		dayhisto = in->days ?
+			in->days->z[day][irange][in->irtype[in->window_rtype]] : NULL;
+		for (j=0; j<entry->nvalid_cells; j++)
+		{
+			bin = (int)((entry->cell[j].z - histo->z_low)/histo->z_res);
+			zhisto[bin]++;
+			if (dayhisto) dayhisto[bin]++;
+			if (zbin) zbin[j] = bin;
+		}
+	} /* end if (nvalid_cells > 0) */
+	if (srec && in->rtype_known)
+		srec->cell = irange * histo->nrtype + in->irtype[in->window_rtype];
+
+
+	if (entry->nvalid_gauge_rates > 0)  /* Any valid gauge rates? */
+	{
+		/* Average the gauge readings from array 'gauge_rate[]' */
+		gauge_avg = 0.0;
+		for (j=0; j<entry->nvalid_gauge_rates; j++)
+			gauge_avg = gauge_avg + entry->gauge_rate[j];
+		gauge_avg = gauge_avg / entry->nvalid_gauge_rates;
+		/* Add the averaged gauge reading to the appropriate R_histogram. */
+		bin = (int)(gauge_avg*RRATE_SCALE);
+		if (srec) srec->rbin = bin;
+		if (in->rtype_known)
+		{
+			histo->r[irange][in->irtype[in->window_rtype]][bin]++;
+			if (in->days)
+				in->days->r[day][irange][in->irtype[in->window_rtype]][bin]++;
+		}
+		else
+		{
+			/* The raintype is that of the previous block's last window. */
+			if (in->npending + 3 > in->pending_len)
+			{
+				in->pending_len = 2 * in->pending_len + 64;
+				more = (int *)realloc(in->pending, in->pending_len * sizeof(int));
+				if (more == NULL)
+				{
+					perror("add_entry");
+					return(-1);
+				}
+				in->pending = more;
+			}
+			in->pending[in->npending++] = irange;
+			in->pending[in->npending++] = bin;
+			in->pending[in->npending++] = entry->day;
+		}
+	} /* end if (nvalid_gauge_rates > 0) */
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                          add_rec                          */
+/*                                                           */
+/*************************************************************/
+int add_rec(HistoInput *in, int nin, Entry *entry, second_bin_rec_t *rec,
+						char *net, int net_len, char *id, int id_len)
+{
+	/* Add the entry 'rec' of the intermediate_file to the histograms of
+		 each of the 'nin' window configurations: the cells of the bottom
+		 two carpis and all the gauge rates.  'net' and 'id' (net_len and
+		 id_len bytes) are its gauge, for the samples (-S).
+		 Returns -1 if error; 1, else.
+	*/
+	int i, j, k, w;
+
+	for (w=0; w<nin; w++)
+	{
+		if (in[w].sample &&
+				(entry->gauge = zr_sample_gauge(in[w].sample, net, net_len,
+																				id, id_len)) < 0)
+			return(-1);
+		/* For each of the window cells of the bottom two carpis over this
+			 raingauge, the pair of radar-derived values (rtype, z), if valid,
+			 are saved in the array cell[]; the others are discarded. */
+		start_entry(entry, rec->range);
+		entry->day = ZR_HISTO_DAY(rec->time_sec);
+		for (i=0, k=0; i<2 && i<rec->nheights; i++)  /* for the bottom two carpis... */
+			for (j=0; j<rec->ncells[i]; j++, k++)
+				if (add_window_cell(&in[w], entry, j, rec->ncells[i], rec->height[i],
+														rec->rtype[k], rec->z[k]) < 0)
+					return(-1);
+		/*
+		 * Of the gauge rainrates, only the non-negative values recorded
+		 * within the temporal gauge window are saved, in 'gauge_rate[]'.
+		 */
+		for (j=0; j<rec->nrates; j++)
+			if (add_gauge_rate(&in[w], entry, j, rec->rate[j]) < 0)
+				return(-1);
+		if (add_entry(&in[w], entry) < 0)
+			return(-1);
+	}
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                    read_binary_entries                    */
+/*                                                           */
+/*************************************************************/
+int read_binary_entries(HistoInput *in, int nin, second_bin_t *sb,
+												long start, long end)
+{
+	/* Add the entries of rows 'start' to 'end'-1 of the binary
+		 intermediate_file to the histograms of the 'nin' window
+		 configurations.
+		 Returns -1 if error; 1, else.
+	*/
+	second_bin_rec_t rec;
+	second_bin_gauge_t *gauge;
+	Entry entry;
+	long row;
+	int rc = 1;
+
+	memset(&rec, 0, sizeof(rec));
+	memset(&entry, 0, sizeof(entry));
+	for (row = start; row < end && rc > 0; row++)
+	{
+		if ((rc = second_bin_get_rec(sb, row, &rec)) == 0)
+		{
+			rc = 1;
+			continue;     /* Not an entry */
+		}
+		if (rc > 0)
+		{
+			if ((gauge = second_bin_get_gauge(sb, rec.gauge)) == NULL) rc = -1;
+			else rc = add_rec(in, nin, &entry, &rec, gauge->net, strlen(gauge->net),
+												gauge->id, strlen(gauge->id));
+		}
+	}
+	second_bin_free_rec(&rec);
+	free_entry(&entry);
+	return(rc);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                    read_ascii_entries                     */
+/*                                                           */
+/*************************************************************/
+int read_ascii_entries(HistoInput *in, int nin, line_reader_t *file,
+											 long end, long *nbad)
+{
+	/* Add the entry lines of the ASCII intermediate_file, from the next
+		 line of 'file' up to offset 'end', to the histograms of the 'nin'
+		 window configurations.  Each line
+		 is parsed in place (second_bin_parse_line), not with fscanf; blank
+		 and comment lines are skipped.  Other lines that can not be parsed
+		 (e.g., truncated, or with numbers such as '.5' or '1e3') are
+		 skipped too, and counted in '*nbad'.
+		 Returns -1 if error; 1, else.
+	*/
+	second_bin_rec_t rec;
+	Entry entry;
+	char *line;
+	int i, len, rc = 1;
+
+	memset(&rec, 0, sizeof(rec));
+	memset(&entry, 0, sizeof(entry));
+	while (rc > 0 && file->next < end &&
+				 (line = line_reader_next(file, &len)) != NULL)
+	{
+		if ((rc = second_bin_parse_line(line, len, &rec)) == 0)
+		{
+			rc = 1;
+			for (i=0; i<len && isspace((unsigned char)line[i]); i++) ;
+			if (i < len && line[i] != COMMENT_CHAR)
+				(*nbad)++;  /* Not a comment: a bad entry */
+			continue;
+		}
+		if (rc > 0)
+			rc = add_rec(in, nin, &entry, &rec, rec.fields.net, rec.fields.net_len,
+									 rec.fields.id, rec.fields.id_len);
+	}
+	second_bin_free_rec(&rec);
+	free_entry(&entry);
+	return(rc);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        read_block                         */
+/*                                                           */
+/*************************************************************/
+static void *read_block(void *arg)
+{
+	/* Thread: add the entries of a block to the block's histograms. */
+	Block *block = (Block *)arg;
+
+	if (block->sb)
+		block->rc = read_binary_entries(block->in, block->nin, block->sb,
+																		block->start, block->end);
+	else
+	{
+		block->file.next = block->start;
+		block->rc = read_ascii_entries(block->in, block->nin, &block->file,
+																	 block->end, &block->nbad);
+	}
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        read_blocks                        */
+/*                                                           */
+/*************************************************************/
+int read_blocks(HistoInput *in, int nin, line_reader_t *file,
+								second_bin_t *sb, long *nbad)
+{
+	/* Add the entries to the histograms of the 'nin' window
+		 configurations with 'nthreads' threads, each reading one block of
+		 consecutive entries into its own histograms: rows of the binary
+		 intermediate_file 'sb', or lines of the ASCII intermediate_file
+		 'file' from its next line on.  The R bins of a block's entries
+		 that precede its first window with valid Z values are added for
+		 the raintype of the previous block's last such window.  The
+		 histograms are integer counts, so their sum is that of
+		 read_ascii_entries() or read_binary_entries(); the blocks' samples
+		 (-S) are appended in order.  The ASCII lines that could not be
+		 parsed are counted in '*nbad'.
+		 Returns -1 if error; 1, else.
+	*/
+	Block *block;
+	HistoInput *bin;
+	ZR_histo *histo;
+	long start, size;
+	char *nl;
+	int k, w, n, d, irtype, rc = 1;
+
+	if ((block = (Block *)calloc(nthreads, sizeof(Block))) == NULL)
+	{
+		perror("read_blocks");
+		return(-1);
+	}
+	/*
+	 * Block boundaries: equal shares of the rows, or of the table,
+	 * moved to the start of the next line.
+	 */
+	if (sb)
+	{
+		start = 0;
+		size = sb->nrows;
+	}
+	else
+	{
+		start = file->next;
+		size = file->size;
+	}
+	for (k=0; k<nthreads; k++)
+	{
+		block[k].start = (k == 0) ? start : block[k-1].end;
+		block[k].end = start + (size - start) * (k + 1) / nthreads;
+		if (block[k].end < block[k].start) block[k].end = block[k].start;
+		if (!sb && k < nthreads-1 && block[k].end > block[k].start)
+		{
+			nl = (char *)memchr(file->data + block[k].end - 1, '\n',
+													size - block[k].end + 1);
+			block[k].end = nl ? nl - file->data + 1 : size;
+		}
+		if (!sb) block[k].file = *file;
+		block[k].sb = sb;
+		block[k].in = (HistoInput *)calloc(nin, sizeof(HistoInput));
+		block[k].histo = (ZR_histo *)calloc(nin, sizeof(ZR_histo));
+		if (block[k].in == NULL || block[k].histo == NULL)
+		{
+			perror("read_blocks");
+			rc = -1;
+			continue;
+		}
+		block[k].nin = nin;
+		for (w=0; w<nin; w++)
+		{
+			histo = in[w].histo;
+			bin = &block[k].in[w];
+			*bin = in[w];
+			bin->histo = &block[k].histo[w];
+			bin->rtype_known = (k == 0);
+			*bin->histo = *histo;
+			bin->histo->z = new_histogram_vectors(histo->nrange, histo->nrtype,
+																						histo->nZbins);
+			bin->histo->r = new_histogram_vectors(histo->nrange, histo->nrtype,
+																						histo->nRbins);
+			if (bin->histo->z == NULL || bin->histo->r == NULL) rc = -1;
+			bin->pending = NULL;
+			bin->npending = bin->pending_len = 0;
+			if (in[w].days && (bin->days = new_zr_histo_days(histo)) == NULL)
+				rc = -1;
+			if (in[w].sample && (bin->sample = new_zr_sample(histo)) == NULL)
+				rc = -1;
+		}
+	}
+
+	for (k=0; k<nthreads && rc > 0; k++)
+	{
+		block[k].joinable =
+			pthread_create(&block[k].thread, NULL, read_block, &block[k]) == 0;
+		if (!block[k].joinable) read_block(&block[k]);  /* No thread; do it here. */
+	}
+	for (k=0; k<nthreads; k++)
+	{
+		if (block[k].joinable) pthread_join(block[k].thread, NULL);
+		if (block[k].rc < 0) rc = -1;
+		*nbad += block[k].nbad;
+	}
+
+	/*
+	 * Add the blocks' histograms, in order.
+	 */
+	for (k=0; k<nthreads; k++)
+	{
+		for (w=0; w<block[k].nin; w++)
+		{
+			histo = in[w].histo;
+			bin = &block[k].in[w];
+			if (rc > 0)
+			{
+				irtype = in[w].irtype[in[w].window_rtype];
+				for (n=0; n<bin->npending; n+=3)
+				{
+					histo->r[bin->pending[n]][irtype][bin->pending[n+1]]++;
+					if (in[w].days)
+					{
+						if ((d = zr_histo_day(in[w].days, bin->pending[n+2])) < 0)
+						{
+							rc = -1;
+							break;
+						}
+						in[w].days->r[d][bin->pending[n]][irtype][bin->pending[n+1]]++;
+					}
+				}
+				if (in[w].sample && add_zr_samples(bin->sample, in[w].sample, irtype) < 0)
+					rc = -1;
+				if (bin->rtype_known)
+					in[w].window_rtype = bin->window_rtype;
+				add_zr_histo(bin->histo, histo);
+				if (in[w].days && add_zr_histo_days(bin->days, in[w].days) < 0)
+					rc = -1;
+			}
+			free_zr_histo_days(bin->days);
+			free_zr_sample(bin->sample);
+			free_histogram_vectors(bin->histo->z);
+			free_histogram_vectors(bin->histo->r);
+			free(bin->pending);
+		}
+		free(block[k].in);
+		free(block[k].histo);
+	}
+	free(block);
+	return(rc);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       start_window                        */
+/*                                                           */
+/*************************************************************/
+int start_window(HistoInput *in, ZR_histo *histo, Window *window,
+								 FileHeader *hdr)
+{
+	/* Set up the histograms 'histo' of one window configuration for the
+		 entries of the intermediate_file of header 'hdr': the rain types,
+		 the temporal gauge window and the (empty) histograms.
+		 Returns -1 if error; 1, else.
+	*/
+	float temp;
+	int j;
+
+	memset(in, 0, sizeof(HistoInput));
+	in->histo = histo;
+	in->window = window;
+	in->rtype_known = 1;
+
+	if (window->unclassified) histo->nrtype = 1;
+	else if (hdr->nrtype > 0) histo->nrtype = hdr->nrtype;
+	else
+	{
+		fprintf(stderr, "Unknown Rain Class Type\n");
+		return(-1);
+	}
+	histo->rain_type_str = (char **)calloc(histo->nrtype, sizeof(char *));
+	if (window->unclassified)
+	{
+		histo->rain_type_str[0] = (char *) strdup("UNIFORM");
+		in->irtype[1] = 0;             /* Raintype index */
+	}
+	else
+		for (j=0; j<hdr->nrain_types && j<histo->nrtype; j++)
+		{
+			histo->rain_type_str[j] = (char *) strdup(hdr->rain_type_str[j]);
+			in->irtype[hdr->rain_type[j]] = j;  /* Raintype index */
+		}
+	histo->z_low = -15.0;
+  histo->z_hi  =  70.0;
+  histo->z_res =  0.1;
+  histo->nZbins = (histo->z_hi - histo->z_low)/histo->z_res + 1 ;		
+	/*
+	 * Allocate space for 'nrange x nrtype' vectors of length 'nZbins'.
+	 * Each vector will contain a histogram of radar Z values.
+	 */
+	histo->z = new_histogram_vectors(histo->nrange, histo->nrtype,
+																	 histo->nZbins);
+	/*
+	 * Allocate space for 'nrange x nrtype' vectors of length NR_BINS.
+	 * (Max rainrate = 900 mm/hr)
+	 * Each vector will contain a histogram of gauge rainrate values.
+	 */
+	histo->r = new_histogram_vectors(histo->nrange, histo->nrtype, NR_BINS);
+	if (histo->z == NULL || histo->r == NULL) return(-1);
+	/*
+	 * Compute the lo and hi indices of the temporal window used to
+	 * select which of the gauge readings from the file we'll use
+	 * for the R-histograms.
+	 */
+	/* Lower bound */
+	temp = (hdr->fileWindow / 2.0) - (window->duration / 2.0) + window->offset;
+	if (temp < 0.0)	/* Check for valid temporal window lower bound. */
+	{
+		fprintf(stderr, "Lower index of temporal window < 0\n");
+		fprintf(stderr, "0 <= Valid temporal window indices <= %d\n\n",
+						hdr->fileWindow-1);
+		return(-1);
+	}
+	in->temporalWindow_start = (int)temp;
+
+	/* Upper bound */
+	temp = (hdr->fileWindow / 2.0) + (window->duration / 2.0) + window->offset;
+	if (temp > hdr->fileWindow)	/* Check for valid temporal upper window bound. */
+	{
+		fprintf(stderr, "Upper index of temporal window > %d\n", hdr->fileWindow-1);
+		fprintf(stderr, "0 <= Valid temporal window indices <= %d\n\n",
+						hdr->fileWindow-1);
+		return(-1);
+	}
+	in->temporalWindow_end = (int)temp;
+
+	if (verbose)
+	  fprintf(stderr, "temporalWindow_lowerIndex:%d temporalWindow_upperIndex:%d\n",
+						in->temporalWindow_start, in->temporalWindow_end);
+	init_range_start(in);
+	return(1);
+}
+
 /*************************************************************/
 /*                                                           */
 /*                   read_intermediate_file                  */
 /*                                                           */
 /*************************************************************/
-ZR_histo *read_intermediate_file(ZR_histo *histo, char *infile,
-																 Window *window)
+int read_intermediate_file(ZR_histo **histo, char *infile, Window *window,
+													 int nwindows, ZR_histo_days **days,
+													 ZR_sample **samples)
 {
 	/* 
 		 Reads the 'windowed' radar Z values and the raingauge R values
-		 from 'infile'. Uses these values to create histograms for Z and R.
-
-		 Fills header fields in the structure 'ZR_histo' based on header
+		 from 'infile'. Uses these values to create histograms for Z and R,
+		 for each of the 'nwindows' window configurations 'window[]', in
+		 histo[].  The file is read once.  If 'days' is not NULL, the
+		 entries are also added to the histograms of their day in days[]
+		 (created if NULL), which may hold those of other files.  Likewise
+		 to samples[] (-S), if not NULL.
+
+		 Fills header fields in the structures 'ZR_histo' based on header
 		 values found in 'infile'.
 
 		 Returns:
-		     Arrays of histograms for both Z and R, and a partially filled
-				 ZR_histo, if success.
-				 NULL, if failure.
+		     1, if success: arrays of histograms for both Z and R, and
+				    partially filled ZR_histo structures.
+				 -1, if failure.
   */
 	struct tm tm;
 	FILE *fp;          /* intermediate_file */
 	char *s;
-	float temp;
 #define LINE_BUF_SIZE 256
 	char buf[32], line[LINE_BUF_SIZE];
-	int i, j, irange;
-	/* Array of raintype indices; ie, irtype[raintype] gives the index
-	   into the histograms for a specific raintype, where raintypes are
-		 defined in the intermediate_file. */
-	int irtype[32];
-	/*
-	 * Radar affiliated variables
-	 */
-	int radar_says_rain;  /* 1, if a valid Z in spatial window,
-													 0, else. */
-	int ncells, nvalid_cells, nrtype1, nrtype2, rtype, window_rtype=0;
-	float cell_height, z;
-#define ARRAY_SIZE 64
-	WindowCell cell[ARRAY_SIZE];  /* Array of triplets (rtype, z, height) */
-	/*
-	 * Raingauge affiliated variables
-	 */
-	int gauge_says_rain;   /* 1, if a positive rainrate in temporal window,
-														0, else. */
-	int ngauge_rates, nvalid_gauge_rates;
-	int fileWindow;    /* Length (minutes) of the gauge window used to
-												create the 2nd_intermediate file. */
-	int temporalWindow_start; /* Starting index of the temporal gauge
-															 window used to build the R_histogram. */
-	int temporalWindow_end;   /* Ending index of temporal gauge window */
-	float gauge_range, g_rate, gauge_rate[ARRAY_SIZE], gauge_avg;
-	/*
-	 * Z_ and R_histograms
-	 */
-	int ***zbin, ***rbin;
+	int w, rtype, rc;
+	HistoInput *in;    /* Of each window configuration */
+	FileHeader hdr;
+	second_bin_t *sb = NULL;   /* Binary intermediate_file */
+	line_reader_t *file = NULL; /* ASCII intermediate_file, in memory */
+	char *header;
+	int header_len;
+	long nbad = 0;     /* Entry lines that could not be parsed */
+
+	memset(&hdr, 0, sizeof(hdr));
 
 
 	putenv("ZT=UT"); /* No local time zone conversion w/ mktime. */
 	/*
-	 * Open the intermediate_file for input.
+	 * Open the intermediate_file for input.  The header of a binary
+	 * intermediate_file is read from a temporary file.
 	 */
-	fp = fopen(infile, "r");
+	if (second_bin_is_bin_file(infile))
+	{
+		if ((sb = second_bin_open_read(infile)) == NULL) return(-1);
+		header = second_bin_header(sb, &header_len);
+		if ((fp = tmpfile()) == NULL ||
+				fwrite(header, 1, header_len, fp) != header_len)
+		{
+			perror(infile);
+			if (fp) fclose(fp);
+			second_bin_close(sb);
+			return(-1);
+		}
+		rewind(fp);
+	}
+	else
+	  fp = fopen(infile, "r");
 	if (fp == NULL)
 	{
 	  fprintf(stderr, "Error opening file: %s\n", infile);
-		return(NULL);
+		return(-1);
 	}
 	/*
 	 * Find the 1st header line in the intermediate_file.
@@ -200,13 +1080,14 @@ ZR_histo *read_intermediate_file(ZR_histo *histo, char *infile,
 	{
 		fprintf(stderr, "Intermediate table format error.\n");
 		fclose(fp);
-		return(NULL);
+		if (sb) second_bin_close(sb);
+		return(-1);
 	}
 	/*
 	 * Read the various header lines from the intermediate_file.
 	 */
 #define START_COLUMN 35
-  sprintf(histo->site_name, "%s", &s[START_COLUMN]);  /* Site Name */
+  sprintf(histo[0]->site_name, "%s", &s[START_COLUMN]);  /* Site Name */
 
   s = fgets(line, sizeof(line), fp); chop(s); /* Start date/time */
   memset(&tm, 0, sizeof(tm));
@@ -220,7 +1101,7 @@ ZR_histo *read_intermediate_file(ZR_histo *histo, char *infile,
   tm.tm_year -= 1900;
   tm.tm_mon --;
   tm.tm_isdst = -1;    /* Don't use daylight savings time. */
-  histo->start_time = mktime(&tm);
+  histo[0]->start_time = mktime(&tm);
   
   s = fgets(line, sizeof(line), fp); chop(s); /* Stop date/time */
   memset(&tm, 0, sizeof(tm));
@@ -234,339 +1115,756 @@ ZR_histo *read_intermediate_file(ZR_histo *histo, char *infile,
   tm.tm_year -= 1900;
   tm.tm_mon --;
   tm.tm_isdst = -1;    /* Don't use daylight savings time. */
-  histo->stop_time = mktime(&tm);
+  histo[0]->stop_time = mktime(&tm);
 	
   s = fgets(line, sizeof(line), fp); chop(s); /* Radar lat */
-  sscanf(&s[START_COLUMN], "%f", &histo->radar_lat);
+  sscanf(&s[START_COLUMN], "%f", &histo[0]->radar_lat);
 
   s = fgets(line, sizeof(line), fp); chop(s); /* Radar lon */
-  sscanf(&s[START_COLUMN], "%f", &histo->radar_lon);
+  sscanf(&s[START_COLUMN], "%f", &histo[0]->radar_lon);
 
   s = fgets(line, sizeof(line), fp); chop(s); /* Gauge_window_size */
 
   s = fgets(line, sizeof(line), fp); chop(s); /* Rain class type */
-	if (window->unclassified) histo->nrtype = 1;
-	else if (strcmp(&s[START_COLUMN], "DUAL") == 0) histo->nrtype = 2;
-	else if (strcmp(&s[START_COLUMN], "UNIFORM") == 0) histo->nrtype = 1;
-	else
-	{
-		fprintf(stderr, "Unknown Rain Class Type\n");
-		goto error_exit;
-	}
+	if (strcmp(&s[START_COLUMN], "DUAL") == 0) hdr.nrtype = 2;
+	else if (strcmp(&s[START_COLUMN], "UNIFORM") == 0) hdr.nrtype = 1;
+	else hdr.nrtype = 0;  /* Unknown; only with -d */
 
 	s = fgets(line, sizeof(line), fp);  /* Number of rain types */
 	
-	histo->rain_type_str = (char **)calloc(histo->nrtype, sizeof(char *));
 	/*
 	 * Read the rain types.
 	 */
-	j = 0;
+	hdr.nrain_types = 0;
 	while ((s = fgets(line, sizeof(line), fp)))
 	{
 		chop(s);
 		if (strncmp(line, " Rain_type_value", 6) != 0) break; /* End rain_types */
-		sscanf(&s[START_COLUMN], "%d %s", &rtype, buf);
+		sscanf(&s[START_COLUMN], "%d %31s", &rtype, buf);
 		if (rtype < 1) continue;  /* Ignore 0 and -1 */
-		if (window->unclassified) continue; /* Will handle this case below. */
-		histo->rain_type_str[j] = (char *) strdup(buf); /* Raintype descriptive string */
-		irtype[rtype] = j;              /* Raintype index */
-		j++;
+		if (rtype >= 32 || hdr.nrain_types == 32) continue;
+		hdr.rain_type[hdr.nrain_types] = rtype;
+		strcpy(hdr.rain_type_str[hdr.nrain_types], buf); /* Raintype descriptive string */
+		hdr.nrain_types++;
+	}
+	/*
+	 * window duration (minutes) used to generate the
+	 * intermediate file.
+	 */
+	if (s) sscanf(&s[START_COLUMN], "%d", &hdr.fileWindow);  /* Window_time_range */
+
+	/*
+	 * The histograms of each window configuration.
+	 */
+	if ((in = (HistoInput *)calloc(nwindows, sizeof(HistoInput))) == NULL)
+	{
+		perror("read_intermediate_file");
+		fclose(fp);
+		if (sb) second_bin_close(sb);
+		return(-1);
+	}
+	for (w=0; w<nwindows; w++)
+	{
+		if (w > 0)
+		{
+			strcpy(histo[w]->site_name, histo[0]->site_name);
+			histo[w]->start_time = histo[0]->start_time;
+			histo[w]->stop_time = histo[0]->stop_time;
+			histo[w]->radar_lat = histo[0]->radar_lat;
+			histo[w]->radar_lon = histo[0]->radar_lon;
+		}
+		if (start_window(&in[w], histo[w], &window[w], &hdr) < 0)
+		{
+			fclose(fp);
+			if (sb) second_bin_close(sb);
+			free(in);
+			return(-1);
+		}
+		if (samples)
+		{
+			if (samples[w] == NULL &&
+					(samples[w] = new_zr_sample(histo[w])) == NULL)
+				goto error_exit;
+			if (samples[w]->nrtype != histo[w]->nrtype)
+			{
+				fprintf(stderr, "Rain types differ from those of the first file.\n");
+				goto error_exit;
+			}
+			in[w].sample = samples[w];
+		}
+		if (days == NULL) continue;
+		if (days[w] == NULL && (days[w] = new_zr_histo_days(histo[w])) == NULL)
+			goto error_exit;
+		if (days[w]->nrange != histo[w]->nrange ||
+				days[w]->nrtype != histo[w]->nrtype ||
+				days[w]->nZbins != histo[w]->nZbins ||
+				days[w]->nRbins != histo[w]->nRbins)
+		{
+			fprintf(stderr, "Rain types differ from those of the first file.\n");
+			goto error_exit;
+		}
+		in[w].days = days[w];
+	}
+
+	/*
+	 * Find the data table in the file.
+	 */
+	while ((s = fgets(line, sizeof(line), fp)))
+	{
+		chop(s);
+		if (strncmp(line, "Table begins", 10) == 0) break;
+	}
+	if (s == NULL)
+	{
+		fprintf(stderr, "Intermediate table format error.\n");
+		fclose(fp);
+		if (sb) second_bin_close(sb);
+		free(in);
+		return(-1);
+	}
+
+	/*
+	 * The entries: the lines of the table of an ASCII intermediate_file,
+	 * read from memory, or the rows of a binary one.  Each entry is
+	 * added to the histograms of every window configuration.
+	 */
+	if (!sb)
+	{
+		if ((file = line_reader_open(infile)) == NULL) goto error_exit;
+		file->next = ftell(fp);
+	}
+	if (nthreads > 1)
+		rc = read_blocks(in, nwindows, file, sb, &nbad);
+	else if (sb)
+		rc = read_binary_entries(in, nwindows, sb, 0, sb->nrows);
+	else
+		rc = read_ascii_entries(in, nwindows, file, file->size, &nbad);
+	if (rc < 0)
+		goto error_exit;
+	if (nbad > 0)
+		fprintf(stderr, "Warning: %s: %ld entry lines could not be parsed; "
+						"skipped.\n", infile, nbad);
+
+	/* Success... */
+	fclose(fp);
+	if (file) line_reader_close(file);
+	if (sb) second_bin_close(sb);
+	free(in);
+	return(1);
+
+ error_exit:
+	fprintf(stderr, "Error reading file: %s\n", infile);
+	fclose(fp);
+	if (file) line_reader_close(file);
+	if (sb) second_bin_close(sb);
+	free(in);
+	return(-1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                   same_site_and_rain_types                */
+/*                                                           */
+/*************************************************************/
+int same_site_and_rain_types(ZR_histo *histo1, ZR_histo *histo2)
+{
+	/* Returns 1 if the two histograms are of the same radar site and
+		 rain types; 0, else.
+	*/
+	int irtype;
+
+	if (strcmp(histo1->site_name, histo2->site_name) != 0) return(0);
+	if (histo1->radar_lat != histo2->radar_lat) return(0);
+	if (histo1->radar_lon != histo2->radar_lon) return(0);
+	if (histo1->nrtype != histo2->nrtype) return(0);
+	for (irtype=0; irtype<histo1->nrtype; irtype++)
+		if (strcmp(histo1->rain_type_str[irtype],
+							 histo2->rain_type_str[irtype]) != 0)
+			return(0);
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        new_zr_histo                       */
+/*                                                           */
+/*************************************************************/
+ZR_histo *new_zr_histo(float *r, int nrange)
+{
+	/* Create a ZR_histo structure, and fill some slots with the
+		 info that we currently know.
+	*/
+	int irange;
+	ZR_histo *histo;
+
+  histo = (ZR_histo *) calloc(1, sizeof(ZR_histo));
+	histo->range_interval = (float *)calloc(nrange, sizeof(float));
+	/* Move range values from the array 'r' to the ZR_histo structure. */
+	for (irange=0; irange<nrange; irange++)
+	  histo->range_interval[irange] = r[irange];
+	histo->nrange = nrange;
+
+	histo->nRbins = NR_BINS;
+	histo->r_low = 0.0;
+	histo->r_hi = NR_BINS / RRATE_SCALE;
+	histo->r_res = 1.0 / RRATE_SCALE;
+	return(histo);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       free_zr_histos                      */
+/*                                                           */
+/*************************************************************/
+void free_zr_histos(ZR_histo **histo, int n)
+{
+	/* Free the array of 'n' histograms 'histo'. */
+	int w;
+
+	if (histo == NULL) return;
+	for (w=0; w<n; w++)
+		if (histo[w]) free_zr_histo(histo[w]);
+	free(histo);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                      build_zr_histograms                  */
+/*                                                           */
+/*************************************************************/
+ZR_histo **build_zr_histograms(char **infile, int ninfiles, float *r,
+															 int nrange, Window *window, int nwindows,
+															 ZR_histo_days **days, ZR_sample **samples)
+{
+	/* Builds Z-R histograms, using the radar and raingauge data
+		 found in the 'ninfiles' files 'infile', for each of the
+		 'nwindows' window configurations 'window[]'.  Each file is read
+		 once.  The histograms of the files are added, as by
+		 merge_zr_histo: the header is that of the first file.
+		 If 'days' is not NULL, days[] are set to the histograms of
+		 each day of each window configuration (-D); if 'samples' is not
+		 NULL, samples[] to their entries (-S).
+
+		 Returns:
+		     An array of 'nwindows' filled 'ZR_histo' structures, if success.
+				 NULL, if failure.
+  */
+	int i, w;
+	ZR_histo **histo, **fileHisto = NULL;
+
+	/*
+	 * Read the radar and raingauge values from the intermediate
+	 * files, and build Z_ and R_ histograms.
+	 */
+	if ((histo = (ZR_histo **)calloc(nwindows, sizeof(ZR_histo *))) == NULL)
+	{
+		perror("build_zr_histograms");
+		return(NULL);
+	}
+	for (w=0; w<nwindows; w++)
+		if ((histo[w] = new_zr_histo(r, nrange)) == NULL) goto error_exit;
+	if (read_intermediate_file(histo, infile[0], window, nwindows, days,
+														 samples) < 0)
+		goto error_exit;
+	for (i=1; i<ninfiles; i++)
+	{
+		if (verbose) fprintf(stderr, "Reading %s\n", infile[i]);
+		fileHisto = (ZR_histo **)calloc(nwindows, sizeof(ZR_histo *));
+		if (fileHisto == NULL) goto error_exit;
+		for (w=0; w<nwindows; w++)
+			if ((fileHisto[w] = new_zr_histo(r, nrange)) == NULL) goto error_exit;
+		if (read_intermediate_file(fileHisto, infile[i], window, nwindows,
+															 days, samples) < 0)
+			goto error_exit;
+		if (!same_site_and_rain_types(fileHisto[0], histo[0]))
+		{
+			fprintf(stderr, "Site or rain types of %s differ from those of %s.\n",
+							infile[i], infile[0]);
+			goto error_exit;
+		}
+		for (w=0; w<nwindows; w++)
+			add_zr_histo(fileHisto[w], histo[w]);
+		free_zr_histos(fileHisto, nwindows);
+		fileHisto = NULL;
+	}
+
+	return(histo);
+
+ error_exit:
+	free_zr_histos(fileHisto, nwindows);
+	free_zr_histos(histo, nwindows);
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        window_grid                        */
+/*                                                           */
+/*************************************************************/
+int window_grid(char *grid, Window *base, Window *window, char **suffix)
+{
+	/* Expand the grid of window configurations 'grid' (-G), e.g.,
+		 "h=0:1.5:3.0,t=6:10,o=0:2", into window[], at most MAX_WINDOWS:
+		 every combination of the values of its fields, the last field
+		 varying fastest.  The fields are c, h, t, o and d, as the options
+		 of the same name (c=0 or 1; d=0 or 1); the others are those of
+		 'base'.  suffix[w] is set to the outFile suffix of window[w]:
+		 '.', and each field with its value as given; e.g., ".h1.5t10o2".
+
+		 Returns the number of window configurations; -1, if error.
+	*/
+#define MAX_GRID_FIELDS 5
+	char field[MAX_GRID_FIELDS + 1];    /* Field names, in order */
+	char *value[MAX_GRID_FIELDS][MAX_WINDOWS];
+	int nvalues[MAX_GRID_FIELDS], k[MAX_GRID_FIELDS];
+	int nfields = 0, nwindows = 1;
+	char *s, *tok, *v, *save1, *save2;
+	int f, w, len;
+	Window *win;
+
+	field[0] = '\0';
+	if ((s = strdup(grid)) == NULL)
+	{
+		perror("window_grid");
+		return(-1);
+	}
+	for (tok = strtok_r(s, ",", &save1); tok; tok = strtok_r(NULL, ",", &save1))
+	{
+		if (nfields == MAX_GRID_FIELDS || tok[0] == '\0' ||
+				strchr("chtod", tok[0]) == NULL || tok[1] != '=' ||
+				strchr(field, tok[0]))
+		{
+			fprintf(stderr, "\n-G: Invalid field: %s\n\n", tok);
+			free(s);
+			return(-1);
+		}
+		field[nfields] = tok[0];
+		field[nfields+1] = '\0';
+		nvalues[nfields] = 0;
+		for (v = strtok_r(tok+2, ":", &save2); v; v = strtok_r(NULL, ":", &save2))
+		{
+			if (nvalues[nfields] == MAX_WINDOWS) break;  /* Too many anyway */
+			value[nfields][nvalues[nfields]++] = v;
+		}
+		if (nvalues[nfields] == 0)
+		{
+			fprintf(stderr, "\n-G: No values for %c\n\n", tok[0]);
+			free(s);
+			return(-1);
+		}
+		nwindows *= nvalues[nfields];
+		if (nwindows > MAX_WINDOWS)
+		{
+			fprintf(stderr, "\n-G: More than %d window configurations\n\n",
+							MAX_WINDOWS);
+			free(s);
+			return(-1);
+		}
+		nfields++;
+	}
+
+	memset(k, 0, sizeof(k));
+	for (w=0; w<nwindows; w++)
+	{
+		win = &window[w];
+		*win = *base;
+		len = 2;
+		for (f=0; f<nfields; f++)
+			len += 1 + strlen(value[f][k[f]]);
+		if ((suffix[w] = (char *)malloc(len)) == NULL)
+		{
+			perror("window_grid");
+			nwindows = -1;
+			break;
+		}
+		strcpy(suffix[w], ".");
+		for (f=0; f<nfields; f++)
+		{
+			v = value[f][k[f]];
+			sprintf(suffix[w] + strlen(suffix[w]), "%c%s", field[f], v);
+			switch (field[f])
+			{
+			case 'c':
+				win->cell_over_gauge_only = atoi(v);
+				break;
+			case 'h':
+				win->height = atof(v);
+				if (win->height != 0.0 && win->height != 1.5 && win->height != 3.0)
+				{
+					fprintf(stderr, "\n-G: Invalid window height arg:%s\n\n", v);
+					nwindows = -1;
+				}
+				break;
+			case 't':
+				win->duration = (int) atof(v);
+				if (win->duration < 1)
+				{
+					fprintf(stderr, "\n-G: Invalid temporal window:%s\n\n", v);
+					nwindows = -1;
+				}
+				break;
+			case 'o':
+				win->offset = atof(v);
+				break;
+			case 'd':
+				win->unclassified = atoi(v);
+				break;
+			}
+		}
+		if (nwindows < 0) break;
+		/* Next combination: the last field varies fastest. */
+		for (f=nfields-1; f>=0; f--)
+		{
+			if (++k[f] < nvalues[f]) break;
+			k[f] = 0;
+		}
+	}
+	free(s);
+	return(nwindows);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                      run_config_hash                      */
+/*                                                           */
+/*************************************************************/
+unsigned int run_config_hash(float *r, int nrange, Window *window,
+														 int nwindows)
+{
+	/* FNV-1a of what the histograms of an inFile depend on, besides the
+		 inFile: the range intervals and the window configurations.
+	*/
+	char str[256];
+	unsigned int h = 2166136261u;
+	int i;
+	char *p;
+
+#define HASH_STR(s) for (p = (s); *p; p++) h = (h ^ (unsigned char) *p) * 16777619u
+	for (i=0; i<nrange; i++)
+	{
+		sprintf(str, "%.2f ", r[i]);
+		HASH_STR(str);
 	}
-	if (window->unclassified)
+	for (i=0; i<nwindows; i++)
 	{
-		histo->rain_type_str[0] = (char *) strdup("UNIFORM");
-		irtype[1] = 0;             /* Raintype index */
+		sprintf(str, "\n%d %.1f %d %.2f %d", window[i].cell_over_gauge_only,
+						window[i].height, window[i].duration, window[i].offset,
+						window[i].unclassified);
+		HASH_STR(str);
 	}
-	histo->z_low = -15.0;
-  histo->z_hi  =  70.0;
-  histo->z_res =  0.1;
-  histo->nZbins = (histo->z_hi - histo->z_low)/histo->z_res + 1 ;		
-	/*
-	 * Allocate space for 'nrange x nrtype' vectors of length 'nZbins'.
-	 * Each vector will contain a histogram of radar Z values.
-	 */
-	zbin = (int ***) new_histogram_vectors(histo->nrange, histo->nrtype,
-																				 histo->nZbins);
-	histo->z = zbin;
-	/*
-	 * Allocate space for 'nrange x nrtype' vectors of length NR_BINS.
-	 * (Max rainrate = 900 mm/hr)
-	 * Each vector will contain a histogram of gauge rainrate values.
-	 */
-	rbin = (int ***) new_histogram_vectors(histo->nrange, histo->nrtype,
-																				 NR_BINS);
-	histo->r = rbin;
-	/*
-	 * window duration (minutes) used to generate the
-	 * intermediate file.
-	 */
-	sscanf(&s[START_COLUMN], "%d", &fileWindow);  /* Window_time_range */
-	/*
-	 * Compute the lo and hi indices of the temporal window used to
-	 * select which of the gauge readings from the file we'll use
-	 * for the R-histograms.
-	 */
-	/* Lower bound */
-	temp = (fileWindow / 2.0) - (window->duration / 2.0) + window->offset;
-	if (temp < 0.0)	/* Check for valid temporal window lower bound. */
+#undef HASH_STR
+	return(h);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                         read_parts                        */
+/*                                                           */
+/*************************************************************/
+int read_parts(char *fname, unsigned int hash, Part **part, int *nparts)
+{
+	/* Read the parts file 'fname' (-U) of the configuration 'hash': the
+		 inFiles already in the histograms, into the array 'part' of
+		 '*nparts'.
+		 Returns 1 if successful; 0 if there is no parts file; -1, else.
+	*/
+	FILE *fp;
+	char line[PATH_MAX + 64];
+	unsigned int parts_hash;
+	long size, mtime;
+	int n, len;
+	Part *more;
+
+	*part = NULL;
+	*nparts = 0;
+	if ((fp = fopen(fname, "r")) == NULL) return(0);
+	if (fscanf(fp, "# %*s parts Config_hash %x Parts %d\n", &parts_hash,
+						 &n) != 2)
 	{
-		fprintf(stderr, "Lower index of temporal window < 0\n");
-		fprintf(stderr, "0 <= Valid temporal window indices <= %d\n\n",
-						fileWindow-1);
+		fprintf(stderr, "Error: Bad parts file: %s\n", fname);
 		fclose(fp);
-		return(NULL);
+		return(-1);
 	}
-	temporalWindow_start = (int)temp;
-
-	/* Upper bound */
-	temp = (fileWindow / 2.0) + (window->duration / 2.0) + window->offset;
-	if (temp > fileWindow)	/* Check for valid temporal upper window bound. */
+	if (parts_hash != hash)
 	{
-		fprintf(stderr, "Upper index of temporal window > %d\n", fileWindow-1);
-		fprintf(stderr, "0 <= Valid temporal window indices <= %d\n\n",
-						fileWindow-1);
+		fprintf(stderr, "Error: The histograms of %s were built with different options.\n", fname);
 		fclose(fp);
-		return(NULL);
+		return(-1);
 	}
-	temporalWindow_end = (int)temp;
-
-	if (verbose)
-	  fprintf(stderr, "temporalWindow_lowerIndex:%d temporalWindow_upperIndex:%d\n",
-						temporalWindow_start, temporalWindow_end);
-
-	/*
-	 * Find the data table in the file.
-	 */
-	while ((s = fgets(line, sizeof(line), fp)))
+	while (fgets(line, sizeof(line), fp) != NULL)
 	{
-		chop(s);
-		if (strncmp(line, "Table begins", 10) == 0) break;
+		if (sscanf(line, "%ld %ld %n", &size, &mtime, &len) != 2) break;
+		line[strcspn(line, "\n")] = '\0';
+		more = (Part *)realloc(*part, (*nparts + 1) * sizeof(Part));
+		if (more == NULL || (more[*nparts].path = strdup(line + len)) == NULL)
+		{
+			perror("read_parts");
+			fclose(fp);
+			return(-1);
+		}
+		*part = more;
+		(*part)[*nparts].size = size;
+		(*part)[*nparts].mtime = mtime;
+		(*nparts)++;
 	}
-	if (s == NULL)
+	fclose(fp);
+	if (*nparts != n)
 	{
-		fprintf(stderr, "Intermediate table format error.\n");
-		fclose(fp);
-		return(NULL);
+		fprintf(stderr, "Error: Bad parts file: %s\n", fname);
+		return(-1);
 	}
+	return(1);
+}
 
-	/********************
-		 Read each line of VOS_gauge window data values from infile. Write
-		 the valid values into temporary storage arrays, and discard the
-		 invalid/irrelevant values.
-	1. If valid radar Z values exist, they are added to the
-		 appropriate Z_histogram, determined by gauge_range and raintype,
-		 and the gauge R values are added to the appropriate R_histogram.
-	2. If valid gauge rates exist, they are averaged over a temporal window,
-	   and the average added to the appropriate R_histogram.
-	*********************/
-	while (fscanf(fp, "%*d %*s %*s %*s %f %*d", &gauge_range) != EOF)
-	{
-		/* Read from the file the pair of radar-derived values
-			 (rtype, z) for each of the 'ncells' window cells from the
-			 bottom two carpis over this raingauge.
-			 If the values 'rtype' and 'z' are valid,
-			 save the values in the array cell[], otherwise discard. */
-		radar_says_rain = 0;
-		nvalid_cells = 0;
-		for (i=0; i<2; i++)  /* for the bottom two carpis... */
-		{
-			/* Read carpi height, and number of cells which follow. */
-			fscanf(fp, "%f %d", &cell_height, &ncells);
-			for (j=0; j<ncells; j++)
-			{
-				/* Read the pair of values (raintype, Z) for one window cell. */
-				fscanf(fp, "%d %f", &rtype, &z);
-				/*
-				 * If only the center window cell is desired, discard all
-				 * other cells.
-				 */
-				if (window->cell_over_gauge_only)
-					if (j != (int)ncells/2) continue;
-				/*
-				 * If this cell isn't from the desired window_height, discard it.
-				 */
-				if ( (window->height == 1.5) && (cell_height != 1.5) ) continue;
-				else if ( (window->height == 3.0) && (cell_height != 3.0) ) continue;
-				else if (window->height == 0.0) /* Range-dependant window height. */
-				{
-					/* If gauge_range < 100.0 , ignore data from 2nd carpi. */
-					if ((gauge_range < 100.0) && (cell_height == 3.0)) continue;
-				}
-				/* If gauge_range >= 100.0 , no valid data in lowest carpi. */
-				if ( (gauge_range >= 100.0) && (cell_height == 1.5) ) continue;
-
-				/*
-				 * Check for valid raintype.
-				 */
-				if (rtype == -1) continue;  /* Discard missing/bad data */
-				if (rtype == 0) continue;   /* No echo ??? */
-				if ( (rtype > 0) && (z > -15.0) ) radar_says_rain = 1;
-				
-				/*
-				 * Check for valid Z value.
-				 */
-				if (z < histo->z_low) z = histo->z_low;
-				if (z > histo->z_hi)  z = histo->z_hi;
-				/*
-				 * Save the triplet (rtype, z, height) in 'cell[]' array.
-				 */
-				cell[nvalid_cells].rtype = rtype;
-				cell[nvalid_cells].z = z;
-				cell[nvalid_cells].height = cell_height;
-				nvalid_cells++;
-				if (nvalid_cells >= ARRAY_SIZE)
-				{
-					fprintf(stderr, "Too many window cells (> %d)\n", ARRAY_SIZE);
-					goto error_exit;
-				}
-			} /* end for (j=0; j<ncells... */
-		} /* end for (i=0... */
-		
-
-		fscanf(fp, "%d", &ngauge_rates);   /* number of gauge observations */
-		/*
-		 * Read all 'ngauge_rates' gauge rainrate values from the file line.
-		 * Store only the non-negative values, recorded within the temporal
-		 * gauge window, into array 'gauge_rate[]'.
-		 */
-		gauge_says_rain = 0;     /* 1 if a positive gauge rate */
-		nvalid_gauge_rates = 0;  /* Number of positive gauge rates */
-		for (j=0; j<ngauge_rates; j++)
-		{
-			fscanf(fp, "%f", &g_rate);
-			/* Discard gauge reading if outside temporal window. */
-			if ( (j < temporalWindow_start) || (j > temporalWindow_end) )
-			  continue;
-			if (g_rate >= 0.0)  /* Discard negative gauge readings. */
-			{
-				gauge_rate[nvalid_gauge_rates] = g_rate;
-				if (g_rate > 0.0) gauge_says_rain = 1;
-				nvalid_gauge_rates++;
-				if (nvalid_gauge_rates >= ARRAY_SIZE)
-				{
-					fprintf(stderr, "Too many gauge_rates (> %d)\n", ARRAY_SIZE);
-					goto error_exit;
-				}
-			} /* end if if (g_rate >= 0.0) */
-		} /* end for (j=0... */
-
-/*	
-fprintf(stderr, "nvalid_cells:%d  nvalid_gauge_rates:%d\n", nvalid_cells,
-						nvalid_gauge_rates);
-*/
-		/* If both radar and gauge report no rain, discard this input line. */
-		if ( (!radar_says_rain) && (!gauge_says_rain) )
-		  continue;
-		
+/*************************************************************/
+/*                                                           */
+/*                        write_parts                        */
+/*                                                           */
+/*************************************************************/
+int write_parts(char *fname, unsigned int hash, Part *part, int nparts)
+{
+	/* Write the parts file 'fname' (-U): the configuration 'hash', and
+		 the 'nparts' inFiles in the histograms.  The file is replaced by
+		 rename(), so it is either the old one or the new one.
+		 Returns 1 if successful; -1, else.
+	*/
+	char tmp_fname[PATH_MAX];
+	FILE *fp;
+	int i;
+
+	snprintf(tmp_fname, sizeof(tmp_fname), "%s.tmp", fname);
+	if ((fp = fopen(tmp_fname, "w")) == NULL)
+	{
+		perror(tmp_fname);
+		return(-1);
+	}
+	fprintf(fp, "# build_zr_histo parts\n");
+	fprintf(fp, "Config_hash      %08x\n", hash);
+	fprintf(fp, "Parts            %d\n", nparts);
+	for (i=0; i<nparts; i++)
+		fprintf(fp, "%ld %ld %s\n", part[i].size, part[i].mtime, part[i].path);
+	if (fflush(fp) != 0 || fsync(fileno(fp)) != 0 || fclose(fp) != 0 ||
+			rename(tmp_fname, fname) != 0)
+	{
+		perror(fname);
+		unlink(tmp_fname);
+		return(-1);
+	}
+	return(1);
+}
 
-		if (nvalid_cells > 0)  /* Any valid Z values? */
+/*************************************************************/
+/*                                                           */
+/*                         new_parts                         */
+/*                                                           */
+/*************************************************************/
+int new_parts(char **infile, int ninfiles, Part **part, int *nparts)
+{
+	/* Keep, in 'infile', the inFiles that are not yet in the 'nparts'
+		 parts 'part' (-U), and add them to 'part'.  An inFile is known
+		 by its full path; one that has changed since it was added (size
+		 or modification time) is an error: its entries can't be taken
+		 out of the histograms.
+		 Returns the number of new inFiles; -1 if error.
+	*/
+	struct stat st;
+	char path[PATH_MAX];
+	int i, j, nnew = 0;
+	Part *more;
+
+	for (i=0; i<ninfiles; i++)
+	{
+		if (realpath(infile[i], path) == NULL || stat(path, &st) != 0)
 		{
-
-			/*
-			 The radar-derived raintypes are not in general the same for all the
-			 cells in a VOS_gauge window. Do a majority-rules-decision to
-			 establish the overall raintype 'window_rtype' to characterize this
-			 window.
-			 */
-			if (histo->nrtype == 1)  /* UNIFORM Regime */
-			{
-				window_rtype = 1;
-			}
-			else if (histo->nrtype == 2)  /* DUAL Regime: Stratiform and Convective */
-			{
-				nrtype1 = nrtype2 = 0;
-				for (j=0; j<nvalid_cells; j++)
-				{
-					if (cell[j].rtype == 1) nrtype1++;
-					else if (cell[j].rtype == 2) nrtype2++;
-					else fprintf(stderr, "Unknown raintype:%d in cell.\n", cell[j].rtype);
-				}
-				if (nrtype1 > nrtype2) window_rtype = 1;
-				else window_rtype = 2;
-			} /* end else if (histo->nrtype == 2) */
-			else
+			perror(infile[i]);
+			return(-1);
+		}
+		for (j=0; j<*nparts; j++)
+			if (strcmp((*part)[j].path, path) == 0) break;
+		if (j < *nparts)
+		{
+			if ((*part)[j].size != (long)st.st_size ||
+					(*part)[j].mtime != (long)st.st_mtime)
 			{
-				fprintf(stderr, "Can't accomodate %d raintypes.\n", histo->nrtype);
-				goto error_exit;
+				fprintf(stderr, "Error: %s changed since it was added to the histograms; rebuild them.\n", infile[i]);
+				return(-1);
 			}
-
-			/* Add the radar Z values from array 'cell[]' to the appropriate 
-				 Z_histogram. */
-			irange = index_of_range(histo->range_interval, histo->nrange, gauge_range);
-			for (j=0; j<nvalid_cells; j++)
-		    zbin[irange][irtype[window_rtype]][(int)((cell[j].z - histo->z_low)/histo->z_res)]++;
-		} /* end if (nvalid_cells > 0) */
-
-
-		if (nvalid_gauge_rates > 0)  /* Any valid gauge rates? */
+			if (verbose) fprintf(stderr, "Already in the histograms: %s\n", infile[i]);
+			continue;
+		}
+		more = (Part *)realloc(*part, (*nparts + 1) * sizeof(Part));
+		if (more == NULL || (more[*nparts].path = strdup(path)) == NULL)
 		{
-			/* Average the gauge readings from array 'gauge_rate[]' */
-			gauge_avg = 0.0;
-			for (j=0; j<nvalid_gauge_rates; j++)
-		    gauge_avg = gauge_avg + gauge_rate[j];
-			gauge_avg = gauge_avg / nvalid_gauge_rates;
-			/* Add the averaged gauge reading to the appropriate R_histogram. */
-			irange = index_of_range(histo->range_interval, histo->nrange, gauge_range);
-			rbin[irange][irtype[window_rtype]][(int)(gauge_avg*RRATE_SCALE)]++;
-		} /* end if (nvalid_gauge_rates > 0) */
+			perror("new_parts");
+			return(-1);
+		}
+		*part = more;
+		(*part)[*nparts].size = (long)st.st_size;
+		(*part)[*nparts].mtime = (long)st.st_mtime;
+		(*nparts)++;
+		infile[nnew++] = infile[i];
+	}
+	return(nnew);
+}
 
-	} /* end while (fscanf(... */
+/*************************************************************/
+/*                                                           */
+/*                          out_name                         */
+/*                                                           */
+/*************************************************************/
+int out_name(char *name, char *file, char *suffix)
+{
+	/* Set 'name' (PATH_MAX chars) to the output file 'file' followed by
+		 the -G 'suffix' of its window configuration (NULL: none).
+		 Returns 1 if successful; -1 if the name is too long.
+	*/
+	if (snprintf(name, PATH_MAX, "%s%s", file, suffix ? suffix : "") >=
+			PATH_MAX)
+	{
+		fprintf(stderr, "Error: File name too long: %s%s\n", file,
+						suffix ? suffix : "");
+		return(-1);
+	}
+	return(1);
+}
 
-	/* Success... */
-	fclose(fp);
-	return(histo);
+/*************************************************************/
+/*                                                           */
+/*                         sync_file                         */
+/*                                                           */
+/*************************************************************/
+int sync_file(char *fname)
+{
+	/* Flush the file 'fname' to disk (-U).
+		 Returns 1 if successful; -1, else.
+	*/
+	int fd;
 
- error_exit:
-	fprintf(stderr, "Error reading file: %s\n", infile);
-	fclose(fp);
-	return(NULL);
+	if ((fd = open(fname, O_RDONLY)) < 0 || fsync(fd) != 0)
+	{
+		perror(fname);
+		if (fd >= 0) close(fd);
+		return(-1);
+	}
+	close(fd);
+	return(1);
 }
 
 /*************************************************************/
 /*                                                           */
-/*                      build_zr_histograms                  */
+/*                       finish_update                       */
 /*                                                           */
 /*************************************************************/
-ZR_histo *build_zr_histograms(char *infile, float *r, int nrange,
-															Window *window)
+int finish_update(char *outfile, char **suffix, int nwindows,
+									char *journal_file, char *parts_file)
 {
-	/* Builds Z-R histograms, using the radar and raingauge data
-		 found in 'infile'.
-
-		 Returns:
-		     A filled 'ZR_histo' structure, if success.
-				 NULL, if failure.
-  */
-	int irange;
-	ZR_histo *histo;
+	/* Complete an update (-U) once its journal, the parts file of the
+		 new histograms, is written: replace each outFile (outFile and
+		 the 'suffix' of each of the 'nwindows' window configurations, if
+		 'suffix' is not NULL) by its .tmp file, if not done already, then
+		 the parts file by the journal.  Until the journal is renamed, a
+		 rerun finishes the update (recover_update), so the histograms
+		 and the parts file always go together.
+		 Returns 1 if successful; -1, else.
+	*/
+	char outname[PATH_MAX], tmp_name[PATH_MAX + sizeof(".tmp")];
+	int w;
+
+	for (w=0; w<nwindows; w++)
+	{
+		if (out_name(outname, outfile, suffix ? suffix[w] : NULL) < 0)
+			return(-1);
+		snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", outname);
+		if (access(tmp_name, F_OK) == 0 && rename(tmp_name, outname) != 0)
+		{
+			perror(outname);
+			return(-1);
+		}
+	}
+	if (rename(journal_file, parts_file) != 0)
+	{
+		perror(parts_file);
+		return(-1);
+	}
+	return(1);
+}
 
-	/*
-	 * Create a ZR_histo structure, and fill some slots with the
-	 * info that we currently know.
-	 */
-  histo = (ZR_histo *) calloc(1, sizeof(ZR_histo));
-	histo->range_interval = (float *)calloc(nrange, sizeof(float));
-	/* Move range values from the array 'r' to the ZR_histo structure. */
-	for (irange=0; irange<nrange; irange++)
-	  histo->range_interval[irange] = r[irange];
-	histo->nrange = nrange;
+/*************************************************************/
+/*                                                           */
+/*                       recover_update                      */
+/*                                                           */
+/*************************************************************/
+int recover_update(char *outfile, char **suffix, int nwindows,
+									 unsigned int hash, char *journal_file, char *parts_file)
+{
+	/* Before an update (-U): if the last one stopped after writing its
+		 journal, finish it; if it stopped before, drop its .tmp files,
+		 as the outFiles and the parts file are still the old ones.
+		 Returns 1 if successful; -1, else.
+	*/
+	char outname[PATH_MAX], tmp_name[PATH_MAX + sizeof(".tmp")];
+	Part *part;
+	int nparts, i, w;
+
+	if (access(journal_file, F_OK) == 0)
+	{
+		if (read_parts(journal_file, hash, &part, &nparts) < 0) return(-1);
+		for (i=0; i<nparts; i++)
+			free(part[i].path);
+		free(part);
+		fprintf(stderr, "Finishing the interrupted update of %s.\n", outfile);
+		return(finish_update(outfile, suffix, nwindows, journal_file, parts_file));
+	}
+	for (w=0; w<nwindows; w++)
+	{
+		if (out_name(outname, outfile, suffix ? suffix[w] : NULL) < 0)
+			return(-1);
+		snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", outname);
+		unlink(tmp_name);
+	}
+	return(1);
+}
 
-	histo->nRbins = NR_BINS;
-	histo->r_low = 0.0;
-	histo->r_hi = NR_BINS / RRATE_SCALE;
-	histo->r_res = 1.0 / RRATE_SCALE;
+/*************************************************************/
+/*                                                           */
+/*                   add_stored_histograms                   */
+/*                                                           */
+/*************************************************************/
+int add_stored_histograms(ZR_histo *histo, char *histo_file)
+{
+	/* Add the histograms of 'histo_file' (-U), of the same configuration,
+		 to 'histo'.  The header is that of the file, with the times
+		 extended to those of 'histo'.
+		 Returns 1 if successful; -1, else.
+	*/
+	ZR_histo *stored;
+	int irange;
 
-	/*
-	 * Read the radar and raingauge values from the intermediate
-	 * file 'infile', and build Z_ and R_ histograms.
-	 */
-	if (read_intermediate_file(histo, infile, window) == NULL)
+	if ((stored = read_zr_histo(histo_file)) == NULL) return(-1);
+	if (!same_site_and_rain_types(stored, histo) ||
+			stored->nrange != histo->nrange || stored->nZbins != histo->nZbins ||
+			stored->nRbins != histo->nRbins)
 	{
-		free_zr_histo(histo);
-		return(NULL);
+		fprintf(stderr, "Site, rain types or bins of %s differ from those of the inFiles.\n",
+						histo_file);
+		free_zr_histo(stored);
+		return(-1);
 	}
-
-	return(histo);
+	for (irange=0; irange<histo->nrange; irange++)
+		if (stored->range_interval[irange] != histo->range_interval[irange])
+		{
+			fprintf(stderr, "Range intervals of %s differ.\n", histo_file);
+			free_zr_histo(stored);
+			return(-1);
+		}
+	add_zr_histo(stored, histo);
+	strcpy(histo->site_name, stored->site_name);
+	if (stored->start_time < histo->start_time)
+		histo->start_time = stored->start_time;
+	if (stored->stop_time > histo->stop_time)
+		histo->stop_time = stored->stop_time;
+	free_zr_histo(stored);
+	return(1);
 }
 
 /*************************************************************/
@@ -591,7 +1889,7 @@ void handler(int sig)
 void usage()
 {
 	fprintf(stderr, "\nUsage (%s):\n\n", PROG_VERSION);
-	fprintf(stderr, "  build_zr_histo [options] inFile outFile\n");
+	fprintf(stderr, "  build_zr_histo [options] [inFile...] outFile\n");
 	fprintf(stderr, "\nOptions:\n");
 	fprintf(stderr, "  -v:               Verbose\n");
 	fprintf(stderr, "  -c:               Use only the cell over gauge from spatial gauge window.\n");
@@ -606,7 +1904,29 @@ void usage()
 	
 	fprintf(stderr, "  -r <r1,r2,.,150>: Range intervals (km) for Z-R tables\n");
 	fprintf(stderr, "  -d:               Disregard rain classification. Lump all classes together\n");
+	fprintf(stderr, "  -B:               Write outFile in the binary histogram format.\n");
+	fprintf(stderr, "                    (Default: ASCII)\n");
+	fprintf(stderr, "  -l list_file:     Also read the inFiles named in list_file, one per line.\n");
+	fprintf(stderr, "                    Blank and '#' lines are skipped.\n");
+	fprintf(stderr, "  -j nthreads:      Read each inFile in nthreads blocks, in parallel.\n");
+	fprintf(stderr, "                    (Default: 1; at most %d)\n", MAX_THREADS);
+	fprintf(stderr, "  -G grid:          Build the histograms of each window configuration of\n");
+	fprintf(stderr, "                    the grid in one pass over the inFiles, e.g.,\n");
+	fprintf(stderr, "                    h=0:1.5:3.0,t=6:10,o=0:2 (fields c, h, t, o and d,\n");
+	fprintf(stderr, "                    as the options; values separated by ':').\n");
+	fprintf(stderr, "                    Each is written to outFile.<suffix>, e.g.,\n");
+	fprintf(stderr, "                    outFile.h1.5t10o2.  (At most %d configurations)\n", MAX_WINDOWS);
+	fprintf(stderr, "  -D cubeFile:      Also write the histograms of each day, as running sums,\n");
+	fprintf(stderr, "                    to cubeFile (cubeFile.<suffix> with -G).  zr_histo_query\n");
+	fprintf(stderr, "                    gives the histograms of any range of days from it.\n");
+	fprintf(stderr, "  -S sampleFile:    Also write the entries, with their gauge, day and bins,\n");
+	fprintf(stderr, "                    to sampleFile (sampleFile.<suffix> with -G), for the\n");
+	fprintf(stderr, "                    bootstrap of build_pmm_zr_table -b.\n");
+	fprintf(stderr, "  -U:               Update: add the inFiles not yet in the histograms of\n");
+	fprintf(stderr, "                    outFile (listed in outFile.parts) to them.  Unless\n");
+	fprintf(stderr, "                    there are new inFiles, outFile is left as is.\n");
 	fprintf(stderr, "\ninFile:  2nd_zr_intermediate_file from 'merge_radarNgauge_data'\n");
+	fprintf(stderr, "         The histograms of several inFiles are added.\n");
 	fprintf(stderr, "outFile: output Z-R histograms.\n");
 	fprintf(stderr, "\n------------------------------------\n\n");
 	
@@ -629,12 +1949,31 @@ extern int getopt(int argc, char * const argv[], const char *optstring);
 /*************************************************************/
 int main(int argc, char **argv)
 {
-	char infile[128], outfile[128];
-	int c, i;
+	char **infile;      /* Input files: command line, then list files. */
+	int ninfiles;
+	char outfile[PATH_MAX];
+	char *list_file[16];
+	int nlist_files = 0;
+	int c, i, w;
 	Window window;
+	char *grid = NULL;  /* -G */
+	Window grid_window[MAX_WINDOWS];  /* Window configurations */
+	char *suffix[MAX_WINDOWS];        /* ... and their outFile suffixes. */
+	int nwindows = 1;
+	char outname[PATH_MAX], tmp_name[PATH_MAX + sizeof(".tmp")];
+	char *cube_file = NULL;           /* -D */
+	char *sample_file = NULL;         /* -S */
+	int update = 0;                   /* -U */
+	char parts_file[PATH_MAX + 16], journal_file[PATH_MAX + 16];
+	Part *part = NULL;                /* ... inFiles in the histograms */
+	int nparts = 0, have_parts = 0;
+	unsigned int hash = 0;
+	ZR_histo_days **days = NULL;      /* ... of each window configuration */
+	ZR_sample **samples = NULL;       /* -S, of each window configuration */
 	int nrange;         /* Number of gauge range intervals */
 	float r[10];        /* gauge range intervals */
-	ZR_histo *histo;
+	ZR_histo **histo;
+	int binary_out = 0;
 	extern char *optarg;
 	extern int optind;
 
@@ -647,7 +1986,6 @@ int main(int argc, char **argv)
 	
 	if (argc < 3) usage();
 
-	memset(infile, '\0', sizeof(infile));
 	memset(outfile, '\0', sizeof(outfile));
 	/* 
 	 * Defaults
@@ -662,7 +2000,7 @@ int main(int argc, char **argv)
 	
 
 	/* Read options from command line. */
-	while ((c=getopt(argc, argv, "vch:t:o:r:d")) != EOF)
+	while ((c=getopt(argc, argv, "vch:t:o:r:dBl:j:G:D:S:U")) != EOF)
 	{
 		switch (c)
 		{
@@ -722,6 +2060,37 @@ int main(int argc, char **argv)
 		case 'd':    /* Unclassified rain regime */
 			window.unclassified = 1;
 			break;
+		case 'B':    /* Binary outFile */
+			binary_out = 1;
+			break;
+		case 'l':    /* List of inFiles */
+			if (nlist_files == 16)
+			{
+				fprintf(stderr, "\nAt most 16 list files (-l).\n\n");
+				exit(-1);
+			}
+			list_file[nlist_files++] = optarg;
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			if (nthreads < 1 || nthreads > MAX_THREADS)
+			{
+				fprintf(stderr, "\n-j: nthreads must be 1 to %d\n\n", MAX_THREADS);
+				exit(-1);
+			}
+			break;
+		case 'G':    /* Grid of window configurations */
+			grid = optarg;
+			break;
+		case 'D':    /* Day cube file */
+			cube_file = optarg;
+			break;
+		case 'S':    /* Sample file */
+			sample_file = optarg;
+			break;
+		case 'U':    /* Update the histograms of outFile */
+			update = 1;
+			break;
 		default:  /* Unknown/illegal option */
 			fprintf(stderr, "\n");
 			exit(-1);
@@ -729,14 +2098,85 @@ int main(int argc, char **argv)
 		}	/* end switch (c) */
 	} /* end while ((c=getopt... */
 
-	/* Check for 2 more command line items: infile and outfile. */
-	if ((argc - optind) != 2) 
+	/* Check for the outfile, and infiles on the command line or in
+		 list files. */
+	if ((argc - optind) < 1 || (argc - optind < 2 && nlist_files == 0)) 
 	{
 		fprintf(stderr, "\nUnspecified 'inFile' and/or 'outFile'\n\n"); 
 		usage();
 	}
-	strncpy(infile, argv[argc-2], 127);
-	strncpy(outfile, argv[argc-1], 127);
+	ninfiles = argc - optind - 1;
+	if ((infile = (char **)malloc((ninfiles + 1) * sizeof(char *))) == NULL)
+	{
+		perror("build_zr_histo");
+		exit(-1);
+	}
+	for (i=0; i<ninfiles; i++)
+		infile[i] = argv[optind + i];
+	if (strlen(argv[argc-1]) >= sizeof(outfile))
+	{
+		fprintf(stderr, "Error: File name too long: %s\n", argv[argc-1]);
+		exit(-1);
+	}
+	strcpy(outfile, argv[argc-1]);
+	for (i=0; i<nlist_files; i++)
+		if ((infile = read_infile_list(list_file[i], infile, &ninfiles)) == NULL)
+			exit(-1);
+	if (ninfiles == 0)
+	{
+		fprintf(stderr, "\nNo input files in the list file(s).\n\n");
+		exit(-1);
+	}
+	if (grid)
+	{
+		if ((nwindows = window_grid(grid, &window, grid_window, suffix)) < 0)
+			exit(-1);
+	}
+	else
+		grid_window[0] = window;
+	/*
+	 * -U: only the inFiles not yet in the histograms of outFile are read,
+	 * and added to them.
+	 */
+	if (update)
+	{
+		if (cube_file || sample_file)
+		{
+			fprintf(stderr, "\n-%c can't be used with -U.\n\n", cube_file ? 'D' : 'S');
+			exit(-1);
+		}
+		hash = run_config_hash(r, nrange, grid_window, nwindows);
+		snprintf(parts_file, sizeof(parts_file), "%s.parts", outfile);
+		snprintf(journal_file, sizeof(journal_file), "%s.parts.new", outfile);
+		if (recover_update(outfile, grid ? suffix : NULL, nwindows, hash,
+											 journal_file, parts_file) < 0)
+			exit(-1);
+		if ((have_parts = read_parts(parts_file, hash, &part, &nparts)) < 0)
+			exit(-1);
+		if (out_name(outname, outfile, grid ? suffix[0] : NULL) < 0) exit(-1);
+		if (!have_parts && access(outname, F_OK) == 0)
+		{
+			fprintf(stderr, "Error: %s has no parts file (%s); not built with -U.\n",
+							outname, parts_file);
+			exit(-1);
+		}
+		if ((ninfiles = new_parts(infile, ninfiles, &part, &nparts)) < 0)
+			exit(-1);
+		if (ninfiles == 0)
+		{
+			if (verbose) fprintf(stderr, "No new inFiles: %s is up to date.\n", outfile);
+			exit(0);
+		}
+	}
+	if ((cube_file &&
+			 (days = (ZR_histo_days **)calloc(nwindows, sizeof(ZR_histo_days *)))
+			 == NULL) ||
+			(sample_file &&
+			 (samples = (ZR_sample **)calloc(nwindows, sizeof(ZR_sample *))) == NULL))
+	{
+		perror("build_zr_histo");
+		exit(-1);
+	}
 
 	if (verbose)
 	{
@@ -766,18 +2206,83 @@ int main(int argc, char **argv)
 		  fprintf(stderr, "Disregard rainclasses in input file\n");
 		else
 		  fprintf(stderr, "Use rainclasses from 2nd interm file\n");
-		fprintf(stderr, "inFile:               %s\n", infile);
-		fprintf(stderr, "outFile:              %s\n\n", outfile);
+		for (i=0; i<ninfiles; i++)
+			fprintf(stderr, "inFile:               %s\n", infile[i]);
+		if (grid)
+			fprintf(stderr, "Window grid:          %s (%d outFiles)\n", grid,
+							nwindows);
+		fprintf(stderr, "outFile:              %s\n", outfile);
+		if (cube_file)
+			fprintf(stderr, "Day cube file:        %s\n", cube_file);
+		if (sample_file)
+			fprintf(stderr, "Sample file:          %s\n", sample_file);
+		fprintf(stderr, "Threads:              %d\n\n", nthreads);
 	}
 
-	/* Build Z-R tables using the radar & gauge data from infile. */
-	histo = (ZR_histo *)build_zr_histograms(infile, r, nrange, &window);
+	/* Build Z-R tables using the radar & gauge data from the infiles. */
+	histo = build_zr_histograms(infile, ninfiles, r, nrange, grid_window,
+															nwindows, days, samples);
 	if (histo == NULL) exit(-1);
 
-  /* Write the Z-R tables to a disk file. */
-	if (verbose) fprintf(stderr, "Writing Z-R histograms to file: %s\n", outfile);
-	write_zr_histo(histo, outfile);
-	free_zr_histo(histo);
+  /* Write the Z-R tables to disk files: 'outFile', or 'outFile' and
+		 the suffix of each window configuration of the grid.  With -U,
+		 the stored histograms are added, and the files are replaced once
+		 all are written. */
+	for (w=0; w<nwindows; w++)
+	{
+		if (out_name(outname, outfile, grid ? suffix[w] : NULL) < 0) exit(-1);
+		if (have_parts && add_stored_histograms(histo[w], outname) < 0)
+			exit(-1);
+		if (snprintf(tmp_name, sizeof(tmp_name), "%s%s", outname,
+								 update ? ".tmp" : "") >= sizeof(tmp_name))
+		{
+			fprintf(stderr, "Error: File name too long: %s.tmp\n", outname);
+			exit(-1);
+		}
+		if (verbose) fprintf(stderr, "Writing Z-R histograms to file: %s\n", outname);
+		if ((binary_out ? write_zr_histo_bin(histo[w], tmp_name) :
+				 write_zr_histo(histo[w], tmp_name)) < 0)
+			exit(-1);
+		if (cube_file)
+		{
+			if (out_name(outname, cube_file, grid ? suffix[w] : NULL) < 0)
+				exit(-1);
+			if (verbose) fprintf(stderr, "Writing day cube to file: %s\n", outname);
+			if (write_zr_histo_cube(histo[w], days[w], outname) < 0)
+				exit(-1);
+			free_zr_histo_days(days[w]);
+		}
+		if (sample_file)
+		{
+			if (out_name(outname, sample_file, grid ? suffix[w] : NULL) < 0)
+				exit(-1);
+			if (verbose) fprintf(stderr, "Writing sample to file: %s\n", outname);
+			if (write_zr_sample(histo[w], samples[w], outname) < 0)
+				exit(-1);
+			free_zr_sample(samples[w]);
+		}
+	}
+	if (update)
+	{
+		/* The new histograms are on disk before the journal, the new parts
+			 file, is; from then on the update is finished, even by a rerun. */
+		for (w=0; w<nwindows; w++)
+		{
+			if (out_name(outname, outfile, grid ? suffix[w] : NULL) < 0) exit(-1);
+			if (snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", outname) >=
+					sizeof(tmp_name) || sync_file(tmp_name) < 0)
+				exit(-1);
+		}
+		if (write_parts(journal_file, hash, part, nparts) < 0 ||
+				finish_update(outfile, grid ? suffix : NULL, nwindows, journal_file,
+											parts_file) < 0)
+			exit(-1);
+	}
+	for (w=0; grid && w<nwindows; w++)
+		free(suffix[w]);
+	free(days);
+	free(samples);
+	free_zr_histos(histo, nwindows);
 	
 	/*------ Testing ------- */
 /*
@@ -0,0 +1,317 @@
+/*
+ * extract_bench
+ *     Check the radar window extraction of get_radar_data_over_gauge
+ *     without the 2A-55 files or gauge directories: gauges are placed at
+ *     random around a radar, the VOS grids come from the synthetic grid
+ *     source (grid_source.h) and the rain class map is random.
+ *
+ *     For every VOS, the columns of extract_columns_by_sweep() are
+ *     compared with those of extract_column() (option -G), and both
+ *     extractions are timed (CPU time, grid generation excluded).  Without
+ *     gauge counts, networks of increasing density are run.  Exits with -1
+ *     if any column differs.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include <IO.h>
+#include <IO_GV.h>
+
+#include "get_radar_data_over_gauge.h"
+#include "grid_source.h"
+#include "zr.h"
+
+int verbose = 0;
+
+#define RADAR_LAT  28.1133
+#define RADAR_LON -80.6542
+#define MAX_GAUGE_RANGE 145.0  /* km.  Keeps the windows on the grid. */
+
+/**********************************************************************/
+/*                                                                    */
+/*                               usage                                */
+/*                                                                    */
+/**********************************************************************/
+void usage(char *prog)
+{
+  fprintf(stderr, "Usage (%s): Check the gauge window extraction on\n"
+		  "\t synthetic grids and gauge networks.\n", PROG_VERSION);
+  fprintf(stderr, "\t %s [-v] [-n nvos] [-s seed] [-x xmax] [-y ymax] [-z zmax]\n"
+		  "\t\t [ngauges ...]\n", prog);
+  fprintf(stderr, "\t where:\n"
+		  "\t  -n    Number of VOSes. Default: 20.\n"
+		  "\t  -s    Seed of the gauges, grids and rain classes. Default: 1.\n"
+		  "\t  -x, -y, -z  Gauge window size in km. Default: 6, 6, 3.\n"
+		  "\t  ngauges     Number of gauges of each network to check.\n"
+		  "\t              Default: 100 1000 5000 20000.\n");
+  exit(-1);
+} /* usage */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        new_synthetic_network                       */
+/*                                                                    */
+/**********************************************************************/
+gauge_network_t *new_synthetic_network(int ngauges)
+{
+  /* Return a network of ngauges gauges spread evenly over the area within
+   * MAX_GAUGE_RANGE km of the radar; NULL for failure.  Uses rand().
+   */
+  gauge_network_t *gnet;
+  Gauge_info *gauge;
+  double r, az, lat;
+  int g;
+
+  gnet = (gauge_network_t *) calloc(1, sizeof(gauge_network_t));
+  if (gnet == NULL) {
+	perror("new_synthetic_network");
+	return NULL;
+  }
+  gnet->gauges = (Gauge_list *) calloc(1, sizeof(Gauge_list));
+  if (gnet->gauges == NULL ||
+	  (gnet->gauges->g = (Gauge_info *) calloc(ngauges, sizeof(Gauge_info)))
+	  == NULL) {
+	perror("new_synthetic_network");
+	free(gnet->gauges);
+	free(gnet);
+	return NULL;
+  }
+  strcpy(gnet->net_name, "SYN");
+  gnet->radarLat = RADAR_LAT;
+  gnet->radarLon = RADAR_LON;
+  gnet->gauges->ngauges = ngauges;
+  lat = RADAR_LAT / 57.29578;
+  for (g = 0; g < ngauges; g++) {
+	gauge = &(gnet->gauges->g[g]);
+	r = MAX_GAUGE_RANGE * sqrt(rand() / (RAND_MAX + 1.0));
+	az = 2 * M_PI * (rand() / (RAND_MAX + 1.0));
+	sprintf(gauge->site_id, "%d", g + 1);
+	gauge->range = r;
+	gauge->azimuth = az * 57.29578;
+	gauge->lat = RADAR_LAT + r * cos(az) / 6378 * 57.29578;
+	gauge->lon = RADAR_LON + r * sin(az) / (6378 * cos(lat)) * 57.29578;
+  }
+  return gnet;
+} /* new_synthetic_network */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       free_synthetic_network                       */
+/*                                                                    */
+/**********************************************************************/
+void free_synthetic_network(gauge_network_t *gnet)
+{
+  if (gnet == NULL) return;
+  if (gnet->gauges) free(gnet->gauges->g);
+  free(gnet->gauges);
+  free(gnet);
+} /* free_synthetic_network */
+
+/**********************************************************************/
+/*                                                                    */
+/*                      free_synthetic_raintype                       */
+/*                                                                    */
+/**********************************************************************/
+void free_synthetic_raintype(Raintype_map *rtype)
+{
+  int r;
+
+  if (rtype == NULL) return;
+  for (r = 0; rtype->ix && r < MAX_NROWS; r++)
+	free(rtype->ix[r]);
+  free(rtype->ix);
+  free(rtype);
+} /* free_synthetic_raintype */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       new_synthetic_raintype                       */
+/*                                                                    */
+/**********************************************************************/
+Raintype_map *new_synthetic_raintype(void)
+{
+  /* Return a map of random rain classes (0, 1, 2 or missing); NULL for
+   * failure.  Uses rand().
+   */
+  static int classes[4] = {0, 1, 2, MISSING_OR_BAD_DATA_C};
+  Raintype_map *rtype;
+  int r, c;
+
+  if ((rtype = (Raintype_map *) calloc(1, sizeof(Raintype_map))) == NULL ||
+	  (rtype->ix = (int **) calloc(MAX_NROWS, sizeof(int *))) == NULL) {
+	perror("new_synthetic_raintype");
+	free(rtype);
+	return NULL;
+  }
+  rtype->xdim = MAX_NCOLS;
+  rtype->ydim = MAX_NROWS;
+  for (r = 0; r < MAX_NROWS; r++) {
+	if ((rtype->ix[r] = (int *) calloc(MAX_NCOLS, sizeof(int))) == NULL) {
+	  perror("new_synthetic_raintype");
+	  free_synthetic_raintype(rtype);
+	  return NULL;
+	}
+	for (c = 0; c < MAX_NCOLS; c++)
+	  rtype->ix[r][c] = classes[rand() % 4];
+  }
+  return rtype;
+} /* new_synthetic_raintype */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          columns_differ                            */
+/*                                                                    */
+/**********************************************************************/
+int columns_differ(zc_column_t *c1, zc_column_t *c2)
+{
+  /* Return 1 if the two columns differ in anything output_column()
+   * writes but the VOS time; 0, otherwise.
+   */
+  int h, i;
+  height_info_t *h1, *h2;
+
+  if (strcmp(c1->gauge_id, c2->gauge_id) != 0 ||
+	  c1->gauge_range != c2->gauge_range || c1->c != c2->c ||
+	  c1->nhinfo != c2->nhinfo) return 1;
+  for (h = 0; h < c1->nhinfo; h++) {
+	h1 = c1->hinfo[h];
+	h2 = c2->hinfo[h];
+	if (h1->height != h2->height || h1->nzc != h2->nzc) return 1;
+	for (i = 0; i < h1->nzc; i++)
+	  if (h1->zc[i].c != h2->zc[i].c || h1->zc[i].z != h2->zc[i].z)
+		return 1;
+  }
+  return 0;
+} /* columns_differ */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           check_network                            */
+/*                                                                    */
+/**********************************************************************/
+int check_network(int ngauges, int nvos, unsigned int seed,
+				  float xmax, float ymax, float zmax)
+{
+  /* Extract the columns of a synthetic network of ngauges gauges over
+   * nvos synthetic VOSes both ways, time and compare them.
+   * Return the number of columns that differ; -1 for failure.
+   */
+  gauge_network_t *gnet;
+  Raintype_map *rain_class;
+  gauge_window_list_t *wlist;
+  gauge_window_t *w;
+  grid_source_t *src = NULL;
+  static grid_subset_t subset;
+  static zc_column_t column;
+  TIME_STR stime;
+  int levels[GRID_SOURCE_MAX_LEVELS];
+  int row_low, row_high, nlevels;
+  int ndiffer = 0, ncolumns = 0, i, g;
+  clock_t t0, sweep_ticks = 0, gauge_ticks = 0;
+
+  srand(seed);
+  gnet = new_synthetic_network(ngauges);
+  rain_class = new_synthetic_raintype();
+  wlist = new_gauge_window_list(gnet, xmax, ymax, zmax);
+  memset(&column, '\0', sizeof(zc_column_t));
+  if (gnet == NULL || rain_class == NULL || wlist == NULL ||
+	  initialize_zc_column(&column, xmax, ymax, zmax) < 0) {
+	ndiffer = -1;
+	goto DONE;
+  }
+  if (gauge_window_rows_range(wlist, &row_low, &row_high, &nlevels) < 0)
+	goto DONE;
+
+  memset(&stime, '\0', sizeof(TIME_STR));
+  src = grid_source_open_synthetic(nvos, &stime, seed);
+  for (i = 0; i < nlevels; i++) levels[i] = i;
+  if (src == NULL ||
+	  grid_source_set_subset(src, nlevels, levels, row_low, row_high) < 0) {
+	ndiffer = -1;
+	goto DONE;
+  }
+
+  while (grid_source_read_next(src, &subset) > 0) {
+	/* Time each extraction alone, as get_radar_data_over_gauge runs it. */
+	t0 = clock();
+	for (g = 0; g < wlist->nw; g++)
+	  extract_column(&column, gnet->radarLat, gnet->radarLon,
+					 wlist->w[g].gauge, &subset, rain_class);
+	gauge_ticks += clock() - t0;
+	t0 = clock();
+	extract_columns_by_sweep(wlist, &subset, rain_class);
+	sweep_ticks += clock() - t0;
+
+	for (g = 0; g < wlist->nw; g++) {
+	  w = &(wlist->w[g]);
+	  extract_column(&column, gnet->radarLat, gnet->radarLon, w->gauge,
+					 &subset, rain_class);
+	  ncolumns++;
+	  if (columns_differ(&column, &(w->column))) {
+		ndiffer++;
+		if (verbose)
+		  fprintf(stderr, "Gauge %s, VOS %.2d:%.2d: columns differ.\n",
+				  w->column.gauge_id, subset.tktime.tkhour,
+				  subset.tktime.tkminute);
+	  }
+	}
+  }
+  printf("%7d gauges %4d VOS %9d columns %6d differ  "
+		 "by gauge %7.3f s  sweep %7.3f s  speedup %5.2f\n",
+		 ngauges, nvos, ncolumns, ndiffer,
+		 (double) gauge_ticks / CLOCKS_PER_SEC,
+		 (double) sweep_ticks / CLOCKS_PER_SEC,
+		 sweep_ticks > 0 ? (double) gauge_ticks / sweep_ticks : 0.0);
+
+ DONE:
+  grid_source_close(src);
+  free_grid_subset(&subset);
+  free_zc_column(&column);
+  free_gauge_window_list(wlist);
+  free_synthetic_raintype(rain_class);
+  free_synthetic_network(gnet);
+  return ndiffer;
+} /* check_network */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             main                                   */
+/*                                                                    */
+/**********************************************************************/
+int main (int ac, char **av)
+{
+  static int densities[] = {100, 1000, 5000, 20000};
+  int c, i, n, rc = 0;
+  int nvos = 20;
+  unsigned int seed = 1;
+  float xmax = 6.0, ymax = 6.0, zmax = 3.0;
+
+  while ((c = getopt(ac, av, "vn:s:x:y:z:")) != -1)
+	switch (c) {
+	case 'v': verbose = 1; break;
+	case 'n': nvos = atoi(optarg); break;
+	case 's': seed = strtoul(optarg, NULL, 10); break;
+	case 'x': xmax = atof(optarg); break;
+	case 'y': ymax = atof(optarg); break;
+	case 'z': zmax = atof(optarg); break;
+	default: usage(av[0]);
+	}
+  if (nvos <= 0) usage(av[0]);
+
+  if (optind == ac)
+	for (i = 0; i < sizeof(densities) / sizeof(densities[0]); i++)
+	  if (check_network(densities[i], nvos, seed, xmax, ymax, zmax) != 0)
+		rc = -1;
+
+  for (i = optind; i < ac; i++) {
+	if ((n = atoi(av[i])) <= 0) usage(av[0]);
+	if (check_network(n, nvos, seed, xmax, ymax, zmax) != 0) rc = -1;
+  }
+  exit(rc);
+}
@@ -0,0 +1,447 @@
+/*
+ *  extract_sweep.c:
+ *      Extract radar windows over all gauges of a site in one sweep of
+ *      the 2A-55 grid.
+ *
+ *      extract_column() visits the gauges one at a time and pulls the
+ *      window around each of them from every CAPPI level, which jumps
+ *      randomly around the reflectivity volume.  For dense gauge networks
+ *      that access pattern dominates the run time.
+ *
+ *      Here, the window of every gauge is located once per run (gauges
+ *      don't move between VOSes).  The window rows of all gauges are then
+ *      sorted by grid row so that each CAPPI plane is read in row-major
+ *      order, filling every gauge's zc_column_t in a single pass.
+ *
+ *      The columns produced are identical to those of extract_column(),
+ *      which is also here with the other column helpers: option -G of
+ *      get_radar_data_over_gauge uses it, and extract_bench checks the
+ *      sweep against it.
+ *      The grid comes from a grid source (grid_source.h), which only hands
+ *      out the levels and rows asked for; gauge_window_rows_range() gives
+ *      the rows.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <IO.h>
+#include <IO_GV.h>
+
+#include "get_radar_data_over_gauge.h"
+#include "zr.h"
+
+extern int verbose;
+
+/**********************************************************************/
+/*                                                                    */
+/*                         compare_window_rows                        */
+/*                                                                    */
+/**********************************************************************/
+static int compare_window_rows(const void *a, const void *b)
+{
+  /* Order window rows by grid row, then by the first grid column.
+   * Ties are broken by gauge order so that the sort is deterministic.
+   */
+  const window_row_t *r1 = (const window_row_t *) a;
+  const window_row_t *r2 = (const window_row_t *) b;
+
+  if (r1->iy != r2->iy) return (r1->iy < r2->iy) ? -1 : 1;
+  if (r1->ix_low != r2->ix_low) return (r1->ix_low < r2->ix_low) ? -1 : 1;
+  if (r1->w != r2->w) return (r1->w < r2->w) ? -1 : 1;
+  return 0;
+} /* compare_window_rows */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        new_gauge_window_list                       */
+/*                                                                    */
+/**********************************************************************/
+gauge_window_list_t *new_gauge_window_list(gauge_network_t *gnet_list,
+										   float gauge_win_xmax,
+										   float gauge_win_ymax,
+										   float gauge_win_zmax)
+{
+  /* Locate the 2A-55 window of every gauge in gnet_list and build the
+   * row list used by extract_columns_by_sweep().  Gauges past 150 km
+   * are left out, as extract_column() does.
+   * The windows keep the network/gauge order of gnet_list.
+   *
+   * Return a pointer to the list for successful; NULL, otherwise.
+   * The caller should free the list with free_gauge_window_list().
+   */
+  gauge_window_list_t *wlist;
+  gauge_window_t *w;
+  window_row_t *row;
+  gauge_network_t *gnet;
+  Gauge_info *gauge;
+  int g, iy, nw, nrows;
+
+  if (gnet_list == NULL) return NULL;
+
+  /* Count the gauges in range. */
+  nw = 0;
+  for (gnet = gnet_list; gnet; gnet = gnet->next) {
+	if (gnet->gauges == NULL) continue;
+	for (g = 0; g < gnet->gauges->ngauges; g++)
+	  if (gnet->gauges->g[g].range < 150.0) nw++;
+  }
+
+  wlist = (gauge_window_list_t *) calloc(1, sizeof(gauge_window_list_t));
+  if (wlist == NULL) {
+	perror("Allocate gauge window list");
+	return NULL;
+  }
+  if (nw == 0) return wlist;
+
+  wlist->w = (gauge_window_t *) calloc(nw, sizeof(gauge_window_t));
+  if (wlist->w == NULL) {
+	perror("Allocate gauge windows");
+	free(wlist);
+	return NULL;
+  }
+
+  for (gnet = gnet_list; gnet; gnet = gnet->next) {
+	if (gnet->gauges == NULL) continue;
+	for (g = 0; g < gnet->gauges->ngauges; g++) {
+	  gauge = &(gnet->gauges->g[g]);
+	  if (gauge->range >= 150.0) continue; /* Ignore gauges past 150 km */
+
+	  w = &(wlist->w[wlist->nw]);
+	  if (initialize_zc_column(&w->column, gauge_win_xmax, gauge_win_ymax,
+							   gauge_win_zmax) < 0) {
+		free_gauge_window_list(wlist);
+		return NULL;
+	  }
+	  wlist->nw++;
+	  w->gnet = gnet;
+	  w->gauge = gauge;
+	  strncpy(w->column.gauge_id, gauge->site_id, MAX_NAME_LEN-1);
+	  w->column.gauge_range = gauge->range;
+
+	  /* Same indexing as extract_column(): 2km x 2km grid cells with
+	   * the radar at grid cell (75,75).
+	   */
+	  indexgrid(gauge->lat, gauge->lon, gnet->radarLat, gnet->radarLon,
+				2.0, 2.0, 75.0, 75.0, &w->gauge_ix, &w->gauge_iy);
+	  w->iy_low = w->gauge_iy - w->column.nx2/2.0 + 0.5;
+	  w->ix_low = w->gauge_ix - w->column.nx1/2.0 + 0.5;
+	}
+  }
+
+  /* One row entry per window row of every gauge. */
+  nrows = 0;
+  for (g = 0; g < wlist->nw; g++)
+	nrows += wlist->w[g].column.nx2;
+
+  wlist->rows = (window_row_t *) calloc(nrows, sizeof(window_row_t));
+  if (wlist->rows == NULL) {
+	perror("Allocate gauge window rows");
+	free_gauge_window_list(wlist);
+	return NULL;
+  }
+  row = wlist->rows;
+  for (g = 0; g < wlist->nw; g++) {
+	w = &(wlist->w[g]);
+	for (iy = 0; iy < w->column.nx2; iy++, row++) {
+	  row->iy = w->iy_low + iy;
+	  row->ix_low = w->ix_low;
+	  row->izc = iy * w->column.nx1;  /* Same cell order as extract_column() */
+	  row->w = w;
+	}
+  }
+  wlist->nrows = nrows;
+  qsort(wlist->rows, wlist->nrows, sizeof(window_row_t), compare_window_rows);
+
+  if (verbose)
+	fprintf(stderr, "Gauge windows: %d gauges, %d window rows.\n",
+			wlist->nw, wlist->nrows);
+  return wlist;
+} /* new_gauge_window_list */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        free_gauge_window_list                      */
+/*                                                                    */
+/**********************************************************************/
+void free_gauge_window_list(gauge_window_list_t *wlist)
+{
+  int i;
+
+  if (wlist == NULL) return;
+  for (i = 0; i < wlist->nw; i++)
+	free_zc_column(&(wlist->w[i].column));
+  if (wlist->w) free(wlist->w);
+  if (wlist->rows) free(wlist->rows);
+  free(wlist);
+} /* free_gauge_window_list */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       gauge_window_rows_range                      */
+/*                                                                    */
+/**********************************************************************/
+int gauge_window_rows_range(gauge_window_list_t *wlist, int *row_low,
+							int *row_high, int *nlevels)
+{
+  /* Set the first and last grid rows covered by the windows in wlist and
+   * the number of CAPPI levels of their columns.
+   * Return 1 for successful; -1, otherwise (no windows).
+   */
+  int i;
+  gauge_window_t *w;
+
+  if (wlist == NULL || wlist->nw == 0) return -1;
+  *row_low = wlist->w[0].iy_low;
+  *row_high = wlist->w[0].iy_low + wlist->w[0].column.nx2 - 1;
+  *nlevels = wlist->w[0].column.nx3;
+  for (i = 1; i < wlist->nw; i++) {
+	w = &(wlist->w[i]);
+	if (w->iy_low < *row_low) *row_low = w->iy_low;
+	if (w->iy_low + w->column.nx2 - 1 > *row_high)
+	  *row_high = w->iy_low + w->column.nx2 - 1;
+	if (w->column.nx3 > *nlevels) *nlevels = w->column.nx3;
+  }
+  return 1;
+} /* gauge_window_rows_range */
+
+/**********************************************************************/
+/*                                                                    */
+/*                      extract_columns_by_sweep                      */
+/*                                                                    */
+/**********************************************************************/
+int extract_columns_by_sweep(gauge_window_list_t *wlist,
+							 grid_subset_t *d3Drefl,
+							 Raintype_map *rain_class)
+{
+  /* Fill the column of every window in wlist from the 3D reflectivity
+   * subset and the rain class map.  Each CAPPI plane is swept once, row by
+   * row, in the order of wlist->rows.  Plane iz of the subset must hold
+   * level iz; rows outside the subset are set to MISSING_Z.
+   * The VOS start time (column->stime) is left to the caller.
+   *
+   * Return 1 for successful; -1, otherwise.
+   */
+  int i, iz, ix, nx3;
+  window_row_t *row, *end_row;
+  gauge_window_t *w;
+  zc_t *zc;
+  int *rc_row;
+  float *z_row;
+
+  if (wlist == NULL || d3Drefl == NULL || rain_class == NULL) return -1;
+  if (wlist->nw == 0) return 1;
+
+  /* Per gauge values: rain type at the gauge and the column heights. */
+  nx3 = 0;
+  for (i = 0; i < wlist->nw; i++) {
+	w = &(wlist->w[i]);
+	w->column.c = rain_class->ix[w->gauge_iy][w->gauge_ix];
+	for (iz = 0; iz < w->column.nx3; iz++)
+	  (w->column.hinfo[iz])->height = 1.5 * (iz + 1);
+	if (w->column.nx3 > nx3) nx3 = w->column.nx3;
+  }
+  if (nx3 > d3Drefl->nlevels) {
+	fprintf(stderr, "Grid subset has %d levels; %d needed.\n",
+			d3Drefl->nlevels, nx3);
+	return -1;
+  }
+
+  end_row = wlist->rows + wlist->nrows;
+  for (iz = 0; iz < nx3; iz++) {
+	for (row = wlist->rows; row < end_row; row++) {
+	  w = row->w;
+	  if (iz >= w->column.nx3) continue;
+	  zc = &((w->column.hinfo[iz])->zc[row->izc]);
+	  rc_row = &(rain_class->ix[row->iy][row->ix_low]);
+	  if (row->iy < d3Drefl->row_low || row->iy > d3Drefl->row_high) {
+		for (ix = 0; ix < w->column.nx1; ix++) {
+		  zc[ix].c = rc_row[ix];
+		  zc[ix].z = MISSING_Z;
+		}
+		continue;
+	  }
+	  /* Already mapped to MISSING_Z by the grid source. */
+	  z_row = GRID_SUBSET_ROW(d3Drefl, iz, row->iy) + row->ix_low;
+	  for (ix = 0; ix < w->column.nx1; ix++) {
+		zc[ix].c = rc_row[ix];
+		zc[ix].z = z_row[ix];
+	  }
+	} /* for row */
+  } /* for iz */
+
+  return 1;
+} /* extract_columns_by_sweep */
+
+/***************************************************************************/
+/*                                                                         */
+/*                              free_zc_column                             */
+/*                                                                         */
+/***************************************************************************/
+void free_zc_column(zc_column_t *column)
+{
+  /* Free the space in column structure only--not the column itself.
+   */
+  int i;
+
+  if (column == NULL) return;
+
+  for (i = 0; i < MAX_HEIGHT_LEVELS && i < column->nhinfo; i++) {
+	if (column->hinfo[i] != NULL) {
+
+	  if ((column->hinfo[i])->zc != NULL) {
+		free((column->hinfo[i])->zc);
+	  }
+
+	  free(column->hinfo[i]);
+
+	}
+  }
+
+} /* free_zc_column */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          initialize_zc_column                      */
+/*                                                                    */
+/**********************************************************************/
+int initialize_zc_column(zc_column_t *column, 
+						 float gauge_win_xmax, float gauge_win_ymax,
+						 float gauge_win_zmax)
+{
+	/*
+		 Initialize one 'zc_column_t' structure.
+		 Assumes 3D grid resolution (in km) dx=2.0 , dy=2.0 , dz=1.5
+		 A column is 2 carpis high.
+         Return 1 for successful; -1, otherwise.
+	*/
+	/* Grid resolution */
+	float xres=2.0;
+	float yres=2.0;
+	int i;
+
+	if (column == NULL) return -1;
+	column->nx1 = ceil(gauge_win_xmax / xres);
+	column->nx2 = ceil(gauge_win_ymax / yres);
+	column->nx3 = 2;  /* Column is 2 carpis high. */
+	column->nhinfo = column->nx3;
+	for (i = 0; i < MAX_HEIGHT_LEVELS; i++) {
+	  column->hinfo[i] = NULL;
+	}
+	for (i = 0; i < column->nx3; i++) {
+	  column->hinfo[i] = (height_info_t *) calloc(1, sizeof(height_info_t));
+	  if (column->hinfo[i] == NULL)	{
+		free_zc_column(column);
+		return -1;
+	  }
+	  (column->hinfo[i])->nzc = column->nx1 * column->nx2;
+	  (column->hinfo[i])->zc = (zc_t *) calloc((column->hinfo[i])->nzc, sizeof(zc_t));
+
+	  if ((column->hinfo[i])->zc == NULL)	{
+		free_zc_column(column);
+		return -1;
+	  }
+	}
+
+	return 1;
+}
+
+/**********************************************************************/
+/*                                                                    */
+/*                          indexgrid                                 */
+/*                                                                    */
+/**********************************************************************/
+void indexgrid(float point_lat, float point_lon,
+			   float radar_lat, float radar_lon,
+			   float grid_xsize, float grid_ysize,
+			   float radar_xorig, float radar_yorig,
+			   int *ix, int *iy)
+{
+/*
+  C **********************************************************************
+  C *  This subroutine gets any lat & long point and calculates its X,Y  *
+  C *  cordinate assuming:                                               *
+  C *  a.  Radar location is at center of grid # (75,75).                *
+  C *  b.  X increase  east, y increase north                            *
+  C *  c.  Each grid size is 2 km x 2 km.                                *
+  C **********************************************************************
+  C *    PROGRAM WRITTEN BY: EYAL AMITAI                                 *
+  c *                        JCET/UMBC - GSFC/NASA                       *
+  c **********************************************************************
+  C *    PROGRAM WAS LAST MODIFIED:   NOV 1, 1999                        *
+  c **********************************************************************
+  */
+       double LA1,LA2,LON1,LON2;
+
+       LA2=point_lat/57.29578;
+       LA1=radar_lat/57.29578;
+       LON2=point_lon/57.29578;
+       LON1=radar_lon/57.29578;
+
+       *ix = radar_yorig+0.5+6378*cos((LA1+LA2)/2.0)*(LON2-LON1)/grid_xsize;
+       *iy = radar_xorig+0.5+6378*(LA2-LA1)/grid_ysize;
+}
+
+/**********************************************************************/
+/*                                                                    */
+/*                           extract_column                           */
+/*                                                                    */
+/**********************************************************************/
+int extract_column(zc_column_t *column, float radarLat, float radarLon,
+				   Gauge_info *gauge, grid_subset_t *d3Drefl,
+				   Raintype_map *rain_class)
+{
+	/*
+		 Assumes 3D grid resolution (in km) dx=2.0 , dy=2.0 , dz=1.5
+
+		 No column is generated if gauge range > 150 km
+
+		 Returns: 0, if gauge range < 150 km.
+		         -1, otherwise.
+	*/
+  static int i, ix, iy, iz;
+  static int ix_low,   iy_low;
+  static int gauge_ix, gauge_iy;  /* 2A55 grid indices of the gauge */
+
+	if (gauge->range >= 150.0) return(-1); /* Ignore gauges past 150 km */
+	strncpy(column->gauge_id, gauge->site_id, MAX_NAME_LEN-1);
+	column->gauge_range = gauge->range;
+	
+	/* Find the indices (gauge_ix, gauge_iy) of the 2A55 grid cell
+	   corresponding to the gauge location.
+	   Assuming 2km x 2km grid cells with radar at grid cell (75,75)
+	*/
+	indexgrid(gauge->lat, gauge->lon, radarLat, radarLon,
+			  2.0, 2.0, 75.0, 75.0, &gauge_ix, &gauge_iy);
+	column->c = rain_class->ix[gauge_iy][gauge_ix];
+	if (verbose)
+	  fprintf(stderr,"   Gauge: %s   Grid Location: IX=%d IY=%d\n",
+			  column->gauge_id, gauge_ix, gauge_iy);
+
+
+	/* Get all column entries which surround the gauge. */
+	for (iz=0; iz<column->nx3; iz++){
+		iy_low = gauge_iy - column->nx2/2.0 + 0.5;
+		(column->hinfo[iz])->height = 1.5 * (iz + 1);
+		i = 0;
+		for (iy=iy_low; iy<(iy_low + column->nx2); iy++){
+			ix_low = gauge_ix - column->nx1/2.0 + 0.5;
+			for (ix=ix_low; ix<(ix_low + column->nx1); ix++){
+				(column->hinfo[iz])->zc[i].c = rain_class->ix[iy][ix];
+				/* TK_DEFAULT is already MISSING_Z in the subset. */
+				if (iy < d3Drefl->row_low || iy > d3Drefl->row_high ||
+					iz >= d3Drefl->nlevels)
+				  (column->hinfo[iz])->zc[i].z = MISSING_Z;
+				else
+				  (column->hinfo[iz])->zc[i].z = GRID_SUBSET_ROW(d3Drefl, iz, iy)[ix];
+				i++;
+			} /* end for (ix=... */
+		} /* end for (iy=... */
+	} /* end for (iz=0... */
+	column->gauge_range = gauge->range;
+
+	return(0);
+}
@@ -1,12 +1,492 @@
 #include <stdio.h>
 #include <gdbm.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "zr.h"
 #include "get_radar_data_over_gauge_db.h"
+#include "first_log.h"
 
 char *this_prog = "first2ascii";
 int verbose = 0;
+
+#define NO_ORDER       -1      /* Hash order of the GDBM file. */
+#define DEFAULT_MAX_ENTRIES_IN_MEMORY 1000000
+#define TABLE2_KEY_LEN (5 + sizeof(time_t) + 1)
+#define OUT_FLUSH_LEN  65536   /* Write the output in chunks of this size. */
+
+static line_buf_t out;         /* Output not written yet. */
+
+#define MAX_THREADS      32
+#define BATCH_PER_THREAD 4096  /* Entries formatted by a thread per batch. */
+
+/* Sort key of a table 2 entry (GDBM).  Compared by major, time, minor:
+ *   FIRST_LOG_GAUGE_ORDER:    major = rank of (network, gauge #).
+ *   FIRST_LOG_NET_TIME_ORDER: major = rank of network; minor = rank of
+ *                             gauge # as text.
+ */
+typedef struct {
+  int    major, minor;
+  time_t time_sec;
+  short  ngID;
+} entry_key_t;
+
+/* A run of sorted keys spilled to a temporary file. */
+typedef struct {
+  FILE        *fp;
+  entry_key_t key;
+  int         more;
+} run_t;
+
+/* A thread formatting a slice of a batch of entries (-j). */
+typedef struct {
+  GDBM_FILE   gf;              /* Read-only handle of its own. */
+  ngID_map_t  *ngID_map;
+  entry_key_t *keys;
+  int         nkeys;
+  line_buf_t  out;
+  pthread_t   thread;
+} worker_t;
+
+static worker_t workers[MAX_THREADS];
+static int nworkers = 0;       /* 0: Entries are formatted by main(). */
+static entry_key_t *batch;     /* Entries to format, in output order. */
+static int nbatch;
+
+/**********************************************************************/
+/*                                                                    */
+/*                             end_line                               */
+/*                                                                    */
+/**********************************************************************/
+static void end_line(void)
+{
+  /* End the line in out; write out once it holds OUT_FLUSH_LEN. */
+  line_buf_append(&out, "\n", 1);
+  if (out.len >= OUT_FLUSH_LEN) line_buf_flush(&out, stdout);
+} /* end_line */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             log2ascii                              */
+/*                                                                    */
+/**********************************************************************/
+int log2ascii(char *infile, int order)
+{
+  /* Dump the first intermediate file in the binary log format, in VOS
+   * order or in order (FIRST_LOG_*_ORDER).
+   * Return 0 for successful; -1, otherwise.
+   */
+  first_log_t *log;
+  char header_line[HEADER_LEN];
+  int rc;
+
+  log = first_log_open_read(infile);
+  if (log == NULL) return -1;
+
+  memset(header_line, '\0', HEADER_LEN);
+  first_log_read_header(log, header_line);
+  printf("%s\n", header_line);
+
+  if (order != NO_ORDER && first_log_set_order(log, order) < 0) {
+	first_log_close(log);
+	return -1;
+  }
+  while ((rc = first_log_next_entry_line(log, &out)) > 0)
+	end_line();
+  line_buf_flush(&out, stdout);
+
+  first_log_close(log);
+  return rc;
+} /* log2ascii */
+
+static int compare_net_gauge(const void *a, const void *b)
+{
+  ngID_entry_t *g1 = *(ngID_entry_t **) a, *g2 = *(ngID_entry_t **) b;
+  int rc;
+
+  if ((rc = strcmp(g1->netID, g2->netID)) != 0) return rc;
+  if (g1->gaugeID != g2->gaugeID) return g1->gaugeID < g2->gaugeID ? -1 : 1;
+  return 0;
+}
+
+static int compare_gauge_str(const void *a, const void *b)
+{
+  /* Gauge # as text, like sort(1) does with whole lines "gauge# net ...". */
+  char s1[MAX_NAME_LEN], s2[MAX_NAME_LEN];
+
+  sprintf(s1, "%d", (*(ngID_entry_t **) a)->gaugeID);
+  sprintf(s2, "%d", (*(ngID_entry_t **) b)->gaugeID);
+  return strcmp(s1, s2);
+}
+
+static int compare_entry_keys(const void *a, const void *b)
+{
+  const entry_key_t *k1 = (const entry_key_t *) a;
+  const entry_key_t *k2 = (const entry_key_t *) b;
+
+  if (k1->major != k2->major) return k1->major < k2->major ? -1 : 1;
+  if (k1->time_sec != k2->time_sec) return k1->time_sec < k2->time_sec ? -1 : 1;
+  if (k1->minor != k2->minor) return k1->minor < k2->minor ? -1 : 1;
+  return 0;
+}
+
+/**********************************************************************/
+/*                                                                    */
+/*                           rank_gauges                              */
+/*                                                                    */
+/**********************************************************************/
+static int rank_gauges(ngID_list_t *ngID_list, int order,
+					   int *major, int *minor)
+{
+  /* Set major[ngID] and minor[ngID] (see entry_key_t) for all gauges in
+   * ngID_list.
+   * Return 1 for successful; -1, otherwise.
+   */
+  ngID_list_t *l;
+  ngID_entry_t **g;
+  int i, n, ng = 0;
+
+  for (l = ngID_list; l; l = l->next) ng += l->nentries;
+  g = (ngID_entry_t **) malloc((ng + 1) * sizeof(ngID_entry_t *));
+  if (g == NULL) {
+	perror("rank_gauges");
+	return -1;
+  }
+  for (n = 0, l = ngID_list; l; l = l->next)
+	for (i = 0; i < l->nentries; i++) {
+	  if (l->ngID_array[i].ngID < 0) continue;
+	  g[n++] = &l->ngID_array[i];
+	}
+  ng = n;
+
+  qsort(g, ng, sizeof(ngID_entry_t *), compare_net_gauge);
+  for (i = 0, n = 0; i < ng; i++) {
+	if (order == FIRST_LOG_GAUGE_ORDER)
+	  major[g[i]->ngID] = i;
+	else {
+	  if (i > 0 && strcmp(g[i]->netID, g[i-1]->netID) != 0) n++;
+	  major[g[i]->ngID] = n;
+	}
+	minor[g[i]->ngID] = 0;
+  }
+  if (order == FIRST_LOG_NET_TIME_ORDER) {
+	qsort(g, ng, sizeof(ngID_entry_t *), compare_gauge_str);
+	for (i = 0; i < ng; i++) minor[g[i]->ngID] = i;
+  }
+  free(g);
+  return 1;
+} /* rank_gauges */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        key_to_entry_key                            */
+/*                                                                    */
+/**********************************************************************/
+static int key_to_entry_key(datum *key, entry_key_t *k)
+{
+  /* Set the ngID and time of k from key.
+   * Return 1 if key is a table 2 key ('2' ' ' ngID ' ' time_sec '\0');
+   * -1, otherwise.
+   */
+  if (key->dsize != TABLE2_KEY_LEN || key->dptr[0] != '2') return -1;
+  memcpy(&k->ngID, key->dptr + 2, sizeof(short));
+  memcpy(&k->time_sec, key->dptr + 5, sizeof(time_t));
+  return 1;
+} /* key_to_entry_key */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        entry_key_to_key                            */
+/*                                                                    */
+/**********************************************************************/
+static void entry_key_to_key(entry_key_t *k, char *key_str, datum *key)
+{
+  /* Make key, stored in key_str (TABLE2_KEY_LEN chars), the table 2 key
+   * of k.
+   */
+  key_str[0] = '2';
+  key_str[1] = ' ';
+  memcpy(key_str + 2, &k->ngID, sizeof(short));
+  key_str[4] = ' ';
+  memcpy(key_str + 5, &k->time_sec, sizeof(time_t));
+  key_str[5 + sizeof(time_t)] = '\0';
+  key->dptr = key_str;
+  key->dsize = TABLE2_KEY_LEN;
+} /* entry_key_to_key */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           format_slice                             */
+/*                                                                    */
+/**********************************************************************/
+static void *format_slice(void *arg)
+{
+  /* Thread: format the entries of a worker's slice into its buffer. */
+  worker_t *w = (worker_t *) arg;
+  char key_str[TABLE2_KEY_LEN];
+  datum key;
+  int i;
+
+  for (i = 0; i < w->nkeys; i++) {
+	entry_key_to_key(&w->keys[i], key_str, &key);
+	if (construct_entry_line(w->gf, &key, w->ngID_map, &w->out) == 1)
+	  line_buf_append(&w->out, "\n", 1);
+  }
+  return NULL;
+} /* format_slice */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           format_batch                             */
+/*                                                                    */
+/**********************************************************************/
+static void format_batch(void)
+{
+  /* Split the batch in consecutive slices, one per worker, format them in
+   * parallel and write them out in order.
+   */
+  int w, slice, first;
+
+  slice = (nbatch + nworkers - 1) / nworkers;
+  for (w = 0, first = 0; w < nworkers; w++, first += slice) {
+	workers[w].keys = batch + first;
+	workers[w].nkeys = first >= nbatch ? 0 :
+	  (first + slice <= nbatch ? slice : nbatch - first);
+	if (pthread_create(&workers[w].thread, NULL, format_slice, &workers[w]) != 0) {
+	  workers[w].thread = pthread_self();
+	  format_slice(&workers[w]);
+	}
+  }
+  line_buf_flush(&out, stdout);
+  for (w = 0; w < nworkers; w++) {
+	if (!pthread_equal(workers[w].thread, pthread_self()))
+	  pthread_join(workers[w].thread, NULL);
+	line_buf_flush(&workers[w].out, stdout);
+  }
+  nbatch = 0;
+} /* format_batch */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          start_workers                             */
+/*                                                                    */
+/**********************************************************************/
+static void start_workers(char *infile, int nthreads, ngID_map_t *ngID_map)
+{
+  /* Set up nthreads workers, each with its own handle of infile.  With
+   * fewer than 2, entries are formatted by main().
+   */
+  GDBM_FILE gf;
+
+  if (nthreads < 2) return;
+  batch = (entry_key_t *) malloc(nthreads * BATCH_PER_THREAD * sizeof(entry_key_t));
+  if (batch == NULL) {
+	perror("start_workers");
+	return;
+  }
+  for (nworkers = 0; nworkers < nthreads; nworkers++) {
+	if ((gf = gdbm_open(infile, 512, GDBM_READER, 0, 0)) == NULL) {
+	  fprintf(stderr, "%s: %s\n", infile, gdbm_strerror(gdbm_errno));
+	  break;
+	}
+	memset(&workers[nworkers], '\0', sizeof(worker_t));
+	workers[nworkers].gf = gf;
+	workers[nworkers].ngID_map = ngID_map;
+  }
+  if (verbose)
+	fprintf(stderr, "Formatting entries with %d threads.\n", nworkers);
+  nbatch = 0;
+} /* start_workers */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           stop_workers                             */
+/*                                                                    */
+/**********************************************************************/
+static void stop_workers(void)
+{
+  int w;
+
+  if (nworkers > 0 && nbatch > 0) format_batch();
+  for (w = 0; w < nworkers; w++) {
+	forget_db_cache(workers[w].gf);
+	gdbm_close(workers[w].gf);
+	line_buf_free(&workers[w].out);
+  }
+  nworkers = 0;
+  if (batch) free(batch);
+  batch = NULL;
+} /* stop_workers */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           print_entry                              */
+/*                                                                    */
+/**********************************************************************/
+static void print_entry(GDBM_FILE gf, ngID_map_t *ngID_map, entry_key_t *k)
+{
+  /* Print the entry with the table 2 key for k; with workers, when its
+   * batch is full.
+   */
+  char key_str[TABLE2_KEY_LEN];
+  datum key;
+
+  if (nworkers > 0) {
+	batch[nbatch++] = *k;
+	if (nbatch == nworkers * BATCH_PER_THREAD) format_batch();
+	return;
+  }
+  entry_key_to_key(k, key_str, &key);
+  if (construct_entry_line(gf, &key, ngID_map, &out) == 1)
+	end_line();
+} /* print_entry */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            spill_run                               */
+/*                                                                    */
+/**********************************************************************/
+static int spill_run(entry_key_t *keys, int nkeys, run_t **runs, int *nruns)
+{
+  /* Sort keys and write them to a new temporary file.
+   * Return 1 for successful; -1, otherwise.
+   */
+  run_t *new_runs;
+  FILE *fp;
+
+  qsort(keys, nkeys, sizeof(entry_key_t), compare_entry_keys);
+  new_runs = (run_t *) realloc(*runs, (*nruns + 1) * sizeof(run_t));
+  if (new_runs == NULL || (fp = tmpfile()) == NULL) {
+	perror("spill_run");
+	if (new_runs) *runs = new_runs;
+	return -1;
+  }
+  *runs = new_runs;
+  if (fwrite(keys, sizeof(entry_key_t), nkeys, fp) != nkeys) {
+	perror("spill_run");
+	fclose(fp);
+	return -1;
+  }
+  rewind(fp);
+  (*runs)[*nruns].fp = fp;
+  (*runs)[*nruns].more = fread(&(*runs)[*nruns].key, sizeof(entry_key_t), 1, fp);
+  (*nruns)++;
+  if (verbose)
+	fprintf(stderr, "Spilled sorted run %d of %d entries.\n", *nruns, nkeys);
+  return 1;
+} /* spill_run */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        print_sorted_entries                        */
+/*                                                                    */
+/**********************************************************************/
+static int print_sorted_entries(GDBM_FILE gf, ngID_list_t *ngID_list,
+								ngID_map_t *ngID_map, int order,
+								int max_entries)
+{
+  /* Print the table 2 entries in order (FIRST_LOG_GAUGE_ORDER or
+   * FIRST_LOG_NET_TIME_ORDER).  Only the keys are read in the first pass;
+   * when there are more than max_entries, they are sorted in runs spilled
+   * to temporary files and merged.  The entries are then fetched in order.
+   * Return 1 for successful; -1, otherwise.
+   */
+  static int major[SHRT_MAX + 1], minor[SHRT_MAX + 1];
+  entry_key_t *keys;
+  run_t *runs = NULL;
+  int nkeys = 0, nruns = 0, i, r, rc = 1;
+  datum key, nextkey;
+  entry_key_t k;
+  short ngID;
+
+  keys = (entry_key_t *) malloc(max_entries * sizeof(entry_key_t));
+  if (keys == NULL) {
+	perror("print_sorted_entries");
+	rc = -1;
+	goto DONE;
+  }
+  if (rank_gauges(ngID_list, order, major, minor) < 0) {
+	rc = -1;
+	goto DONE;
+  }
+
+  key.dptr = NULL;
+  for(nextkey = gdbm_firstkey(gf); nextkey.dptr;
+	  nextkey = gdbm_nextkey(gf, key)) {
+	if (key.dptr) free(key.dptr);
+	key = nextkey;
+	if (key_to_entry_key(&nextkey, &k) < 0) continue;
+	ngID = k.ngID;
+	if (ngID < 0 || ngID_map->prefix[ngID] == NULL) continue;
+	if (nkeys == max_entries) {
+	  if (spill_run(keys, nkeys, &runs, &nruns) < 0) {
+		rc = -1;
+		goto DONE;
+	  }
+	  nkeys = 0;
+	}
+	keys[nkeys] = k;
+	keys[nkeys].major = major[ngID];
+	keys[nkeys].minor = minor[ngID];
+	nkeys++;
+  }
+  if (key.dptr) free(key.dptr);
+
+  if (nruns == 0) {
+	qsort(keys, nkeys, sizeof(entry_key_t), compare_entry_keys);
+	for (i = 0; i < nkeys; i++)
+	  print_entry(gf, ngID_map, &keys[i]);
+	goto DONE;
+  }
+
+  if (nkeys > 0 && spill_run(keys, nkeys, &runs, &nruns) < 0) {
+	rc = -1;
+	goto DONE;
+  }
+  /* Merge the runs; there are few, so a linear search for the least will do. */
+  while (1) {
+	for (i = -1, r = 0; r < nruns; r++)
+	  if (runs[r].more &&
+		  (i < 0 || compare_entry_keys(&runs[r].key, &runs[i].key) < 0))
+		i = r;
+	if (i < 0) break;
+	print_entry(gf, ngID_map, &runs[i].key);
+	runs[i].more = fread(&runs[i].key, sizeof(entry_key_t), 1, runs[i].fp);
+  }
+
+DONE:
+  for (r = 0; r < nruns; r++) fclose(runs[r].fp);
+  if (runs) free(runs);
+  if (keys) free(keys);
+  return rc;
+} /* print_sorted_entries */
+
+/**********************************************************************/
+/*                                                                    */
+/*                               usage                                */
+/*                                                                    */
+/**********************************************************************/
+void usage(char *prog)
+{
+  fprintf(stderr, "Usage (%s): Convert the first ZR intermediate file from GDBM\n"
+		  "\t (or the binary log format) to ASCII.\n", PROG_VERSION);
+  fprintf(stderr, "\t %s [-g | -t] [-m max_entries] [-j nthreads] [-v] gdbm_file|log_file\n", prog);
+  fprintf(stderr, "\t where:\n"
+		  "\t  -g  Sort by network, gauge # and time, as sort_zr_intermediate_ascii.\n"
+		  "\t  -t  Sort by network and time, as sort_zr_intermediate_ascii_by_time.\n"
+		  "\t  -m  Sort at most max_entries in memory; more are sorted in runs\n"
+		  "\t      spilled to temporary files.  Default: %d.\n"
+		  "\t  -j  Fetch and format the entries of a GDBM file with nthreads\n"
+		  "\t      threads (at most %d).  Default: 1.\n"
+		  "\t  -v  Verbose.\n"
+		  "\t Without -g or -t, entries are in hash order (GDBM) or VOS order (log).\n",
+		  DEFAULT_MAX_ENTRIES_IN_MEMORY, MAX_THREADS);
+  exit(-1);
+} /* usage */
+
 /**********************************************************************/
 /*                                                                    */
 /*                             main                                   */
@@ -21,15 +501,34 @@ int main (int ac, char **av)
   int rc = 0;
   char header_line[HEADER_LEN];
   ngID_list_t ngID_list;
-  char entry_line[MAX_ENTRY_LINE_LEN];
+  ngID_map_t *ngID_map = NULL;
+  int c, order = NO_ORDER, max_entries = DEFAULT_MAX_ENTRIES_IN_MEMORY;
+  int nthreads = 1;
+  entry_key_t k;
 
   this_prog = av[0];
-  if (ac == 2) infile = av[1];
-  else {
-	fprintf(stderr, "Usage (%s): Convert the first ZR intermediate file from GDBM to ASCII.\n", PROG_VERSION);
-	fprintf(stderr, "\t %s gdbm_file\n", av[0]);
-	exit(-1);
+  while ((c = getopt(ac, av, "gtm:j:v")) != -1) {
+	switch (c) {
+	case 'g': order = FIRST_LOG_GAUGE_ORDER; break;
+	case 't': order = FIRST_LOG_NET_TIME_ORDER; break;
+	case 'm':
+	  if (sscanf(optarg, "%d", &max_entries) != 1 || max_entries < 1)
+		usage(av[0]);
+	  break;
+	case 'j':
+	  if (sscanf(optarg, "%d", &nthreads) != 1 || nthreads < 1 ||
+		  nthreads > MAX_THREADS)
+		usage(av[0]);
+	  break;
+	case 'v': verbose = 1; break;
+	default: usage(av[0]);
+	}
   }
+  if (ac - optind == 1) infile = av[optind];
+  else usage(av[0]);
+
+  if (first_log_is_log_file(infile))
+	exit(log2ascii(infile, order));
 
   gf = gdbm_open(infile, 512, GDBM_READER, 0, 0);
   if (gf == NULL) {
@@ -54,14 +553,26 @@ int main (int ac, char **av)
   }
   if (verbose)
 	print_ngID_list(&ngID_list);
+  /* Table from ngID to the entry line prefix. */
+  if ((ngID_map = new_ngID_map(&ngID_list)) == NULL) {
+	rc = -1;
+	goto DONE;
+  }
+  start_workers(infile, nthreads, ngID_map);
+  if (order != NO_ORDER) {
+	if (print_sorted_entries(gf, &ngID_list, ngID_map, order, max_entries) < 0)
+	  rc = -1;
+	goto DONE;
+  }
   key.dptr = NULL;
 
   for(nextkey = gdbm_firstkey(gf); nextkey.dptr; 
 	  nextkey = gdbm_nextkey(gf, key)) {
 	key_str = nextkey.dptr;
-	memset(entry_line, '\0', MAX_ENTRY_LINE_LEN);
-	if (construct_entry_line(gf, &nextkey, &ngID_list, entry_line) == 1) 
-	  printf("%s\n", entry_line);
+	if (nworkers > 0) {
+	  if (key_to_entry_key(&nextkey, &k) == 1) print_entry(gf, ngID_map, &k);
+	} else if (construct_entry_line(gf, &nextkey, ngID_map, &out) == 1)
+	  end_line();
 
 	if (key.dptr)
 	  free(key.dptr);
@@ -71,8 +582,12 @@ int main (int ac, char **av)
   if (key.dptr)
 	free(key.dptr);
 DONE:
+  stop_workers();
+  line_buf_flush(&out, stdout);
+  free_ngID_map(ngID_map);
+  forget_db_cache(gf);
   gdbm_close(gf);
-  exit(0);
+  exit(rc);
 }
 
 
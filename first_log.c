@@ -0,0 +1,971 @@
+/*
+ * first_log.c
+ *     Write and read the first ZR intermediate file in the append-only
+ *     binary log format.  See first_log.h for the layout.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gv_utils.h>
+
+#include "first_log.h"
+#include "zr.h"
+
+extern int verbose;
+
+#define PUT_X(b, x) { memcpy((b), &(x), sizeof(x)); (b) += sizeof(x); }
+#define GET_X(b, x) { memcpy(&(x), (b), sizeof(x)); (b) += sizeof(x); }
+
+/**********************************************************************/
+/*                                                                    */
+/*                            grow_buffer                             */
+/*                                                                    */
+/**********************************************************************/
+static int grow_buffer(void **buf, int *len, int n, int size)
+{
+  /* Make room for n elements of 'size' bytes in *buf.
+   * Return 1 for successful; -1, otherwise.
+   */
+  void *new_buf;
+  int new_len;
+
+  if (n <= *len) return 1;
+  new_len = *len > 0 ? *len : 64;
+  while (new_len < n) new_len *= 2;
+  new_buf = realloc(*buf, (size_t) new_len * size);
+  if (new_buf == NULL) {
+	perror("first_log");
+	return -1;
+  }
+  *buf = new_buf;
+  *len = new_len;
+  return 1;
+} /* grow_buffer */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            gauge_hash                              */
+/*                                                                    */
+/**********************************************************************/
+static unsigned int gauge_hash(char *net, int gauge_id)
+{
+  unsigned int h = (unsigned int) gauge_id * 31;
+
+  while (*net) h = h * 131 + (unsigned char) *net++;
+  return h;
+} /* gauge_hash */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           lookup_gauge                             */
+/*                                                                    */
+/**********************************************************************/
+static int lookup_gauge(first_log_t *log, char *net, int gauge_id, int *added)
+{
+  /* Return the index of (net, gauge_id) in log->gauges, adding it if it
+   * isn't there yet (*added is set to 1 then).  Return -1 on error.
+   */
+  int i, slot, mask, *new_hash;
+  first_log_gauge_t *g;
+
+  *added = 0;
+  /* Keep the table at most half full. */
+  if (2 * (log->ngauges + 1) > log->hash_len) {
+	int new_len = log->hash_len > 0 ? 2 * log->hash_len : 256;
+	new_hash = (int *) malloc(new_len * sizeof(int));
+	if (new_hash == NULL) {
+	  perror("first_log gauge table");
+	  return -1;
+	}
+	for (i = 0; i < new_len; i++) new_hash[i] = -1;
+	for (i = 0; i < log->ngauges; i++) {
+	  g = &(log->gauges[i]);
+	  slot = gauge_hash(g->net, g->gauge_id) & (new_len - 1);
+	  while (new_hash[slot] >= 0) slot = (slot + 1) & (new_len - 1);
+	  new_hash[slot] = i;
+	}
+	if (log->hash) free(log->hash);
+	log->hash = new_hash;
+	log->hash_len = new_len;
+  }
+
+  mask = log->hash_len - 1;
+  slot = gauge_hash(net, gauge_id) & mask;
+  while (log->hash[slot] >= 0) {
+	g = &(log->gauges[log->hash[slot]]);
+	if (g->gauge_id == gauge_id && strcmp(g->net, net) == 0)
+	  return log->hash[slot];
+	slot = (slot + 1) & mask;
+  }
+
+  if (grow_buffer((void **) &log->gauges, &log->gauges_len,
+				  log->ngauges + 1, sizeof(first_log_gauge_t)) < 0)
+	return -1;
+  g = &(log->gauges[log->ngauges]);
+  memset(g, '\0', sizeof(first_log_gauge_t));
+  strncpy(g->net, net, MAX_NAME_LEN-1);
+  g->gauge_id = gauge_id;
+  log->hash[slot] = log->ngauges;
+  *added = 1;
+  return log->ngauges++;
+} /* lookup_gauge */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             add_index                              */
+/*                                                                    */
+/**********************************************************************/
+static int add_index(first_log_t *log, int gauge, time_t time_sec,
+					 long offset, int granule)
+{
+  first_log_index_t *e;
+
+  if (grow_buffer((void **) &log->index, &log->index_len, log->nindex + 1,
+				  sizeof(first_log_index_t)) < 0)
+	return -1;
+  e = &(log->index[log->nindex]);
+  e->gauge = gauge;
+  e->time_sec = time_sec;
+  e->offset = offset;
+  e->granule = granule;
+  e->seq = log->nindex++;
+  return 1;
+} /* add_index */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           write_record                             */
+/*                                                                    */
+/**********************************************************************/
+static long write_record(first_log_t *log, char type, char *body, int n)
+{
+  /* Append a record to the log.
+   * Return the offset of the record for successful; -1, otherwise.
+   */
+  long offset;
+  int len = n + 1;
+
+  offset = ftell(log->fp);
+  if (fwrite(&len, sizeof(len), 1, log->fp) != 1 ||
+	  fwrite(&type, 1, 1, log->fp) != 1 ||
+	  (n > 0 && fwrite(body, n, 1, log->fp) != 1)) {
+	perror("Write first_log record");
+	return -1;
+  }
+  return offset;
+} /* write_record */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            read_record                             */
+/*                                                                    */
+/**********************************************************************/
+static int read_record(first_log_t *log, long offset, char *type)
+{
+  /* Read the record at offset (-1: current position) into log->buf.
+   * Return the length of the body; -1 at end of file or for an
+   * incomplete record.
+   */
+  int len;
+
+  if (offset >= 0 && fseek(log->fp, offset, SEEK_SET) != 0) return -1;
+  if (fread(&len, sizeof(len), 1, log->fp) != 1 || len < 1) return -1;
+  if (fread(type, 1, 1, log->fp) != 1) return -1;
+  if (grow_buffer((void **) &log->buf, &log->buf_len, len, 1) < 0) return -1;
+  if (len > 1 && fread(log->buf, len - 1, 1, log->fp) != 1) return -1;
+  log->buf[len - 1] = '\0';
+  return len - 1;
+} /* read_record */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          add_granule                               */
+/*                                                                    */
+/**********************************************************************/
+static first_log_granule_t *add_granule(first_log_t *log, long offset,
+										char *h_body)
+{
+  /* Add a granule starting at offset to the reader, given the body of
+   * its 'H' record.
+   */
+  first_log_granule_t *gr;
+  char *p = h_body;
+
+  if (grow_buffer((void **) &log->granules, &log->granules_len,
+				  log->ngranules + 1, sizeof(first_log_granule_t)) < 0)
+	return NULL;
+  gr = &(log->granules[log->ngranules++]);
+  memset(gr, '\0', sizeof(first_log_granule_t));
+  gr->offset = offset;
+  gr->noecho_offset = -1;
+  GET_X(p, gr->stime);
+  GET_X(p, gr->etime);
+  memcpy(gr->stime_str, p, FIRST_LOG_TIME_STR_LEN);
+  p += FIRST_LOG_TIME_STR_LEN;
+  memcpy(gr->etime_str, p, FIRST_LOG_TIME_STR_LEN);
+  return gr;
+} /* add_granule */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       add_granule_gauge                            */
+/*                                                                    */
+/**********************************************************************/
+static int add_granule_gauge(first_log_t *log, first_log_granule_t *gr,
+							 char *net, int gauge_id)
+{
+  /* Give the next gauge # of granule gr to (net, gauge_id).
+   * Return 1 for successful; -1, otherwise.
+   */
+  int added, g;
+
+  g = lookup_gauge(log, net, gauge_id, &added);
+  if (g < 0) return -1;
+  if (grow_buffer((void **) &gr->gauge_map, &gr->gauge_map_len,
+				  gr->ngauges + 1, sizeof(int)) < 0) return -1;
+  gr->gauge_map[gr->ngauges++] = g;
+  return 1;
+} /* add_granule_gauge */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           reset_reader                             */
+/*                                                                    */
+/**********************************************************************/
+static void reset_reader(first_log_t *log)
+{
+  int i;
+
+  for (i = 0; i < log->ngranules; i++) {
+	if (log->granules[i].noecho) free(log->granules[i].noecho);
+	if (log->granules[i].gauge_map) free(log->granules[i].gauge_map);
+  }
+  log->ngranules = 0;
+  log->ngauges = 0;
+  for (i = 0; i < log->hash_len; i++) log->hash[i] = -1;
+  log->nindex = 0;
+  log->next = 0;
+} /* reset_reader */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           scan_records                             */
+/*                                                                    */
+/**********************************************************************/
+static long scan_records(first_log_t *log, int build_index)
+{
+  /* Read the log record by record from its start.  When build_index is
+   * set, the granules, gauges and columns found are added to the reader.
+   * Return the offset just past the last complete record; -1 on error.
+   */
+  long offset, end;
+  int gauge, gauge_id;
+  char type, *p;
+  time_t time_sec;
+  first_log_granule_t *gr = NULL;
+
+  end = offset = FIRST_LOG_MAGIC_LEN;
+  if (fseek(log->fp, offset, SEEK_SET) != 0) return -1;
+  while (read_record(log, -1, &type) >= 0) {
+	if (build_index) {
+	  p = log->buf;
+	  switch (type) {
+	  case 'H':
+		if ((gr = add_granule(log, offset, log->buf)) == NULL) return -1;
+		break;
+	  case 'G':
+		if (gr == NULL) break;
+		GET_X(p, gauge_id);
+		if (add_granule_gauge(log, gr, p, gauge_id) < 0) return -1;
+		break;
+	  case 'E':
+		if (gr) gr->noecho_offset = offset;
+		break;
+	  case 'C':
+		if (gr == NULL) break;
+		GET_X(p, gauge);
+		GET_X(p, time_sec);
+		if (gauge < 0 || gauge >= gr->ngauges) break;
+		if (add_index(log, gr->gauge_map[gauge], time_sec, offset,
+					  log->ngranules - 1) < 0) return -1;
+		break;
+	  default:  /* 'F': the index is rebuilt from the records anyway. */
+		break;
+	  }
+	}
+	end = offset = ftell(log->fp);
+  }
+  return end;
+} /* scan_records */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           read_footer                              */
+/*                                                                    */
+/**********************************************************************/
+static int read_footer(first_log_t *log, long granule_offset,
+					   long footer_offset)
+{
+  /* Add the granule at granule_offset to the reader from its 'H' record
+   * and its footer.  Return 1 for successful; -1, otherwise.
+   */
+  first_log_granule_t *gr;
+  char type, *p, *net;
+  int n, i, ngauges, ncolumns, gauge, gauge_id;
+  time_t time_sec;
+  long offset;
+
+  if (read_record(log, granule_offset, &type) < 0 || type != 'H') return -1;
+  if ((gr = add_granule(log, granule_offset, log->buf)) == NULL) return -1;
+
+  if ((n = read_record(log, footer_offset, &type)) < 0 || type != 'F')
+	return -1;
+  p = log->buf;
+  GET_X(p, ngauges);
+  for (i = 0; i < ngauges; i++) {
+	GET_X(p, gauge_id);
+	net = p;
+	p += MAX_NAME_LEN;
+	if (add_granule_gauge(log, gr, net, gauge_id) < 0) return -1;
+  }
+  GET_X(p, gr->noecho_offset);
+  GET_X(p, ncolumns);
+  for (i = 0; i < ncolumns; i++) {
+	GET_X(p, gauge);
+	GET_X(p, time_sec);
+	GET_X(p, offset);
+	if (gauge < 0 || gauge >= gr->ngauges) return -1;
+	if (add_index(log, gr->gauge_map[gauge], time_sec, offset,
+				  log->ngranules - 1) < 0) return -1;
+  }
+  if (p - log->buf + FIRST_LOG_TRAILER_LEN != n) return -1;
+  return 1;
+} /* read_footer */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        first_log_is_log_file                       */
+/*                                                                    */
+/**********************************************************************/
+int first_log_is_log_file(char *fname)
+{
+  /* Return 1 if fname is a first intermediate file in the log format;
+   * 0, otherwise.
+   */
+  FILE *fp;
+  char magic[FIRST_LOG_MAGIC_LEN];
+  int rc = 0;
+
+  if (fname == NULL || (fp = fopen(fname, "rb")) == NULL) return 0;
+  if (fread(magic, FIRST_LOG_MAGIC_LEN, 1, fp) == 1 &&
+	  memcmp(magic, FIRST_LOG_MAGIC, FIRST_LOG_MAGIC_LEN) == 0)
+	rc = 1;
+  fclose(fp);
+  return rc;
+} /* first_log_is_log_file */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        date_time_to_log_str                        */
+/*                                                                    */
+/**********************************************************************/
+static int date_time_to_log_str(DATE_STR *date, TIME_STR *time, char *str)
+{
+  /* Write date and time to str (FIRST_LOG_TIME_STR_LEN bytes) as
+   * 'mm/dd/yyyy hh:mm:ss'.
+   * Return 1 for successful; -1, otherwise (the fields don't fit).
+   */
+  char buf[64];
+  int n;
+
+  n = snprintf(buf, sizeof(buf), "%.2d/%.2d/%.4d %.2d:%.2d:%.2d",
+			   date->tkmonth, date->tkday, date->tkyear,
+			   time->tkhour, time->tkminute, time->tksecond);
+  if (n < 0 || n >= FIRST_LOG_TIME_STR_LEN) {
+	fprintf(stderr, "first_log: Bad granule date/time: %s\n", buf);
+	return -1;
+  }
+  memcpy(str, buf, n + 1);
+  return 1;
+} /* date_time_to_log_str */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        first_log_open_append                       */
+/*                                                                    */
+/**********************************************************************/
+first_log_t *first_log_open_append(char *fname, char *site,
+								   DATE_STR *sdate, TIME_STR *stime,
+								   DATE_STR *edate, TIME_STR *etime,
+								   float lat, float lon,
+								   float gauge_win_xmax, float gauge_win_ymax,
+								   float gauge_win_zmax,
+								   rain_class_type_t rain_class_type)
+{
+  /* Open the log 'fname' for appending one granule, creating it if it
+   * doesn't exist, and write the granule header.  The log format
+   * counterpart of open_outfile_and_write_header_info().
+   * An incomplete record left at the end of the file by a killed writer
+   * is cut off first.
+   *
+   * Return the log for successful; NULL, otherwise.
+   * The caller should close the log with first_log_close(); that writes
+   * the granule footer.
+   */
+  first_log_t *log;
+  char magic[FIRST_LOG_MAGIC_LEN];
+  char h_str[2][FIRST_LOG_TIME_STR_LEN];
+  time_t stime_sec, etime_sec;
+  long size, end;
+  Header_t *header;
+  char *p;
+  int n;
+
+  log = (first_log_t *) calloc(1, sizeof(first_log_t));
+  if (log == NULL) {
+	perror("first_log_open_append");
+	return NULL;
+  }
+  log->writing = 1;
+  log->noecho_offset = -1;
+
+  log->fp = fopen(fname, "r+b");
+  if (log->fp == NULL) {
+	log->fp = fopen(fname, "w+b");
+	if (log->fp == NULL ||
+		fwrite(FIRST_LOG_MAGIC, FIRST_LOG_MAGIC_LEN, 1, log->fp) != 1) {
+	  perror(fname);
+	  goto ERROR;
+	}
+  }
+  else {
+	if (fread(magic, FIRST_LOG_MAGIC_LEN, 1, log->fp) != 1 ||
+		memcmp(magic, FIRST_LOG_MAGIC, FIRST_LOG_MAGIC_LEN) != 0) {
+	  fprintf(stderr, "%s: Not a first intermediate log file.\n", fname);
+	  goto ERROR;
+	}
+	fseek(log->fp, 0, SEEK_END);
+	size = ftell(log->fp);
+	end = size;
+	if (size > FIRST_LOG_MAGIC_LEN) {
+	  if (size < FIRST_LOG_MAGIC_LEN + (long) FIRST_LOG_TRAILER_LEN ||
+		  fseek(log->fp, size - FIRST_LOG_MAGIC_LEN, SEEK_SET) != 0 ||
+		  fread(magic, FIRST_LOG_MAGIC_LEN, 1, log->fp) != 1 ||
+		  memcmp(magic, FIRST_LOG_END_MAGIC, FIRST_LOG_MAGIC_LEN) != 0)
+		end = scan_records(log, 0);  /* Last granule has no footer. */
+	}
+	if (end < 0) goto ERROR;
+	if (end < size) {
+	  fprintf(stderr, "%s: Cutting off %ld bytes of an incomplete record.\n",
+			  fname, size - end);
+	  fflush(log->fp);
+	  if (ftruncate(fileno(log->fp), end) != 0) {
+		perror(fname);
+		goto ERROR;
+	  }
+	}
+	fseek(log->fp, end, SEEK_SET);
+  }
+
+  /* Granule header. */
+  date_time2system_time(sdate, stime, &stime_sec);
+  date_time2system_time(edate, etime, &etime_sec);
+  memset(h_str, '\0', sizeof(h_str));
+  if (date_time_to_log_str(sdate, stime, h_str[0]) < 0 ||
+	  date_time_to_log_str(edate, etime, h_str[1]) < 0) goto ERROR;
+  header = construct_header(site, lat, lon,
+							gauge_win_xmax, gauge_win_ymax, gauge_win_zmax,
+							rain_class_type);
+  if (header == NULL) goto ERROR;
+  n = 2 * sizeof(time_t) + sizeof(h_str) + header->n;
+  if (grow_buffer((void **) &log->buf, &log->buf_len, n, 1) < 0) {
+	free(header);
+	goto ERROR;
+  }
+  p = log->buf;
+  PUT_X(p, stime_sec);
+  PUT_X(p, etime_sec);
+  memcpy(p, h_str, sizeof(h_str));
+  p += sizeof(h_str);
+  memcpy(p, header->h, header->n);
+  free(header);
+  log->granule_offset = write_record(log, 'H', log->buf, n);
+  if (log->granule_offset < 0) goto ERROR;
+  return log;
+
+ ERROR:
+  if (log->fp) fclose(log->fp);
+  log->fp = NULL;
+  first_log_close(log);
+  return NULL;
+} /* first_log_open_append */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       first_log_append_column                      */
+/*                                                                    */
+/**********************************************************************/
+int first_log_append_column(first_log_t *log, zc_column_t *column,
+							char *net_name)
+{
+  /* Append column to the log.  The log format counterpart of
+   * append_column_to_file().
+   * Return 1 for successful; -1, otherwise.
+   */
+  int gauge, gauge_id, added, n, hdr, noecho_len;
+  time_t time_sec;
+  long offset;
+  char *p, *noecho;
+
+  if (log == NULL || log->fp == NULL || column == NULL || net_name == NULL)
+	return -1;
+
+  /* Same gauge number as the GDBM table 1 key. */
+  gauge_id = (short) atoi(column->gauge_id);
+  gauge = lookup_gauge(log, net_name, gauge_id, &added);
+  if (gauge < 0) return -1;
+  if (added) {
+	n = sizeof(int) + strlen(net_name) + 1;
+	if (grow_buffer((void **) &log->buf, &log->buf_len, n, 1) < 0) return -1;
+	p = log->buf;
+	PUT_X(p, gauge_id);
+	strcpy(p, net_name);
+	if (write_record(log, 'G', log->buf, n) < 0) return -1;
+  }
+
+  /* Room for the record header fields, the column content and, after
+   * them, the NOECHO cells.
+   */
+  n = column_content_max_len(column);
+  hdr = sizeof(int) + sizeof(time_t);
+  if (grow_buffer((void **) &log->buf, &log->buf_len, hdr + 2 * n, 1) < 0)
+	return -1;
+  noecho = log->buf + hdr + n;
+
+  date_time2system_time(&column->sdate, &column->stime, &time_sec);
+  p = log->buf;
+  PUT_X(p, gauge);
+  PUT_X(p, time_sec);
+  n = column_to_content(column, FIRST_LOG_CODEC, p, noecho, &noecho_len);
+
+  if (noecho_len > 0 && log->noecho_offset < 0) {
+	log->noecho_offset = write_record(log, 'E', noecho, noecho_len);
+	if (log->noecho_offset < 0) return -1;
+  }
+  if ((offset = write_record(log, 'C', log->buf, hdr + n)) < 0) return -1;
+  return add_index(log, gauge, time_sec, offset, 0);
+} /* first_log_append_column */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        first_log_open_read                         */
+/*                                                                    */
+/**********************************************************************/
+first_log_t *first_log_open_read(char *fname)
+{
+  /* Open the log 'fname' for reading and load the index of all of its
+   * granules, from the granule footers if they are all there; else by
+   * scanning the records.  Entries are read in VOS order unless
+   * first_log_set_order() says otherwise.
+   * Return the log for successful; NULL, otherwise.
+   */
+  first_log_t *log;
+  char magic[FIRST_LOG_MAGIC_LEN];
+  long size, pos, *offsets = NULL;
+  int noffsets = 0, offsets_len = 0, i, rc;
+
+  log = (first_log_t *) calloc(1, sizeof(first_log_t));
+  if (log == NULL) {
+	perror("first_log_open_read");
+	return NULL;
+  }
+  log->fp = fopen(fname, "rb");
+  if (log->fp == NULL) {
+	perror(fname);
+	free(log);
+	return NULL;
+  }
+  if (fread(magic, FIRST_LOG_MAGIC_LEN, 1, log->fp) != 1 ||
+	  memcmp(magic, FIRST_LOG_MAGIC, FIRST_LOG_MAGIC_LEN) != 0) {
+	fprintf(stderr, "%s: Not a first intermediate log file.\n", fname);
+	first_log_close(log);
+	return NULL;
+  }
+
+  /* Walk the granules back from the end of the file by their trailers.
+   * offsets[] gets (granule offset, footer offset) pairs, last granule
+   * first.
+   */
+  fseek(log->fp, 0, SEEK_END);
+  size = ftell(log->fp);
+  rc = 1;
+  for (pos = size; rc > 0 && pos > FIRST_LOG_MAGIC_LEN; ) {
+	long granule_offset, footer_offset;
+	rc = -1;
+	if (pos < FIRST_LOG_MAGIC_LEN + (long) FIRST_LOG_TRAILER_LEN) break;
+	if (fseek(log->fp, pos - FIRST_LOG_TRAILER_LEN, SEEK_SET) != 0 ||
+		fread(&granule_offset, sizeof(long), 1, log->fp) != 1 ||
+		fread(&footer_offset, sizeof(long), 1, log->fp) != 1 ||
+		fread(magic, FIRST_LOG_MAGIC_LEN, 1, log->fp) != 1 ||
+		memcmp(magic, FIRST_LOG_END_MAGIC, FIRST_LOG_MAGIC_LEN) != 0)
+	  break;
+	if (granule_offset < FIRST_LOG_MAGIC_LEN ||
+		footer_offset <= granule_offset || footer_offset >= pos)
+	  break;
+	if (grow_buffer((void **) &offsets, &offsets_len, 2 * noffsets + 2,
+					sizeof(long)) < 0)
+	  break;
+	offsets[2*noffsets] = granule_offset;
+	offsets[2*noffsets+1] = footer_offset;
+	noffsets++;
+	pos = granule_offset;
+	rc = 1;
+  }
+  for (i = noffsets - 1; rc > 0 && i >= 0; i--)
+	rc = read_footer(log, offsets[2*i], offsets[2*i+1]);
+  if (offsets) free(offsets);
+
+  if (rc < 0) {
+	if (verbose)
+	  fprintf(stderr, "%s: Missing granule footer. Scanning all records.\n",
+			  fname);
+	reset_reader(log);
+	if (scan_records(log, 1) < 0) {
+	  first_log_close(log);
+	  return NULL;
+	}
+  }
+  if (verbose)
+	fprintf(stderr, "%s: %d granules, %d gauges, %d columns.\n", fname,
+			log->ngranules, log->ngauges, log->nindex);
+
+  if (first_log_set_order(log, FIRST_LOG_VOS_ORDER) < 0) {
+	first_log_close(log);
+	return NULL;
+  }
+  return log;
+} /* first_log_open_read */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        first_log_read_header                       */
+/*                                                                    */
+/**********************************************************************/
+int first_log_read_header(first_log_t *log, char *header_line)
+{
+  /* Get the header of the last granule written, with the start and end
+   * time over all granules, as read_header_from_db() does for the GDBM
+   * format.  header_line must hold HEADER_LEN characters.
+   * Return 1 for successful; -1, otherwise.
+   */
+  first_log_granule_t *gr, *first, *last;
+  char type, *p;
+  int i, n, skip;
+
+  if (log == NULL || header_line == NULL || log->ngranules == 0) return -1;
+
+  first = last = &(log->granules[0]);
+  for (i = 1; i < log->ngranules; i++) {
+	gr = &(log->granules[i]);
+	if (difftime(gr->stime, first->stime) < 0) first = gr;
+	if (difftime(gr->etime, last->etime) > 0) last = gr;
+  }
+
+  gr = &(log->granules[log->ngranules - 1]);
+  skip = 2 * sizeof(time_t) + 2 * FIRST_LOG_TIME_STR_LEN;
+  if ((n = read_record(log, gr->offset, &type)) < skip || type != 'H')
+	return -1;
+  if (n - skip >= HEADER_LEN) return -1;
+  strcpy(header_line, log->buf + skip);
+  if ((p = strstr(header_line, START_DATE_TIME_STR)) != NULL &&
+	  (p = strstr(p, "MM/DD/YYYY")) != NULL)
+	memcpy(p, first->stime_str, strlen(first->stime_str));
+  if ((p = strstr(header_line, END_DATE_TIME_STR)) != NULL &&
+	  (p = strstr(p, "MM/DD/YYYY")) != NULL)
+	memcpy(p, last->etime_str, strlen(last->etime_str));
+  return 1;
+} /* first_log_read_header */
+
+/* Gauge ranks for the qsort() comparison functions below. */
+static first_log_gauge_t *sort_gauges;
+static int *sort_rank;
+static int *sort_net_rank, *sort_str_rank;
+
+static int compare_gauges(const void *a, const void *b)
+{
+  const first_log_gauge_t *g1 = &sort_gauges[*(const int *) a];
+  const first_log_gauge_t *g2 = &sort_gauges[*(const int *) b];
+  int rc;
+
+  if ((rc = strcmp(g1->net, g2->net)) != 0) return rc;
+  if (g1->gauge_id != g2->gauge_id) return g1->gauge_id < g2->gauge_id ? -1 : 1;
+  return 0;
+}
+
+static int compare_gauge_strs(const void *a, const void *b)
+{
+  /* Gauge # as text, like sort(1) does with whole lines "gauge# net ...". */
+  char s1[MAX_NAME_LEN], s2[MAX_NAME_LEN];
+
+  sprintf(s1, "%d", sort_gauges[*(const int *) a].gauge_id);
+  sprintf(s2, "%d", sort_gauges[*(const int *) b].gauge_id);
+  return strcmp(s1, s2);
+}
+
+static int compare_by_net_time(const void *a, const void *b)
+{
+  const first_log_index_t *e1 = (const first_log_index_t *) a;
+  const first_log_index_t *e2 = (const first_log_index_t *) b;
+
+  if (sort_net_rank[e1->gauge] != sort_net_rank[e2->gauge])
+	return sort_net_rank[e1->gauge] < sort_net_rank[e2->gauge] ? -1 : 1;
+  if (e1->time_sec != e2->time_sec) return e1->time_sec < e2->time_sec ? -1 : 1;
+  if (sort_str_rank[e1->gauge] != sort_str_rank[e2->gauge])
+	return sort_str_rank[e1->gauge] < sort_str_rank[e2->gauge] ? -1 : 1;
+  return 0;
+}
+
+static int compare_by_gauge(const void *a, const void *b)
+{
+  const first_log_index_t *e1 = (const first_log_index_t *) a;
+  const first_log_index_t *e2 = (const first_log_index_t *) b;
+
+  if (e1->gauge != e2->gauge)
+	return sort_rank[e1->gauge] < sort_rank[e2->gauge] ? -1 : 1;
+  if (e1->time_sec != e2->time_sec) return e1->time_sec < e2->time_sec ? -1 : 1;
+  if (e1->seq != e2->seq) return e1->seq < e2->seq ? -1 : 1;
+  return 0;
+}
+
+static int compare_by_vos(const void *a, const void *b)
+{
+  const first_log_index_t *e1 = (const first_log_index_t *) a;
+  const first_log_index_t *e2 = (const first_log_index_t *) b;
+
+  if (e1->time_sec != e2->time_sec) return e1->time_sec < e2->time_sec ? -1 : 1;
+  if (e1->seq != e2->seq) return e1->seq < e2->seq ? -1 : 1;
+  return 0;
+}
+
+/**********************************************************************/
+/*                                                                    */
+/*                        first_log_set_order                         */
+/*                                                                    */
+/**********************************************************************/
+int first_log_set_order(first_log_t *log, int order)
+{
+  /* Order the entries of the log and start reading from the first one.
+   *   FIRST_LOG_VOS_ORDER:   By VOS time; entries of a VOS as written
+   *                          (network/gauge order).
+   *   FIRST_LOG_GAUGE_ORDER: By network, gauge # and VOS time, as
+   *                          sort_zr_intermediate_ascii does.
+   *   FIRST_LOG_NET_TIME_ORDER: By network, VOS time and gauge # (as
+   *                          text), as sort_zr_intermediate_ascii_by_time
+   *                          does.
+   * A (gauge, VOS) written more than once (granule processed again) is
+   * only kept as last written, as in the GDBM format.
+   * Return 1 for successful; -1, otherwise.
+   */
+  int *by_name, i, n;
+
+  if (log == NULL || log->writing) return -1;
+  log->next = 0;
+  if (log->nindex == 0) return 1;
+
+  by_name = (int *) malloc(log->ngauges * sizeof(int));
+  sort_rank = (int *) malloc(log->ngauges * sizeof(int));
+  if (by_name == NULL || sort_rank == NULL) {
+	perror("first_log_set_order");
+	if (by_name) free(by_name);
+	if (sort_rank) free(sort_rank);
+	return -1;
+  }
+  for (i = 0; i < log->ngauges; i++) by_name[i] = i;
+  sort_gauges = log->gauges;
+  qsort(by_name, log->ngauges, sizeof(int), compare_gauges);
+  for (i = 0; i < log->ngauges; i++) sort_rank[by_name[i]] = i;
+
+  qsort(log->index, log->nindex, sizeof(first_log_index_t), compare_by_gauge);
+  /* Drop all but the last written of the same (gauge, time). */
+  for (i = 1, n = 0; i < log->nindex; i++) {
+	if (log->index[i].gauge != log->index[n].gauge ||
+		log->index[i].time_sec != log->index[n].time_sec)
+	  n++;
+	log->index[n] = log->index[i];
+  }
+  if (verbose && n + 1 != log->nindex)
+	fprintf(stderr, "first_log: %d columns written more than once.\n",
+			log->nindex - n - 1);
+  log->nindex = n + 1;
+
+  if (order == FIRST_LOG_VOS_ORDER)
+	qsort(log->index, log->nindex, sizeof(first_log_index_t), compare_by_vos);
+  else if (order == FIRST_LOG_NET_TIME_ORDER) {
+	sort_net_rank = (int *) malloc(log->ngauges * sizeof(int));
+	sort_str_rank = (int *) malloc(log->ngauges * sizeof(int));
+	if (sort_net_rank == NULL || sort_str_rank == NULL) {
+	  perror("first_log_set_order");
+	  n = -1;
+	} else {
+	  for (i = 0, n = 0; i < log->ngauges; i++) {
+		if (i > 0 && strcmp(log->gauges[by_name[i]].net,
+							log->gauges[by_name[i-1]].net) != 0) n++;
+		sort_net_rank[by_name[i]] = n;
+	  }
+	  for (i = 0; i < log->ngauges; i++) by_name[i] = i;
+	  qsort(by_name, log->ngauges, sizeof(int), compare_gauge_strs);
+	  for (i = 0; i < log->ngauges; i++) sort_str_rank[by_name[i]] = i;
+	  qsort(log->index, log->nindex, sizeof(first_log_index_t),
+			compare_by_net_time);
+	}
+	if (sort_net_rank) free(sort_net_rank);
+	if (sort_str_rank) free(sort_str_rank);
+	sort_net_rank = sort_str_rank = NULL;
+  }
+
+  free(by_name);
+  free(sort_rank);
+  sort_rank = NULL;
+  return n < 0 ? -1 : 1;
+} /* first_log_set_order */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        first_log_next_record                       */
+/*                                                                    */
+/**********************************************************************/
+int first_log_next_record(first_log_t *log, first_log_gauge_t **gauge,
+						  time_t *time_sec, char **content, char **noecho)
+{
+  /* Read the next entry of the log.  *content is the column content (see
+   * column_to_content()) and *noecho the NOECHO cells of its granule
+   * (NULL if there are none).  Both are only valid until the next call.
+   * Return 1 for successful; 0 when there are no more entries; -1 on
+   * error.
+   */
+  first_log_index_t *e;
+  first_log_granule_t *gr;
+  char type;
+  int n;
+
+  if (log == NULL || log->writing) return -1;
+  if (log->next >= log->nindex) return 0;
+  e = &(log->index[log->next++]);
+  gr = &(log->granules[e->granule]);
+
+  if (gr->noecho == NULL && gr->noecho_offset >= 0) {
+	if ((n = read_record(log, gr->noecho_offset, &type)) < 0 || type != 'E')
+	  return -1;
+	gr->noecho = (char *) malloc(n + 1);
+	if (gr->noecho == NULL) {
+	  perror("first_log_next_record");
+	  return -1;
+	}
+	memcpy(gr->noecho, log->buf, n + 1);
+  }
+  if ((n = read_record(log, e->offset, &type)) < 0 || type != 'C' ||
+	  n < (int) (sizeof(int) + sizeof(time_t))) {
+	fprintf(stderr, "first_log: Bad column record at offset %ld\n", e->offset);
+	return -1;
+  }
+  *gauge = &(log->gauges[e->gauge]);
+  *time_sec = e->time_sec;
+  *content = log->buf + sizeof(int) + sizeof(time_t);
+  *noecho = gr->noecho;
+  return 1;
+} /* first_log_next_record */
+
+/**********************************************************************/
+/*                                                                    */
+/*                      first_log_next_entry_line                     */
+/*                                                                    */
+/**********************************************************************/
+int first_log_next_entry_line(first_log_t *log, line_buf_t *line)
+{
+  /* Append the ASCII line of the next entry (no newline) to line, as
+   * construct_entry_line() does for the GDBM format.
+   * Return 1 for successful; 0 when there are no more entries; -1 on
+   * error.
+   */
+  first_log_gauge_t *gauge;
+  time_t time_sec;
+  char *content, *noecho;
+  char date_str[MAX_NAME_LEN];
+  char time_str[MAX_NAME_LEN];
+  int rc;
+
+  if ((rc = first_log_next_record(log, &gauge, &time_sec, &content,
+								  &noecho)) <= 0)
+	return rc;
+  time_secs2date_time_strs(time_sec, 1, 0, date_str, time_str);
+  line_buf_printf(line, "%d %s %s %s ", gauge->gauge_id, gauge->net,
+				  date_str, time_str);
+  return content_to_entry_line(content, FIRST_LOG_CODEC, NULL, noecho, line);
+} /* first_log_next_entry_line */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          first_log_close                           */
+/*                                                                    */
+/**********************************************************************/
+int first_log_close(first_log_t *log)
+{
+  /* Close the log and free it.  For a log open for appending, write the
+   * footer of the granule first.
+   * Return 1 for successful; -1, otherwise.
+   */
+  int rc = 1, n, i;
+  long footer_offset;
+  char *p;
+
+  if (log == NULL) return -1;
+  if (log->writing && log->fp) {
+	n = sizeof(int) + log->ngauges * (sizeof(int) + MAX_NAME_LEN) +
+	  sizeof(long) + sizeof(int) +
+	  log->nindex * (sizeof(int) + sizeof(time_t) + sizeof(long)) +
+	  FIRST_LOG_TRAILER_LEN;
+	if (grow_buffer((void **) &log->buf, &log->buf_len, n, 1) < 0)
+	  rc = -1;
+	else {
+	  memset(log->buf, '\0', n);
+	  footer_offset = ftell(log->fp);
+	  p = log->buf;
+	  PUT_X(p, log->ngauges);
+	  for (i = 0; i < log->ngauges; i++) {
+		PUT_X(p, log->gauges[i].gauge_id);
+		memcpy(p, log->gauges[i].net, MAX_NAME_LEN);
+		p += MAX_NAME_LEN;
+	  }
+	  PUT_X(p, log->noecho_offset);
+	  PUT_X(p, log->nindex);
+	  for (i = 0; i < log->nindex; i++) {
+		PUT_X(p, log->index[i].gauge);
+		PUT_X(p, log->index[i].time_sec);
+		PUT_X(p, log->index[i].offset);
+	  }
+	  PUT_X(p, log->granule_offset);
+	  PUT_X(p, footer_offset);
+	  memcpy(p, FIRST_LOG_END_MAGIC, FIRST_LOG_MAGIC_LEN);
+	  if (write_record(log, 'F', log->buf, n) < 0) rc = -1;
+	}
+	if (verbose)
+	  fprintf(stderr, "first_log: Wrote %d columns of %d gauges.\n",
+			  log->nindex, log->ngauges);
+  }
+  if (log->fp && fclose(log->fp) != 0) {
+	perror("first_log_close");
+	rc = -1;
+  }
+
+  reset_reader(log);
+  if (log->granules) free(log->granules);
+  if (log->gauges) free(log->gauges);
+  if (log->hash) free(log->hash);
+  if (log->index) free(log->index);
+  if (log->buf) free(log->buf);
+  free(log);
+  return rc;
+} /* first_log_close */
@@ -0,0 +1,134 @@
+/*
+ * first_log.h
+ *     Append-only binary log format for the first ZR intermediate file.
+ *
+ *     The GDBM format (output.c) stores each (gauge, VOS) column under a
+ *     hashed key, so every write is a random update plus a table-1 lookup,
+ *     and every reader gets the entries back in hash order.  The log format
+ *     writes the columns sequentially, one granule after another, and ends
+ *     each granule with a footer indexing its columns.  Readers get the
+ *     entries in VOS order or gauge order without sorting the ASCII dump.
+ *
+ *     File layout:
+ *         FIRST_LOG_MAGIC
+ *         granule 1
+ *         ...
+ *         granule N
+ *
+ *     Each granule is a sequence of records:
+ *         int  len    Number of bytes that follow (type + body).
+ *         char type
+ *         body
+ *
+ *     Record types and bodies:
+ *       'H' Granule header: time_t start, time_t end,
+ *           char start_str[FIRST_LOG_TIME_STR_LEN],
+ *           char end_str[FIRST_LOG_TIME_STR_LEN], header text ('\0' ended).
+ *       'G' Gauge: int gauge_id, network name ('\0' ended).  Gauges are
+ *           numbered 0, 1, ... in the order of their 'G' records within
+ *           the granule; 'G' precedes the gauge's first 'C'.
+ *       'E' NOECHO cells, as the GDBM NOECHO entry.
+ *       'C' Column: int gauge number, time_t VOS time, content as the
+ *           GDBM table 2 content (see column_to_content()), always in
+ *           the compact codec (FIRST_LOG_CODEC).
+ *       'F' Footer: int ngauges, ngauges x (int gauge_id, net name of
+ *           MAX_NAME_LEN bytes), long offset of 'E' (-1 if none),
+ *           int ncolumns, ncolumns x (int gauge number, time_t time,
+ *           long record offset), long granule offset, long footer offset,
+ *           FIRST_LOG_END_MAGIC.
+ *
+ *     The last FIRST_LOG_TRAILER_LEN bytes of a granule (granule and footer
+ *     offsets, end magic) let a reader walk the granules from the end of
+ *     the file.
+ *     Should a granule lack its footer (writer killed), readers fall back
+ *     to scanning the records from the start of the file.
+ *
+ *     Numbers are in the byte order of the writing host, as in the GDBM
+ *     format.
+ */
+
+#ifndef __FIRST_LOG_H__
+#define __FIRST_LOG_H__ 1
+
+#include <stdio.h>
+#include <time.h>
+#include "get_radar_data_over_gauge_db.h"
+
+#define FIRST_LOG_MAGIC        "ZRLOG01\n"
+#define FIRST_LOG_END_MAGIC    "ZRLOGEND"
+#define FIRST_LOG_MAGIC_LEN    8
+#define FIRST_LOG_TRAILER_LEN  (2*sizeof(long) + FIRST_LOG_MAGIC_LEN)
+#define FIRST_LOG_TIME_STR_LEN 20      /* mm/dd/yyyy hh:mm:ss */
+#define FIRST_LOG_CODEC        COLUMN_CODEC_COMPACT
+
+#define FIRST_LOG_VOS_ORDER    0       /* By VOS time, then as written. */
+#define FIRST_LOG_GAUGE_ORDER  1       /* By network, gauge, VOS time. */
+#define FIRST_LOG_NET_TIME_ORDER 2     /* By network, VOS time, gauge. */
+
+typedef struct {
+  char   net[MAX_NAME_LEN];
+  int    gauge_id;
+} first_log_gauge_t;
+
+typedef struct {
+  int    gauge;          /* Writer: granule gauge #; reader: index in gauges. */
+  time_t time_sec;
+  long   offset;         /* Offset of the 'C' record. */
+  int    granule;        /* Reader only. */
+  int    seq;            /* Reader only: order of the record in the file. */
+} first_log_index_t;
+
+typedef struct {
+  long   offset;         /* Offset of the 'H' record. */
+  time_t stime, etime;
+  char   stime_str[FIRST_LOG_TIME_STR_LEN];
+  char   etime_str[FIRST_LOG_TIME_STR_LEN];
+  long   noecho_offset;  /* -1: none. */
+  char   *noecho;        /* Loaded on demand. */
+  int    *gauge_map;     /* Granule gauge # -> index in gauges. */
+  int    ngauges, gauge_map_len;
+} first_log_granule_t;
+
+typedef struct {
+  FILE   *fp;
+  int    writing;
+  /* Gauges: writer, of the current granule; reader, of all granules. */
+  first_log_gauge_t *gauges;
+  int    ngauges, gauges_len;
+  int    *hash;          /* Open addressing table of gauge indices. */
+  int    hash_len;
+  /* Columns: writer, of the current granule; reader, of all granules. */
+  first_log_index_t *index;
+  int    nindex, index_len;
+  /* Writer. */
+  long   granule_offset;
+  long   noecho_offset;
+  /* Reader. */
+  first_log_granule_t *granules;
+  int    ngranules, granules_len;
+  int    next;           /* Next entry of index to read. */
+  char   *buf;           /* Record buffer. */
+  int    buf_len;
+} first_log_t;
+
+int first_log_is_log_file(char *fname);
+first_log_t *first_log_open_append(char *fname, char *site,
+								   DATE_STR *sdate, TIME_STR *stime,
+								   DATE_STR *edate, TIME_STR *etime,
+								   float lat, float lon,
+								   float gauge_win_xmax, float gauge_win_ymax,
+								   float gauge_win_zmax,
+								   rain_class_type_t rain_class_type);
+int first_log_append_column(first_log_t *log, zc_column_t *column,
+							char *net_name);
+
+first_log_t *first_log_open_read(char *fname);
+int first_log_read_header(first_log_t *log, char *header_line);
+int first_log_set_order(first_log_t *log, int order);
+int first_log_next_record(first_log_t *log, first_log_gauge_t **gauge,
+						  time_t *time_sec, char **content, char **noecho);
+int first_log_next_entry_line(first_log_t *log, line_buf_t *line);
+
+int first_log_close(first_log_t *log);
+
+#endif
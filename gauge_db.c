@@ -60,6 +60,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
 
 
 #include <gdbm.h>
@@ -76,6 +77,25 @@ static int verbose = 0;
 extern int verbose;
 #endif
 
+/* What gauge_db_entry_exists_for_this_month() fetched last, for each open
+ * database, so that threads reading with handles of their own
+ * (merge_radarNgauge_data -j) don't share it.  Entries are dropped by
+ * gauge_db_close().
+ */
+#define MONTH_CACHE_LEN 64
+
+typedef struct {
+  GDBM_FILE dbf;         /* NULL: entry not in use. */
+  int  save_mon, nyears;
+  char save_gaugeID[MAX_NAME_LEN], save_netID[MAX_NAME_LEN];
+  int  years_list[MAX_YEAR_NUM];
+} month_cache_t;
+
+static month_cache_t month_caches[MONTH_CACHE_LEN];
+static pthread_mutex_t month_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+pthread_mutex_t gauge_db_time_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int create_table1_key(GDBM_FILE dbf, char *netID, char *gaugeID,
 				datum *key);
 int get_or_create_ngID(GDBM_FILE dbf, char *netID, char *gaugeID, 
@@ -172,7 +192,9 @@ int add_info_to_table_3(GDBM_FILE dbf, char *netID,
   if (netID == NULL ||
 	  gaugeID == NULL || strlen(netID) == 0 || strlen(gaugeID) == 0)
 	return -1;
+  pthread_mutex_lock(&gauge_db_time_lock);
   gv_utils_get_month_year_for_time(rr_time, &mon, &year);
+  pthread_mutex_unlock(&gauge_db_time_lock);
   memset(key_str, '\0', MAX_STR_LEN);
   key.dptr = key_str;
   key.dsize = 0;
@@ -273,6 +295,37 @@ fprintf(stderr, "NNNN = %d\n", n++);
 } /* gauge_db_add */
 
 
+/**********************************************************************/
+/*                                                                    */
+/*                           get_month_cache                          */
+/*                                                                    */
+/**********************************************************************/
+static month_cache_t *get_month_cache(GDBM_FILE dbf)
+{
+  /* Return the month cache entry of dbf; the least recently added one is
+   * reused when all are in use.
+   */
+  static int next_free = 0;
+  month_cache_t *cache = NULL;
+  int i;
+
+  pthread_mutex_lock(&month_cache_lock);
+  for (i = 0; i < MONTH_CACHE_LEN && cache == NULL; i++)
+	if (month_caches[i].dbf == dbf) cache = &month_caches[i];
+  if (cache == NULL) {
+	for (i = 0; i < MONTH_CACHE_LEN && cache == NULL; i++)
+	  if (month_caches[i].dbf == NULL) cache = &month_caches[i];
+	if (cache == NULL) {
+	  cache = &month_caches[next_free];
+	  next_free = (next_free + 1) % MONTH_CACHE_LEN;
+	}
+	memset(cache, '\0', sizeof(month_cache_t));
+	cache->dbf = dbf;
+  }
+  pthread_mutex_unlock(&month_cache_lock);
+  return cache;
+} /* get_month_cache */
+
 /**********************************************************************/
 /*                                                                    */
 /*                       gauge_db_entry_exists_for_this_month         */
@@ -285,27 +338,28 @@ int gauge_db_entry_exists_for_this_month(GDBM_FILE dbf,  char *netID, char
    * the month of rr_time; 0, otherwise.
    *  Note: This routine check data from table 3.
    */
-  static int save_mon = 0, nyears = 0;
-  static char save_gaugeID[MAX_NAME_LEN], save_netID[MAX_NAME_LEN];
-  static int years_list[MAX_YEAR_NUM];
+  month_cache_t *c;
   int mon = 0, year = 0;
   datum key, content;
-  char *tok, *tmp_str;
+  char *tok, *tmp_str, *last;
   int i;
   char key_str[MAX_STR_LEN];
 
   /* Algorithm:
-   *   1. Save statically the month, gaugeID, netID..
+   *   1. Save the month, gaugeID, netID in dbf's month cache.
    *   2. Fetch from the databse the list of years for rr_time's month --
-   *      store this list statically. Fetch again for different month only.
+   *      store this list in the cache. Fetch again for different month only.
    *   3. return 1 if there is an entry for this month and the year exists
    *      in the year list; 0, otherwise.
    */
+  pthread_mutex_lock(&gauge_db_time_lock);
   gv_utils_get_month_year_for_time(rr_time, &mon, &year);
+  pthread_mutex_unlock(&gauge_db_time_lock);
   if (mon == 0 || year == 0) return 0;
-  if (save_mon == 0 ||
-	  (mon != save_mon || strcmp(save_gaugeID, gaugeID) != 0 ||
-	   strcmp(save_netID, netID) != 0)) {
+  c = get_month_cache(dbf);
+  if (c->save_mon == 0 ||
+	  (mon != c->save_mon || strcmp(c->save_gaugeID, gaugeID) != 0 ||
+	   strcmp(c->save_netID, netID) != 0)) {
 	memset(key_str, '\0', MAX_STR_LEN);
 	key.dptr = key_str;
 	key.dsize = 0;
@@ -318,25 +372,25 @@ int gauge_db_entry_exists_for_this_month(GDBM_FILE dbf,  char *netID, char
 	  return 0; /* No Entry */
 
 	/* Parse year from string and store as int in years list */
-	memset(years_list, 0, sizeof(years_list)); /* Initialize*/
-	tok = strtok(content.dptr, " ");
+	memset(c->years_list, 0, sizeof(c->years_list)); /* Initialize*/
+	tok = strtok_r(content.dptr, " ", &last);
 	tmp_str = content.dptr;
 	i = 0;
-	while (tok) {
-	  years_list[i] = atoi(tok);
-	  tok = strtok(NULL, " ");
+	while (tok && i < MAX_YEAR_NUM) {
+	  c->years_list[i] = atoi(tok);
+	  tok = strtok_r(NULL, " ", &last);
 	  i++;
 	}
-	nyears = i;
+	c->nyears = i;
 	if (tmp_str) free(tmp_str);
 	/* Save */
-	save_mon = mon;
-	strcpy(save_netID, netID);
-	strcpy(save_gaugeID, gaugeID);
+	c->save_mon = mon;
+	strcpy(c->save_netID, netID);
+	strcpy(c->save_gaugeID, gaugeID);
   }
   
-  for (i = 0; i< nyears; i++) {
-	if (years_list[i] == year) 
+  for (i = 0; i< c->nyears; i++) {
+	if (c->years_list[i] == year) 
 	  return 1; /* year for this month found */
   }
 
@@ -668,11 +722,17 @@ int gauge_db_create_table2_key(GDBM_FILE dbf, char *netID, char *gaugeID,
 void gauge_db_close(GDBM_FILE dbf, char read_write_flag)
 {
   /* Close the database. */
+  int i;
 
   if (dbf == NULL) return;
 
   if (verbose)
 	fprintf(stderr, "Closing gauge db...\n");
+  pthread_mutex_lock(&month_cache_lock);
+  for (i = 0; i < MONTH_CACHE_LEN; i++)
+	if (month_caches[i].dbf == dbf)
+	  memset(&month_caches[i], '\0', sizeof(month_cache_t));
+  pthread_mutex_unlock(&month_cache_lock);
   if (read_write_flag == 'w') 
 	gdbm_sync(dbf);   /* synchronize the data on disk since it used GDBM_FAST 
 					   * option in open.
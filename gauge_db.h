@@ -27,6 +27,7 @@
 #define __GAUGE_DB_H__ 1
 
 #include <gdbm.h>
+#include <pthread.h>
 #ifdef MAX_NAME_LEN
 #undef MAX_NAME_LEN
 #endif
@@ -36,6 +37,13 @@
 
 typedef enum { P2A56_FILE, UNKNOWN_FILE} gauge_file_type_t;
 
+/* gauge_db_time_lock: Held around the gv_utils/toolkit time conversions,
+ * which use static storage (localtime(), TZ switching), by routines that
+ * may run in several threads.  Each thread must use a database handle of
+ * its own.
+ */
+extern pthread_mutex_t gauge_db_time_lock;
+
 /*  gauge_db_open: 
  * Open the gauge data base depending on specified 
  * read_write_flag. The database will be created if it does not exist and 
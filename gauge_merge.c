@@ -0,0 +1,955 @@
+/*
+ * gauge_merge.c
+ *     Merge the entry lines of the first ZR intermediate file with rain
+ *     rates from the gauge database.  See gauge_merge.h.
+ *
+ *     Cut from merge_radarNgauge_data.c, so that get_radar_data_over_gauge
+ *     can write the second intermediate file directly.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <IO.h>
+#include <gv_utils.h>
+#include <gdbm.h>
+#include "gauge_db.h"
+#include "gauge_merge.h"
+#include "zr.h"
+
+extern int verbose;
+extern char *this_prog;
+
+/**********************************************************************/
+/*                                                                    */
+/*                            next_token                              */
+/*                                                                    */
+/**********************************************************************/
+static char *next_token(char **p, char *end, int *len)
+{
+  /* Return the token at *p, skipping blanks, and its length; advance *p
+   * past it.  Return NULL if there is none before end.
+   */
+  char *tok;
+
+  while (*p < end && (**p == ' ' || **p == '\t' || **p == '\r')) (*p)++;
+  if (*p >= end) return NULL;
+  tok = *p;
+  while (*p < end && **p != ' ' && **p != '\t' && **p != '\r') (*p)++;
+  *len = *p - tok;
+  return tok;
+} /* next_token */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            parse_int                               */
+/*                                                                    */
+/**********************************************************************/
+static char *parse_int(char *s, char *end, int *val)
+{
+  /* Parse the leading integer of s[0..end-1], as sscanf's %d does.
+   * Return the character after it; NULL if there is none.
+   */
+  int sign = 1, n = 0;
+  char *digits;
+
+  if (s < end && (*s == '-' || *s == '+')) {
+	if (*s == '-') sign = -1;
+	s++;
+  }
+  for (digits = s; s < end && *s >= '0' && *s <= '9'; s++)
+	n = n * 10 + (*s - '0');
+  if (s == digits) return NULL;
+  *val = sign * n;
+  return s;
+} /* parse_int */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            parse_float                             */
+/*                                                                    */
+/**********************************************************************/
+static int parse_float(char *tok, int len, float *val)
+{
+  /* Convert the token to float, as sscanf's %f does.
+   * Return 1 for successful; -1, otherwise.
+   */
+  char buf[64], *e;
+
+  if (len <= 0 || len >= (int) sizeof(buf)) return -1;
+  memcpy(buf, tok, len);
+  buf[len] = '\0';
+  *val = strtof(buf, &e);
+  return e == buf ? -1 : 1;
+} /* parse_float */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       extract_info_from_data_line                  */
+/*                                                                    */
+/**********************************************************************/
+int extract_info_from_data_line(char *line, int line_len, char *gauge_id, 
+								char *network_name,
+								time_t *vos_stime_sec, 
+								int *all_radar_data_missing,
+								int *all_radar_data_no_rain,
+								float min_valid_z_value)
+								
+{
+  /* Extract gauge id, start date/time, and end date/time from the data
+   * line, line[0..line_len-1], which need not be '\0' ended.
+   * This routine doesnot allocate memory, so the caller must
+   * allocate memory for the elements (MAX_NAME_LEN).
+   * Set all_radar_data_missing = 1 if all tuples contain missing data -- 
+   * missing data is determined by checking whether the tuple contains
+   * either a missing rain type or Z value.
+   * Set all_radar_data_no_rain = 1 if all tuples contain no rain data -- 
+   * no rain data is determined by checking whether the tuple contains
+   * either a no-rain rain type or Z value.
+   *
+   * The line is parsed in one pass, in place.
+   * It will return 1 upon successful; -1, otherwise.
+   *
+   * line starts with the following items:
+   *    GaugeID GaugeNetworkName mm/dd/yyyy hh:mm r N H1 C1 Z1 ... CN ZN ...
+   *       HN C1 Z1 ... CN ZN
+   * 
+   *  where:  
+   *        -- Fields from the first zr intermediate file --
+   *          Gauge ID         = Gauge number.
+   *          GaugeNetworkName = Gauge network name, i.e., KSC, STJ,...
+   *          mm/dd/yyyy       = Start date.
+   *          hh:mm            = Start time.
+   *          r                = Gauge to Radar range (km).
+   *          N                = Number of different height(s).
+   *          H1               = First height in km.
+   *          n                = Number of 2 tuples (C Z) that follow.
+   *          C                = Rain type.
+   *          Z                = Reflectivity in dBZ.
+   *          ...
+   *
+   *          H n C Z will be repeated for N-1 times.
+   *
+   */
+  char *p, *end, *tok, *q, *tok_end;
+  int len;
+  int ntuples = 0, nheights = 0;
+  int all_missing = 1, all_no_rain = 1;
+  int rain_type, h,i;
+  int mon, day, year, hour, min;
+  float Z;
+  DATE_STR vos_sdate;
+  TIME_STR vos_stime;
+
+  if (line == NULL || gauge_id == NULL || network_name == NULL || 
+	  vos_stime_sec == NULL || all_radar_data_missing == NULL ||
+	  all_radar_data_no_rain == NULL)
+	return -1;
+
+  p = line;
+  end = line + line_len;
+  /* GaugeID GaugeNetworkName mm/dd/yyyy hh:mm r N */
+  if ((tok = next_token(&p, end, &len)) == NULL || len >= MAX_NAME_LEN)
+	goto obsolete;
+  memcpy(gauge_id, tok, len);
+  gauge_id[len] = '\0';
+  if ((tok = next_token(&p, end, &len)) == NULL || len >= MAX_NAME_LEN)
+	goto obsolete;
+  memcpy(network_name, tok, len);
+  network_name[len] = '\0';
+  if ((tok = next_token(&p, end, &len)) == NULL) goto obsolete;
+  tok_end = tok + len;
+  if ((q = parse_int(tok, tok_end, &mon)) == NULL || q >= tok_end || *q != '/' ||
+	  (q = parse_int(q + 1, tok_end, &day)) == NULL || q >= tok_end || *q != '/' ||
+	  parse_int(q + 1, tok_end, &year) == NULL)
+	goto obsolete;
+  if ((tok = next_token(&p, end, &len)) == NULL) goto obsolete;
+  tok_end = tok + len;
+  if ((q = parse_int(tok, tok_end, &hour)) == NULL || q >= tok_end || *q != ':' ||
+	  parse_int(q + 1, tok_end, &min) == NULL)
+	goto obsolete;
+  if (next_token(&p, end, &len) == NULL ||                       /* r */
+	  (tok = next_token(&p, end, &len)) == NULL ||
+	  parse_int(tok, tok + len, &nheights) == NULL)
+	goto obsolete;
+
+  vos_sdate.tkyear = year;
+  vos_stime.tksecond = 0;
+  vos_stime.tkhour = hour;
+  vos_stime.tkminute = min;
+  vos_sdate.tkmonth = mon;
+  vos_sdate.tkday = day;
+  pthread_mutex_lock(&gauge_db_time_lock);
+  date_time2system_time(&vos_sdate, &vos_stime, vos_stime_sec);
+  pthread_mutex_unlock(&gauge_db_time_lock);
+
+  /* Check if all tuples contain bad raintype or Z */
+  for (h = 0; h < nheights && (all_no_rain == 1 || all_missing == 1); h++) {
+	/* Extract ntuples: heihgt ntuple ... */
+	if (next_token(&p, end, &len) == NULL ||
+		(tok = next_token(&p, end, &len)) == NULL ||
+		parse_int(tok, tok + len, &ntuples) == NULL) {
+	  fprintf(stderr, "Obsolete format. Expecting ntuples.\n");
+	  return -1;
+	}
+	for (i = 0; i < ntuples; i++) {
+	  if ((tok = next_token(&p, end, &len)) == NULL ||
+		  parse_int(tok, tok + len, &rain_type) == NULL ||
+		  (tok = next_token(&p, end, &len)) == NULL ||
+		  parse_float(tok, len, &Z) < 0) {
+		fprintf(stderr, "Obsolete format. Expecting rain_type and Z tuple\n");
+		return -1;
+	  }
+
+	  /* A cell is not rain if NO_ECHO_C && Z <= 0 and Z < min_valid_z_value
+	   * A cell is missing if Z is MISSING. Rain type is not important in 
+	   * this case.
+	   */
+	  if (rain_type != NO_ECHO_C &&  Z > 0.0 && Z > min_valid_z_value &&
+		  Z != MISSING_Z) {
+		/* A good cell is found  */
+		all_no_rain = 0;
+		all_missing = 0; 
+	  }
+	  else if (rain_type != NO_ECHO_C &&  Z > 0.0 && Z > min_valid_z_value) 
+		all_no_rain = 0;
+
+	  else if (Z != MISSING_Z) 
+		all_missing = 0;
+	}
+  }/* for h*/
+
+  *all_radar_data_missing = all_missing;
+  *all_radar_data_no_rain = all_no_rain;
+
+  return 1;
+
+ obsolete:
+  fprintf(stderr, "Line's format is obsolete <%.*s>.\n", line_len, line);
+  return -1;
+}  /* extract_info_from_data_line */
+
+
+/**********************************************************************/
+/*                                                                    */
+/*                     read_write_header_info                         */
+/*                                                                    */
+/**********************************************************************/
+int read_write_header_info(FILE *infile_fp, char *infile, char *outfile_name,
+						   char *discarded_vos_fname,
+						   int vos_window_time_interval, 
+						   int vos_window_center_offset_min, 
+						   float min_valid_z_value,
+						   int keep_all_entries, FILE **discarded_vos_fp, 
+						   FILE **outfile_fp)
+{
+  /* Read header info from infile_fp and write them to outfile_fp.
+   * Write some of that header info to discarded_vos_fp.
+   * infile is the name of infile_fp, for the comments.  infile_fp is left
+   * at the line following the 'Table begins:' line.
+   * Routine will not close files when returns.
+   */
+  char line[MERGE_MAX_LINE_LEN];
+  int rc = 1;
+  int i = 0;
+  char date_str[MAX_NAME_LEN], time_str[MAX_NAME_LEN];
+
+  if (infile_fp == NULL || infile == NULL || outfile_name == NULL ||
+	  *outfile_fp == NULL || *discarded_vos_fp == NULL ||
+	  discarded_vos_fname == NULL) return -1;
+
+  memset(date_str, '\0', MAX_NAME_LEN);
+  memset(time_str, '\0', MAX_NAME_LEN);
+  gv_utils_time_secs2date_time_strs(time(NULL), 1, 0, date_str, time_str);
+
+  /* Write comments to outfile_fp first. */
+  fprintf(*outfile_fp, "%s This table is the second intermediate product for creating the ZR table\n", USER_COMMENT_CHARS);
+  fprintf(*outfile_fp, "%s It contains radar windows, rain classifications, and rain rates data for\n", USER_COMMENT_CHARS); 
+  fprintf(*outfile_fp, "%s rain gauges.  Line starts with # is considered comment.\n", USER_COMMENT_CHARS);
+  fprintf(*outfile_fp, "%s\n", USER_COMMENT_CHARS);
+  fprintf(*outfile_fp, "%s File generation information:\n"
+                       "%s    Created by:     %s (%s).\n"
+                       "%s    Input file:     %s\n"
+                       "%s    Generated time: %s %s\n", 
+		  USER_COMMENT_CHARS, USER_COMMENT_CHARS, this_prog, PROG_VERSION,
+		  USER_COMMENT_CHARS, infile, USER_COMMENT_CHARS,date_str, time_str);
+
+ 
+
+  fprintf(*outfile_fp, "%s\n", USER_COMMENT_CHARS);
+
+
+  /* Write comments to discarded_vos_fp.  */
+  fprintf(*discarded_vos_fp, "%s This file contains information of all VOSes excluded \n"
+                               "%s from the second intermediate file, '%s'.\n"
+                               "%s Line starts with # is considered comment.\n"
+		                       "%s\n",
+		  USER_COMMENT_CHARS, USER_COMMENT_CHARS, outfile_name, USER_COMMENT_CHARS, USER_COMMENT_CHARS);
+  fprintf(*discarded_vos_fp, "%s File generation information:\n"
+                       "%s    Created by:               %s (%s).\n"
+                       "%s    Input file:               %s\n"
+                       "%s    Second intermediate file: %s\n"
+                       "%s    Generated time:           %s %s\n", 
+		  USER_COMMENT_CHARS, USER_COMMENT_CHARS, this_prog, PROG_VERSION,
+		  USER_COMMENT_CHARS, infile, 
+		  USER_COMMENT_CHARS, outfile_name, 
+		  USER_COMMENT_CHARS,date_str, time_str);
+
+
+  fprintf(*discarded_vos_fp, "%c\n", COMMENT_CHAR);
+
+  /* Read from infile */
+  while (!feof(infile_fp)) {
+
+	memset(line, '\0', MERGE_MAX_LINE_LEN);
+	/* Read the next line from infile. */
+	if (fgets(line, MERGE_MAX_LINE_LEN, infile_fp) == NULL) break; 
+	if (strncmp(line, USER_COMMENT_CHARS, strlen(USER_COMMENT_CHARS))==0)
+		continue;  /* It's comment, skip. */
+
+	if (strstr(line, TABLE_RECORD_INFO_STR) != NULL) {
+	  fprintf(*outfile_fp, " Window_time_range_in_minutes      %d\n",vos_window_time_interval);
+	  fprintf(*outfile_fp, " Window_center_offset_in_minutes   %d\n", vos_window_center_offset_min);
+	  i++;
+	}	
+	else if (strstr(line, TABLE_START_STR) != NULL) {
+	  /* Print to comment section: what is being kept in the product.
+	   */
+	  fprintf(*outfile_fp, "%c\n", COMMENT_CHAR);
+	  fprintf(*outfile_fp, "%s Note: \n", FILE_COMMENT_CHARS);
+
+	  if (keep_all_entries) {
+		fprintf(*outfile_fp, "%s    * This file keeps all entries from the input file. \n",
+				FILE_COMMENT_CHARS);
+	  }
+	  else {
+
+		fprintf(*outfile_fp, "%s    * VOSes are kept based on the following criteria:\n",  FILE_COMMENT_CHARS);
+
+		fprintf(*outfile_fp, "%s       (1) Both radar and gauge data are not missing or\n"
+				             "%s       (2) Either radar or gauge sees rain. \n"
+				             "%s    * Gauge data is missing if:\n"
+                             "%s       (1) There is no rain rate for the interested month and year, or\n"
+                             "%s       (2) There is no info for the interested gauge ID/netID, or\n"
+                             "%s       (3) R <= %.2f\n"
+				             "%s    * Gauge data shows no rain if R = 0.0\n"
+                             "%s    * Radar data is missing if Z = %.2f.\n"
+                             "%s    * Radar data shows no rain if C = %d (NO_ECHO) && Z <= 0.0 && Z <= %.2f (min_valid_Z_value)\n",
+				FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,FILE_COMMENT_CHARS, MISSING_RAIN_RATE, FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,MISSING_Z, FILE_COMMENT_CHARS, NO_ECHO_C, min_valid_z_value);
+
+		fprintf(*outfile_fp, "%s    * See file, '%s', for information on discarded VOSes.\n", FILE_COMMENT_CHARS, discarded_vos_fname);
+	  }
+	  fprintf(*outfile_fp, "%c\n", COMMENT_CHAR);
+
+	  i = 0;
+	  fprintf(*outfile_fp, "%s", line); /* Write header line to outfile. */
+
+	  fprintf(*discarded_vos_fp, "%c\n", COMMENT_CHAR); 
+	  fprintf(*discarded_vos_fp, "%c TABLE RECORD INFORMATION:\n"
+			  "%c Record Format:\n"
+			  "%c    Gauge_ID Net_ID VOS_Date VOS_Time\n",
+			  COMMENT_CHAR, COMMENT_CHAR, COMMENT_CHAR);
+
+	  fprintf(*discarded_vos_fp, "%c\n", COMMENT_CHAR); 
+	  fprintf(*discarded_vos_fp, "%s", line); /* Write header line to discarded_vos_fp. */
+	  break;                         /* Done, end of header info. is reached. */
+	}
+
+	else if (i > 0) {
+	  /* Assumming this line is part of the table record's format. */
+	  if (line[strlen(line)-1] == '\n')
+		line[strlen(line)-1] = '\0';  /* Remove \n */
+
+
+	  if (strstr(line, COMMENT_RECORD_FORMAT_LINE) != NULL)
+		fprintf(*outfile_fp, "%c%s\n", COMMENT_CHAR, 
+				line+strlen(COMMENT_RECORD_FORMAT_LINE));
+
+	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE1) != NULL)
+		fprintf(*outfile_fp, "%c%s      _NR R's_\n", COMMENT_CHAR, 
+				line+strlen(COMMENT_RECORD_FORMAT_LINE1));
+	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE2) != NULL)
+		fprintf(*outfile_fp, "%c%s      |      |\n", COMMENT_CHAR, 
+				line+strlen(COMMENT_RECORD_FORMAT_LINE2));
+	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE3) != NULL)
+		fprintf(*outfile_fp, "%c%s NR R1 ...\n", COMMENT_CHAR,
+				line+strlen(COMMENT_RECORD_FORMAT_LINE3));
+	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE4) != NULL)
+		fprintf(*outfile_fp, "%c%s           I  F  \n", COMMENT_CHAR,
+				line+strlen(COMMENT_RECORD_FORMAT_LINE4));
+
+	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE5) != NULL) {
+		fprintf(*outfile_fp, "%c%s\n", COMMENT_CHAR, 
+				line+strlen(COMMENT_RECORD_FORMAT_LINE5));
+		fprintf(*outfile_fp, "%c    NR   = Number of R's    R    = Rain Rate, < 0.0 suspicion, %.2f missing\n", COMMENT_CHAR,  MISSING_RAIN_RATE);
+	  }
+	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE6) != NULL)
+		fprintf(*outfile_fp, "%c%s\n", COMMENT_CHAR, 
+				line+strlen(COMMENT_RECORD_FORMAT_LINE6));
+	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE7) != NULL) {
+		fprintf(*outfile_fp, "%c%s\n", COMMENT_CHAR, 
+				line+strlen(COMMENT_RECORD_FORMAT_LINE7));
+		/* Add the time window here */
+        fprintf(*outfile_fp, "%c\n"
+                             "%c   Time Window of N Minutes Centered at VOS_time + Offset:\n"
+				             "%c       |--t1--|--t2--|...|--tN--|\n"
+                             "%c       |  R1  |  R2  |...|  RN  |\n"
+                             "%c\n",
+
+				COMMENT_CHAR, COMMENT_CHAR, COMMENT_CHAR, COMMENT_CHAR, COMMENT_CHAR);
+
+	  }
+
+	  else {
+		
+		fprintf(*outfile_fp, "%s\n", line); /* Write comment info to outfile. */
+	  }
+	  i++;
+
+	  continue;
+	}
+	  
+	fprintf(*outfile_fp, "%s", line); /* Write header info to outfile. */
+
+	if (strstr(line, SITE_NAME_STR) != NULL) {
+	  /* Write this line to discarded_time_fp. */
+	  fprintf(*discarded_vos_fp, "%c %s", COMMENT_CHAR, line);
+	}
+	else if (strstr(line, END_DATE_TIME_STR) != NULL ||
+			 strstr(line, START_DATE_TIME_STR) != NULL) {
+	  /* Write this line to discarded_time_fp. */
+	  fprintf(*discarded_vos_fp, "%c %s", COMMENT_CHAR, line);
+	}
+
+  }
+
+  return rc;
+} /* read_write_header_info */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           rate_cache_new                           */
+/*                                                                    */
+/**********************************************************************/
+rate_cache_t *rate_cache_new(GDBM_FILE gauge_dbf)
+{
+  rate_cache_t *rates;
+
+  rates = (rate_cache_t *) calloc(1, sizeof(rate_cache_t));
+  if (rates == NULL) {
+	perror("rate_cache_new");
+	return NULL;
+  }
+  rates->dbf = gauge_dbf;
+  return rates;
+} /* rate_cache_new */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           rate_cache_free                          */
+/*                                                                    */
+/**********************************************************************/
+void rate_cache_free(rate_cache_t *rates)
+{
+  if (rates == NULL) return;
+  if (verbose)
+	fprintf(stderr, "Rain rates: %ld minutes fetched, %ld reused.\n",
+			rates->nfetched, rates->nreused);
+  if (rates->gauges) free(rates->gauges);
+  if (rates->hash) free(rates->hash);
+  if (rates->minute_rc) free(rates->minute_rc);
+  if (rates->minute_rate) free(rates->minute_rate);
+  free(rates);
+} /* rate_cache_free */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             rates_hash                             */
+/*                                                                    */
+/**********************************************************************/
+static unsigned int rates_hash(char *net, char *gauge)
+{
+  /* FNV-1a of "net gauge". */
+  unsigned int h = 2166136261u;
+
+  for (; *net; net++) h = (h ^ (unsigned char) *net) * 16777619u;
+  h = (h ^ ' ') * 16777619u;
+  for (; *gauge; gauge++) h = (h ^ (unsigned char) *gauge) * 16777619u;
+  return h;
+} /* rates_hash */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            lookup_gauge                            */
+/*                                                                    */
+/**********************************************************************/
+static gauge_rates_t *lookup_gauge(rate_cache_t *rates, char *net,
+								   char *gauge)
+{
+  /* Return the rates of (net, gauge), adding them (all slots empty) if
+   * they are not there.  NULL on error.
+   */
+  gauge_rates_t *g, *new_gauges;
+  int i, slot, mask, new_len, *new_hash;
+
+  if (2 * (rates->ngauges + 1) > rates->hash_len) {
+	new_len = rates->hash_len > 0 ? 2 * rates->hash_len : 256;
+	if ((new_hash = (int *) malloc(new_len * sizeof(int))) == NULL) {
+	  perror("rate_cache");
+	  return NULL;
+	}
+	for (i = 0; i < new_len; i++) new_hash[i] = -1;
+	for (i = 0; i < rates->ngauges; i++) {
+	  g = &rates->gauges[i];
+	  slot = rates_hash(g->net, g->gauge) & (new_len - 1);
+	  while (new_hash[slot] >= 0) slot = (slot + 1) & (new_len - 1);
+	  new_hash[slot] = i;
+	}
+	if (rates->hash) free(rates->hash);
+	rates->hash = new_hash;
+	rates->hash_len = new_len;
+  }
+
+  mask = rates->hash_len - 1;
+  for (slot = rates_hash(net, gauge) & mask; (i = rates->hash[slot]) >= 0;
+	   slot = (slot + 1) & mask) {
+	g = &rates->gauges[i];
+	if (strcmp(g->gauge, gauge) == 0 && strcmp(g->net, net) == 0)
+	  return g;
+  }
+
+  if (rates->ngauges >= rates->gauges_len) {
+	new_len = rates->gauges_len > 0 ? 2 * rates->gauges_len : 64;
+	new_gauges = (gauge_rates_t *) realloc(rates->gauges,
+										   new_len * sizeof(gauge_rates_t));
+	if (new_gauges == NULL) {
+	  perror("rate_cache");
+	  return NULL;
+	}
+	rates->gauges = new_gauges;
+	rates->gauges_len = new_len;
+  }
+  g = &rates->gauges[rates->ngauges];
+  memset(g, '\0', sizeof(gauge_rates_t));
+  strncpy(g->net, net, MAX_NAME_LEN - 1);
+  strncpy(g->gauge, gauge, MAX_NAME_LEN - 1);
+  for (i = 0; i < RATE_RING_LEN; i++) g->time[i] = -1;
+  rates->hash[slot] = rates->ngauges++;
+  return g;
+} /* lookup_gauge */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            fetch_minute                            */
+/*                                                                    */
+/**********************************************************************/
+static int fetch_minute(rate_cache_t *rates, gauge_rates_t *g, char *netID,
+						char *gaugeID, time_t time_sec, char *rate_str,
+						char **rate)
+{
+  /* Set *rate to the rain rate of the minute time_sec of gauge g (netID,
+   * gaugeID): from the gauge's ring if it is there; else fetched from the
+   * gauge database into rate_str (RATE_MAX_STR_LEN) and put in the ring.
+   * g may be NULL (not kept).
+   * Return gauge_db_fetch()'s return.
+   */
+  int rc, slot;
+
+  slot = (time_sec / 60) & (RATE_RING_LEN - 1);
+  if (g != NULL && g->time[slot] == time_sec) {
+	*rate = g->rate[slot];
+	rates->nreused++;
+	return g->rc[slot];
+  }
+  memset(rate_str, '\0', RATE_MAX_STR_LEN);
+  if ((rc = gauge_db_fetch(rates->dbf, netID, gaugeID, time_sec,
+						   rate_str)) < 0)
+	/* Failure occurred. */
+	return rc;
+  *rate = rate_str;
+  rates->nfetched++;
+  if (g != NULL) {
+	g->time[slot] = -1;
+	if (strlen(rate_str) < RATE_STR_LEN) {
+	  g->time[slot] = time_sec;
+	  g->rc[slot] = rc;
+	  strcpy(g->rate[slot], rate_str);
+	}
+  }
+  return rc;
+} /* fetch_minute */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       rate_cache_fetch_range                       */
+/*                                                                    */
+/**********************************************************************/
+int rate_cache_fetch_range(rate_cache_t *rates, char *netID, char *gaugeID,
+						   time_t stime_sec, time_t etime_sec,
+						   char *rain_rates_str,
+						   int *n_non_missingNnon_zero_rain_rates,
+						   int *n_zero_rain_rates, int *nrain_rates)
+{
+  /* Get gauge rain rates for the given network ID, gauge_id, from the
+   * start time to end time, as gauge_db_fetch_range() does.  Each minute
+   * is taken from the gauge's ring if it is there; else it is fetched from
+   * the gauge database and put in the ring.
+   * Return 1 upon successful; -1 otherwise.
+   */
+  gauge_rates_t *g;
+  time_t time_sec, rounded_time_sec = 0;
+  int rc;
+  char rate_str[RATE_MAX_STR_LEN];
+  char *rate, *rates_end = NULL;
+
+  if (rates == NULL || gaugeID == NULL || netID == NULL ||
+	  n_non_missingNnon_zero_rain_rates == NULL ||
+	  n_zero_rain_rates == NULL || nrain_rates == NULL)
+	return -1;
+  if (strlen(netID) >= MAX_NAME_LEN || strlen(gaugeID) >= MAX_NAME_LEN ||
+	  (g = lookup_gauge(rates, netID, gaugeID)) == NULL)
+	/* Can't keep this gauge; fetch it all. */
+	return gauge_db_fetch_range(rates->dbf, netID, gaugeID,
+								stime_sec, etime_sec, NULL, NULL,
+								rain_rates_str,
+								n_non_missingNnon_zero_rain_rates,
+								n_zero_rain_rates, nrain_rates);
+
+  if (rain_rates_str != NULL)
+	rates_end = rain_rates_str + strlen(rain_rates_str);
+  round_time_to_the_minute(stime_sec, &rounded_time_sec);
+  for (time_sec = rounded_time_sec; time_sec <= etime_sec; time_sec += 60) {
+	if ((rc = fetch_minute(rates, g, netID, gaugeID, time_sec, rate_str,
+						   &rate)) < 0)
+	  /* Failure occurred. */
+	  return -1;
+
+	if (rc == 1 || rc == 0 || rc == 2) {
+	  (*nrain_rates)++;
+	  if (rates_end != NULL) {
+		/* Append "rate " */
+		strcpy(rates_end, rate);
+		rates_end += strlen(rates_end);
+		*rates_end++ = ' ';
+		*rates_end = '\0';
+	  }
+	  if (rc == 1)
+		/* Rain rate is not mising nor zero */
+		(*n_non_missingNnon_zero_rain_rates)++;
+	  else if (rc == 0)
+		/* Rain rate is zero.  */
+		(*n_zero_rain_rates)++;
+	}
+  } /* for */
+
+  return 1;
+} /* rate_cache_fetch_range */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        fetch_config_rates                          */
+/*                                                                    */
+/**********************************************************************/
+static int fetch_config_rates(rate_cache_t *rates, gauge_rates_t *g,
+							  char *net_id, char *gauge_id,
+							  time_t union_stime_sec, time_t stime_sec,
+							  time_t etime_sec, char *rain_rates_str,
+							  int *n_non_missingNnon_zero_rain_rates,
+							  int *n_zero_rain_rates, int *nrain_rates)
+{
+  /* As rate_cache_fetch_range(), for the window stime_sec..etime_sec of a
+   * configuration.  Each minute is fetched once for all configurations
+   * into the minutes of the cache, from union_stime_sec on.
+   * Return 1 upon successful; -1 otherwise.
+   */
+  time_t time_sec;
+  int i, rc;
+  char *rate, *rates_end;
+
+  rates_end = rain_rates_str + strlen(rain_rates_str);
+  for (time_sec = stime_sec; time_sec <= etime_sec; time_sec += 60) {
+	i = (time_sec - union_stime_sec) / 60;
+	if (rates->minute_rc[i] == MINUTE_NOT_FETCHED) {
+	  if ((rc = fetch_minute(rates, g, net_id, gauge_id, time_sec,
+							 rates->minute_rate[i], &rate)) < 0)
+		return -1;
+	  if (rate != rates->minute_rate[i]) strcpy(rates->minute_rate[i], rate);
+	  rates->minute_rc[i] = rc;
+	}
+	rc = rates->minute_rc[i];
+	rate = rates->minute_rate[i];
+
+	if (rc == 1 || rc == 0 || rc == 2) {
+	  (*nrain_rates)++;
+	  /* Append "rate " */
+	  strcpy(rates_end, rate);
+	  rates_end += strlen(rates_end);
+	  *rates_end++ = ' ';
+	  *rates_end = '\0';
+	  if (rc == 1)
+		/* Rain rate is not mising nor zero */
+		(*n_non_missingNnon_zero_rain_rates)++;
+	  else if (rc == 0)
+		/* Rain rate is zero.  */
+		(*n_zero_rain_rates)++;
+	}
+  } /* for */
+  return 1;
+} /* fetch_config_rates */
+
+/**********************************************************************/
+/*                                                                    */
+/*                   merge_gauge_and_append_to_outfiles               */
+/*                                                                    */
+/**********************************************************************/
+int merge_gauge_and_append_to_outfiles(rate_cache_t *rates,
+									   merge_config_t *configs, int nconfigs,
+									   int keep_all_entries, 
+									   float min_valid_z_value,
+									   char *radar_column_data,
+									   int radar_column_data_len)
+{
+  /* Merge radar, rain class, and rain rates data and append the results
+   * to the outfile_fp of each configuration, with the rain rates of its
+   * window.  The rain gauge data is from the database; each minute of
+   * the windows is fetched once.
+   * if keep_all_entries != 1, do not write vos having no rain rates and
+   * no radar data. 
+   * Write to discarded_vos_fp any vos not included in outfile_fp.
+   * radar_column_data need not be '\0' ended.
+   * Return 1 for successful; -1, otherwise.
+   *
+   * Output entry to file based on the following criteria:
+   *   * Both radar and gauge data are not missing.
+   *   * Or either radar or gauge sees rain. 
+   *   * Or keep_all_entries is specified.
+   *
+   */
+  char rain_rates_buf[RATES_BUF_LEN], *rain_rates_str;
+  size_t rain_rates_len;
+  int nrain_rates, n_non_missingNnon_zero_rain_rates, n_zero_rain_rates;
+  time_t vos_window_stime_sec[MAX_MERGE_CONFIGS];
+  time_t vos_window_etime_sec[MAX_MERGE_CONFIGS];
+  time_t union_stime_sec = 0, union_etime_sec = 0;
+  char gauge_id[MAX_NAME_LEN], net_id[MAX_NAME_LEN];
+  time_t vos_time_sec;
+  int all_radar_data_missing = 0;
+  int all_radar_data_no_rain = 0;
+  char date_str[MAX_NAME_LEN], time_str[MAX_NAME_LEN];
+  int all_gauge_data_missing = 0, all_gauge_data_no_rain = 0;
+  gauge_rates_t *g = NULL;
+  merge_config_t *c;
+  int i, nminutes, aligned;
+  void *p;
+
+  if (radar_column_data == NULL || rates == NULL || configs == NULL ||
+	  nconfigs < 1 || nconfigs > MAX_MERGE_CONFIGS)
+	return -1;
+  for (i = 0; i < nconfigs; i++)
+	if (configs[i].outfile_fp == NULL || configs[i].discarded_vos_fp == NULL)
+	  return -1;
+
+  extract_info_from_data_line(radar_column_data, radar_column_data_len,
+							  gauge_id, net_id, 
+							  &vos_time_sec, &all_radar_data_missing, 
+							  &all_radar_data_no_rain,
+							  min_valid_z_value);
+
+  /* The windows, from their rounded start times, and their union. */
+  aligned = 1;
+  for (i = 0; i < nconfigs; i++) {
+	c = &configs[i];
+	find_vos_window_time(vos_time_sec, c->vos_window_time_interval,
+						 c->window_center_offset_min,
+						 &vos_window_stime_sec[i], &vos_window_etime_sec[i]);
+	if (verbose) {
+	  fprintf(stderr, "net <%s> gauge <%s>: vos window start time %s\n",
+			  net_id, gauge_id, ctime(&vos_window_stime_sec[i]));
+	  fprintf(stderr, "net <%s> gauge <%s>: vos window start time %s\n",
+			  net_id, gauge_id, ctime(&vos_window_etime_sec[i]));
+	}
+	round_time_to_the_minute(vos_window_stime_sec[i], &vos_window_stime_sec[i]);
+	if (i == 0 || vos_window_stime_sec[i] < union_stime_sec)
+	  union_stime_sec = vos_window_stime_sec[i];
+	if (i == 0 || vos_window_etime_sec[i] > union_etime_sec)
+	  union_etime_sec = vos_window_etime_sec[i];
+  }
+  for (i = 0; i < nconfigs; i++)
+	if ((vos_window_stime_sec[i] - union_stime_sec) % 60 != 0) aligned = 0;
+
+  /* No minute of the union is fetched yet. */
+  nminutes = union_etime_sec >= union_stime_sec ?
+	(union_etime_sec - union_stime_sec) / 60 + 1 : 0;
+  if (aligned && nminutes > rates->minutes_len) {
+	if ((p = realloc(rates->minute_rc, nminutes)) == NULL) {
+	  perror("merge_gauge_and_append_to_outfiles");
+	  return -1;
+	}
+	rates->minute_rc = (signed char *) p;
+	if ((p = realloc(rates->minute_rate,
+					 nminutes * sizeof(*rates->minute_rate))) == NULL) {
+	  perror("merge_gauge_and_append_to_outfiles");
+	  return -1;
+	}
+	rates->minute_rate = (char (*)[RATE_MAX_STR_LEN]) p;
+	rates->minutes_len = nminutes;
+  }
+  if (aligned) {
+	memset(rates->minute_rc, MINUTE_NOT_FETCHED, nminutes);
+	if (strlen(net_id) < MAX_NAME_LEN && strlen(gauge_id) < MAX_NAME_LEN)
+	  g = lookup_gauge(rates, net_id, gauge_id);
+  }
+
+  for (i = 0; i < nconfigs; i++) {
+	c = &configs[i];
+	/* rain_rates_str will contain rain rate or each minute for the 
+	 * specified time period.  Wide windows don't fit in rain_rates_buf.
+	 */
+	rain_rates_len = ((vos_window_etime_sec[i] - vos_window_stime_sec[i]) / 60
+					  + 2) * (RATE_MAX_STR_LEN + 1) + 1;
+	rain_rates_str = rain_rates_buf;
+	if (rain_rates_len > sizeof(rain_rates_buf) &&
+		(rain_rates_str = (char *) malloc(rain_rates_len)) == NULL) {
+	  perror("merge_gauge_and_append_to_outfiles");
+	  return -1;
+	}
+	rain_rates_str[0] = '\0';
+	nrain_rates = n_non_missingNnon_zero_rain_rates = n_zero_rain_rates = 0;
+	if (aligned)
+	  fetch_config_rates(rates, g, net_id, gauge_id, union_stime_sec,
+						 vos_window_stime_sec[i], vos_window_etime_sec[i],
+						 rain_rates_str, &n_non_missingNnon_zero_rain_rates,
+						 &n_zero_rain_rates, &nrain_rates);
+	else
+	  rate_cache_fetch_range(rates, net_id, gauge_id, vos_window_stime_sec[i],
+							 vos_window_etime_sec[i], rain_rates_str,
+							 &n_non_missingNnon_zero_rain_rates,
+							 &n_zero_rain_rates, &nrain_rates);
+
+	/* Output entry to file based on the criteria defined in Brad Fisher's 
+	 * message:
+	 *   For radar gauge QC it is important to know whether either
+	 *   instrument records rainfall.  It is an OR condition.  So if the Rain 
+	 *   Gauge sees OR the Radar we should write that data to the second 
+	 *   intermediate file. 
+	 *
+	 *   It is probably less critical to write out records 
+	 *   if the radar OR gauge data is missing OR both instruments see no rain.
+	 *
+	 *   In the interest of smaller files we will not write the data out if 
+	 *   one or the other is missing, but if for instance the radar sees no 
+	 *   rain, but the gauge does, write it out. 
+	 */
+
+	all_gauge_data_missing = (n_non_missingNnon_zero_rain_rates == 0 &&
+							  n_zero_rain_rates == 0);
+	all_gauge_data_no_rain = (n_zero_rain_rates == nrain_rates);
+
+
+	if (!keep_all_entries &&
+		/* Either radar or gauge data is missing */
+		((all_gauge_data_missing == 1 || all_radar_data_missing == 1) ||
+		 /* Or both radar and gauge see no rain. */
+		 (all_gauge_data_no_rain == 1 && all_radar_data_no_rain))) {
+	  /* Don't keep this VOS */
+
+	  memset(date_str, '\0', MAX_NAME_LEN);
+	  memset(time_str, '\0', MAX_NAME_LEN);
+	  pthread_mutex_lock(&gauge_db_time_lock);
+	  gv_utils_time_secs2date_time_strs(vos_time_sec, 1, 0, date_str, time_str);
+	  pthread_mutex_unlock(&gauge_db_time_lock);
+	  fprintf(c->discarded_vos_fp, "%s %s %s %s\n", gauge_id, net_id, date_str,
+			  time_str);
+	  if (verbose) {
+		fprintf(stderr, "Ignored: radar data: %.*s\n", radar_column_data_len,
+				radar_column_data);
+		fprintf(stderr, "Ignored: rain rate count: %d\n", nrain_rates);
+		fprintf(stderr, "Ignored: rain rates: %s\n", rain_rates_str);
+	  }
+	}
+	else {
+	  /* Keep this VOS */
+	  /*   * Both radar and gauge data are not missing.
+	   *   * Or either radar or gauge sees rain. 
+	   *   * Or keep_all_entries is specified.
+	   */
+	  if (verbose) {
+		fprintf(stderr, "Kept: radar data: %.*s\n", radar_column_data_len,
+				radar_column_data);
+		fprintf(stderr, "Kept: rain rate count: %d\n", nrain_rates);
+		fprintf(stderr, "Kept:rain rates: %s\n", rain_rates_str);
+	  }
+
+	  fwrite(radar_column_data, 1, radar_column_data_len, c->outfile_fp);
+	  fprintf(c->outfile_fp, " %d %s\n", nrain_rates, rain_rates_str);
+	}
+
+	if (rain_rates_str != rain_rates_buf) free(rain_rates_str);
+  }
+  return 1;
+} /* merge_gauge_and_append_to_outfiles */
+
+/**********************************************************************/
+/*                                                                    */
+/*                    merge_gauge_and_append_to_outfile               */
+/*                                                                    */
+/**********************************************************************/
+int merge_gauge_and_append_to_outfile(rate_cache_t *rates,
+									  time_t vos_window_time_interval,
+									  int window_center_offset_min,
+									  int keep_all_entries, 
+									  float min_valid_z_value,
+									  char *radar_column_data,
+									  int radar_column_data_len,
+									  FILE **discarded_vos_fp,
+									  FILE **outfile_fp)
+{
+  /* merge_gauge_and_append_to_outfiles() with one configuration. */
+  merge_config_t config;
+
+  if (outfile_fp == NULL || discarded_vos_fp == NULL) return -1;
+  config.vos_window_time_interval = vos_window_time_interval;
+  config.window_center_offset_min = window_center_offset_min;
+  config.outfile_fp = *outfile_fp;
+  config.discarded_vos_fp = *discarded_vos_fp;
+  return merge_gauge_and_append_to_outfiles(rates, &config, 1,
+											keep_all_entries,
+											min_valid_z_value,
+											radar_column_data,
+											radar_column_data_len);
+} /*merge_gauge_and_append_to_outfile */
+
+
+
+/**********************************************************************/
+/*                                                                    */
+/*                      find_vos_window_time                          */
+/*                                                                    */
+/**********************************************************************/
+void find_vos_window_time(time_t vos_stime_sec, int vos_window_time_interval,
+						  int window_center_offset_min,
+						  time_t *vos_window_stime_sec,
+						  time_t *vos_window_etime_sec)
+{
+	/* Find the vos window start/end times based on the vos start time and
+	 * thw window time interval as followed:
+	 * vos_window_stime = vos_center_time - 
+	 *                              (vos_window_time_interval/2 * 60) 
+	 * vos_window_etime = vos_center_time + 
+	 *                              (vos_window_time_interval/2 * 60) 
+	 *  where vos_center_time = vos_stime_sec + window_center_offset_min*60 
+	 */
+  time_t vos_center_time_sec;
+
+  vos_center_time_sec = vos_stime_sec + window_center_offset_min*60;
+
+  *vos_window_stime_sec = vos_center_time_sec - 
+	((int) (vos_window_time_interval/2) * 60);
+
+  *vos_window_etime_sec = vos_center_time_sec + 
+	((int) (vos_window_time_interval/2) * 60);
+
+} /* find_vos_window_time */
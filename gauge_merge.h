@@ -0,0 +1,146 @@
+/*
+ * gauge_merge.h
+ *     Routines for merging the entry lines of the first ZR intermediate
+ *     file with rain rates from the gauge database, producing the lines of
+ *     the second ZR intermediate file.
+ *
+ *     Used by merge_radarNgauge_data, which reads the entry lines from the
+ *     first intermediate ASCII file, and by get_radar_data_over_gauge -R,
+ *     which builds them from the columns it has just extracted.
+ *
+ ***************************************************************************/
+
+#ifndef __GAUGE_MERGE_H__
+#define __GAUGE_MERGE_H__ 1
+
+#include <stdio.h>
+#include <time.h>
+#include <gdbm.h>
+#include "gauge_db.h"
+
+#define MERGE_MAX_LINE_LEN               500 /* Header lines. */
+#define MIN_VALID_Z_VALUE                0.0 /* Cell with Z < this value is bad */
+#define DEFAULT_VOS_WINDOW_TIME_RANGE    10  /* In minutes */
+#define DEFAULT_VOS_WINDOW_CENTER_OFFSET 2   /* In minutes */
+
+/* Rain rates of the recent minutes of each gauge, so that the overlapping
+ * windows of the VOSes of a gauge fetch each minute from the gauge
+ * database once.  A gauge's minutes are kept in a ring of RATE_RING_LEN
+ * slots indexed by minute; wider windows still work, but refetch.
+ * Entries may come in any order; grouped by gauge (first2ascii -g), the
+ * gauge lookups hit the same entry line after line.
+ */
+#define RATE_RING_LEN 32       /* Minutes; a power of 2. */
+#define RATE_STR_LEN  16       /* Longer rates are not kept in the ring. */
+#define RATE_MAX_STR_LEN (MAX_NAME_LEN * 2) /* Longest rate from the database. */
+#define RATES_BUF_LEN 4096     /* Rates of a window, unless it is wider. */
+#define MINUTE_NOT_FETCHED -2  /* minute_rc of a minute not fetched yet. */
+
+typedef struct {
+  char   net[MAX_NAME_LEN];
+  char   gauge[MAX_NAME_LEN];
+  time_t time[RATE_RING_LEN];           /* Minute in the slot; -1: empty. */
+  signed char rc[RATE_RING_LEN];        /* gauge_db_fetch()'s return. */
+  char   rate[RATE_RING_LEN][RATE_STR_LEN];
+} gauge_rates_t;
+
+typedef struct {
+  GDBM_FILE dbf;
+  gauge_rates_t *gauges;
+  int    ngauges, gauges_len;
+  int    *hash;                /* Open addressing table of gauges; -1: empty. */
+  int    hash_len;
+  long   nfetched, nreused;    /* Minutes fetched from dbf; found in a ring. */
+  /* Minutes of the union of the windows of an entry's configurations:
+   * gauge_db_fetch()'s return (or MINUTE_NOT_FETCHED) and rate.
+   */
+  signed char *minute_rc;
+  char   (*minute_rate)[RATE_MAX_STR_LEN];
+  int    minutes_len;
+} rate_cache_t;
+
+/* A (window time, window center offset) configuration of the merge, with
+ * its outfiles.  One pass merges the entries for several (-C).
+ */
+#define MAX_MERGE_CONFIGS 16
+typedef struct {
+  int    vos_window_time_interval;     /* Minutes. */
+  int    window_center_offset_min;
+  FILE   *outfile_fp, *discarded_vos_fp;
+} merge_config_t;
+
+rate_cache_t *rate_cache_new(GDBM_FILE gauge_dbf);
+void rate_cache_free(rate_cache_t *rates);
+
+/* rate_cache_fetch_range: As gauge_db_fetch_range(), for rain_rates_str
+ * only, but from the rings when it can.
+ * Return 1 upon successful; -1 otherwise.
+ */
+int rate_cache_fetch_range(rate_cache_t *rates, char *netID, char *gaugeID,
+						   time_t stime_sec, time_t etime_sec,
+						   char *rain_rates_str,
+						   int *n_non_missingNnon_zero_rain_rates,
+						   int *n_zero_rain_rates, int *nrain_rates);
+
+/* extract_info_from_data_line: Extract the gauge, network and VOS time of
+ * an entry line of the first intermediate file, line[0..line_len-1], and
+ * whether its radar data is all missing or all no rain.  The line need not
+ * be '\0' ended and may be of any length.
+ * Return 1 upon successful; -1, otherwise.
+ */
+int extract_info_from_data_line(char *line, int line_len, char *gauge_id,
+								char *network_name,
+								time_t *vos_stime_sec,
+								int *all_radar_data_missing,
+								int *all_radar_data_no_rain,
+								float min_valid_z_value);
+
+/* read_write_header_info: Read the header of the first intermediate file
+ * from infile_fp (named infile), up to and including the 'Table begins:'
+ * line, and write the header of the second intermediate file to
+ * *outfile_fp and of the discarded VOS file to *discarded_vos_fp.
+ * Return 1 for successful; -1, otherwise.
+ */
+int read_write_header_info(FILE *infile_fp, char *infile, char *outfile_name,
+						   char *discarded_vos_file,
+						   int vos_window_time_interval,
+						   int vos_window_center_offset_min,
+						   float min_valid_z_value,
+						   int keep_all_entries, FILE **discarded_vos_fp,
+						   FILE **outfile_fp);
+
+/* merge_gauge_and_append_to_outfile: Append the entry line
+ * radar_column_data (radar_column_data_len bytes, not necessarily '\0'
+ * ended), with its window of rain rates from rates, to
+ * *outfile_fp; or, if the VOS is discarded, its gauge and time to
+ * *discarded_vos_fp.
+ * Return 1 for successful; -1, otherwise.
+ */
+int merge_gauge_and_append_to_outfile(rate_cache_t *rates,
+									  time_t vos_window_time_interval,
+									  int window_center_offset_min,
+									  int keep_all_entries,
+									  float min_valid_z_value,
+									  char *radar_column_data,
+									  int radar_column_data_len,
+									  FILE **discarded_vos_fp,
+									  FILE **outfile_fp);
+
+/* merge_gauge_and_append_to_outfiles: As merge_gauge_and_append_to_outfile,
+ * for each of nconfigs configurations.  The entry line is parsed once,
+ * and each minute of the union of the windows is fetched once.
+ * Return 1 for successful; -1, otherwise.
+ */
+int merge_gauge_and_append_to_outfiles(rate_cache_t *rates,
+									   merge_config_t *configs, int nconfigs,
+									   int keep_all_entries,
+									   float min_valid_z_value,
+									   char *radar_column_data,
+									   int radar_column_data_len);
+
+void find_vos_window_time(time_t vos_stime_sec, int vos_window_time_interval,
+						  int window_center_offset_min,
+						  time_t *vos_window_stime_sec,
+						  time_t *vos_window_etime_sec);
+
+#endif
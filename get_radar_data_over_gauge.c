@@ -14,6 +14,7 @@
  *    2. END TIME
  *    3. HEADER  ( w/o the START and END time entries. )
  *    4. NOECHO
+ *    5. CODEC   ( Encoding of the data below; see output.c. )
  *
  * All other entries in the database are keyed as:
  *    1. key <gauge_id, net_id> --->content <ngID>
@@ -38,6 +39,12 @@
  * The output is:
  *    1. GDBM file containing the radar data over the gauge.
  *
+ *    With -R gauge_db, the columns are merged with the gauge rain rates as
+ *    they are extracted, and the output is the second intermediate file,
+ *    the same as 'merge_radarNgauge_data' gives for the first intermediate
+ *    file of this granule (entries are in extraction order).  See
+ *    gauge_merge.h.
+ *
  *
  *--------------------------------------------------------------------------
  *  Program's exit code:
@@ -82,6 +89,8 @@
 #include "gv_utils.h"
 #include "zr.h"
 #include "gauge_db.h"
+#include "gauge_merge.h"
+#include "first_log.h"
 
 #if defined (__linux)
 #undef PI
@@ -89,7 +98,23 @@
 #define PI 3.14159265
 #define VOS_MINS      5    /* Time duration of a vos in minutes */
 
+/* Options of -R: merge the columns with the gauge rain rates. */
+typedef struct {
+  char  *gauge_db_file;      /* NULL: write the first intermediate file. */
+  char  *discarded_vos_file; /* NULL: '<outfile>.discarded_vos.ascii'. */
+  int   window_time_interval;
+  int   window_center_offset;
+  int   keep_all_entries;
+  float min_valid_z_value;
+} merge_opts_t;
+
 GDBM_FILE zr_rr_fp;
+first_log_t *zr_rr_log;    /* Instead of zr_rr_fp, with -b. */
+/* Instead of zr_rr_fp, with -R. */
+static merge_opts_t merge_opts;
+static GDBM_FILE gauge_dbf;
+static rate_cache_t *gauge_rates;
+static FILE *second_fp, *discarded_vos_fp;
 char *this_prog = "get_radar_data_over_gauge";
 extern int getopt(int argc, char * const argv[],
                   const char *optstring);
@@ -105,7 +130,15 @@ static void process_argv(int argc, char ** argv, float *gauge_win_xmax,
 						 char **gauge_top_dir, char *site,
 						 rain_class_type_t *rain_class_type,
 						 char **csmap_file, char **threeDrefl_file, 
-						 char ** zr_rr_file);
+						 char ** zr_rr_file, int *by_gauge,
+						 int *log_format, merge_opts_t *merge_opts);
+static int open_second_outfile(char *site, DATE_STR *sdate, TIME_STR *stime,
+							   DATE_STR *edate, TIME_STR *etime,
+							   float lat, float lon, float gauge_win_xmax,
+							   float gauge_win_ymax, float gauge_win_zmax,
+							   rain_class_type_t rain_class_type,
+							   char *infile, char *outfile);
+static int output_column(zc_column_t *column, char *net_name);
 void free_zc_column(zc_column_t *column);
 
 /**********************************************************************/
@@ -122,7 +155,10 @@ int main (int argc, char **argv)
   static Raintype_map *rain_class = NULL;
   int rc = 0;
   IO_HANDLE g3Drefl_fh;
-  L2A_55_SINGLE_RADARGRID d3Drefl_grid;
+  grid_source_t *grid_src = NULL;
+  static grid_subset_t d3Drefl;
+  int levels[GRID_SOURCE_MAX_LEVELS];
+  int row_low, row_high, nlevels;
   static zc_column_t data_column;
   DATE_STR sdate, edate;
   TIME_STR stime, etime;
@@ -136,6 +172,10 @@ int main (int argc, char **argv)
   int i, g;
   float lat, lon;
   char *gauge_top_dir = NULL;
+  int by_gauge = 0;   /* 1: Extract gauge by gauge; 0: sweep the grid. */
+  int log_format = 0; /* 1: Write the binary log format; 0: GDBM. */
+  gauge_window_list_t *wlist = NULL;
+  gauge_window_t *w;
 
   signal(SIGINT, handler);
   signal(SIGFPE, handler);
@@ -149,11 +189,18 @@ int main (int argc, char **argv)
   gauge_win_ymax = 6.0;
   gauge_win_zmax = 3.0;
   rain_class_type = DUAL;
+  by_gauge = 0;
+  log_format = 0;
+  memset(&merge_opts, '\0', sizeof(merge_opts_t));
+  merge_opts.window_time_interval = DEFAULT_VOS_WINDOW_TIME_RANGE;
+  merge_opts.window_center_offset = DEFAULT_VOS_WINDOW_CENTER_OFFSET;
+  merge_opts.min_valid_z_value = MIN_VALID_Z_VALUE;
   memset(site, '\0', MAX_NAME_LEN);
   this_prog = argv[0];
   process_argv(argc, argv, &gauge_win_xmax, &gauge_win_ymax, &gauge_win_zmax,
 			   &gauge_top_dir, site, &rain_class_type, &csmap_file, 
-			   &threeDrefl_file, &zr_rr_file);
+			   &threeDrefl_file, &zr_rr_file, &by_gauge, &log_format,
+			   &merge_opts);
 	
   if (verbose) {
 	    fprintf(stderr, "gauge win size x,y,z: %f,%f,%f\n", gauge_win_xmax,
@@ -193,13 +240,27 @@ int main (int argc, char **argv)
    * exist yet; else modify the start/end data/time rows if appropriate.
    */
 
-  zr_rr_fp = open_outfile_and_write_header_info(site, &sdate, &stime,
-												&edate, &etime, lat, lon,
-												gauge_win_xmax,
-												gauge_win_ymax, 
-												gauge_win_zmax,
-												rain_class_type,
-												zr_rr_file);
+  if (merge_opts.gauge_db_file) {
+	if (open_second_outfile(site, &sdate, &stime, &edate, &etime, lat, lon,
+							gauge_win_xmax, gauge_win_ymax, gauge_win_zmax,
+							rain_class_type, threeDrefl_file, zr_rr_file) < 0)
+	  CLOSE_FILES_AND_EXIT(&g3Drefl_fh, NULL, -1);
+  }
+  else if (log_format) {
+	zr_rr_log = first_log_open_append(zr_rr_file, site, &sdate, &stime,
+									  &edate, &etime, lat, lon,
+									  gauge_win_xmax, gauge_win_ymax,
+									  gauge_win_zmax, rain_class_type);
+	if (zr_rr_log == NULL) CLOSE_FILES_AND_EXIT(&g3Drefl_fh, NULL, -1);
+  }
+  else
+	zr_rr_fp = open_outfile_and_write_header_info(site, &sdate, &stime,
+												  &edate, &etime, lat, lon,
+												  gauge_win_xmax,
+												  gauge_win_ymax, 
+												  gauge_win_zmax,
+												  rain_class_type,
+												  zr_rr_file);
   if (verbose) {
 		fprintf(stderr, "Will extract columns of data for %d-VOS granule.\n", nvos);
   }
@@ -226,6 +287,39 @@ int main (int argc, char **argv)
   
   memcpy(&data_column.sdate, &sdate, sizeof(DATE_STR));
 
+  /* Locate the window over each gauge once; they are the same for 
+   * every VOS.  Even when extracting gauge by gauge, the windows tell which
+   * grid rows and levels have to be read.
+   */
+  wlist = new_gauge_window_list(gnet_list, gauge_win_xmax, gauge_win_ymax,
+								gauge_win_zmax);
+  if (wlist == NULL) {
+	free_zc_column(&data_column);
+	free_gauge_network_list(save_gnet_list);
+	CLOSE_FILES_AND_EXIT(&g3Drefl_fh, NULL, -1);
+  }
+  for (g = 0; g < wlist->nw; g++)
+	memcpy(&(wlist->w[g].column.sdate), &sdate, sizeof(DATE_STR));
+
+  /* Only read the levels and rows under the gauge windows. */
+  if (gauge_window_rows_range(wlist, &row_low, &row_high, &nlevels) < 0) {
+	if (verbose)
+	  fprintf(stderr, "No gauges within 150 km of the radar.\n");
+	nvos = 0;
+  }
+  else {
+	grid_src = grid_source_open_hdf(&g3Drefl_fh);
+	for (g = 0; g < nlevels; g++) levels[g] = g;
+	if (grid_src == NULL ||
+		grid_source_set_subset(grid_src, nlevels, levels,
+							   row_low, row_high) < 0) {
+	  grid_source_close(grid_src);
+	  free_zc_column(&data_column);
+	  free_gauge_window_list(wlist);
+	  free_gauge_network_list(save_gnet_list);
+	  CLOSE_FILES_AND_EXIT(&g3Drefl_fh, NULL, -1);
+	}
+  }
   
   /* This loop will extract and write columns of radar and rain gauge info, 
    * based on 3D reflectivities and rain gauges, for each VOS from the HDF 
@@ -238,7 +332,7 @@ int main (int argc, char **argv)
 	       fprintf(stderr, "Processing vos <%d>\n", i);
 
 		/* Get the next 3D reflectivity grid from the HDF file. */
-		if (get_next_3D_field(&g3Drefl_fh, &d3Drefl_grid) < 0) {
+		if (grid_source_read_next(grid_src, &d3Drefl) < 0) {
 	    if (verbose) 
 	       fprintf(stderr, "Failed to get next 3D field for vos <%d>. Ignore.\n", i);
 		  continue;
@@ -251,7 +345,7 @@ int main (int argc, char **argv)
 		   *                    2 (Convective)
 		   *                  MISSING_CS (Missing or bad data)
 		   */
-		  rain_class = get_rain_class(&d3Drefl_grid.tktime, csmap_file);
+		  rain_class = get_rain_class(&d3Drefl.tktime, csmap_file);
 		else if (rain_class_type == SINGLE) 
 		  /* rain_class[x][y] = 1
 		   */
@@ -260,10 +354,24 @@ int main (int argc, char **argv)
 		if (rain_class == NULL) {
 			if (verbose) 
 			  fprintf(stderr, "Warning: There is no rain class map for vos: %d:%d:%d. Ignore.\n",
-					  d3Drefl_grid.tktime.tkhour, d3Drefl_grid.tktime.tkminute, 
-					  d3Drefl_grid.tktime.tksecond);
+					  d3Drefl.tktime.tkhour, d3Drefl.tktime.tkminute, 
+					  d3Drefl.tktime.tksecond);
 			continue;
 		}
+		if (!by_gauge) {
+		  /* Extract the columns over all gauges in one sweep of the grid,
+		   * then write them to file in network/gauge order.
+		   */
+		  if (verbose)
+			fprintf(stderr, "Extracting data columns over %d gauges...\n", wlist->nw);
+		  extract_columns_by_sweep(wlist, &d3Drefl, rain_class);
+		  for (g = 0; g < wlist->nw; g++) {
+			w = &(wlist->w[g]);
+			memcpy(&(w->column.stime), &(d3Drefl.tktime), sizeof(TIME_STR));
+			if (output_column(&(w->column), w->gnet->net_name) < 0) rc = -1;
+		  }
+		  continue;
+		}
 		/* For each network, 
 		 * extract a column of data over each gauge and write it to file.
 		 */
@@ -281,17 +389,17 @@ int main (int argc, char **argv)
 				}
 
 				status = extract_column(&data_column, gnet->radarLat, gnet->radarLon,
-										gauge, &d3Drefl_grid, rain_class);
+										gauge, &d3Drefl, rain_class);
 				if (status < 0)  {
 				  if (verbose)
 					fprintf(stderr, "extract_column() returns < 0\n");
 				  continue;  /* Ignore this column, since gauge range > 150km */
 				}
-				memcpy(&data_column.stime, &(d3Drefl_grid.tktime), sizeof(TIME_STR));
+				memcpy(&data_column.stime, &(d3Drefl.tktime), sizeof(TIME_STR));
 
 				if (verbose) 
 					fprintf(stderr, "Appending data column to file\n");
-				append_column_to_file(&data_column, gnet->net_name, zr_rr_fp);
+				if (output_column(&data_column, gnet->net_name) < 0) rc = -1;
 
 			} /* end for (g = 0...*/
 			gnet = gnet->next;             /* Go to the next network. */
@@ -301,6 +409,9 @@ int main (int argc, char **argv)
   } /* for each vos */
 
   free_zc_column(&data_column);
+  free_grid_subset(&d3Drefl);
+  grid_source_close(grid_src);
+  free_gauge_window_list(wlist);
   free_gauge_network_list(save_gnet_list);
   if (rc < 0) {
 	if (verbose) {
@@ -329,7 +440,8 @@ void process_argv(int argc, char ** argv, float *gauge_win_xmax,
 				  char **gauge_top_dir, char *site,
 				  rain_class_type_t *rain_class_type,
 				  char **csmap_file, char **threeDrefl_file, 
-				  char ** zr_rr_file)
+				  char ** zr_rr_file, int *by_gauge, int *log_format,
+				  merge_opts_t *merge_opts)
 
 {
   extern char *optarg;
@@ -340,15 +452,27 @@ void process_argv(int argc, char ** argv, float *gauge_win_xmax,
   if (argc < 3) {
   USAGE:	
 		fprintf(stderr, "Usage (%s): Build the first ZR intermediate file\n"
-            "     %s  [-v] [-S site_name] \n"
+            "     %s  [-v] [-G] [-b] [-S site_name] \n"
 						"\t   [-x gauge_win_xmax] [-y gauge_win_ymax] \n"
 						"\t   [-c rain_class_type] [-g gauge_locations_top_dir] \n"
+						"\t   [-R gauge_db_file [-n] [-t window_time] [-O window_center_offset]\n"
+						"\t    [-z min_valid_Z_value] [-F discarded_vos_file]]\n"
 						"\t  2A-54_granule_hdf 2A-55_granule_hdf first_zr_intermediate_outfile\n"
 						"\n   where:\n"
 						"     -S     Specify site name. Default: get from 2A-55 file.\n"
 						"     -x     Specify the X length of the gauge window in km. Default: 6.0\n"
 						"     -y     Specify the Y length of the gauge window in km. Default: 6.0\n"
 						"     -c     Specify rain classification (uniform, conv/strat). Default: conv/strat\n"
+						"     -G     Extract the window of each gauge separately instead of\n"
+						"            sweeping the 3D grid once for all gauges.  Faster for\n"
+						"            very dense networks (over ~5000 gauges); the output is\n"
+						"            the same.\n"
+						"     -b     Write the output file in the append-only binary log\n"
+						"            format instead of GDBM.  See first_log.h.\n"
+						"     -R     Merge the columns with the rain rates of gauge_db_file\n"
+						"            as they are extracted, and write the second intermediate\n"
+						"            file instead of the first.  The output file is overwritten.\n"
+						"            -n, -t, -O, -z, and -F are as for merge_radarNgauge_data.\n"
             "     -g     Default: $GVS_DATA_PATH.  The site locations data files are actually in a\n"
             "            subdirectory called 'sitelist', but don't specify that here.\n"
             "            Specify the directory where 'sitelist/' resides.\n"
@@ -363,7 +487,7 @@ void process_argv(int argc, char ** argv, float *gauge_win_xmax,
 		exit(-1);
   }
 	
-  while ((c = getopt(argc, argv,  ":x:y:c:g:S:v")) != -1) {
+  while ((c = getopt(argc, argv,  ":x:y:c:g:S:vGbR:nt:O:z:F:")) != -1) {
 		switch (c) {
 		case 'S':
 		  if (site) strcpy(site, optarg);
@@ -395,6 +519,30 @@ void process_argv(int argc, char ** argv, float *gauge_win_xmax,
 		case 'v':
 			verbose = 1;
 			break;
+		case 'G':
+			*by_gauge = 1;
+			break;
+		case 'b':
+			*log_format = 1;
+			break;
+		case 'R':
+			merge_opts->gauge_db_file = optarg;
+			break;
+		case 'n':
+			merge_opts->keep_all_entries = 1;
+			break;
+		case 't':
+			merge_opts->window_time_interval = atoi(optarg);
+			break;
+		case 'O':
+			merge_opts->window_center_offset = atoi(optarg);
+			break;
+		case 'z':
+			merge_opts->min_valid_z_value = atof(optarg);
+			break;
+		case 'F':
+			merge_opts->discarded_vos_file = optarg;
+			break;
 		case 'g':
 			if (optarg[0] == '-') goto USAGE;
 			*gauge_top_dir = (char *) strdup(optarg);
@@ -421,32 +569,121 @@ void process_argv(int argc, char ** argv, float *gauge_win_xmax,
 	*gauge_top_dir = "/usr/local/trmm/GVBOX/data";
 
 } /* process_argv */
-/***************************************************************************/
-/*                                                                         */
-/*                             get_next_3D_field                           */
-/*                                                                         */
-/***************************************************************************/
-int get_next_3D_field(IO_HANDLE *fh, L2A_55_SINGLE_RADARGRID *field)
+
+/**********************************************************************/
+/*                                                                    */
+/*                        open_second_outfile                         */
+/*                                                                    */
+/**********************************************************************/
+static int open_second_outfile(char *site, DATE_STR *sdate, TIME_STR *stime,
+							   DATE_STR *edate, TIME_STR *etime,
+							   float lat, float lon, float gauge_win_xmax,
+							   float gauge_win_ymax, float gauge_win_zmax,
+							   rain_class_type_t rain_class_type,
+							   char *infile, char *outfile)
 {
-  /* Read the next field (grid) from the openned HDF file (2A-55 product)
+  /* For -R: open the gauge database, and create the second intermediate
+   * file, outfile, and its discarded VOS file, with their headers.  The
+   * headers are made from the first intermediate file's header for this
+   * granule, as merge_radarNgauge_data makes them.
    * Return 1 for successful; -1, otherwise.
    */
-	int status, rc = 1;
-	
-  if (fh == NULL || field == NULL)
+  Header_t *header;
+  FILE *header_fp;
+  char *p, time_str[MAX_NAME_LEN];
+  char discarded_vos_file[MAX_FILENAME_LEN];
+  int rc;
+
+  gauge_dbf = gauge_db_open(merge_opts.gauge_db_file, 'r');
+  if (gauge_dbf == NULL) {
+	fprintf(stderr, "Error: Failed to open gauge database:%s\n",
+			merge_opts.gauge_db_file);
 	return -1;
-  
-  memset(field, '\0', sizeof(L2A_55_SINGLE_RADARGRID));
-  /* Read each grid from HDF file */
-  status = TKreadGrid(fh, field);
-  if (status != TK_SUCCESS) {
-		fprintf(stderr, "TKreadGrid failed\n");
-		rc = -1;
-  }	
+  }
+  if ((gauge_rates = rate_cache_new(gauge_dbf)) == NULL) return -1;
+  if (merge_opts.discarded_vos_file)
+	strcpy(discarded_vos_file, merge_opts.discarded_vos_file);
+  else
+	sprintf(discarded_vos_file, "%s.discarded_vos.ascii", outfile);
+  if ((second_fp = fopen(outfile, "w")) == NULL) {
+	perror(outfile);
+	return -1;
+  }
+  if ((discarded_vos_fp = fopen(discarded_vos_file, "w")) == NULL) {
+	perror(discarded_vos_file);
+	return -1;
+  }
+
+  /* The first intermediate header, with this granule's times, as
+   * first2ascii prints it.
+   */
+  header = construct_header(site, lat, lon, gauge_win_xmax, gauge_win_ymax,
+							gauge_win_zmax, rain_class_type);
+  if (header == NULL) return -1;
+  if ((p = strstr(header->h, START_DATE_TIME_STR)) != NULL &&
+	  (p = strstr(p, "MM/DD/YYYY")) != NULL) {
+	sprintf(time_str, "%.2d/%.2d/%.4d %.2d:%.2d:%.2d",
+			sdate->tkmonth, sdate->tkday, sdate->tkyear,
+			stime->tkhour, stime->tkminute, stime->tksecond);
+	memcpy(p, time_str, strlen(time_str));
+  }
+  if ((p = strstr(header->h, END_DATE_TIME_STR)) != NULL &&
+	  (p = strstr(p, "MM/DD/YYYY")) != NULL) {
+	sprintf(time_str, "%.2d/%.2d/%.4d %.2d:%.2d:%.2d",
+			edate->tkmonth, edate->tkday, edate->tkyear,
+			etime->tkhour, etime->tkminute, etime->tksecond);
+	memcpy(p, time_str, strlen(time_str));
+  }
+  if ((header_fp = tmpfile()) == NULL) {
+	perror("tmpfile");
+	free(header);
+	return -1;
+  }
+  fprintf(header_fp, "%s\n", header->h);
+  free(header);
+  rewind(header_fp);
+  rc = read_write_header_info(header_fp, infile, outfile, discarded_vos_file,
+							  merge_opts.window_time_interval,
+							  merge_opts.window_center_offset,
+							  merge_opts.min_valid_z_value,
+							  merge_opts.keep_all_entries,
+							  &discarded_vos_fp, &second_fp);
+  fclose(header_fp);
   return rc;
-} /* get_next_3D_field */
+} /* open_second_outfile */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           output_column                            */
+/*                                                                    */
+/**********************************************************************/
+static int output_column(zc_column_t *column, char *net_name)
+{
+  /* Write column to the output file: the first intermediate file (GDBM or
+   * log), or with -R, the second intermediate file.
+   * Return 1 for successful; -1, otherwise.
+   */
+  static line_buf_t line, content, noecho;
 
+  if (zr_rr_log)
+	return first_log_append_column(zr_rr_log, column, net_name);
+  if (second_fp == NULL) {
+	append_column_to_file(column, net_name, zr_rr_fp);
+	return 1;
+  }
 
+  /* Merge the column's entry line with the gauge's rain rates. */
+  line.len = 0;
+  if (column_to_entry_line(column, net_name, &content, &noecho, &line) < 0)
+	return -1;
+  return merge_gauge_and_append_to_outfile(gauge_rates,
+										   merge_opts.window_time_interval,
+										   merge_opts.window_center_offset,
+										   merge_opts.keep_all_entries,
+										   merge_opts.min_valid_z_value,
+										   line.s, line.len, &discarded_vos_fp,
+										   &second_fp);
+} /* output_column */
 /***************************************************************************/
 /*                                                                         */
 /*                                 get_rain_class                          */
@@ -672,33 +909,6 @@ void free_gauge_network_list(gauge_network_t *gnet_list)
 } /* free_gauge_list */
 
 
-/***************************************************************************/
-/*                                                                         */
-/*                              free_zc_column                             */
-/*                                                                         */
-/***************************************************************************/
-void free_zc_column(zc_column_t *column)
-{
-  /* Free the space in column structure only--not the column itself.
-   */
-  int i;
-
-  if (column == NULL) return;
-
-  for (i = 0; i < MAX_HEIGHT_LEVELS && i < column->nhinfo; i++) {
-	if (column->hinfo[i] != NULL) {
-
-	  if ((column->hinfo[i])->zc != NULL) {
-		free((column->hinfo[i])->zc);
-	  }
-
-	  free(column->hinfo[i]);
-
-	}
-  }
-
-} /* free_zc_column */
-
 /***************************************************************************/
 /*                                                                         */
 /*                             free_raintype_map                           */
@@ -770,147 +980,6 @@ int read_granule_info_from_hdf(IO_HANDLE *hdf_fh, int *nvos, float *lat,
   return 1;
 } /* read_granule_info_from_hdf */
 
-/**********************************************************************/
-/*                                                                    */
-/*                          initialize_zc_column                      */
-/*                                                                    */
-/**********************************************************************/
-int initialize_zc_column(zc_column_t *column, 
-						 float gauge_win_xmax, float gauge_win_ymax,
-						 float gauge_win_zmax)
-{
-	/*
-		 Initialize one 'zc_column_t' structure.
-		 Assumes 3D grid resolution (in km) dx=2.0 , dy=2.0 , dz=1.5
-		 A column is 2 carpis high.
-         Return 1 for successful; -1, otherwise.
-	*/
-	/* Grid resolution */
-	float xres=2.0;
-	float yres=2.0;
-	int i;
-
-	if (column == NULL) return -1;
-	column->nx1 = ceil(gauge_win_xmax / xres);
-	column->nx2 = ceil(gauge_win_ymax / yres);
-	column->nx3 = 2;  /* Column is 2 carpis high. */
-	column->nhinfo = column->nx3;
-	for (i = 0; i < MAX_HEIGHT_LEVELS; i++) {
-	  column->hinfo[i] = NULL;
-	}
-	for (i = 0; i < column->nx3; i++) {
-	  column->hinfo[i] = (height_info_t *) calloc(1, sizeof(height_info_t));
-	  if (column->hinfo[i] == NULL)	{
-		free_zc_column(column);
-		return -1;
-	  }
-	  (column->hinfo[i])->nzc = column->nx1 * column->nx2;
-	  (column->hinfo[i])->zc = (zc_t *) calloc((column->hinfo[i])->nzc, sizeof(zc_t));
-
-	  if ((column->hinfo[i])->zc == NULL)	{
-		free_zc_column(column);
-		return -1;
-	  }
-	}
-
-	return 1;
-}
-
-/**********************************************************************/
-/*                                                                    */
-/*                          indexgrid                                 */
-/*                                                                    */
-/**********************************************************************/
-void indexgrid(float point_lat, float point_lon,
-			   float radar_lat, float radar_lon,
-			   float grid_xsize, float grid_ysize,
-			   float radar_xorig, float radar_yorig,
-			   int *ix, int *iy)
-{
-/*
-  C **********************************************************************
-  C *  This subroutine gets any lat & long point and calculates its X,Y  *
-  C *  cordinate assuming:                                               *
-  C *  a.  Radar location is at center of grid # (75,75).                *
-  C *  b.  X increase  east, y increase north                            *
-  C *  c.  Each grid size is 2 km x 2 km.                                *
-  C **********************************************************************
-  C *    PROGRAM WRITTEN BY: EYAL AMITAI                                 *
-  c *                        JCET/UMBC - GSFC/NASA                       *
-  c **********************************************************************
-  C *    PROGRAM WAS LAST MODIFIED:   NOV 1, 1999                        *
-  c **********************************************************************
-  */
-       double LA1,LA2,LON1,LON2;
-
-       LA2=point_lat/57.29578;
-       LA1=radar_lat/57.29578;
-       LON2=point_lon/57.29578;
-       LON1=radar_lon/57.29578;
-
-       *ix = radar_yorig+0.5+6378*cos((LA1+LA2)/2.0)*(LON2-LON1)/grid_xsize;
-       *iy = radar_xorig+0.5+6378*(LA2-LA1)/grid_ysize;
-}
-
-/**********************************************************************/
-/*                                                                    */
-/*                           extract_column                           */
-/*                                                                    */
-/**********************************************************************/
-int extract_column(zc_column_t *column, float radarLat, float radarLon,
-				   Gauge_info *gauge, L2A_55_SINGLE_RADARGRID *d3Drefl_grid, 
-				   Raintype_map *rain_class)
-{
-	/*
-		 Assumes 3D grid resolution (in km) dx=2.0 , dy=2.0 , dz=1.5
-
-		 No column is generated if gauge range > 150 km
-
-		 Returns: 0, if gauge range < 150 km.
-		         -1, otherwise.
-	*/
-  static int i, ix, iy, iz;
-  static int ix_low,   iy_low;
-  static int gauge_ix, gauge_iy;  /* 2A55 grid indices of the gauge */
-
-	if (gauge->range >= 150.0) return(-1); /* Ignore gauges past 150 km */
-	strncpy(column->gauge_id, gauge->site_id, MAX_NAME_LEN-1);
-	column->gauge_range = gauge->range;
-	
-	/* Find the indices (gauge_ix, gauge_iy) of the 2A55 grid cell
-	   corresponding to the gauge location.
-	   Assuming 2km x 2km grid cells with radar at grid cell (75,75)
-	*/
-	indexgrid(gauge->lat, gauge->lon, radarLat, radarLon,
-			  2.0, 2.0, 75.0, 75.0, &gauge_ix, &gauge_iy);
-	column->c = rain_class->ix[gauge_iy][gauge_ix];
-	if (verbose)
-	  fprintf(stderr,"   Gauge: %s   Grid Location: IX=%d IY=%d\n",
-			  column->gauge_id, gauge_ix, gauge_iy);
-
-
-	/* Get all column entries which surround the gauge. */
-	for (iz=0; iz<column->nx3; iz++){
-		iy_low = gauge_iy - column->nx2/2.0 + 0.5;
-		(column->hinfo[iz])->height = 1.5 * (iz + 1);
-		i = 0;
-		for (iy=iy_low; iy<(iy_low + column->nx2); iy++){
-			ix_low = gauge_ix - column->nx1/2.0 + 0.5;
-			for (ix=ix_low; ix<(ix_low + column->nx1); ix++){
-				(column->hinfo[iz])->zc[i].c = rain_class->ix[iy][ix];
-				if (d3Drefl_grid->threeDreflect[iz][iy][ix] <= TK_DEFAULT)
-				  (column->hinfo[iz])->zc[i].z = MISSING_Z;
-				else
-				  (column->hinfo[iz])->zc[i].z = d3Drefl_grid->threeDreflect[iz][iy][ix];
-				i++;
-			} /* end for (ix=... */
-		} /* end for (iy=... */
-	} /* end for (iz=0... */
-	column->gauge_range = gauge->range;
-
-	return(0);
-}
-
 /**********************************************************************/
 /*                                                                    */
 /*                           get_gauge_network_list                   */
@@ -1004,8 +1073,20 @@ void handler(int sig)
 /**********************************************************************/
 void clean_up()
 {
-  if (zr_rr_fp)
+  if (second_fp) fclose(second_fp);
+  if (discarded_vos_fp) fclose(discarded_vos_fp);
+  second_fp = discarded_vos_fp = NULL;
+  rate_cache_free(gauge_rates);
+  gauge_rates = NULL;
+  if (gauge_dbf) gauge_db_close(gauge_dbf, 'r');
+  gauge_dbf = NULL;
+  if (zr_rr_fp) {
+	forget_db_cache(zr_rr_fp);
     gdbm_close(zr_rr_fp);
+  }
+  if (zr_rr_log)
+	first_log_close(zr_rr_log);
+  zr_rr_log = NULL;
 }
 
 
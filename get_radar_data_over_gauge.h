@@ -12,6 +12,7 @@
 #include <gsl.h>
 #include <gdbm.h>
 #include "zr.h"
+#include "grid_source.h"
 
 #define MAX_NAME_LEN     51
 #define MAX_FILENAME_LEN 256
@@ -55,6 +56,31 @@ typedef struct _gauge {
   struct _gauge *next;
 } gauge_network_t;
 
+/* Window of 2A-55 grid cells over one gauge.  It is computed once per run;
+ * see extract_sweep.c.
+ */
+typedef struct _gauge_window {
+  gauge_network_t *gnet;   /* Network of the gauge. */
+  Gauge_info    *gauge;
+  int           gauge_ix, gauge_iy; /* 2A-55 grid cell of the gauge. */
+  int           ix_low, iy_low;     /* First grid cell of the window. */
+  zc_column_t   column;    /* Column over the gauge, filled for each VOS. */
+} gauge_window_t;
+
+typedef struct _window_row {
+  int           iy;        /* Grid row. */
+  int           ix_low;    /* First grid column of the row. */
+  int           izc;       /* Index of the row's first zc entry in column. */
+  gauge_window_t *w;
+} window_row_t;
+
+typedef struct _gauge_window_list {
+  gauge_window_t *w;       /* Windows, in network/gauge order. */
+  int           nw;
+  window_row_t  *rows;     /* Rows of all windows, sorted by (iy, ix_low). */
+  int           nrows;
+} gauge_window_list_t;
+
 
 #define CLOSE_FILES_AND_EXIT(fh, gauge_dbf, rc)     \
       {if (fh != NULL) TKclose(fh); \
@@ -73,14 +99,23 @@ void indexgrid(float point_lat, float point_lon,
 			   float radar_xorig, float radar_yorig,
 			   int *ix, int *iy);
 int extract_column(zc_column_t *column, float radarLat, float radarLon,
-				   Gauge_info *gauge, L2A_55_SINGLE_RADARGRID *d3Drefl_grid, 
+				   Gauge_info *gauge, grid_subset_t *d3Drefl,
 				   Raintype_map *rain_class);
+gauge_window_list_t *new_gauge_window_list(gauge_network_t *gnet_list,
+										   float gauge_win_xmax,
+										   float gauge_win_ymax,
+										   float gauge_win_zmax);
+void free_gauge_window_list(gauge_window_list_t *wlist);
+int gauge_window_rows_range(gauge_window_list_t *wlist, int *row_low,
+							int *row_high, int *nlevels);
+int extract_columns_by_sweep(gauge_window_list_t *wlist,
+							 grid_subset_t *d3Drefl,
+							 Raintype_map *rain_class);
 void append_column_to_file(zc_column_t *column,
 						   char *net_name, GDBM_FILE fp);
 int csmap2raintype_map(L2A_54_SINGLE_RADARGRID *csmap, Raintype_map *rtmap);
 Raintype_map **create_rain_class_list(char *csmap_file);
 Raintype_map *get_rain_class(TIME_STR *class_time, char *csmap_file);
-int get_next_3D_field(IO_HANDLE *fh, L2A_55_SINGLE_RADARGRID *field);
 gauge_network_t *get_gauge_network_list(char *gauge_top_dir, char *site);
 Raintype_map *set_single_raintype(void);
 void free_raintype_map(Raintype_map *map);
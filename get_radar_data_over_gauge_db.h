@@ -5,12 +5,19 @@
 #ifndef __GET_RADAR_DATA_OVER_GAUGE_DB_H__
 #define __GET_RADAR_DATA_OVER_GAUGE_DB_H__ 1
 
+#include <limits.h>
 #include "get_radar_data_over_gauge.h"
 
 #define HEADER_LEN 15000
 #define MAX_ENTRY_LINE_LEN 2000
 #define MAX_NGID_ENTRIES 2000
 
+/* Encodings of the column content (table 2).  See output.c. */
+#define COLUMN_CODEC_SCALED_INT  0      /* 4-byte ints scaled by 1000. */
+#define COLUMN_CODEC_COMPACT     1      /* Varints, int8 C, int16 Z. */
+#define COLUMN_CODEC_KEY         "CODEC"
+#define COLUMN_CODEC_COMPACT_STR "COMPACT"
+
 typedef struct {
   char netID[MAX_NAME_LEN];
   int gaugeID;
@@ -22,9 +29,52 @@ typedef struct _ngID_list{
   int nentries;
   struct _ngID_list *next;
 } ngID_list_t;
+
+/* ngID -> line prefix, for writing entry lines.  ngIDs are shorts, so
+ * the table is indexed by ngID.
+ */
+#define NGID_MAP_LEN (SHRT_MAX + 1)
+typedef struct {
+  char   *prefix[NGID_MAP_LEN];  /* "gaugeID netID"; NULL: unknown ngID. */
+} ngID_map_t;
+
+/* Growable text buffer, appended to. */
+typedef struct {
+  char *s;
+  int  len, size;
+} line_buf_t;
+
+typedef struct {
+  char h[HEADER_LEN];
+  int  n;
+} Header_t;
+
+Header_t *construct_header(char *site,
+					   float lat, float lon,
+					   float gauge_win_xmax,
+					   float gauge_win_ymax, 
+					   float gauge_win_zmax,
+					   rain_class_type_t rain_class_type);
 int get_ngID_list_from_db(GDBM_FILE gf, ngID_list_t *ngID_list);
 int read_header_from_db(GDBM_FILE gf, char *header_line);
-int construct_entry_line(GDBM_FILE gf, datum *key, ngID_list_t *ngID_list,char *entry_line);
+int construct_entry_line(GDBM_FILE gf, datum *key, ngID_map_t *ngID_map,
+						 line_buf_t *line);
+ngID_map_t *new_ngID_map(ngID_list_t *ngID_list);
+void free_ngID_map(ngID_map_t *map);
+int line_buf_printf(line_buf_t *b, char *fmt, ...);
+int line_buf_append(line_buf_t *b, char *str, int n);
+int line_buf_flush(line_buf_t *b, FILE *fp);
+void line_buf_free(line_buf_t *b);
+int column_content_max_len(zc_column_t *column);
+int column_to_content(zc_column_t *column, int codec, char *content,
+					  char *noecho, int *noecho_len);
+int content_to_entry_line(char *content, int codec, GDBM_FILE gf,
+						  char *noecho, line_buf_t *line);
+int column_to_entry_line(zc_column_t *column, char *net_name,
+						 line_buf_t *content, line_buf_t *noecho,
+						 line_buf_t *line);
+int get_column_codec_from_db(GDBM_FILE fp);
+void forget_db_cache(GDBM_FILE fp);
 
 void print_ngID_list(ngID_list_t *ngID_list);
 
@@ -0,0 +1,353 @@
+/*
+ * grid_source.c
+ *     Sources of 3D reflectivity grids for the radar window extraction.
+ *     See grid_source.h.
+ *
+ *     Note: The toolkit has no call to read part of a 2A-55 grid, so the HDF
+ *           source still lets TKreadGrid decode each VOS.  It does so into
+ *           one buffer kept for the life of the source (instead of clearing
+ *           and filling a fresh grid per VOS) and only the requested levels
+ *           and rows are copied out and looked at afterwards.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <IO.h>
+#include <IO_GV.h>
+
+#include "grid_source.h"
+#include "zr.h"
+
+extern int verbose;
+
+#define NLEVELS_2A55(g)  ((int) (sizeof((g)->threeDreflect) / \
+								 sizeof((g)->threeDreflect[0])))
+
+typedef struct {
+  IO_HANDLE               *fh;
+  L2A_55_SINGLE_RADARGRID *grid;   /* Reused for every VOS. */
+} hdf_source_t;
+
+typedef struct {
+  int          nvos;
+  int          ivos;
+  TIME_STR     stime;
+  unsigned int seed;
+} synthetic_source_t;
+
+/**********************************************************************/
+/*                                                                    */
+/*                          allocate_subset                           */
+/*                                                                    */
+/**********************************************************************/
+static int allocate_subset(grid_source_t *src, grid_subset_t *subset)
+{
+  /* Size subset for the levels and rows requested from src.  The storage
+   * is only reallocated when it grows.
+   * Return 1 for successful; -1, otherwise.
+   */
+  int l, nrows, len;
+  float *buf;
+
+  nrows = src->row_high - src->row_low + 1;
+  len = src->nlevels * nrows * MAX_NCOLS;
+  if (len > subset->buf_len) {
+	buf = (float *) realloc(subset->buf, len * sizeof(float));
+	if (buf == NULL) {
+	  perror("Allocate grid subset");
+	  return -1;
+	}
+	subset->buf = buf;
+	subset->buf_len = len;
+  }
+  subset->nlevels = src->nlevels;
+  subset->row_low = src->row_low;
+  subset->row_high = src->row_high;
+  subset->ncols = MAX_NCOLS;
+  for (l = 0; l < src->nlevels; l++) {
+	subset->level[l] = src->level[l];
+	subset->plane[l] = subset->buf + l * nrows * MAX_NCOLS;
+  }
+  return 1;
+} /* allocate_subset */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           hdf_read_next                            */
+/*                                                                    */
+/**********************************************************************/
+static int hdf_read_next(grid_source_t *src, grid_subset_t *subset)
+{
+  hdf_source_t *hdf = (hdf_source_t *) src->data;
+  int l, iy, ix;
+  float *z_in, *z_out;
+
+  if (TKreadGrid(hdf->fh, hdf->grid) != TK_SUCCESS) {
+	fprintf(stderr, "TKreadGrid failed\n");
+	return -1;
+  }
+  if (allocate_subset(src, subset) < 0) return -1;
+  memcpy(&subset->tktime, &hdf->grid->tktime, sizeof(TIME_STR));
+
+  for (l = 0; l < subset->nlevels; l++) {
+	for (iy = subset->row_low; iy <= subset->row_high; iy++) {
+	  z_in = hdf->grid->threeDreflect[subset->level[l]][iy];
+	  z_out = GRID_SUBSET_ROW(subset, l, iy);
+	  for (ix = 0; ix < subset->ncols; ix++) {
+		if (z_in[ix] <= TK_DEFAULT)
+		  z_out[ix] = MISSING_Z;
+		else
+		  z_out[ix] = z_in[ix];
+	  }
+	}
+  }
+  return 1;
+} /* hdf_read_next */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            hdf_close                               */
+/*                                                                    */
+/**********************************************************************/
+static void hdf_close(grid_source_t *src)
+{
+  hdf_source_t *hdf = (hdf_source_t *) src->data;
+
+  if (hdf == NULL) return;
+  if (hdf->grid) free(hdf->grid);
+  free(hdf);
+} /* hdf_close */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        grid_source_open_hdf                        */
+/*                                                                    */
+/**********************************************************************/
+grid_source_t *grid_source_open_hdf(IO_HANDLE *fh)
+{
+  grid_source_t *src;
+  hdf_source_t *hdf;
+
+  if (fh == NULL) return NULL;
+  src = (grid_source_t *) calloc(1, sizeof(grid_source_t));
+  hdf = (hdf_source_t *) calloc(1, sizeof(hdf_source_t));
+  if (src == NULL || hdf == NULL) {
+	perror("Allocate HDF grid source");
+	if (src) free(src);
+	if (hdf) free(hdf);
+	return NULL;
+  }
+  hdf->fh = fh;
+  hdf->grid = (L2A_55_SINGLE_RADARGRID *) calloc(1, sizeof(L2A_55_SINGLE_RADARGRID));
+  if (hdf->grid == NULL) {
+	perror("Allocate 2A-55 grid");
+	free(hdf);
+	free(src);
+	return NULL;
+  }
+  src->name = "2A-55 HDF";
+  src->read_next = hdf_read_next;
+  src->close = hdf_close;
+  src->data = hdf;
+  /* Default: everything. */
+  src->nlevels = 0;
+  src->row_low = 0;
+  src->row_high = MAX_NROWS - 1;
+  return src;
+} /* grid_source_open_hdf */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         synthetic_random                           */
+/*                                                                    */
+/**********************************************************************/
+static unsigned int synthetic_random(unsigned int *state)
+{
+  /* Small LCG; rand() would make the grids depend on the C library. */
+  *state = *state * 1103515245 + 12345;
+  return (*state >> 16) & 0x7fff;
+} /* synthetic_random */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        synthetic_read_next                         */
+/*                                                                    */
+/**********************************************************************/
+static int synthetic_read_next(grid_source_t *src, grid_subset_t *subset)
+{
+  /* Fill the subset with storm cells that drift 2 cells east per VOS and
+   * weaken with height.  Every 37th cell (by a hash of its position) is
+   * missing.
+   */
+#define NSTORMS 6
+  synthetic_source_t *syn = (synthetic_source_t *) src->data;
+  unsigned int state;
+  float sx[NSTORMS], sy[NSTORMS], sz[NSTORMS], sr[NSTORMS];
+  int s, l, iy, ix, secs;
+  float *z_out, z, d2;
+
+  if (syn->ivos >= syn->nvos) return -1;
+  if (allocate_subset(src, subset) < 0) return -1;
+
+  /* VOS time: start time + 5 minutes per VOS. */
+  secs = syn->stime.tkhour*3600 + syn->stime.tkminute*60 +
+	syn->stime.tksecond + syn->ivos*5*60;
+  secs %= 24*3600;
+  subset->tktime.tkhour = secs / 3600;
+  subset->tktime.tkminute = (secs / 60) % 60;
+  subset->tktime.tksecond = secs % 60;
+
+  state = syn->seed;
+  for (s = 0; s < NSTORMS; s++) {
+	sx[s] = synthetic_random(&state) % MAX_NCOLS + 2.0 * syn->ivos;
+	sy[s] = synthetic_random(&state) % MAX_NROWS;
+	sz[s] = 30.0 + synthetic_random(&state) % 30;
+	sr[s] = 3.0 + synthetic_random(&state) % 10;
+  }
+
+  for (l = 0; l < subset->nlevels; l++) {
+	for (iy = subset->row_low; iy <= subset->row_high; iy++) {
+	  z_out = GRID_SUBSET_ROW(subset, l, iy);
+	  for (ix = 0; ix < subset->ncols; ix++) {
+		if (((iy * MAX_NCOLS + ix) * 2654435761u + syn->seed) % 37 == 0) {
+		  z_out[ix] = MISSING_Z;
+		  continue;
+		}
+		z = -10.0;
+		for (s = 0; s < NSTORMS; s++) {
+		  d2 = ((ix - fmod(sx[s], MAX_NCOLS)) * (ix - fmod(sx[s], MAX_NCOLS)) +
+				(iy - sy[s]) * (iy - sy[s])) / (sr[s] * sr[s]);
+		  if (d2 < 4.0 && sz[s] * exp(-d2) - 5.0 * subset->level[l] > z)
+			z = sz[s] * exp(-d2) - 5.0 * subset->level[l];
+		}
+		z_out[ix] = z;
+	  }
+	}
+  }
+  syn->ivos++;
+  return 1;
+} /* synthetic_read_next */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           synthetic_close                          */
+/*                                                                    */
+/**********************************************************************/
+static void synthetic_close(grid_source_t *src)
+{
+  if (src->data) free(src->data);
+} /* synthetic_close */
+
+/**********************************************************************/
+/*                                                                    */
+/*                     grid_source_open_synthetic                     */
+/*                                                                    */
+/**********************************************************************/
+grid_source_t *grid_source_open_synthetic(int nvos, TIME_STR *stime,
+										  unsigned int seed)
+{
+  grid_source_t *src;
+  synthetic_source_t *syn;
+
+  src = (grid_source_t *) calloc(1, sizeof(grid_source_t));
+  syn = (synthetic_source_t *) calloc(1, sizeof(synthetic_source_t));
+  if (src == NULL || syn == NULL) {
+	perror("Allocate synthetic grid source");
+	if (src) free(src);
+	if (syn) free(syn);
+	return NULL;
+  }
+  syn->nvos = nvos;
+  syn->ivos = 0;
+  syn->seed = seed;
+  if (stime) memcpy(&syn->stime, stime, sizeof(TIME_STR));
+  src->name = "synthetic";
+  src->read_next = synthetic_read_next;
+  src->close = synthetic_close;
+  src->data = syn;
+  src->nlevels = 0;
+  src->row_low = 0;
+  src->row_high = MAX_NROWS - 1;
+  return src;
+} /* grid_source_open_synthetic */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       grid_source_set_subset                       */
+/*                                                                    */
+/**********************************************************************/
+int grid_source_set_subset(grid_source_t *src, int nlevels, int *levels,
+						   int row_low, int row_high)
+{
+  int l, max_levels;
+  L2A_55_SINGLE_RADARGRID *g = NULL;
+
+  if (src == NULL || levels == NULL) return -1;
+  max_levels = NLEVELS_2A55(g);
+  if (nlevels < 1 || nlevels > GRID_SOURCE_MAX_LEVELS) {
+	fprintf(stderr, "Invalid number of grid levels: %d\n", nlevels);
+	return -1;
+  }
+  for (l = 0; l < nlevels; l++) {
+	if (levels[l] < 0 || levels[l] >= max_levels) {
+	  fprintf(stderr, "Invalid grid level: %d\n", levels[l]);
+	  return -1;
+	}
+	src->level[l] = levels[l];
+  }
+  src->nlevels = nlevels;
+
+  if (row_low < 0) row_low = 0;
+  if (row_high > MAX_NROWS - 1) row_high = MAX_NROWS - 1;
+  if (row_low > row_high) {
+	fprintf(stderr, "Invalid grid rows: %d - %d\n", row_low, row_high);
+	return -1;
+  }
+  src->row_low = row_low;
+  src->row_high = row_high;
+  if (verbose)
+	fprintf(stderr, "%s grid source: %d levels, rows %d - %d\n", src->name,
+			src->nlevels, src->row_low, src->row_high);
+  return 1;
+} /* grid_source_set_subset */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       grid_source_read_next                        */
+/*                                                                    */
+/**********************************************************************/
+int grid_source_read_next(grid_source_t *src, grid_subset_t *subset)
+{
+  if (src == NULL || subset == NULL || src->nlevels < 1) return -1;
+  return src->read_next(src, subset);
+} /* grid_source_read_next */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         grid_source_close                          */
+/*                                                                    */
+/**********************************************************************/
+void grid_source_close(grid_source_t *src)
+{
+  if (src == NULL) return;
+  if (src->close) src->close(src);
+  free(src);
+} /* grid_source_close */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          free_grid_subset                          */
+/*                                                                    */
+/**********************************************************************/
+void free_grid_subset(grid_subset_t *subset)
+{
+  /* Free the storage in subset only--not the subset itself. */
+  if (subset == NULL) return;
+  if (subset->buf) free(subset->buf);
+  subset->buf = NULL;
+  subset->buf_len = 0;
+} /* free_grid_subset */
@@ -0,0 +1,81 @@
+/*
+ * grid_source.h
+ *     Sources of 3D reflectivity grids for the radar window extraction.
+ *
+ *     A grid source hands out, VOS by VOS, only the CAPPI levels and the
+ *     band of grid rows that the extraction asks for.  There are two
+ *     implementations:
+ *        1. HDF:       2A-55 granule read through the TSDIS toolkit.
+ *        2. Synthetic: Generated in memory.  For testing without any
+ *                      2A-55 file (see extract_bench.c); the grid types
+ *                      still come from the toolkit headers.
+ */
+
+#ifndef __GRID_SOURCE_H__
+#define __GRID_SOURCE_H__ 1
+
+#include <IO.h>
+#include "2A53.h"
+
+#define GRID_SOURCE_MAX_LEVELS 4
+
+/* The part of one VOS grid that was asked for.  Plane l holds level
+ * level[l], rows row_low..row_high, all ncols columns.  Values at or below
+ * TK_DEFAULT are already set to MISSING_Z.
+ */
+typedef struct _grid_subset {
+  TIME_STR  tktime;                         /* VOS time. */
+  int       nlevels;
+  int       level[GRID_SOURCE_MAX_LEVELS];  /* 2A-55 level of each plane. */
+  int       row_low, row_high;
+  int       ncols;
+  float     *plane[GRID_SOURCE_MAX_LEVELS];
+  float     *buf;                           /* Storage for all planes. */
+  int       buf_len;                        /* Number of floats in buf. */
+} grid_subset_t;
+
+/* Address of grid row 'iy' of plane 'l' in subset 's'. */
+#define GRID_SUBSET_ROW(s, l, iy) \
+      ((s)->plane[l] + ((iy) - (s)->row_low) * (s)->ncols)
+
+typedef struct _grid_source {
+  char      *name;
+  /* Requested levels and rows. */
+  int       nlevels;
+  int       level[GRID_SOURCE_MAX_LEVELS];
+  int       row_low, row_high;
+  /* Implementation. Return 1 for successful; -1, otherwise. */
+  int       (*read_next)(struct _grid_source *src, grid_subset_t *subset);
+  void      (*close)(struct _grid_source *src);
+  void      *data;
+} grid_source_t;
+
+/* grid_source_open_hdf: Source reading VOS grids from an openned 2A-55
+ * file.  The caller keeps ownership of fh.
+ */
+grid_source_t *grid_source_open_hdf(IO_HANDLE *fh);
+
+/* grid_source_open_synthetic: Source generating nvos VOS grids, 5 minutes
+ * apart starting at stime.  The grids hold a few storm cells drifting
+ * over a no-echo background, with some missing cells; they only depend
+ * on seed.
+ */
+grid_source_t *grid_source_open_synthetic(int nvos, TIME_STR *stime,
+										  unsigned int seed);
+
+/* grid_source_set_subset: Ask for levels[0..nlevels-1] and grid rows
+ * row_low..row_high only. Return 1 for successful; -1, otherwise.
+ */
+int grid_source_set_subset(grid_source_t *src, int nlevels, int *levels,
+						   int row_low, int row_high);
+
+/* grid_source_read_next: Read the next VOS into subset.  subset must be
+ * zeroed before its first use; its storage is reused from call to call.
+ * Return 1 for successful; -1, otherwise.
+ */
+int grid_source_read_next(grid_source_t *src, grid_subset_t *subset);
+
+void grid_source_close(grid_source_t *src);
+void free_grid_subset(grid_subset_t *subset);
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * line_reader.c
+ *     Read a text file line by line, with no limit on the line length.
+ *     See line_reader.h.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "line_reader.h"
+
+/**********************************************************************/
+/*                                                                    */
+/*                           read_all                                 */
+/*                                                                    */
+/**********************************************************************/
+static int read_all(int fd, line_reader_t *r)
+{
+  /* Read what is left of fd into r->data.
+   * Return 1 for successful; -1, otherwise.
+   */
+  size_t len = 0;
+  ssize_t n;
+  char *new_data;
+
+  r->data = NULL;
+  r->size = 0;
+  do {
+	if (r->size == len) {
+	  len = len > 0 ? 2 * len : 65536;
+	  if ((new_data = (char *) realloc(r->data, len)) == NULL) return -1;
+	  r->data = new_data;
+	}
+	n = read(fd, r->data + r->size, len - r->size);
+	if (n > 0) r->size += n;
+  } while (n > 0);
+  return n < 0 ? -1 : 1;
+} /* read_all */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          line_reader_open                          */
+/*                                                                    */
+/**********************************************************************/
+line_reader_t *line_reader_open(char *fname)
+{
+  /* Return NULL upon failure. */
+  line_reader_t *r;
+  struct stat st;
+  int fd;
+  void *p;
+
+  if (fname == NULL) return NULL;
+  if ((r = (line_reader_t *) calloc(1, sizeof(line_reader_t))) == NULL) {
+	perror("line_reader_open");
+	return NULL;
+  }
+  if ((fd = open(fname, O_RDONLY)) < 0) {
+	perror(fname);
+	free(r);
+	return NULL;
+  }
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+	p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p != MAP_FAILED) {
+	  r->data = (char *) p;
+	  r->size = (size_t) st.st_size;
+	  r->mapped = 1;
+#ifdef MADV_SEQUENTIAL
+	  madvise(p, r->size, MADV_SEQUENTIAL);
+#endif
+	}
+  }
+  if (!r->mapped && read_all(fd, r) < 0) {
+	perror(fname);
+	close(fd);
+	line_reader_close(r);
+	return NULL;
+  }
+  close(fd);
+  return r;
+} /* line_reader_open */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          line_reader_next                          */
+/*                                                                    */
+/**********************************************************************/
+char *line_reader_next(line_reader_t *r, int *len)
+{
+  char *line, *nl;
+
+  if (r == NULL || r->next >= r->size) return NULL;
+  line = r->data + r->next;
+  nl = (char *) memchr(line, '\n', r->size - r->next);
+  if (nl == NULL) {
+	/* Last line, without '\n'. */
+	*len = (int) (r->size - r->next);
+	r->next = r->size;
+  }
+  else {
+	*len = (int) (nl - line);
+	r->next += *len + 1;
+  }
+  return line;
+} /* line_reader_next */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          line_reader_find                          */
+/*                                                                    */
+/**********************************************************************/
+int line_reader_find(char *line, int len, char *str)
+{
+  int n = strlen(str);
+  char *p, *end = line + len - n;
+
+  if (n == 0) return 1;
+  for (p = line; p <= end; p++) {
+	if ((p = (char *) memchr(p, str[0], end - p + 1)) == NULL) break;
+	if (memcmp(p, str, n) == 0) return 1;
+  }
+  return 0;
+} /* line_reader_find */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          line_reader_close                         */
+/*                                                                    */
+/**********************************************************************/
+void line_reader_close(line_reader_t *r)
+{
+  if (r == NULL) return;
+  if (r->mapped)
+	munmap(r->data, r->size);
+  else if (r->data)
+	free(r->data);
+  free(r);
+} /* line_reader_close */
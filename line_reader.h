@@ -0,0 +1,35 @@
+/*
+ * line_reader.h
+ *     Read a text file line by line, with no limit on the line length.
+ *
+ *     The file is mapped into memory (read into it when it can't be
+ *     mapped, e.g., a pipe), and lines are handed out as pointers into it,
+ *     so they are not copied.  A line is not '\0' ended: use its length.
+ *     Lines stay valid until line_reader_close().
+ */
+
+#ifndef __LINE_READER_H__
+#define __LINE_READER_H__ 1
+
+#include <stddef.h>
+
+typedef struct {
+  char   *data;          /* The file's bytes. */
+  size_t size;
+  size_t next;           /* Offset of the next line. */
+  int    mapped;         /* 1: data is mmap'ed; 0: malloc'ed. */
+} line_reader_t;
+
+line_reader_t *line_reader_open(char *fname);
+
+/* line_reader_next: Return the next line, without its '\n', and set *len
+ * to its length.  Return NULL at the end of the file.
+ */
+char *line_reader_next(line_reader_t *r, int *len);
+
+/* line_reader_find: Return 1 if str occurs in line[0..len-1]; 0, otherwise. */
+int line_reader_find(char *line, int len, char *str);
+
+void line_reader_close(line_reader_t *r);
+
+#endif
@@ -81,6 +81,13 @@
  *   1.  This program will read gauge data from the gauge database:
  *         "$GVS_DB_PATH/gauge.gdbm".  It will build that database
  *         if it doesnot exist.
+ *   2.  Every so many entries (--checkpoint), the outfiles are flushed and
+ *       '<outfile>.checkpoint' records how far the run got: the offset in
+ *       the infile after the last merged entry, the size of each outfile
+ *       and a hash of the run's configuration.  After a crash, the same
+ *       command with --resume cuts the outfiles back to those sizes and
+ *       merges the rest of the infile.  The checkpoint file is removed
+ *       when the run succeeds.
  *
  *--------------------------------------------------------------------------
  *
@@ -104,70 +111,77 @@
 #include <unistd.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
+#include "getopt.h"
 
 #include <IO.h>
 #include <gsl.h>
 #include <gv_utils.h>
 #include <gdbm.h>
 #include "gauge_db.h"
+#include "gauge_merge.h"
+#include "line_reader.h"
+#include "second_bin.h"
 #include "zr.h"
 
 /************************  Definitions and data types ********************/
-#define CLOSE_FILES_N_EXIT(fp1, fp2, fp3, rc) {if (fp1 != NULL) fclose(fp1);\
-                                          if (fp2 != NULL) fclose(fp2); \
-                                          if (fp3 != NULL) fclose(fp3); \
-                                          exit(rc);}
-#define MIN_VALID_Z_VALUE   0.0      /* Cell with Z < this value is bad */
+#define CLOSE_FILES_N_EXIT(fp1, rc) {if (fp1 != NULL) fclose(fp1);\
+                                   close_configs(params.configs, params.nconfigs); \
+                                   exit(rc);}
 #define MAX_CMD_LEN         300
-#define MAX_LINE_LEN        500
 #define MAX_FILENAME_LEN    256
-
-#define DEFAULT_VOS_WINDOW_TIME_RANGE 10   /* In minutes */
+#define MAX_THREADS         32
+#define BATCH_PER_THREAD    1024  /* Lines merged by a thread per batch. */
+#define DEFAULT_CHECKPOINT_ENTRIES 0 /* Entries between checkpoints; 0: none. */
 
 int verbose = 0;
 char *this_prog = "merge_radarNgauge_data";
 static GDBM_FILE gauge_dbf = NULL;
+static rate_cache_t *gauge_rates = NULL;
+
+/* An entry line, in the line reader's memory; not '\0' ended. */
+typedef struct {
+  char *s;
+  int  len;
+} entry_line_t;
+
+/* A thread merging a slice of a batch of entry lines (-j).  Its output
+ * goes to temporary files, which are appended to the outfiles in the
+ * order of the slices, so the outfiles are as in a serial run.
+ */
+typedef struct {
+  GDBM_FILE    dbf;            /* Read-only handle of its own. */
+  rate_cache_t *rates;
+  entry_line_t *lines;
+  int          nlines;
+  merge_config_t configs[MAX_MERGE_CONFIGS]; /* With temporary files. */
+  int          rc;
+  pthread_t    thread;
+} worker_t;
+
+/* What merge_gauge_and_append_to_outfiles() needs besides the line. */
+typedef struct {
+  merge_config_t configs[MAX_MERGE_CONFIGS]; /* With the outfiles. */
+  int   nconfigs;
+  int   keep_all_entries;
+  float min_valid_z_value;
+} merge_params_t;
+
+static worker_t workers[MAX_THREADS];
+static int nworkers = 0;       /* 0: Lines are merged by main(). */
+static entry_line_t *batch;    /* Lines to merge, in input order. */
+static int nbatch;
+static merge_params_t params;
 /************************ Function Prototypes ************************/
 void clean_up();
-int merge_gauge_and_append_to_outfile(GDBM_FILE gauge_dbf, 
-									  time_t vos_window_time_interval,
-									  int window_center_offset_min,
-									  int keep_all_entries, 
-									  float min_valid_z_value,
-									  char *radar_column_data, 
-									  FILE **discarded_vos_fp,
-									  FILE **outfile_fp);
 extern FILE *popen( const char *command, const char *type);
 extern int pclose( FILE *stream);
 
 extern int strcasecmp(const char *s1, const char *s2);
-extern int getopt(int argc, char * const argv[],
-                  const char *optstring);
-
-extern char *optarg;
-extern int optind, opterr, optopt;
-
-int extract_info_from_data_line(char *line, char *gauge_id, 
-								char *network_name,
-								time_t *vos_stime_sec, 
-								int *all_radar_data_missing,
-								int *all_radar_data_no_rain,
-								float min_valid_z_value);
-
-
-int read_write_header_info(char *infile, char *outfile_name,
-						   char *discarded_vos_file,
-						   int vos_window_time_interval, 
-						   int vos_window_center_offset_min, 
-						   float min_valid_z_value,
-						   int keep_all_entries, FILE **discarded_vos_fp,
-						   FILE **outfile_fp);
 
 static void handler(int sig);
-void find_vos_window_time(time_t vos_stime_sec, int vos_window_time_interval,
-						  int window_center_offset_min,
-						  time_t *vos_window_stime_sec,
-						  time_t *vos_window_etime_sec);
+static int close_configs(merge_config_t *configs, int nconfigs);
+static int file_name(char *name, int size, char *file, char *suffix);
 /**********************************************************************/
 
 /**********************************************************************/
@@ -184,7 +198,9 @@ void usage(char *prog)
   fprintf(stderr, "   %s [-v] \n"
 		          "      [-k] [-n] [-t window_time] [-O window_center_offset]\n"
 		          "      [-f gauge_db_file] [-z min_valid_Z_value]\n"
-                  "      [-F discarded_vos_file]\n"
+                  "      [-F discarded_vos_file] [-j nthreads] [-B]\n"
+                  "      [-C window_time/window_center_offset[,...]]\n"
+                  "      [--checkpoint nentries] [--resume]\n"
                   "      first_zr_intermediate_infile second_zr_intermediate_outfile\n", prog);
   fprintf(stderr, "\n   where,\n");
   fprintf(stderr, "     -v: Show verbose messages of program execution.\n"
@@ -203,11 +219,25 @@ void usage(char *prog)
                   "         Default: 0.0.\n"  
                   "     -F: Specify discarded vos filename. The program will write the info. of\n"
                   "         the discarded VOSes to this file. Default: \'<ouput filename>.discarded_vos.ascii\'.\n"
+                  "     -j: Merge with nthreads threads (at most %d), each with its own handle\n"
+                  "         of the gauge database.  The outfiles are the same.  Default: 1.\n"
+                  "     -B: Write the outfile in the binary columnar format (see second2ascii).\n"
+                  "         Default: ASCII.\n"
+                  "     -C: Merge for each (window time, center offset) in one pass, instead of\n"
+                  "         -t and -O (at most %d).  Each gets its outfile\n"
+                  "         '<outfile>.t<window_time>o<offset>' (and discarded vos file).\n"
+                  "     --checkpoint: Flush the outfiles and record in '<outfile>.checkpoint'\n"
+                  "         how far the run got every nentries entries; 0: never.  When\n"
+                  "         a checkpoint was recorded, the outfiles are kept on failure.\n"
+                  "         Default: %d (no checkpoints).\n"
+                  "     --resume: Continue the run that failed, with the same options and\n"
+                  "         files, from its last checkpoint.\n"
 		          "\n"
 		          "     first_zr_intermediate_infile:    File contains radar data\n"
                   "          and rain types for gauges\n"
 		          "     second_zr_intermediate_outfile:  Filename for output.  File will \n"  
-                  "         contain radar data, rain types, and gauge data.\n");
+                  "         contain radar data, rain types, and gauge data.\n",
+		  MAX_THREADS, MAX_MERGE_CONFIGS, DEFAULT_CHECKPOINT_ENTRIES);
   exit(-1);
 }
 
@@ -221,19 +251,37 @@ void process_argvs(int argc, char **argv, int *remove_file,
 				   int *keep_all_entries, int *vos_window_time_interval,
 				   int *vos_window_center_offset,
 				   float *min_valid_z_value, char *discarded_vos_file,
-				   char *gauge_db_file, char **infile, char **outfile)
+				   char *gauge_db_file, int *nthreads, int *binary_out,
+				   merge_config_t *configs, int *nconfigs,
+				   long *checkpoint_entries, int *resume,
+				   char **infile, char **outfile)
 {
-  extern char *optarg;
-  extern int optind, opterr, optopt;
-
-  int c;
+  static struct option long_options[] =
+  {
+	{"checkpoint", 1, 0, 0},
+	{"resume", 0, 0, 0},
+	{NULL, 0, 0, 0}
+  };
+  int c, n;
+  int long_index = 0;
+  char *p;
 
 
   if (argc < 2) 
 	usage(argv[0]);
 
-  while ((c = getopt(argc, argv, "f:t:O:z:F:vkn")) != -1) {
+  while ((c = getopt_long(argc, argv, "f:t:O:z:F:j:C:vknB", long_options,
+						  &long_index)) != -1) {
 	switch (c) {
+	case 0:
+	  if (strcmp(long_options[long_index].name, "checkpoint") == 0) {
+		if (sscanf(optarg, "%ld", checkpoint_entries) != 1 ||
+			*checkpoint_entries < 0)
+		  usage(argv[0]);
+	  }
+	  else if (strcmp(long_options[long_index].name, "resume") == 0)
+		*resume = 1;
+	  break;
 	case 'v':
 	  verbose = 1;
 	  break;
@@ -249,12 +297,38 @@ void process_argvs(int argc, char **argv, int *remove_file,
 	case 'z':
 	  *min_valid_z_value = atof(optarg);
 	  break;
-	case 'f': strcpy(gauge_db_file, optarg); break;
+	case 'f':
+	  if (file_name(gauge_db_file, MAX_FILENAME_LEN, optarg, "") < 0)
+		exit(-1);
+	  break;
 	case 't':
 	  *vos_window_time_interval = atoi(optarg);
 	  break;
 	case 'F':
-	  strcpy(discarded_vos_file, optarg); break;
+	  if (file_name(discarded_vos_file, MAX_FILENAME_LEN, optarg, "") < 0)
+		exit(-1);
+	  break;
+	case 'j':
+	  if (sscanf(optarg, "%d", nthreads) != 1 || *nthreads < 1 ||
+		  *nthreads > MAX_THREADS)
+		usage(argv[0]);
+	  break;
+	case 'B':
+	  *binary_out = 1;
+	  break;
+	case 'C':
+	  /* window_time/offset[,window_time/offset...] */
+	  for (p = optarg, *nconfigs = 0; *p; p += n) {
+		if (*nconfigs >= MAX_MERGE_CONFIGS ||
+			sscanf(p, "%d/%d%n", &configs[*nconfigs].vos_window_time_interval,
+				   &configs[*nconfigs].window_center_offset_min, &n) != 2)
+		  usage(argv[0]);
+		(*nconfigs)++;
+		if (p[n] == ',') n++;
+		else if (p[n] != '\0') usage(argv[0]);
+	  }
+	  if (*nconfigs == 0) usage(argv[0]);
+	  break;
 	case '?': fprintf(stderr, "option -%c is undefined\n", optopt);
 	  usage(argv[0]);
     case ':': fprintf(stderr, "option -%c requires an argument\n",optopt);
@@ -271,6 +345,403 @@ void process_argvs(int argc, char **argv, int *remove_file,
 } /* process_argvs */
 
 
+/**********************************************************************/
+/*                                                                    */
+/*                            merge_slice                             */
+/*                                                                    */
+/**********************************************************************/
+static void *merge_slice(void *arg)
+{
+  /* Thread: merge the lines of a worker's slice into its temporary files.
+   * Stop at the first line that fails, as main() does.
+   */
+  worker_t *w = (worker_t *) arg;
+  int i;
+
+  w->rc = 1;
+  for (i = 0; i < w->nlines; i++) {
+	if (merge_gauge_and_append_to_outfiles(w->rates, w->configs,
+										   params.nconfigs,
+										   params.keep_all_entries,
+										   params.min_valid_z_value,
+										   w->lines[i].s, w->lines[i].len) < 0) {
+	  w->rc = -1;
+	  break;
+	}
+  }
+  return NULL;
+} /* merge_slice */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          append_tmpfile                            */
+/*                                                                    */
+/**********************************************************************/
+static int append_tmpfile(FILE *tmp_fp, FILE *fp)
+{
+  /* Append what was written to tmp_fp to fp and empty tmp_fp.
+   * Return 1 for successful; -1, otherwise.
+   */
+  char buf[BUFSIZ];
+  long len;
+  size_t n;
+
+  if ((len = ftell(tmp_fp)) < 0) return -1;
+  rewind(tmp_fp);
+  while (len > 0) {
+	n = fread(buf, 1, len < (long) sizeof(buf) ? (size_t) len : sizeof(buf),
+			  tmp_fp);
+	if (n == 0 || fwrite(buf, 1, n, fp) != n) return -1;
+	len -= n;
+  }
+  rewind(tmp_fp);
+  return 1;
+} /* append_tmpfile */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            merge_batch                             */
+/*                                                                    */
+/**********************************************************************/
+static int merge_batch(void)
+{
+  /* Split the batch in consecutive slices, one per worker, merge them in
+   * parallel and append their output to the outfiles in order.  The output
+   * of the slices after one that failed is dropped.
+   * Return 1 for successful; -1, otherwise.
+   */
+  merge_config_t *c;
+  int w, i, slice, first, rc = 1;
+
+  slice = (nbatch + nworkers - 1) / nworkers;
+  for (w = 0, first = 0; w < nworkers; w++, first += slice) {
+	workers[w].lines = batch + first;
+	workers[w].nlines = first >= nbatch ? 0 :
+	  (first + slice <= nbatch ? slice : nbatch - first);
+	if (pthread_create(&workers[w].thread, NULL, merge_slice, &workers[w]) != 0) {
+	  workers[w].thread = pthread_self();
+	  merge_slice(&workers[w]);
+	}
+  }
+  for (w = 0; w < nworkers; w++) {
+	if (!pthread_equal(workers[w].thread, pthread_self()))
+	  pthread_join(workers[w].thread, NULL);
+	if (rc < 0) continue;
+	for (i = 0; i < params.nconfigs && rc > 0; i++) {
+	  c = &workers[w].configs[i];
+	  if (append_tmpfile(c->outfile_fp, params.configs[i].outfile_fp) < 0 ||
+		  append_tmpfile(c->discarded_vos_fp,
+						 params.configs[i].discarded_vos_fp) < 0) {
+		perror("merge_batch");
+		rc = -1;
+	  }
+	}
+	if (workers[w].rc < 0) {
+	  fprintf(stderr, "Error: merge_gauge_and_append_to_outfile failed.\n");
+	  rc = -1;
+	}
+  }
+  nbatch = 0;
+  return rc;
+} /* merge_batch */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           close_configs                            */
+/*                                                                    */
+/**********************************************************************/
+static int close_configs(merge_config_t *configs, int nconfigs)
+{
+  /* Close the outfiles of the configurations that are open.
+   * Return 1 for successful; -1 if a close failed.
+   */
+  int i, rc = 1;
+
+  for (i = 0; i < nconfigs; i++) {
+	if (configs[i].outfile_fp && fclose(configs[i].outfile_fp) != 0) rc = -1;
+	if (configs[i].discarded_vos_fp &&
+		fclose(configs[i].discarded_vos_fp) != 0) rc = -1;
+	configs[i].outfile_fp = configs[i].discarded_vos_fp = NULL;
+  }
+  return rc;
+} /* close_configs */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          start_workers                             */
+/*                                                                    */
+/**********************************************************************/
+static void start_workers(char *gauge_db_name, int nthreads)
+{
+  /* Set up nthreads workers, each with its own handle of the gauge
+   * database and rate cache, and temporary outfiles for each
+   * configuration of params.  With fewer than 2, lines are merged by main().
+   */
+  worker_t *w;
+  int i;
+
+  if (nthreads < 2) return;
+  batch = (entry_line_t *) malloc(nthreads * BATCH_PER_THREAD *
+								  sizeof(entry_line_t));
+  if (batch == NULL) {
+	perror("start_workers");
+	return;
+  }
+  for (nworkers = 0; nworkers < nthreads; nworkers++) {
+	w = &workers[nworkers];
+	memset(w, '\0', sizeof(worker_t));
+	if ((w->dbf = gauge_db_open(gauge_db_name, 'r')) == NULL) {
+	  fprintf(stderr, "Error: Failed to open gauge database:%s\n", gauge_db_name);
+	  break;
+	}
+	memcpy(w->configs, params.configs, sizeof(w->configs));
+	for (i = 0; i < params.nconfigs; i++)
+	  w->configs[i].outfile_fp = w->configs[i].discarded_vos_fp = NULL;
+	w->rates = rate_cache_new(w->dbf);
+	for (i = 0; i < params.nconfigs && w->rates; i++)
+	  if ((w->configs[i].outfile_fp = tmpfile()) == NULL ||
+		  (w->configs[i].discarded_vos_fp = tmpfile()) == NULL)
+		break;
+	if (w->rates == NULL || i < params.nconfigs) {
+	  perror("start_workers");
+	  rate_cache_free(w->rates);
+	  close_configs(w->configs, params.nconfigs);
+	  gauge_db_close(w->dbf, 'r');
+	  break;
+	}
+  }
+  if (nworkers < 2) {
+	/* Not worth it. */
+	for (; nworkers > 0; nworkers--) {
+	  w = &workers[nworkers-1];
+	  rate_cache_free(w->rates);
+	  close_configs(w->configs, params.nconfigs);
+	  gauge_db_close(w->dbf, 'r');
+	}
+	free(batch);
+	batch = NULL;
+	return;
+  }
+  if (verbose)
+	fprintf(stderr, "Merging with %d threads.\n", nworkers);
+  nbatch = 0;
+} /* start_workers */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           stop_workers                             */
+/*                                                                    */
+/**********************************************************************/
+static void stop_workers(void)
+{
+  worker_t *w;
+  int i;
+
+  for (i = 0; i < nworkers; i++) {
+	w = &workers[i];
+	rate_cache_free(w->rates);
+	close_configs(w->configs, params.nconfigs);
+	gauge_db_close(w->dbf, 'r');
+  }
+  nworkers = 0;
+  if (batch) free(batch);
+  batch = NULL;
+} /* stop_workers */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          run_config_hash                           */
+/*                                                                    */
+/**********************************************************************/
+static unsigned int run_config_hash(char *infile, char *gauge_db_name,
+									int binary_out,
+									char outfiles[][MAX_FILENAME_LEN],
+									char discarded_vos_files[][MAX_FILENAME_LEN])
+{
+  /* FNV-1a of what the outfiles depend on: the files, with the size and
+   * modification time of the infile and gauge database, and the options
+   * of params.  Not the number of threads, that doesn't change them.
+   */
+  char str[MAX_FILENAME_LEN+64];
+  struct stat st;
+  unsigned int h = 2166136261u;
+  int i;
+  char *p;
+
+#define HASH_STR(s) for (p = (s); *p; p++) h = (h ^ (unsigned char) *p) * 16777619u
+  memset(&st, '\0', sizeof(st));
+  stat(infile, &st);
+  sprintf(str, "%s %ld %ld\n", infile, (long) st.st_size, (long) st.st_mtime);
+  HASH_STR(str);
+  memset(&st, '\0', sizeof(st));
+  stat(gauge_db_name, &st);
+  sprintf(str, "%s %ld %ld\n", gauge_db_name, (long) st.st_size,
+		  (long) st.st_mtime);
+  HASH_STR(str);
+  sprintf(str, "%d %f %d %d\n", params.keep_all_entries,
+		  params.min_valid_z_value, binary_out, params.nconfigs);
+  HASH_STR(str);
+  for (i = 0; i < params.nconfigs; i++) {
+	sprintf(str, "%d %d\n", params.configs[i].vos_window_time_interval,
+			params.configs[i].window_center_offset_min);
+	HASH_STR(str);
+	HASH_STR(outfiles[i]);
+	HASH_STR(discarded_vos_files[i]);
+  }
+#undef HASH_STR
+  return h;
+} /* run_config_hash */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          write_checkpoint                          */
+/*                                                                    */
+/**********************************************************************/
+static int write_checkpoint(char *fname, unsigned int hash,
+							long input_offset, long nentries)
+{
+  /* Flush the outfiles of params to disk and record their sizes, with
+   * input_offset, the infile offset after the last merged entry, in the
+   * checkpoint file fname.  The file is replaced by rename(), so it is
+   * either the old checkpoint or the new one.
+   * Return 1 for successful; -1, otherwise.
+   */
+  char tmp_fname[MAX_FILENAME_LEN+16+sizeof(".tmp")]; /* checkpoint_file */
+  FILE *fp;
+  merge_config_t *c;
+  long out_offset, discarded_offset;
+  int i;
+
+  if (file_name(tmp_fname, sizeof(tmp_fname), fname, ".tmp") < 0)
+	return -1;
+  if ((fp = fopen(tmp_fname, "w")) == NULL) {
+	perror(tmp_fname);
+	return -1;
+  }
+  fprintf(fp, "# merge_radarNgauge_data checkpoint\n");
+  fprintf(fp, "Config_hash      %08x\n", hash);
+  fprintf(fp, "Input_offset     %ld\n", input_offset);
+  fprintf(fp, "Entries_merged   %ld\n", nentries);
+  fprintf(fp, "Outfiles         %d\n", params.nconfigs);
+  for (i = 0; i < params.nconfigs; i++) {
+	c = &params.configs[i];
+	if (fflush(c->outfile_fp) != 0 || fflush(c->discarded_vos_fp) != 0 ||
+		fsync(fileno(c->outfile_fp)) != 0 ||
+		fsync(fileno(c->discarded_vos_fp)) != 0 ||
+		(out_offset = ftell(c->outfile_fp)) < 0 ||
+		(discarded_offset = ftell(c->discarded_vos_fp)) < 0) {
+	  perror("write_checkpoint");
+	  fclose(fp);
+	  unlink(tmp_fname);
+	  return -1;
+	}
+	fprintf(fp, "%ld %ld\n", out_offset, discarded_offset);
+  }
+  if (fflush(fp) != 0 || fsync(fileno(fp)) != 0 || fclose(fp) != 0 ||
+	  rename(tmp_fname, fname) != 0) {
+	perror(fname);
+	unlink(tmp_fname);
+	return -1;
+  }
+  if (verbose)
+	fprintf(stderr, "Checkpoint: %ld entries merged.\n", nentries);
+  return 1;
+} /* write_checkpoint */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          read_checkpoint                           */
+/*                                                                    */
+/**********************************************************************/
+static int read_checkpoint(char *fname, unsigned int hash,
+						   long *input_offset, long *nentries,
+						   long out_offsets[], long discarded_offsets[])
+{
+  /* Read the checkpoint file fname of a run of the configuration hash
+   * into input_offset, nentries and the outfile sizes of each
+   * configuration of params.
+   * Return 1 for successful; -1, otherwise.
+   */
+  FILE *fp;
+  unsigned int ckpt_hash;
+  int i, n;
+
+  if ((fp = fopen(fname, "r")) == NULL) {
+	fprintf(stderr, "Error: No checkpoint to resume from: %s\n", fname);
+	return -1;
+  }
+  if (fscanf(fp, "# %*s checkpoint Config_hash %x Input_offset %ld "
+			 "Entries_merged %ld Outfiles %d", &ckpt_hash, input_offset,
+			 nentries, &n) != 4) {
+	fprintf(stderr, "Error: Bad checkpoint file: %s\n", fname);
+	fclose(fp);
+	return -1;
+  }
+  if (ckpt_hash != hash || n != params.nconfigs) {
+	fprintf(stderr, "Error: %s is the checkpoint of a run with different options or files.\n", fname);
+	fclose(fp);
+	return -1;
+  }
+  for (i = 0; i < n; i++)
+	if (fscanf(fp, "%ld %ld", &out_offsets[i], &discarded_offsets[i]) != 2)
+	  break;
+  fclose(fp);
+  if (i < n) {
+	fprintf(stderr, "Error: Bad checkpoint file: %s\n", fname);
+	return -1;
+  }
+  return 1;
+} /* read_checkpoint */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          reopen_outfile                            */
+/*                                                                    */
+/**********************************************************************/
+static FILE *reopen_outfile(char *fname, long offset)
+{
+  /* Open the outfile fname of the run being resumed for appending after
+   * its first offset bytes, cutting off what was written after the
+   * checkpoint.
+   * Return the file for successful; NULL, otherwise.
+   */
+  FILE *fp;
+  struct stat st;
+
+  if ((fp = fopen(fname, "r+")) == NULL) {
+	perror(fname);
+	return NULL;
+  }
+  if (fstat(fileno(fp), &st) != 0 || st.st_size < offset) {
+	fprintf(stderr, "Error: %s is shorter than at the checkpoint.\n", fname);
+	fclose(fp);
+	return NULL;
+  }
+  if (ftruncate(fileno(fp), offset) != 0 || fseek(fp, offset, SEEK_SET) != 0) {
+	perror(fname);
+	fclose(fp);
+	return NULL;
+  }
+  return fp;
+} /* reopen_outfile */
+
+/**********************************************************************/
+/*                                                                    */
+/*                              file_name                             */
+/*                                                                    */
+/**********************************************************************/
+static int file_name(char *name, int size, char *file, char *suffix)
+{
+  /* Set name (size chars) to file followed by suffix.
+   * Return 1 for successful; -1 if the name is too long.
+   */
+  if (snprintf(name, size, "%s%s", file, suffix) >= size) {
+	fprintf(stderr, "Error: File name too long: %s%s\n", file, suffix);
+	return -1;
+  }
+  return 1;
+} /* file_name */
+
 /**********************************************************************/
 /*                                                                    */
 /*                          main                                      */
@@ -280,94 +751,210 @@ int main(int argc, char **argv)
 {
   
   char *infile, *outfile;
-  FILE *infile_fp=NULL, *outfile_fp=NULL, *discarded_vos_fp = NULL;
+  FILE *infile_fp=NULL;
+  line_reader_t *reader = NULL;
   int rc = 1;
   int remove_outfile = 1;
   int keep_all_entries = 0;
   int vos_window_time_interval = DEFAULT_VOS_WINDOW_TIME_RANGE;
   int data_flag;
-  char line[MAX_LINE_LEN];
+  char *line;
+  int len;
   char gauge_db_name[MAX_FILENAME_LEN], discarded_vos_file[MAX_FILENAME_LEN];
-  int vos_window_center_offset_min = 2;  /* Default to 2 mins. */
+  char outfiles[MAX_MERGE_CONFIGS][MAX_FILENAME_LEN];
+  char discarded_vos_files[MAX_MERGE_CONFIGS][MAX_FILENAME_LEN];
+  char ascii_files[MAX_MERGE_CONFIGS][MAX_FILENAME_LEN+8]; /* -B */
+  char checkpoint_file[MAX_FILENAME_LEN+16];
+  char suffix[32];                      /* -C: '.t<window_time>o<offset>' */
+  long checkpoint_entries = DEFAULT_CHECKPOINT_ENTRIES;
+  long out_offsets[MAX_MERGE_CONFIGS], discarded_offsets[MAX_MERGE_CONFIGS];
+  long input_offset = 0, nentries = 0, checkpoint_nentries = 0;
+  unsigned int config_hash;
+  int resume = 0, checkpointed = 0;
+  int vos_window_center_offset_min = DEFAULT_VOS_WINDOW_CENTER_OFFSET;
   float min_valid_z_value = MIN_VALID_Z_VALUE;
+  int nthreads = 1;
+  int binary_out = 0;
+  second_bin_t *sb;
+  merge_config_t *c;
+  int i;
 
   set_signal_handlers();
   this_prog = argv[0];
   memset(gauge_db_name, '\0', MAX_FILENAME_LEN);
   memset(discarded_vos_file, '\0', MAX_FILENAME_LEN);
+  memset(&params, '\0', sizeof(params));
   gauge_construct_default_db_name(gauge_db_name); /* $GVS_DB_PATH/gauge.gdbm */
   process_argvs(argc, argv,  &remove_outfile, &keep_all_entries,
 				&vos_window_time_interval, &vos_window_center_offset_min,
 				&min_valid_z_value, discarded_vos_file,
-				gauge_db_name, &infile, &outfile);
-
-  if (strlen(discarded_vos_file) < 1) {
-	/* Set default: '<outfile>.discarded_vos.ascii' */
-	sprintf(discarded_vos_file, "%s.discarded_vos.ascii", outfile);
+				gauge_db_name, &nthreads, &binary_out,
+				params.configs, &params.nconfigs, &checkpoint_entries, &resume,
+				&infile, &outfile);
+
+  if (params.nconfigs == 0) {
+	/* One configuration: -t and -O. */
+	params.nconfigs = 1;
+	params.configs[0].vos_window_time_interval = vos_window_time_interval;
+	params.configs[0].window_center_offset_min = vos_window_center_offset_min;
+	if (file_name(outfiles[0], MAX_FILENAME_LEN, outfile, "") < 0)
+	  exit(-1);
+	if (strlen(discarded_vos_file) < 1) {
+	  /* Set default: '<outfile>.discarded_vos.ascii' */
+	  if (file_name(discarded_vos_files[0], MAX_FILENAME_LEN, outfile,
+					".discarded_vos.ascii") < 0)
+		exit(-1);
+	}
+	else
+	  strcpy(discarded_vos_files[0], discarded_vos_file);
   }
+  else {
+	/* -C: '<outfile>.t<window_time>o<offset>' for each configuration.
+	 * Names are never cut short: two configurations would share a file.
+	 */
+	for (i = 0; i < params.nconfigs; i++) {
+	  c = &params.configs[i];
+	  sprintf(suffix, ".t%do%d", c->vos_window_time_interval,
+			  c->window_center_offset_min);
+	  if (file_name(outfiles[i], MAX_FILENAME_LEN, outfile, suffix) < 0)
+		exit(-1);
+	  if (strlen(discarded_vos_file) < 1) {
+		if (file_name(discarded_vos_files[i], MAX_FILENAME_LEN, outfiles[i],
+					  ".discarded_vos.ascii") < 0)
+		  exit(-1);
+	  }
+	  else if (file_name(discarded_vos_files[i], MAX_FILENAME_LEN,
+						 discarded_vos_file, suffix) < 0)
+		exit(-1);
+	}
+  }
+  for (i = 0; i < params.nconfigs; i++)
+	/* With -B, the ASCII outfile the binary one is made from.  A named file
+	 * when checkpointing, so that a resumed run finds it.
+	 */
+	if (file_name(ascii_files[i], sizeof(ascii_files[i]), outfiles[i],
+				  ".partial") < 0)
+	  exit(-1);
+  if (file_name(checkpoint_file, sizeof(checkpoint_file), outfile,
+				".checkpoint") < 0)
+	exit(-1);
+  params.keep_all_entries = keep_all_entries;
+  params.min_valid_z_value = min_valid_z_value;
+  config_hash = run_config_hash(infile, gauge_db_name, binary_out, outfiles,
+								discarded_vos_files);
+  if (resume &&
+	  read_checkpoint(checkpoint_file, config_hash, &input_offset,
+					  &checkpoint_nentries, out_offsets,
+					  discarded_offsets) < 0)
+	exit(-1);
+  checkpointed = resume;
+  nentries = checkpoint_nentries;
+
   if (verbose) {
 	fprintf(stderr, "infile:    %s\n", infile);
-	fprintf(stderr, "outfile:   %s\n", outfile);
 	fprintf(stderr, "min_valid_z_value: %f\n", min_valid_z_value);
 	fprintf(stderr, "gauge db:  %s\n", gauge_db_name);
-	fprintf(stderr, "discarded_vos_file: %s\n", discarded_vos_file);
+	for (i = 0; i < params.nconfigs; i++) {
+	  fprintf(stderr, "outfile:   %s\n", outfiles[i]);
+	  fprintf(stderr, "discarded_vos_file: %s\n", discarded_vos_files[i]);
+	}
   }
 
-  /* Open output file for writing. */
-  if ((outfile_fp = fopen(outfile, "w")) == NULL) {
-	fprintf(stderr, "Error: Failed to open %s\n", outfile);
-	CLOSE_FILES_N_EXIT(infile_fp, outfile_fp, discarded_vos_fp, -1);
+  for (i = 0; i < params.nconfigs && resume; i++) {
+	/* Back to the outfiles at the checkpoint. */
+	c = &params.configs[i];
+	if ((c->outfile_fp = reopen_outfile(binary_out ? ascii_files[i] :
+										outfiles[i], out_offsets[i])) == NULL ||
+		(c->discarded_vos_fp = reopen_outfile(discarded_vos_files[i],
+											  discarded_offsets[i])) == NULL)
+	  CLOSE_FILES_N_EXIT(infile_fp, -1);
   }
-  /* Open discarded_vos file for writing. */
-  if ((discarded_vos_fp = fopen(discarded_vos_file, "w")) == NULL) {
-	fprintf(stderr, "Error: Failed to open %s\n", discarded_vos_file);
-	CLOSE_FILES_N_EXIT(infile_fp, outfile_fp, discarded_vos_fp, -1);
+  if (resume && verbose)
+	fprintf(stderr, "Resuming after %ld entries.\n", checkpoint_nentries);
+
+  /* Open input file for reading. */
+  if (!resume && (infile_fp = fopen(infile, "r")) == NULL) {
+	fprintf(stderr, "Error: Failed to open %s\n", infile);
+	CLOSE_FILES_N_EXIT(infile_fp, -1);
   }
 
+  for (i = 0; i < params.nconfigs && !resume; i++) {
+	c = &params.configs[i];
+	/* Open output file for writing.  The binary outfile is converted from
+	 * the ASCII one at the end.
+	 */
+	if (binary_out)
+	  c->outfile_fp = checkpoint_entries > 0 ? fopen(ascii_files[i], "w+") :
+		tmpfile();
+	else
+	  c->outfile_fp = fopen(outfiles[i], "w");
+	if (c->outfile_fp == NULL) {
+	  fprintf(stderr, "Error: Failed to open %s\n", outfiles[i]);
+	  CLOSE_FILES_N_EXIT(infile_fp, -1);
+	}
+	/* Open discarded_vos file for writing. */
+	if ((c->discarded_vos_fp = fopen(discarded_vos_files[i], "w")) == NULL) {
+	  fprintf(stderr, "Error: Failed to open %s\n", discarded_vos_files[i]);
+	  CLOSE_FILES_N_EXIT(infile_fp, -1);
+	}
 
-  if (verbose)
-	fprintf(stderr, "Calling read_write_header_info()...\n");
-  /* Read header info from infile and write them to outfile_fp;
-   */
-  if (read_write_header_info(infile, outfile, discarded_vos_file,
-							 vos_window_time_interval,
-							 vos_window_center_offset_min,
-							 min_valid_z_value,
-							 keep_all_entries,
-							 &discarded_vos_fp,
-							 &outfile_fp) < 0) {
-	fprintf(stderr, "Error: read_write_header_info() failed.\n");
-	CLOSE_FILES_N_EXIT(infile_fp, outfile_fp, discarded_vos_fp, -1);
+	if (verbose)
+	  fprintf(stderr, "Calling read_write_header_info()...\n");
+	/* Read header info from infile and write them to outfile_fp;
+	 */
+	rewind(infile_fp);
+	if (read_write_header_info(infile_fp, infile, outfiles[i],
+							   discarded_vos_files[i],
+							   c->vos_window_time_interval,
+							   c->window_center_offset_min,
+							   min_valid_z_value,
+							   keep_all_entries,
+							   &c->discarded_vos_fp,
+							   &c->outfile_fp) < 0) {
+	  fprintf(stderr, "Error: read_write_header_info() failed.\n");
+	  CLOSE_FILES_N_EXIT(infile_fp, -1);
+	}
   }
-
-  /* Open input file for reading. */
-  if ((infile_fp = fopen(infile, "r")) == NULL) {
+  if (infile_fp) fclose(infile_fp);
+  infile_fp = NULL;
+  /* The entry lines may be of any length. */
+  if ((reader = line_reader_open(infile)) == NULL) {
 	fprintf(stderr, "Error: Failed to open %s\n", infile);
-	CLOSE_FILES_N_EXIT(infile_fp, outfile_fp, discarded_vos_fp,-1);
+	CLOSE_FILES_N_EXIT(infile_fp, -1);
   }
+  if (resume) {
+	/* The checkpoint is past the header. */
+	if (input_offset < 0 || (size_t) input_offset > reader->size) {
+	  fprintf(stderr, "Error: %s is shorter than at the checkpoint.\n", infile);
+	  CLOSE_FILES_N_EXIT(infile_fp, -1);
+	}
+	reader->next = input_offset;
+  }
+
   /* Open the gauge database */
   gauge_dbf = gauge_db_open(gauge_db_name, 'r');
   if (gauge_dbf == NULL) {
 	fprintf(stderr, "Error: Failed to open gauge database:%s\n", gauge_db_name);
-	CLOSE_FILES_N_EXIT(infile_fp, outfile_fp, discarded_vos_fp,-1);
+	CLOSE_FILES_N_EXIT(infile_fp, -1);
   }
+  if ((gauge_rates = rate_cache_new(gauge_dbf)) == NULL) {
+	clean_up();
+	CLOSE_FILES_N_EXIT(infile_fp, -1);
+  }
+  start_workers(gauge_db_name, nthreads);
   
   /* While not EOF (Note: we don't need to sort the input file nor remove 
    * duplicated entries since the gauge data is a database.
    * File contains header info -- so skip the header info.
    * 1. read a line 
    * 2. skip if it's not a data line.
-   * 3. merge line with gauge data and append it to the outfile
+   * 3. merge line with gauge data and append it to the outfiles
    *
    */
-  data_flag = 0;
-  while (!feof(infile_fp)) {
-	memset(line, '\0', MAX_LINE_LEN);
-	if (fgets(line, MAX_LINE_LEN, infile_fp) == NULL) break;
-
-	line[strlen(line)-1] = '\0'; /* Remove \n */
-	if (strlen(line) < 1) continue;   /* Skip empty line */
-	if (strstr(line, TABLE_START_STR) != NULL) {
+  data_flag = resume;
+  while ((line = line_reader_next(reader, &len)) != NULL) {
+	if (len < 1) continue;   /* Skip empty line */
+	if (line_reader_find(line, len, TABLE_START_STR)) {
 	  data_flag = 1;
 	  continue;
 	}
@@ -376,394 +963,89 @@ int main(int argc, char **argv)
 	else if (line[0] == COMMENT_CHAR)    /* Comment line */
 	  continue;
 
-	/* Merge gauge data and append to outfile */
-	if (merge_gauge_and_append_to_outfile(gauge_dbf, vos_window_time_interval,
-										  vos_window_center_offset_min,
-										  keep_all_entries, 
-										  min_valid_z_value, line, 
-										  &discarded_vos_fp, &outfile_fp)
-		< 0){
-	  fprintf(stderr, "Error: merge_gauge_and_append_to_outfile failed.\n");
-	  rc = -1;
-	  break;
+	if (nworkers > 0) {
+	  /* Leave it to the workers. */
+	  batch[nbatch].s = line;
+	  batch[nbatch].len = len;
+	  nentries++;
+	  if (++nbatch < nworkers * BATCH_PER_THREAD) continue;
+	  if (merge_batch() < 0) {
+		rc = -1;
+		break;
+	  }
+	}
+	else {
+	  /* Merge gauge data and append to outfiles */
+	  if (merge_gauge_and_append_to_outfiles(gauge_rates, params.configs,
+											 params.nconfigs, keep_all_entries,
+											 min_valid_z_value, line, len) < 0) {
+		fprintf(stderr, "Error: merge_gauge_and_append_to_outfile failed.\n");
+		rc = -1;
+		break;
+	  }
+	  nentries++;
 	}
 
+	/* Every entry up to the reader's offset is in the outfiles. */
+	if (checkpoint_entries > 0 &&
+		nentries - checkpoint_nentries >= checkpoint_entries) {
+	  if (write_checkpoint(checkpoint_file, config_hash, (long) reader->next,
+						   nentries) > 0)
+		checkpointed = 1;
+	  else
+		fprintf(stderr, "Warning: Failed to write the checkpoint %s.\n",
+				checkpoint_file);
+	  checkpoint_nentries = nentries;
+	}
   }  /* While not eof */
+  if (nworkers > 0 && nbatch > 0 && rc > 0)
+	rc = merge_batch();
+  stop_workers();
+
+  for (i = 0; i < params.nconfigs && binary_out && rc > 0; i++) {
+	if (verbose)
+	  fprintf(stderr, "Writing the binary outfile %s...\n", outfiles[i]);
+	rewind(params.configs[i].outfile_fp);
+	if ((sb = second_bin_create(outfiles[i])) == NULL) rc = -1;
+	else {
+	  if (second_bin_add_ascii(sb, params.configs[i].outfile_fp) < 0) rc = -1;
+	  if (second_bin_close(sb) < 0) rc = -1;
+	}
+	if (rc < 0)
+	  fprintf(stderr, "Error: Failed to write %s\n", outfiles[i]);
+  }
   
   if (verbose)
 	fprintf(stderr, "Closing outfiles and infile...\n");
-  fclose(outfile_fp);
-  fclose(infile_fp);
-  fclose(discarded_vos_fp);
+  close_configs(params.configs, params.nconfigs);
+  line_reader_close(reader);
 
   clean_up();
   if (rc < 0) {
 	/* Error */
-	if (remove_outfile)
-	  unlink(outfile);    /* Remove output file. */
+	if (checkpointed)
+	  /* Keep them for --resume. */
+	  fprintf(stderr, "The outfiles are kept; rerun with --resume to continue from %s.\n",
+			  checkpoint_file);
+	else if (remove_outfile)
+	  for (i = 0; i < params.nconfigs; i++) {
+		unlink(outfiles[i]);    /* Remove output file. */
+		if (binary_out) unlink(ascii_files[i]);
+	  }
 
 	if (verbose)
 	  fprintf(stderr, "Failed.\n");
 	exit(-1);
   }
+  unlink(checkpoint_file);
+  for (i = 0; i < params.nconfigs && binary_out; i++)
+	unlink(ascii_files[i]);
   if (verbose)
 	fprintf(stderr, "Successful.\n");
   exit(0);
 } /* main */
 
 
-
-/**********************************************************************/
-/*                                                                    */
-/*                       extract_info_from_data_line                  */
-/*                                                                    */
-/**********************************************************************/
-int extract_info_from_data_line(char *line, char *gauge_id, 
-								char *network_name,
-								time_t *vos_stime_sec, 
-								int *all_radar_data_missing,
-								int *all_radar_data_no_rain,
-								float min_valid_z_value)
-								
-{
-  /* Extract gauge id, start date/time, and end date/time from the data
-   * line. This routine doesnot allocate memory, so the caller must
-   * allocate memory for the elements.
-   * Set all_radar_data_missing = 1 if all tuples contain missing data -- 
-   * missing data is determined by checking whether the tuple contains
-   * either a missing rain type or Z value.
-   * Set all_radar_data_no_rain = 1 if all tuples contain no rain data -- 
-   * no rain data is determined by checking whether the tuple contains
-   * either a no-rain rain type or Z value.
-   *
-   * It will return 1 upon successful; -1, otherwise.
-   *
-   * line starts with the following items:
-   *    GaugeID GaugeNetworkName mm/dd/yyyy hh:mm r N H1 C1 Z1 ... CN ZN ...
-   *       HN C1 Z1 ... CN ZN
-   * 
-   *  where:  
-   *        -- Fields from the first zr intermediate file --
-   *          Gauge ID         = Gauge number.
-   *          GaugeNetworkName = Gauge network name, i.e., KSC, STJ,...
-   *          mm/dd/yyyy       = Start date.
-   *          hh:mm            = Start time.
-   *          r                = Gauge to Radar range (km).
-   *          N                = Number of different height(s).
-   *          H1               = First height in km.
-   *          n                = Number of 2 tuples (C Z) that follow.
-   *          C                = Rain type.
-   *          Z                = Reflectivity in dBZ.
-   *          ...
-   *
-   *          H n C Z will be repeated for N-1 times.
-   *
-   */
-  char *tuple_data_ptr;
-  int ntuples = 0, nheights = 0;
-  int all_missing = 1, all_no_rain = 1;
-  int rain_type, h,i;
-  float Z;
-  char smon[3], emon[3], sday[3];
-  char shour[3], smin[3], ehour[3], emin[3], syr[5];
-  DATE_STR vos_sdate;
-  TIME_STR vos_stime;
-
-  if (line == NULL || gauge_id == NULL || network_name == NULL || 
-	  vos_stime_sec == NULL || all_radar_data_missing == NULL ||
-	  all_radar_data_no_rain == NULL)
-	return -1;
-
-  /* sscanf doesnot work correctly if we extract these as integer, so 
-   * we have to extract them as string and convert them to integer.
-   */
-
-  memset(smon, '\0', 3);
-  memset(emon, '\0', 3);
-  memset(sday, '\0', 3);
-  memset(sday, '\0', 3);
-  memset(shour, '\0', 3);
-  memset(ehour, '\0', 3);
-  memset(smin, '\0', 3);
-  memset(emin, '\0', 3);
- 
-  if (sscanf(line, "%s %s %2s/%2s/%s %2s:%2s %*f %d %*s",
-			 gauge_id, network_name, 
-			 smon, sday, syr, 
-			 shour, smin, &nheights) != 8) {
-	fprintf(stderr, "Line's format is obsolete <%s>.\n", line);
-	return -1;
-  }
-  vos_sdate.tkyear = atoi(syr);
-  vos_stime.tksecond = 0;
-  vos_stime.tkhour = atoi(shour);
-  vos_stime.tkminute = atoi(smin);
-  vos_sdate.tkmonth = atoi(smon);
-  vos_sdate.tkday = atoi(sday);
-  date_time2system_time(&vos_sdate, &vos_stime, vos_stime_sec);
-
-
-  tuple_data_ptr = line;
-  /* Skip to the first height */
-  for (i = 0; i < 7 && tuple_data_ptr != NULL; i++) {
-	tuple_data_ptr = strchr(tuple_data_ptr, ' ');
-	if (tuple_data_ptr == NULL) {
-	  fprintf(stderr, "Obsolete format. Expecting more entries.\n");
-	  return -1;
-	}
-	tuple_data_ptr++;
-  }
-
-  /* Check if all tuples contain bad raintype or Z */
-  for (h = 0; h < nheights && (all_no_rain == 1 || all_missing == 1) && 
-		 tuple_data_ptr != NULL; h++) {
-	/* Extract ntuples: heihgt ntuple ... */
-	if (sscanf(tuple_data_ptr, "%*f %d %*s", &ntuples) != 1) {
-	  fprintf(stderr, "Obsolete format. Expecting ntuples.\n");
-	  return -1;
-	}
-	/* Skip to tuples */
-	tuple_data_ptr = strchr(tuple_data_ptr, ' '); /* Skip height */
-	tuple_data_ptr++;
-	tuple_data_ptr = strchr(tuple_data_ptr, ' '); /* Skip ntuples */
-	tuple_data_ptr++;
-	for (i = 0; i < ntuples && tuple_data_ptr != NULL; i++) {
-	  if (sscanf(tuple_data_ptr, "%d %f %*s", &rain_type, &Z) != 2) {
-		fprintf(stderr, "Obsolete format. Expecting rain_type and Z tuple\n");
-		return -1;
-	  }
-
-	  /* A cell is not rain if NO_ECHO_C && Z <= 0 and Z < min_valid_z_value
-	   * A cell is missing if Z is MISSING. Rain type is not important in 
-	   * this case.
-	   */
-	  if (rain_type != NO_ECHO_C &&  Z > 0.0 && Z > min_valid_z_value &&
-		  Z != MISSING_Z) {
-		/* A good cell is found  */
-		all_no_rain = 0;
-		all_missing = 0; 
-	  }
-	  else if (rain_type != NO_ECHO_C &&  Z > 0.0 && Z > min_valid_z_value) 
-		all_no_rain = 0;
-
-	  else if (Z != MISSING_Z) 
-		all_missing = 0;
-
-
-
-	  tuple_data_ptr = strchr(tuple_data_ptr, ' '); /* Skip raintype */
-	  tuple_data_ptr++;
-	  tuple_data_ptr = strchr(tuple_data_ptr, ' '); /* Skip Z */
-	  tuple_data_ptr++;
-	}
-  }/* for h*/
-
-  *all_radar_data_missing = all_missing;
-  *all_radar_data_no_rain = all_no_rain;
-
-  return 1;
-}  /* extract_info_from_data_line */
-
-
-/**********************************************************************/
-/*                                                                    */
-/*                     read_write_header_info                         */
-/*                                                                    */
-/**********************************************************************/
-int read_write_header_info(char *infile, char *outfile_name,
-						   char *discarded_vos_fname,
-						   int vos_window_time_interval, 
-						   int vos_window_center_offset_min, 
-						   float min_valid_z_value,
-						   int keep_all_entries, FILE **discarded_vos_fp, 
-						   FILE **outfile_fp)
-{
-  /* Read header info from infile_fp and write them to outfile_fp.
-   * Write some of that header info to discarded_vos_fp.
-   * Routine will not close files when returns.
-   */
-  char line[MAX_LINE_LEN];
-  int rc = 1;
-  FILE *infile_fp;
-  int i = 0;
-  char date_str[MAX_NAME_LEN], time_str[MAX_NAME_LEN];
-
-  if ( infile == NULL || outfile_name == NULL || *outfile_fp == NULL ||
-	   *discarded_vos_fp == NULL || discarded_vos_fname == NULL) return -1;
-
-  if ((infile_fp = fopen(infile, "r")) == NULL) {
-	perror("fopen infile");
-	return -1;
-  }
-  memset(date_str, '\0', MAX_NAME_LEN);
-  memset(time_str, '\0', MAX_NAME_LEN);
-  gv_utils_time_secs2date_time_strs(time(NULL), 1, 0, date_str, time_str);
-
-  /* Write comments to outfile_fp first. */
-  fprintf(*outfile_fp, "%s This table is the second intermediate product for creating the ZR table\n", USER_COMMENT_CHARS);
-  fprintf(*outfile_fp, "%s It contains radar windows, rain classifications, and rain rates data for\n", USER_COMMENT_CHARS); 
-  fprintf(*outfile_fp, "%s rain gauges.  Line starts with # is considered comment.\n", USER_COMMENT_CHARS);
-  fprintf(*outfile_fp, "%s\n", USER_COMMENT_CHARS);
-  fprintf(*outfile_fp, "%s File generation information:\n"
-                       "%s    Created by:     %s (%s).\n"
-                       "%s    Input file:     %s\n"
-                       "%s    Generated time: %s %s\n", 
-		  USER_COMMENT_CHARS, USER_COMMENT_CHARS, this_prog, PROG_VERSION,
-		  USER_COMMENT_CHARS, infile, USER_COMMENT_CHARS,date_str, time_str);
-
- 
-
-  fprintf(*outfile_fp, "%s\n", USER_COMMENT_CHARS);
-
-
-  /* Write comments to discarded_vos_fp.  */
-  fprintf(*discarded_vos_fp, "%s This file contains information of all VOSes excluded \n"
-                               "%s from the second intermediate file, '%s'.\n"
-                               "%s Line starts with # is considered comment.\n"
-		                       "%s\n",
-		  USER_COMMENT_CHARS, USER_COMMENT_CHARS, outfile_name, USER_COMMENT_CHARS, USER_COMMENT_CHARS);
-  fprintf(*discarded_vos_fp, "%s File generation information:\n"
-                       "%s    Created by:               %s (%s).\n"
-                       "%s    Input file:               %s\n"
-                       "%s    Second intermediate file: %s\n"
-                       "%s    Generated time:           %s %s\n", 
-		  USER_COMMENT_CHARS, USER_COMMENT_CHARS, this_prog, PROG_VERSION,
-		  USER_COMMENT_CHARS, infile, 
-		  USER_COMMENT_CHARS, outfile_name, 
-		  USER_COMMENT_CHARS,date_str, time_str);
-
-
-  fprintf(*discarded_vos_fp, "%c\n", COMMENT_CHAR);
-
-  /* Read from infile */
-  while (!feof(infile_fp)) {
-
-	memset(line, '\0', MAX_LINE_LEN);
-	/* Read the next line from infile. */
-	if (fgets(line, MAX_LINE_LEN, infile_fp) == NULL) break; 
-	if (strncmp(line, USER_COMMENT_CHARS, strlen(USER_COMMENT_CHARS))==0)
-		continue;  /* It's comment, skip. */
-
-	if (strstr(line, TABLE_RECORD_INFO_STR) != NULL) {
-	  fprintf(*outfile_fp, " Window_time_range_in_minutes      %d\n",vos_window_time_interval);
-	  fprintf(*outfile_fp, " Window_center_offset_in_minutes   %d\n", vos_window_center_offset_min);
-	  i++;
-	}	
-	else if (strstr(line, TABLE_START_STR) != NULL) {
-	  /* Print to comment section: what is being kept in the product.
-	   */
-	  fprintf(*outfile_fp, "%c\n", COMMENT_CHAR);
-	  fprintf(*outfile_fp, "%s Note: \n", FILE_COMMENT_CHARS);
-
-	  if (keep_all_entries) {
-		fprintf(*outfile_fp, "%s    * This file keeps all entries from the input file. \n",
-				FILE_COMMENT_CHARS);
-	  }
-	  else {
-
-		fprintf(*outfile_fp, "%s    * VOSes are kept based on the following criteria:\n",  FILE_COMMENT_CHARS);
-
-		fprintf(*outfile_fp, "%s       (1) Both radar and gauge data are not missing or\n"
-				             "%s       (2) Either radar or gauge sees rain. \n"
-				             "%s    * Gauge data is missing if:\n"
-                             "%s       (1) There is no rain rate for the interested month and year, or\n"
-                             "%s       (2) There is no info for the interested gauge ID/netID, or\n"
-                             "%s       (3) R <= %.2f\n"
-				             "%s    * Gauge data shows no rain if R = 0.0\n"
-                             "%s    * Radar data is missing if Z = %.2f.\n"
-                             "%s    * Radar data shows no rain if C = %d (NO_ECHO) && Z <= 0.0 && Z <= %.2f (min_valid_Z_value)\n",
-				FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,FILE_COMMENT_CHARS, MISSING_RAIN_RATE, FILE_COMMENT_CHARS,FILE_COMMENT_CHARS,MISSING_Z, FILE_COMMENT_CHARS, NO_ECHO_C, min_valid_z_value);
-
-		fprintf(*outfile_fp, "%s    * See file, '%s', for information on discarded VOSes.\n", FILE_COMMENT_CHARS, discarded_vos_fname);
-	  }
-	  fprintf(*outfile_fp, "%c\n", COMMENT_CHAR);
-
-	  i = 0;
-	  fprintf(*outfile_fp, "%s", line); /* Write header line to outfile. */
-
-	  fprintf(*discarded_vos_fp, "%c\n", COMMENT_CHAR); 
-	  fprintf(*discarded_vos_fp, "%c TABLE RECORD INFORMATION:\n"
-			  "%c Record Format:\n"
-			  "%c    Gauge_ID Net_ID VOS_Date VOS_Time\n",
-			  COMMENT_CHAR, COMMENT_CHAR, COMMENT_CHAR);
-
-	  fprintf(*discarded_vos_fp, "%c\n", COMMENT_CHAR); 
-	  fprintf(*discarded_vos_fp, "%s", line); /* Write header line to discarded_vos_fp. */
-	  break;                         /* Done, end of header info. is reached. */
-	}
-
-	else if (i > 0) {
-	  /* Assumming this line is part of the table record's format. */
-	  if (line[strlen(line)-1] == '\n')
-		line[strlen(line)-1] = '\0';  /* Remove \n */
-
-
-	  if (strstr(line, COMMENT_RECORD_FORMAT_LINE) != NULL)
-		fprintf(*outfile_fp, "%c%s\n", COMMENT_CHAR, 
-				line+strlen(COMMENT_RECORD_FORMAT_LINE));
-
-	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE1) != NULL)
-		fprintf(*outfile_fp, "%c%s      _NR R's_\n", COMMENT_CHAR, 
-				line+strlen(COMMENT_RECORD_FORMAT_LINE1));
-	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE2) != NULL)
-		fprintf(*outfile_fp, "%c%s      |      |\n", COMMENT_CHAR, 
-				line+strlen(COMMENT_RECORD_FORMAT_LINE2));
-	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE3) != NULL)
-		fprintf(*outfile_fp, "%c%s NR R1 ...\n", COMMENT_CHAR,
-				line+strlen(COMMENT_RECORD_FORMAT_LINE3));
-	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE4) != NULL)
-		fprintf(*outfile_fp, "%c%s           I  F  \n", COMMENT_CHAR,
-				line+strlen(COMMENT_RECORD_FORMAT_LINE4));
-
-	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE5) != NULL) {
-		fprintf(*outfile_fp, "%c%s\n", COMMENT_CHAR, 
-				line+strlen(COMMENT_RECORD_FORMAT_LINE5));
-		fprintf(*outfile_fp, "%c    NR   = Number of R's    R    = Rain Rate, < 0.0 suspicion, %.2f missing\n", COMMENT_CHAR,  MISSING_RAIN_RATE);
-	  }
-	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE6) != NULL)
-		fprintf(*outfile_fp, "%c%s\n", COMMENT_CHAR, 
-				line+strlen(COMMENT_RECORD_FORMAT_LINE6));
-	  else if (strstr(line, COMMENT_RECORD_FORMAT_LINE7) != NULL) {
-		fprintf(*outfile_fp, "%c%s\n", COMMENT_CHAR, 
-				line+strlen(COMMENT_RECORD_FORMAT_LINE7));
-		/* Add the time window here */
-        fprintf(*outfile_fp, "%c\n"
-                             "%c   Time Window of N Minutes Centered at VOS_time + Offset:\n"
-				             "%c       |--t1--|--t2--|...|--tN--|\n"
-                             "%c       |  R1  |  R2  |...|  RN  |\n"
-                             "%c\n",
-
-				COMMENT_CHAR, COMMENT_CHAR, COMMENT_CHAR, COMMENT_CHAR, COMMENT_CHAR);
-
-	  }
-
-	  else {
-		
-		fprintf(*outfile_fp, "%s\n", line); /* Write comment info to outfile. */
-	  }
-	  i++;
-
-	  continue;
-	}
-	  
-	fprintf(*outfile_fp, "%s", line); /* Write header info to outfile. */
-
-	if (strstr(line, SITE_NAME_STR) != NULL) {
-	  /* Write this line to discarded_time_fp. */
-	  fprintf(*discarded_vos_fp, "%c %s", COMMENT_CHAR, line);
-	}
-	else if (strstr(line, END_DATE_TIME_STR) != NULL ||
-			 strstr(line, START_DATE_TIME_STR) != NULL) {
-	  /* Write this line to discarded_time_fp. */
-	  fprintf(*discarded_vos_fp, "%c %s", COMMENT_CHAR, line);
-	}
-
-  }
-
-  fclose(infile_fp);
-  return rc;
-} /* read_write_header_info */
-
 /**********************************************************************/
 /*                                                                    */
 /*                           clean_up                                 */
@@ -771,7 +1053,10 @@ int read_write_header_info(char *infile, char *outfile_name,
 /**********************************************************************/
 void clean_up()
 {
+  rate_cache_free(gauge_rates);
+  gauge_rates = NULL;
   gauge_db_close(gauge_dbf, 'r'); /* Close the gauge database */
+  gauge_dbf = NULL;
 }
 
 
@@ -790,158 +1075,3 @@ void handler(int sig)
 	exit (-2);
   exit(-1);
 }
-
-
-/**********************************************************************/
-/*                                                                    */
-/*                    merge_gauge_and_append_to_outfile               */
-/*                                                                    */
-/**********************************************************************/
-int merge_gauge_and_append_to_outfile(GDBM_FILE gauge_dbf, 
-									  time_t vos_window_time_interval,
-									  int window_center_offset_min,
-									  int keep_all_entries, 
-									  float min_valid_z_value,
-									  char *radar_column_data, 
-									  FILE **discarded_vos_fp,
-									  FILE **outfile_fp)
-{
-  /* Merge radar, rain class, and rain rates data and append the results
-   * to outfile_fp.  The rain gauge data is from the database.
-   * if keep_all_entries != 1, do not write vos having no rain rates and
-   * no radar data. 
-   * Write to discarded_vos_fp any vos not included in outfile_fp.
-   * Return 1 for successful; -1, otherwise.
-   *
-   * Output entry to file based on the following criteria:
-   *   * Both radar and gauge data are not missing.
-   *   * Or either radar or gauge sees rain. 
-   *   * Or keep_all_entries is specified.
-   *
-   */
-  char rain_rates_str[MAX_LINE_LEN];
-  int nrain_rates = 0, n_non_missingNnon_zero_rain_rates = 0, 
-	n_zero_rain_rates = 0;
-  time_t vos_window_stime_sec, vos_window_etime_sec;
-  char gauge_id[MAX_NAME_LEN], net_id[MAX_NAME_LEN];
-  time_t vos_time_sec;
-  int all_radar_data_missing = 0;
-  int all_radar_data_no_rain = 0;
-  char date_str[MAX_NAME_LEN], time_str[MAX_NAME_LEN];
-  int all_gauge_data_missing = 0, all_gauge_data_no_rain = 0;
-
-  if (radar_column_data == NULL || *outfile_fp == NULL || gauge_dbf == NULL ||
-	  *discarded_vos_fp == NULL)
-	return -1;
-
-  extract_info_from_data_line(radar_column_data, gauge_id, net_id, 
-							  &vos_time_sec, &all_radar_data_missing, 
-							  &all_radar_data_no_rain,
-							  min_valid_z_value);
-
-  find_vos_window_time(vos_time_sec, vos_window_time_interval,
-					   window_center_offset_min,
-					   &vos_window_stime_sec, &vos_window_etime_sec);
-
-
-  if (verbose) {
-	fprintf(stderr, "net <%s> gauge <%s>: vos window start time %s\n",
-			net_id, gauge_id, ctime(&vos_window_stime_sec));
-	fprintf(stderr, "net <%s> gauge <%s>: vos window start time %s\n",
-			net_id, gauge_id, ctime(&vos_window_etime_sec));
-  }
-  /* rain_rates_str will contain rain rate or each minute for the 
-   * specified time period.
-   */
-  memset(rain_rates_str, '\0', MAX_LINE_LEN);
-  gauge_db_fetch_range(gauge_dbf, net_id, gauge_id, vos_window_stime_sec,
-					   vos_window_etime_sec, NULL, NULL, rain_rates_str, 
-					   &n_non_missingNnon_zero_rain_rates, &n_zero_rain_rates,
-					   &nrain_rates);
-
-  /* Output entry to file based on the criteria defined in Brad Fisher's 
-   * message:
-   *   For radar gauge QC it is important to know whether either
-   *   instrument records rainfall.  It is an OR condition.  So if the Rain 
-   *   Gauge sees OR the Radar we should write that data to the second 
-   *   intermediate file. 
-   *
-   *   It is probably less critical to write out records 
-   *   if the radar OR gauge data is missing OR both instruments see no rain.
-   *
-   *   In the interest of smaller files we will not write the data out if 
-   *   one or the other is missing, but if for instance the radar sees no 
-   *   rain, but the gauge does, write it out. 
-   */
-
-  all_gauge_data_missing = (n_non_missingNnon_zero_rain_rates == 0 &&
-							n_zero_rain_rates == 0);
-  all_gauge_data_no_rain = (n_zero_rain_rates == nrain_rates);
-
-
-  if (!keep_all_entries &&
-	  /* Either radar or gauge data is missing */
-	  ((all_gauge_data_missing == 1 || all_radar_data_missing == 1) ||
-	  /* Or both radar and gauge see no rain. */
-	   (all_gauge_data_no_rain == 1 && all_radar_data_no_rain))) {
-	/* Don't keep this VOS */
-
-	memset(date_str, '\0', MAX_NAME_LEN);
-	memset(time_str, '\0', MAX_NAME_LEN);
-	gv_utils_time_secs2date_time_strs(vos_time_sec, 1, 0, date_str, time_str);
-	fprintf(*discarded_vos_fp, "%s %s %s %s\n", gauge_id, net_id, date_str, time_str);
-	if (verbose) {
-	  fprintf(stderr, "Ignored: radar data: %s\n", radar_column_data);
-	  fprintf(stderr, "Ignored: rain rate count: %d\n", nrain_rates);
-	  fprintf(stderr, "Ignored: rain rates: %s\n", rain_rates_str);
-	}
-  }
-  else {
-	/* Keep this VOS */
-	/*   * Both radar and gauge data are not missing.
-	 *   * Or either radar or gauge sees rain. 
-	 *   * Or keep_all_entries is specified.
-	 */
-	if (verbose) {
-	  fprintf(stderr, "Kept: radar data: %s\n", radar_column_data);
-	  fprintf(stderr, "Kept: rain rate count: %d\n", nrain_rates);
-	  fprintf(stderr, "Kept:rain rates: %s\n", rain_rates_str);
-	}
-
-	fprintf(*outfile_fp, "%s %d %s\n", radar_column_data, nrain_rates, rain_rates_str);
-  }
-
-  return 1;
-} /*merge_gauge_and_append_to_outfile */
-
-
-
-/**********************************************************************/
-/*                                                                    */
-/*                      find_vos_window_time                          */
-/*                                                                    */
-/**********************************************************************/
-void find_vos_window_time(time_t vos_stime_sec, int vos_window_time_interval,
-						  int window_center_offset_min,
-						  time_t *vos_window_stime_sec,
-						  time_t *vos_window_etime_sec)
-{
-	/* Find the vos window start/end times based on the vos start time and
-	 * thw window time interval as followed:
-	 * vos_window_stime = vos_center_time - 
-	 *                              (vos_window_time_interval/2 * 60) 
-	 * vos_window_etime = vos_center_time + 
-	 *                              (vos_window_time_interval/2 * 60) 
-	 *  where vos_center_time = vos_stime_sec + window_center_offset_min*60 
-	 */
-  time_t vos_center_time_sec;
-
-  vos_center_time_sec = vos_stime_sec + window_center_offset_min*60;
-
-  *vos_window_stime_sec = vos_center_time_sec - 
-	((int) (vos_window_time_interval/2) * 60);
-
-  *vos_window_etime_sec = vos_center_time_sec + 
-	((int) (vos_window_time_interval/2) * 60);
-
-} /* find_vos_window_time */
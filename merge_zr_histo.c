@@ -8,21 +8,32 @@
 
 	 Usage:
 
-	 merge_zr_histo [options] inFile1 [inFile2...] outFile
+	 merge_zr_histo [options] [inFile1 [inFile2...]] outFile
 
 	 Options:
 	   -v:               Verbose
+	   -B:               Write outFile in the binary histogram format
+	   -l list_file:     Also merge the files named in list_file,
+	                     one per line
+	   -j nthreads:      Read and add the inputs with nthreads threads
 
-	 inFiles: Input ZR histogram files
+	 inFiles: Input ZR histogram files, ASCII or binary
 	 outFile: Output ZR histogram file
 
 	 ------------------------------------
 
-	 Merges ZR histogram pairs from 2 or more input files into
+	 Merges ZR histogram pairs from any number of input files into
 	 one cumulative ZR histogram pair set.  The structure of all
 	 input histograms (rainclasses, range intervals, resolution
 	 and range of the Z and R axes) must be identical.
 
+	 Each thread holds its running sum and the input it is
+	 adding, so memory does not grow with the number of inputs.
+	 The threads' sums are added pairwise, then to the first
+	 input's histograms; the output keeps the first input's
+	 header.  Integer addition, so the output does not depend
+	 on -j.
+
 	 -----------------------------------------------------------------
 
 		mike.kolander@trmm.gsfc.nasa.gov  (301) 286-1540
@@ -39,6 +50,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "zr_utils.h"
 
@@ -46,42 +58,38 @@
 
 #define OK     0
 #define ABORT -1
+#define MAX_THREADS 32
+
+/* A thread's sum of input histograms. */
+typedef struct {
+	pthread_t thread;
+	ZR_histo *sum;      /* NULL: no input yet. */
+	int rc;
+	void *other;        /* The Reducer whose sum add_pair() adds to this. */
+} Reducer;
 
-/* Global variable */
+/* Global variables */
 int verbose=0;
+/* The input files, taken in turn by the threads. */
+struct {
+	pthread_mutex_t lock;
+	char **name;
+	int n, next;        /* next: the next file to read. */
+	int failed;         /* Set when a thread fails; all threads stop. */
+	ZR_histo *first;    /* The histograms of name[0]. */
+} infiles = {PTHREAD_MUTEX_INITIALIZER};
 
 
 /*
  * Functions defined in this file.
  */
-int *add_vectors(int *inVector, int *outVector, int nbins);
 int compatibilityCheck(ZR_histo *histo1, ZR_histo *histo2);
-ZR_histo *merge_zr_histograms(char **infile, int nInfiles);
+ZR_histo *merge_zr_histograms(char **infile, int nInfiles, int nthreads);
 void usage();
 int main(int argc, char **argv);
 
 
 
-/*************************************************************/
-/*                                                           */
-/*                        add_vectors                        */
-/*                                                           */
-/*************************************************************/
-int *add_vectors(int *inVector, int *outVector, int nbins)
-{
-	/* Performs vector addition:
-	 *    outVector = inVector + outVector
-	 *
-	 * Returns outVector.
-	 */
-	int ibin;
-
-	for (ibin=0; ibin<nbins; ibin++)
-	  outVector[ibin] = outVector[ibin] + inVector[ibin];
-
-	return(outVector);
-}
-
 /*************************************************************/
 /*                                                           */
 /*                    compatibilityCheck                     */
@@ -124,55 +132,158 @@ int compatibilityCheck(ZR_histo *histo1, ZR_histo *histo2)
 
 /*************************************************************/
 /*                                                           */
-/*                     merge_zr_histograms                   */
+/*                       reduce_infiles                      */
 /*                                                           */
 /*************************************************************/
-ZR_histo *merge_zr_histograms(char **infile, int nInfiles)
+static void *reduce_infiles(void *arg)
 {
-	int j, irtype, irange;
-	ZR_histo *inHisto, *outHisto;
-	
 	/*
-	 * Read in the first set of input histograms.
+	 * Thread: take the next input file until there are none left, read
+	 * it, check it against the first input file's header, and add it to
+	 * the thread's sum.  One input histogram at a time is in memory.
+	 * Stops when any thread fails.
 	 */
-	outHisto = (ZR_histo *)read_zr_histo(infile[0]);
+	Reducer *reducer = (Reducer *)arg;
+	ZR_histo *inHisto;
+	int j;
 
-	for (j=1; j<nInfiles; j++)
+	reducer->rc = OK;
+	for (;;)
 	{
-		inHisto = read_zr_histo(infile[j]);
+		pthread_mutex_lock(&infiles.lock);
+		j = infiles.next++;
+		if (infiles.failed) j = infiles.n;
+		pthread_mutex_unlock(&infiles.lock);
+		if (j >= infiles.n) break;
+
+		if (verbose) fprintf(stderr, "Reading %s\n", infiles.name[j]);
+		inHisto = read_zr_histo(infiles.name[j]);
 		/*
 		 * Check that the input Z_R histogram header entries are identical
-		 * with those already encountered in the previous infiles.
+		 * with those of the first infile.
 		 */
-		if (compatibilityCheck(inHisto, outHisto) != OK)
+		if (inHisto == NULL || compatibilityCheck(inHisto, infiles.first) != OK)
 		{
-			fprintf(stderr, "Input Z_R histograms are not compatible!!\n");
-			return(NULL);
+			if (inHisto != NULL)
+				fprintf(stderr, "Input Z_R histograms are not compatible!! (%s)\n",
+								infiles.name[j]);
+			free_zr_histo(inHisto);
+			reducer->rc = ABORT;
+			pthread_mutex_lock(&infiles.lock);
+			infiles.failed = 1;
+			pthread_mutex_unlock(&infiles.lock);
+			break;
 		}
-
-		/*
-		 * For each raintype and range interval, add the input R vector to
-		 * the output R vector.  Similiarly, add the input Z vector to the
-		 * output Z vector.
-		 */
-		for (irtype=0; irtype<outHisto->nrtype; irtype++)
+		if (reducer->sum == NULL)
+			reducer->sum = inHisto;
+		else
 		{
-			for (irange=0; irange<outHisto->nrange; irange++)
-			{
-				/* Add the R vectors, place the result in outHisto->r */
-				outHisto->r[irange][irtype] = add_vectors(inHisto->r[irange][irtype],
-																									outHisto->r[irange][irtype],
-																									outHisto->nRbins);
-				/* Add the Z vectors, place the result in outHisto->z */
-				outHisto->z[irange][irtype] = add_vectors(inHisto->z[irange][irtype],
-																									outHisto->z[irange][irtype],
-																									outHisto->nZbins);
-			}
+			add_zr_histo(inHisto, reducer->sum);
+			free_zr_histo(inHisto);
 		}
-		
-		free_zr_histo(inHisto);
-	} /* end for (j=1; j<nInfiles; j++) */
+	}
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                         add_pair                          */
+/*                                                           */
+/*************************************************************/
+static void *add_pair(void *arg)
+{
+	/* Thread: add the sum of reducer->other to that of reducer. */
+	Reducer *reducer = (Reducer *)arg;
+	Reducer *other = (Reducer *)reducer->other;
+
+	if (other->sum == NULL) return(NULL);
+	if (reducer->sum == NULL)
+		reducer->sum = other->sum;
+	else
+	{
+		add_zr_histo(other->sum, reducer->sum);
+		free_zr_histo(other->sum);
+	}
+	other->sum = NULL;
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                     merge_zr_histograms                   */
+/*                                                           */
+/*************************************************************/
+ZR_histo *merge_zr_histograms(char **infile, int nInfiles, int nthreads)
+{
+	/*
+	 * Add the histograms of the nInfiles input files with 'nthreads'
+	 * threads.  Each thread sums the files it reads; the sums are then
+	 * added pairwise, in a tree, and to the first file's histograms.
+	 * Returns the merged histograms, with the first file's header;
+	 * NULL if error.
+	 */
+	Reducer reducer[MAX_THREADS];
+	pthread_t pair[MAX_THREADS];
+	int joinable[MAX_THREADS];
+	ZR_histo *outHisto;
+	int i, step, rc = OK;
 	
+	/*
+	 * Read in the first set of input histograms.
+	 */
+	outHisto = (ZR_histo *)read_zr_histo(infile[0]);
+	if (outHisto == NULL) return(NULL);
+
+	if (nthreads > nInfiles - 1) nthreads = nInfiles - 1;
+	if (nthreads < 1) return(outHisto);
+	infiles.name = infile;
+	infiles.n = nInfiles;
+	infiles.next = 1;
+	infiles.failed = 0;
+	infiles.first = outHisto;
+	memset(reducer, 0, sizeof(reducer));
+	for (i=0; i<nthreads; i++)
+		if (pthread_create(&reducer[i].thread, NULL, reduce_infiles, &reducer[i]) != 0)
+			break;
+	if (i == 0)
+	{
+		reduce_infiles(&reducer[0]);  /* No thread; do it here. */
+		nthreads = 1;
+	}
+	else
+	{
+		nthreads = i;
+		for (i=0; i<nthreads; i++)
+			pthread_join(reducer[i].thread, NULL);
+	}
+	for (i=0; i<nthreads; i++)
+		if (reducer[i].rc != OK) rc = ABORT;
+
+	/*
+	 * Pairwise: reducer[i] += reducer[i+step], for i a multiple of
+	 * 2*step; the pairs of a level are added in parallel.
+	 */
+	for (step=1; step<nthreads && rc == OK; step *= 2)
+	{
+		for (i=0; i+step<nthreads; i+=2*step)
+		{
+			reducer[i].other = &reducer[i+step];
+			joinable[i] = pthread_create(&pair[i], NULL, add_pair, &reducer[i]) == 0;
+			if (!joinable[i]) add_pair(&reducer[i]);  /* No thread; do it here. */
+		}
+		for (i=0; i+step<nthreads; i+=2*step)
+			if (joinable[i]) pthread_join(pair[i], NULL);
+	}
+
+	if (rc == OK && reducer[0].sum != NULL)
+		add_zr_histo(reducer[0].sum, outHisto);
+	for (i=0; i<nthreads; i++)
+		free_zr_histo(reducer[i].sum);
+	if (rc != OK)
+	{
+		free_zr_histo(outHisto);
+		return(NULL);
+	}
 	return(outHisto);
 }
 
@@ -184,15 +295,21 @@ ZR_histo *merge_zr_histograms(char **infile, int nInfiles)
 void usage()
 {
 	fprintf(stderr, "\nUsage (merge_zr_histo-v0.0):\n\n");
-	fprintf(stderr, "  merge_zr_histo [options] inFile1 [inFile2...] outFile\n");
+	fprintf(stderr, "  merge_zr_histo [options] [inFile1 [inFile2...]] outFile\n");
 	fprintf(stderr, "\nOptions:\n");
 	fprintf(stderr, "  -v:               Verbose\n");
-
-	fprintf(stderr, "\ninFiles: Input ZR histogram files\n");
+	fprintf(stderr, "  -B:               Write outFile in the binary histogram format.\n");
+	fprintf(stderr, "                    (Default: ASCII)\n");
+	fprintf(stderr, "  -l list_file:     Also merge the files named in list_file, one per\n");
+	fprintf(stderr, "                    line.  Blank and '#' lines are skipped.\n");
+	fprintf(stderr, "  -j nthreads:      Read and add the inputs with nthreads threads.\n");
+	fprintf(stderr, "                    (Default: 1; at most %d)\n", MAX_THREADS);
+
+	fprintf(stderr, "\ninFiles: Input ZR histogram files, ASCII or binary\n");
 	fprintf(stderr, "outFile: Output ZR histogram file\n");
 	fprintf(stderr, "\n------------------------------------\n\n");
 
-	fprintf(stderr, "Merges ZR histogram pairs from 2 or more input files into\n");
+	fprintf(stderr, "Merges ZR histogram pairs from any number of input files into\n");
 	fprintf(stderr, "one cumulative ZR histogram pair set.  The structure of all\n");
 	fprintf(stderr, "input histograms (rainclasses, range intervals, resolution\n");
 	fprintf(stderr, "and range of the Z and R axes) must be identical.\n");
@@ -208,10 +325,14 @@ extern int getopt(int argc, char * const argv[], const char *optstring);
 /*************************************************************/
 int main(int argc, char **argv)
 {
-	char *infile[16];     /* Maximum of 16 input files */
-	int nInfiles;         /* Number of user-supplied input files. */
+	char **infile = NULL; /* Input files: command line, then list files. */
+	int nInfiles = 0;     /* Number of user-supplied input files. */
 	char *outfile;	
+	char *list_file[16];
+	int nlist_files = 0;
 	int c, j;
+	int binary_out = 0;
+	int nthreads = 1;
 	
 	ZR_histo *histo;
 	extern char *optarg;
@@ -220,18 +341,39 @@ int main(int argc, char **argv)
 	if (argc < 3) usage();
 
 	/* Read options from command line. */
-	while ((c=getopt(argc, argv, "v")) != EOF)
+	while ((c=getopt(argc, argv, "vBl:j:")) != EOF)
 	{
 		switch (c)
 		{
 		case 'v':
 			verbose = 1;
 			break;
+		case 'B':
+			binary_out = 1;
+			break;
+		case 'l':
+			if (nlist_files == 16)
+			{
+				fprintf(stderr, "\nAt most 16 list files (-l).\n\n");
+				usage();
+			}
+			list_file[nlist_files++] = optarg;
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			if (nthreads < 1 || nthreads > MAX_THREADS)
+			{
+				fprintf(stderr, "\nnthreads (-j) must be 1 to %d.\n\n", MAX_THREADS);
+				usage();
+			}
+			break;
+		default:
+			usage();
 		}	/* end switch (c) */
 	} /* end while ((c=getopt... */
 
-	/* Check for 2 or more command line items: infiles and outfile. */
-	if ((argc - optind) < 2) 
+	/* Check for the outfile, and infiles on the command line or in list files. */
+	if ((argc - optind) < 1 || (argc - optind < 2 && nlist_files == 0)) 
 	{
 		fprintf(stderr, "\nUnspecified 'inFile' and/or 'outFile'\n\n"); 
 		usage();
@@ -239,10 +381,23 @@ int main(int argc, char **argv)
 
 	nInfiles = argc - optind - 1;
 	/* Load the array of ptrs to the input files. */
+	if ((infile = (char **)malloc((nInfiles + 1) * sizeof(char *))) == NULL)
+	{
+		perror("merge_zr_histo");
+		exit(-1);
+	}
 	for (j=0; j<nInfiles; j++)
 	  infile[j] = argv[optind++];
 	/* Output file */
 	outfile = argv[optind];
+	for (j=0; j<nlist_files; j++)
+		if ((infile = read_infile_list(list_file[j], infile, &nInfiles)) == NULL)
+			exit(-1);
+	if (nInfiles == 0)
+	{
+		fprintf(stderr, "\nNo input files in the list file(s).\n\n");
+		exit(-1);
+	}
 
 	if (verbose)
 	{
@@ -251,21 +406,22 @@ int main(int argc, char **argv)
 		fprintf(stderr, "%d InFiles:\n", nInfiles);
 		for (j=0; j<nInfiles; j++)
 		  fprintf(stderr, "  %s\n", infile[j]);
-		fprintf(stderr, "OutFile: %s\n\n", outfile);
+		fprintf(stderr, "OutFile: %s\n", outfile);
+		fprintf(stderr, "Threads: %d\n\n", nthreads);
 	} /* end if (verbose) */
 	
 	/*
 	 * Read the ZR histogram pairs from each of the infiles, and merge
 	 * them into one output ZR histogram pair set.
 	 */
-	histo = (ZR_histo *)merge_zr_histograms(infile, nInfiles);
+	histo = (ZR_histo *)merge_zr_histograms(infile, nInfiles, nthreads);
 	if (histo == NULL) exit(-1);
 	/*
 	 * Write the output ZR histogram pairs to a disk file.
 	 */
-	write_zr_histo(histo, outfile);
+	if ((binary_out ? write_zr_histo_bin(histo, outfile) :
+			 write_zr_histo(histo, outfile)) < 0)
+		exit(-1);
 
 	exit(0);
 }
-
-
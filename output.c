@@ -15,12 +15,18 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <pthread.h>
 #include <gdbm.h>
 #include <gv_utils.h>
 #include "get_radar_data_over_gauge.h"
 #include "get_radar_data_over_gauge_db.h"
 #include "zr.h"
 #include "gauge_db.h"
+#include "payload_table.h"
 
 extern int verbose;
 extern char *this_prog;
@@ -52,18 +58,6 @@ extern char *this_prog;
    (b) += sizeof(i);\
 }
 
-typedef struct {
-  char h[HEADER_LEN];
-  int  n;
-} Header_t;
-
-
-Header_t *construct_header(char *site,
-					   float lat, float lon,
-					   float gauge_win_xmax,
-					   float gauge_win_ymax, 
-					   float gauge_win_zmax,
-					   rain_class_type_t rain_class_type);
 void modify_header_time(GDBM_FILE fp, char *which_time, DATE_STR *sdate, TIME_STR *stime);
 
 /**********************************************************************/
@@ -108,6 +102,17 @@ GDBM_FILE open_outfile_and_write_header_info(char *site,
    * conditionally modifies the START and END times.
    */
 
+  /* New files get the compact column codec; files written before it
+   * keep the scaled int codec.
+   */
+  key.dptr = "HEADER"; key.dsize = strlen(key.dptr) + 1;
+  if (!gdbm_exists(fp, key)) {
+	key.dptr = COLUMN_CODEC_KEY; key.dsize = strlen(key.dptr) + 1;
+	content.dptr = COLUMN_CODEC_COMPACT_STR;
+	content.dsize = strlen(content.dptr) + 1;
+	gdbm_store(fp, key, content, GDBM_REPLACE);
+  }
+
   modify_header_time(fp, "START TIME", sdate, stime);
   modify_header_time(fp, "END TIME", edate, etime);
 
@@ -421,6 +426,339 @@ int create_entry_key_str(GDBM_FILE fp, char *gauge_id, char *net_name,
   
 } /*  create_entry_key_str */
 
+/*
+ * Compact column codec (COLUMN_CODEC_COMPACT):
+ *
+ *    varint   gauge range in m          (range * 1000, as SAVE_SCALED_INT)
+ *    varint   number of heights
+ *    For each height:
+ *      svarint  height in m, minus the previous height (0 for the first)
+ *      varint   nzc * 2 + all_noecho
+ *      cells    Left out if all_noecho; see the NOECHO entry.
+ *
+ *    cells of a height:
+ *      missing bitmask  (nzc+7)/8 bytes. Bit set: Z is MISSING_Z, not stored.
+ *      noecho bitmask   (nzc+7)/8 bytes. Bit set: C is NO_ECHO_C, not stored.
+ *      For each cell:   int8 C, int16 Z in 1/100 dBZ (little endian).
+ *
+ * varint: 7 bits per byte, low bits first; svarint: zigzag coded varint.
+ * Z is kept to 1/100 dBZ, the precision of both the 2A-55 product and the
+ * ASCII dump.
+ */
+
+#define PUT_VARINT(b, v) \
+{ \
+   unsigned int u_ = (v); \
+   while (u_ >= 0x80) { *(b)++ = (char) (u_ | 0x80); u_ >>= 7; } \
+   *(b)++ = (char) u_; \
+}
+
+#define GET_VARINT(b, v) \
+{ \
+   unsigned int u_ = 0; \
+   int shift_ = 0; \
+   while (*(unsigned char *) (b) & 0x80) { \
+	 u_ |= (unsigned int) (*(unsigned char *) (b)++ & 0x7f) << shift_; \
+	 shift_ += 7; \
+   } \
+   u_ |= (unsigned int) (*(unsigned char *) (b)++) << shift_; \
+   (v) = u_; \
+}
+
+#define ZIGZAG(x)   ((unsigned int) (((x) << 1) ^ ((x) >> 31)))
+#define UNZIGZAG(u) ((int) ((u) >> 1) ^ -(int) ((u) & 1))
+
+/***************************************************************************/
+/*                                                                         */
+/*                         column_content_max_len                          */
+/*                                                                         */
+/***************************************************************************/
+int column_content_max_len(zc_column_t *column)
+{
+  /* Return the largest number of bytes column_to_content() can use for
+   * column, with any codec.  Also enough for the NOECHO cells.
+   */
+  int h, n;
+
+  n = 2 * sizeof(int);
+  for (h = 0; h < MAX_HEIGHT_LEVELS && h < column->nhinfo; h++)
+	n += 2 * sizeof(int) + (column->hinfo[h])->nzc * 2 * sizeof(int);
+  return n;
+} /* column_content_max_len */
+
+/***************************************************************************/
+/*                                                                         */
+/*                            compact_cells                                */
+/*                                                                         */
+/***************************************************************************/
+static char *compact_cells(zc_t *zc, int nzc, char *p)
+{
+  /* Encode nzc cells at p.  Return the end of the cells. */
+  char *missing, *noecho;
+  int i, nmask, z;
+
+  nmask = (nzc + 7) / 8;
+  missing = p;
+  noecho = p + nmask;
+  memset(p, '\0', 2 * nmask);
+  p += 2 * nmask;
+  for (i = 0; i < nzc; i++) {
+	if (zc[i].c == NO_ECHO_C)
+	  noecho[i >> 3] |= 1 << (i & 7);
+	else
+	  *p++ = (char) zc[i].c;
+	if (zc[i].z == MISSING_Z)
+	  missing[i >> 3] |= 1 << (i & 7);
+	else {
+	  z = floor(zc[i].z * 100.0 + 0.5);
+	  if (z > 32767) z = 32767;
+	  if (z < -32768) z = -32768;
+	  *p++ = (char) (z & 0xff);
+	  *p++ = (char) ((z >> 8) & 0xff);
+	}
+  }
+  return p;
+} /* compact_cells */
+
+/***************************************************************************/
+/*                                                                         */
+/*                           column_to_content                             */
+/*                                                                         */
+/***************************************************************************/
+int column_to_content(zc_column_t *column, int codec, char *content,
+					  char *noecho, int *noecho_len)
+{
+  /* Encode column (range, heights and all 2-tuples) into content, as
+   * stored in the first intermediate file, with codec (COLUMN_CODEC_*).
+   * content must hold column_content_max_len() bytes.
+   *
+   * Space saving trick:
+   *    A height whose cells are all NOECHO is written without its cells
+   *    (flagged by a negative 'nzc' or by the all_noecho bit).  The cells
+   *    of the first such height are put in noecho (if not NULL) and
+   *    *noecho_len is set to their length (0 when there is no such
+   *    height).  The caller stores them once per file as the NOECHO entry.
+   *
+   * Return the number of bytes used in content.
+   */
+  char *p;
+  int i, h, all_noecho, height, prev_height = 0;
+
+  p = content;
+  if (noecho_len) *noecho_len = 0;
+
+  if (codec == COLUMN_CODEC_COMPACT) {
+	PUT_VARINT(p, (int) (column->gauge_range * 1000.0));
+	PUT_VARINT(p, column->nhinfo);
+  } else {
+	SAVE_SCALED_INT(p, column->gauge_range, 1000.0);
+	SAVE_SCALED_INT(p, column->nhinfo, 1000.0);
+  }
+
+  for (h = 0; h < MAX_HEIGHT_LEVELS && h < column->nhinfo; h++) {
+	for (i = 0, all_noecho = 1; all_noecho && i < (column->hinfo[h])->nzc; i++) {
+	  if ((column->hinfo[h])->zc[i].c != NO_ECHO_C) all_noecho = 0;
+	}
+
+	if (codec == COLUMN_CODEC_COMPACT) {
+	  height = (column->hinfo[h])->height * 1000.0;
+	  PUT_VARINT(p, ZIGZAG(height - prev_height));
+	  prev_height = height;
+	  PUT_VARINT(p, (column->hinfo[h])->nzc * 2 + all_noecho);
+	  if (!all_noecho)
+		p = compact_cells((column->hinfo[h])->zc, (column->hinfo[h])->nzc, p);
+	  else if (noecho && noecho_len && *noecho_len == 0)
+		*noecho_len = compact_cells((column->hinfo[h])->zc,
+									(column->hinfo[h])->nzc, noecho) - noecho;
+	  continue;
+	}
+
+	SAVE_SCALED_INT(p, (column->hinfo[h])->height, 1000.0);
+	if (all_noecho) {  /* Set the 'nzc' to negative to flag this. */
+	  SAVE_SCALED_INT(p, -1*(column->hinfo[h])->nzc, 1000.0);
+	  if (noecho && noecho_len && *noecho_len == 0) {
+		char *p_noecho = noecho;
+		for (i = 0; i < (column->hinfo[h])->nzc; i++) {
+		  SAVE_SCALED_INT(p_noecho, (column->hinfo[h])->zc[i].c, 1000.0);
+		  SAVE_SCALED_INT(p_noecho, (column->hinfo[h])->zc[i].z, 1000.0);
+		}
+		*noecho_len = p_noecho - noecho;
+	  }
+	} else {
+	  SAVE_SCALED_INT(p, (column->hinfo[h])->nzc, 1000.0);
+	  /* Write all zc fields. */
+	  for (i = 0; i < (column->hinfo[h])->nzc; i++) {
+		SAVE_SCALED_INT(p, (column->hinfo[h])->zc[i].c, 1000.0);
+		SAVE_SCALED_INT(p, (column->hinfo[h])->zc[i].z, 1000.0);
+	  }
+	}
+  } /* for */
+  return p - content;
+} /* column_to_content */
+
+/* What is known about a database being read or written, so that its
+ * CODEC and NOECHO entries are fetched once, and the ASCII form of each
+ * distinct column content is built once.  Kept for up to DB_CACHE_LEN
+ * open databases; see forget_db_cache().  Threads reading with handles of
+ * their own (first2ascii -j) each get their own entry.  An entry is held
+ * from get_db_cache() to put_db_cache() and is not reused meanwhile.
+ */
+#define DB_CACHE_LEN 64
+
+typedef struct {
+  GDBM_FILE fp;          /* NULL: entry not in use. */
+  int       refs;        /* Callers holding the entry. */
+  int       codec;
+  int       noecho_fetched;  /* The NOECHO entry was looked up. */
+  char      *noecho;     /* The NOECHO cells (malloc'ed); NULL: none.  Not
+						  * in payloads, which may be full. */
+  payload_table_t *payloads;
+  line_buf_t text;       /* Column being decoded. */
+  time_t    last_time;   /* Time of last_date_time. */
+  char      last_date_time[2*MAX_NAME_LEN];
+} db_cache_t;
+
+static db_cache_t db_caches[DB_CACHE_LEN];
+static pthread_mutex_t db_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t db_cache_put = PTHREAD_COND_INITIALIZER;
+
+/***************************************************************************/
+/*                                                                         */
+/*                              forget_db_cache                            */
+/*                                                                         */
+/***************************************************************************/
+void forget_db_cache(GDBM_FILE fp)
+{
+  /* Drop what is remembered about fp.  Call before closing fp. */
+  int i;
+
+  if (fp == NULL) return;
+  pthread_mutex_lock(&db_cache_lock);
+  for (i = 0; i < DB_CACHE_LEN; i++)
+	if (db_caches[i].fp == fp) {
+	  payload_table_free(db_caches[i].payloads);
+	  free(db_caches[i].noecho);
+	  line_buf_free(&db_caches[i].text);
+	  memset(&db_caches[i], '\0', sizeof(db_cache_t));
+	}
+  pthread_mutex_unlock(&db_cache_lock);
+} /* forget_db_cache */
+
+/***************************************************************************/
+/*                                                                         */
+/*                               get_db_cache                              */
+/*                                                                         */
+/***************************************************************************/
+static db_cache_t *get_db_cache(GDBM_FILE fp)
+{
+  /* Return the cache entry of fp, held until put_db_cache().  When all
+   * entries are taken, the least recently added one that is not held is
+   * reused; if all are held, wait for one.
+   */
+  static int next_free = 0;
+  db_cache_t *cache = NULL;
+  datum key, content;
+  int i;
+
+  pthread_mutex_lock(&db_cache_lock);
+  while (cache == NULL) {
+	for (i = 0; i < DB_CACHE_LEN; i++)
+	  if (db_caches[i].fp == fp) {
+		db_caches[i].refs++;
+		pthread_mutex_unlock(&db_cache_lock);
+		return &db_caches[i];
+	  }
+	for (i = 0; i < DB_CACHE_LEN && cache == NULL; i++)
+	  if (db_caches[i].fp == NULL) cache = &db_caches[i];
+	for (i = 0; i < DB_CACHE_LEN && cache == NULL; i++) {
+	  if (db_caches[next_free].refs == 0) {
+		cache = &db_caches[next_free];
+		payload_table_free(cache->payloads);
+		free(cache->noecho);
+		line_buf_free(&cache->text);
+	  }
+	  next_free = (next_free + 1) % DB_CACHE_LEN;
+	}
+	if (cache == NULL)
+	  pthread_cond_wait(&db_cache_put, &db_cache_lock);
+  }
+  memset(cache, '\0', sizeof(db_cache_t));
+  cache->fp = fp;
+  cache->refs = 1;
+  cache->codec = COLUMN_CODEC_SCALED_INT;
+  cache->last_time = -1;
+  cache->payloads = payload_table_new();
+  key.dptr = COLUMN_CODEC_KEY; key.dsize = strlen(key.dptr) + 1;
+  content = gdbm_fetch(fp, key);
+  if (content.dptr) {
+	if (strcmp(content.dptr, COLUMN_CODEC_COMPACT_STR) == 0)
+	  cache->codec = COLUMN_CODEC_COMPACT;
+	free(content.dptr);
+  }
+  pthread_mutex_unlock(&db_cache_lock);
+  return cache;
+} /* get_db_cache */
+
+/***************************************************************************/
+/*                                                                         */
+/*                               put_db_cache                              */
+/*                                                                         */
+/***************************************************************************/
+static void put_db_cache(db_cache_t *cache)
+{
+  /* Release an entry returned by get_db_cache(). */
+  pthread_mutex_lock(&db_cache_lock);
+  if (--cache->refs == 0)
+	pthread_cond_broadcast(&db_cache_put);
+  pthread_mutex_unlock(&db_cache_lock);
+} /* put_db_cache */
+
+/***************************************************************************/
+/*                                                                         */
+/*                        get_column_codec_from_db                         */
+/*                                                                         */
+/***************************************************************************/
+int get_column_codec_from_db(GDBM_FILE fp)
+{
+  /* Return the codec of the columns in the database: COLUMN_CODEC_COMPACT
+   * if it has a CODEC entry saying so; COLUMN_CODEC_SCALED_INT (files
+   * written before the CODEC entry) otherwise.
+   */
+  db_cache_t *cache;
+  int codec;
+
+  cache = get_db_cache(fp);
+  codec = cache->codec;
+  put_db_cache(cache);
+  return codec;
+} /* get_column_codec_from_db */
+
+/***************************************************************************/
+/*                                                                         */
+/*                           get_noecho_from_db                            */
+/*                                                                         */
+/***************************************************************************/
+static char *get_noecho_from_db(GDBM_FILE fp)
+{
+  /* Return the NOECHO cells of the database; NULL if it has none.  They
+   * are fetched the first time only.  They stay valid while the caller
+   * holds the cache entry of fp (see construct_entry_line()).
+   */
+  db_cache_t *cache;
+  char *noecho;
+  datum key;
+
+  cache = get_db_cache(fp);
+  if (!cache->noecho_fetched) {
+	cache->noecho_fetched = 1;
+	key.dptr = "NOECHO"; key.dsize = strlen(key.dptr) + 1;
+	cache->noecho = gdbm_fetch(fp, key).dptr;
+  }
+  noecho = cache->noecho;
+  put_db_cache(cache);
+  return noecho;
+} /* get_noecho_from_db */
+
 /***************************************************************************/
 /*                                                                         */
 /*                           append_column_to_file                         */
@@ -454,14 +792,15 @@ void append_column_to_file(zc_column_t *column,
    * the database.  Gauge ID, GaugeNetworkName, Start date, and Start time
    * are stored separately.  The database stores [key, content] pairs.
    * The content is usually gauge_range, Nheights, height, n2tuple, then the 2-tuples...
+   * See column_to_content().
    */
-  int i;
   datum key, content, key_noecho, content_noecho;
-  static char b200[200], b10000[10000];
-  char *p10000; /* Pointer for current position of b10000. */
-  char *p_noecho;
-  int all_noecho;
-  int h;
+  static char b200[200];
+  static char *b_content = NULL;   /* Column content and NOECHO cells. */
+  static int b_content_len = 0;
+  char *b_noecho, *new_b;
+  int n, noecho_len, codec;
+  db_cache_t *cache;
 
   if (column == NULL || fp == NULL) return;
 
@@ -474,72 +813,38 @@ void append_column_to_file(zc_column_t *column,
 					column->stime, &key) < 0) return;
   if (verbose)
 	fprintf(stderr, "Adding entry to the DB...\n");
-  memset(b10000, '\0', 10000);
-  content.dptr = p10000 = b10000;
-  
-  SAVE_SCALED_INT(p10000, column->gauge_range, 1000.0);
-
-  SAVE_SCALED_INT(p10000, column->nhinfo, 1000.0);
-
-  for (h = 0; h < MAX_HEIGHT_LEVELS && h < column->nhinfo; h++) {
-	SAVE_SCALED_INT(p10000, (column->hinfo[h])->height, 1000.0);
-	/* Space saving trick:
-	 *    Determine if this record contains all NOECHOS.  If so,
-	 *    then point this to the NOECHO entry in the database.
-	 *    If the NOECHO entry doesn't exist, create it.
-	 */
-	for (i = 0, all_noecho = 1; all_noecho && i < (column->hinfo[h])->nzc; i++) {
-	  if ((column->hinfo[h])->zc[i].c != NO_ECHO_C) all_noecho = 0;
+  /* Grow the buffer as needed; room for the '\0' that ends each entry. */
+  n = 2 * (column_content_max_len(column) + 1);
+  if (n > b_content_len) {
+	new_b = (char *) realloc(b_content, n);
+	if (new_b == NULL) {
+	  perror("append_column_to_file");
+	  return;
 	}
-  
-	if (all_noecho) {  /* Set the 'nzc' to negative to flag this. */
-	  SAVE_SCALED_INT(p10000, -1*(column->hinfo[h])->nzc, 1000.0);
-	} else {
-	  SAVE_SCALED_INT(p10000, (column->hinfo[h])->nzc, 1000.0);
+	b_content = new_b;
+	b_content_len = n;
+  }
+  memset(b_content, '\0', b_content_len);
+  b_noecho = b_content + b_content_len / 2;
+  content.dptr = b_content;
+  codec = get_column_codec_from_db(fp);
+  n = column_to_content(column, codec, b_content, b_noecho, &noecho_len);
+
+  /* Create the NOECHO entry, unless the database already has it. */
+  if (noecho_len > 0 && get_noecho_from_db(fp) == NULL) {
+	key_noecho.dptr = "NOECHO"; key_noecho.dsize = strlen(key_noecho.dptr) + 1;
+	content_noecho.dptr = b_noecho;
+	content_noecho.dsize = noecho_len + 1;
+	if (gdbm_store(fp, key_noecho, content_noecho, GDBM_REPLACE) == 0) {
+	  cache = get_db_cache(fp);
+	  if ((cache->noecho = (char *) malloc(noecho_len + 1)) == NULL)
+		perror("append_column_to_file");
+	  else
+		memcpy(cache->noecho, b_noecho, noecho_len + 1);
+	  put_db_cache(cache);
 	}
-	if (all_noecho) { /* Determine if the database already has the NOECHO. */
-	  key_noecho.dptr = "NOECHO"; key_noecho.dsize = strlen(key_noecho.dptr) + 1;
-	  content_noecho = gdbm_fetch(fp, key_noecho);
-	  if (content_noecho.dptr == NULL) { /* Create the NOECHO entry. */
-		p_noecho = p10000; /* Save the start location in the P10000 buffer. */
-		for (i = 0; i < (column->hinfo[h])->nzc; i++) {
-		  SAVE_SCALED_INT(p10000, (column->hinfo[h])->zc[i].c, 1000.0);
-		  SAVE_SCALED_INT(p10000, (column->hinfo[h])->zc[i].z, 1000.0);
-		}
-
-		content_noecho.dptr = p_noecho;
-		content_noecho.dsize = p10000 - p_noecho + 1;
-		gdbm_store(fp, key_noecho, content_noecho, GDBM_REPLACE);
-		p10000 = p_noecho; /* For the key and content below.  
-							* We're no longer storing the NOECHO numbers,
-							* but, we need to write the key and ncz. 
-							*/
-	  } else {
-		free(content_noecho.dptr);
-	  }
-	} else { /* The record is not all NOECHO. */
-	  
-	  /*
-		n = sprintf(p10000, "%.2f", column->gauge_range);
-		p10000 += n;
-		n = sprintf(p10000, " %d", column->nzc);
-		p10000 += n;
-		*/
-	  /* Write all zc fields. */
-	  for (i = 0; i < (column->hinfo[h])->nzc; i++) {
-	  
-	  /*
-		n = sprintf(p10000, " %d %.2f %.2f", column->zc[i].c, column->zc[i].z,
-		column->zc[i].height);
-		p10000 += n;
-		*/
-	  
-		SAVE_SCALED_INT(p10000, (column->hinfo[h])->zc[i].c, 1000.0);
-		SAVE_SCALED_INT(p10000, (column->hinfo[h])->zc[i].z, 1000.0);
-	  }
-	} /* else */
-  } /* for */
-  content.dsize = p10000 - b10000 + 1;
+  }
+  content.dsize = n + 1;
   gdbm_store(fp, key, content, GDBM_REPLACE);
 } /* append_column_to_file */
 
@@ -601,58 +906,6 @@ int read_header_from_db(GDBM_FILE gf, char *header_line)
   return 1;
 } /* read_header_from_db */
 
-/**********************************************************************/
-/*                                                                    */
-/*                        get_line_prefix                             */
-/*                                                                    */
-/**********************************************************************/
-int get_line_prefix(char *key_str, ngID_list_t *ngID_list, char *line_prefix)
-{
-  /* Key_str = '2 ngID time_sec', in binary
-   * Construct line_prefix: netID gaugeID mm/dd/yyyy hh:mm
-   * We want to lookup netID gaugeID from ngID_list based on ngID from
-   * the key_str.
-   * Return 1 for successful; -1, otherwise.
-   */
-  short ngID;
-  time_t time_sec;
-  ngID_entry_t *ngID_entry = NULL;
-  ngID_list_t *tmp_ngID_list;
-  int found; 
-  char date_str[MAX_NAME_LEN];
-  char time_str[MAX_NAME_LEN];
-  int i;
-
-
-  if (key_str == NULL || line_prefix == NULL || ngID_list == NULL) return -1;
-
-  if (key_str[0] != '2') return -1;
-  /* Extract ngID  */
-  memcpy(&ngID, key_str + 2, sizeof(short));
-  /* Extract time */
-  memcpy(&time_sec, key_str + 3 + sizeof(short), sizeof(time_t));
-  time_secs2date_time_strs(time_sec, 1, 0, date_str, time_str);
-
-  /* FInd ngID entry that has ngID */
-  tmp_ngID_list = ngID_list;
-  found = 0;
-  while (tmp_ngID_list && !found) {
-	for (i = 0; i < tmp_ngID_list->nentries; i++) {
-	  if (tmp_ngID_list->ngID_array[i].ngID == ngID) {
-		ngID_entry = &(tmp_ngID_list->ngID_array[i]);
-		found = 1;
-		break;
-	  }
-	}
-	tmp_ngID_list = ngID_list->next;
-
-  }
-  if (ngID_entry == NULL) return -1;
-  sprintf(line_prefix, "%d %s %s %s", ngID_entry->gaugeID, ngID_entry->netID, date_str, time_str);
-
-  return 1;
-} /* get_line_prefix */
-
 /**********************************************************************/
 /*                                                                    */
 /*                       get_new_ngID_list                            */
@@ -682,13 +935,16 @@ int get_ngID_list_from_db(GDBM_FILE gf, ngID_list_t *ngID_list)
    */
   datum nextkey, key, content;
   ngID_entry_t *ngID_entry;
-  ngID_list_t *new_ngID_list;
+  ngID_list_t *new_ngID_list, *block;
   char *key_str;
   char netID[MAX_NAME_LEN];
   int rc = 1;
   int gaugeID;
 
   if (gf == NULL || ngID_list == NULL) return -1;
+  /* Block being filled. */
+  for (block = ngID_list; block->next; block = block->next)
+	;
   key.dptr = NULL;
   content.dptr = NULL;
   for(nextkey = gdbm_firstkey(gf); nextkey.dptr; 
@@ -702,7 +958,7 @@ int get_ngID_list_from_db(GDBM_FILE gf, ngID_list_t *ngID_list)
 	  /* Get the content (ngID) */
 	  content = gdbm_fetch(gf, nextkey);
 	  if (content.dptr != NULL) {
-		if (ngID_list->nentries >= MAX_NGID_ENTRIES) {
+		if (block->nentries >= MAX_NGID_ENTRIES) {
 		  /* Get a new block of array. */
 		  new_ngID_list = get_new_ngID_list();
 		  if (new_ngID_list == NULL) {
@@ -713,17 +969,19 @@ int get_ngID_list_from_db(GDBM_FILE gf, ngID_list_t *ngID_list)
 			rc = -1;
 			break;
 		  }
-		  /* Add new block to the beginning of list. */
-		  new_ngID_list->next = ngID_list;
-		  ngID_list = new_ngID_list;
-
+		  /* Add new block right after the first one; the caller holds
+		   * the first one.
+		   */
+		  new_ngID_list->next = ngID_list->next;
+		  ngID_list->next = new_ngID_list;
+		  block = new_ngID_list;
 		}
 
-		ngID_entry = &(ngID_list->ngID_array[ngID_list->nentries]);
+		ngID_entry = &(block->ngID_array[block->nentries]);
 		strcpy(ngID_entry->netID, netID);
 		ngID_entry->gaugeID = gaugeID;
 		if (sscanf(content.dptr, "%d", &(ngID_entry->ngID)) == 1)
-		  ngID_list->nentries++;
+		  block->nentries++;
 	  }
 	  if (content.dptr)
 		free(content.dptr);
@@ -733,22 +991,320 @@ int get_ngID_list_from_db(GDBM_FILE gf, ngID_list_t *ngID_list)
 	key = nextkey;
 	
   } /* for */
-  if (key.dptr)
+  if (rc == 1 && key.dptr)
 	free(key.dptr);
-  return 1;
+  return rc;
 		
 } /* get_ngID_list_from_db */
 
 /**********************************************************************/
 /*                                                                    */
-/*                          construct_entry_line                      */
+/*                           new_ngID_map                             */
+/*                                                                    */
+/**********************************************************************/
+ngID_map_t *new_ngID_map(ngID_list_t *ngID_list)
+{
+  /* Return the table from ngID to the line prefix ("gaugeID netID") of
+   * each gauge in ngID_list; NULL on error.
+   */
+  ngID_map_t *map;
+  ngID_entry_t *e;
+  char prefix[MAX_STR_LEN];
+  int i;
+
+  map = (ngID_map_t *) calloc(1, sizeof(ngID_map_t));
+  if (map == NULL) {
+	perror("new_ngID_map");
+	return NULL;
+  }
+  for (; ngID_list; ngID_list = ngID_list->next)
+	for (i = 0; i < ngID_list->nentries; i++) {
+	  e = &ngID_list->ngID_array[i];
+	  if (e->ngID < 0 || e->ngID >= NGID_MAP_LEN) continue;
+	  sprintf(prefix, "%d %s", e->gaugeID, e->netID);
+	  if (map->prefix[e->ngID]) free(map->prefix[e->ngID]);
+	  if ((map->prefix[e->ngID] = strdup(prefix)) == NULL) {
+		perror("new_ngID_map");
+		free_ngID_map(map);
+		return NULL;
+	  }
+	}
+  return map;
+} /* new_ngID_map */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           free_ngID_map                            */
+/*                                                                    */
+/**********************************************************************/
+void free_ngID_map(ngID_map_t *map)
+{
+  int i;
+
+  if (map == NULL) return;
+  for (i = 0; i < NGID_MAP_LEN; i++)
+	if (map->prefix[i]) free(map->prefix[i]);
+  free(map);
+} /* free_ngID_map */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           line_buf_grow                            */
+/*                                                                    */
+/**********************************************************************/
+static int line_buf_grow(line_buf_t *b, int n)
+{
+  /* Make room for n chars in b.  Return 1 for successful; -1, otherwise. */
+  char *s;
+  int size;
+
+  if (n <= b->size) return 1;
+  size = b->size > 0 ? b->size : MAX_ENTRY_LINE_LEN;
+  while (size < n) size *= 2;
+  if ((s = (char *) realloc(b->s, size)) == NULL) {
+	perror("line_buf");
+	return -1;
+  }
+  b->s = s;
+  b->size = size;
+  return 1;
+} /* line_buf_grow */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           line_buf_printf                          */
+/*                                                                    */
+/**********************************************************************/
+int line_buf_printf(line_buf_t *b, char *fmt, ...)
+{
+  /* Append, printf() style, to b.  Return the number of chars appended;
+   * -1 on error.
+   */
+  va_list ap;
+  int n;
+
+  while (1) {
+	va_start(ap, fmt);
+	n = vsnprintf(b->s ? b->s + b->len : NULL, b->size - b->len, fmt, ap);
+	va_end(ap);
+	if (n < 0) return -1;
+	if (b->len + n < b->size) break;
+	if (line_buf_grow(b, b->len + n + 1) < 0) return -1;
+  }
+  b->len += n;
+  return n;
+} /* line_buf_printf */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           line_buf_append                          */
+/*                                                                    */
+/**********************************************************************/
+int line_buf_append(line_buf_t *b, char *str, int n)
+{
+  /* Append the n chars of str to b.  Return n; -1 on error. */
+  if (line_buf_grow(b, b->len + n + 1) < 0) return -1;
+  memcpy(b->s + b->len, str, n);
+  b->len += n;
+  b->s[b->len] = '\0';
+  return n;
+} /* line_buf_append */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           line_buf_flush                           */
+/*                                                                    */
+/**********************************************************************/
+int line_buf_flush(line_buf_t *b, FILE *fp)
+{
+  /* Write b to fp and empty it.  Return 1 for successful; -1, otherwise. */
+  int rc = 1;
+
+  if (b->len > 0 && fwrite(b->s, 1, b->len, fp) != b->len) rc = -1;
+  b->len = 0;
+  if (b->s) b->s[0] = '\0';
+  return rc;
+} /* line_buf_flush */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           line_buf_free                            */
 /*                                                                    */
 /**********************************************************************/
-int construct_entry_line(GDBM_FILE gf, datum *key, ngID_list_t *ngID_list,
-						 char *entry_line)
+void line_buf_free(line_buf_t *b)
 {
-  /* Construct the first intermediate's entry line based on key.
+  if (b->s) free(b->s);
+  memset(b, '\0', sizeof(line_buf_t));
+} /* line_buf_free */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        append_compact_cells                        */
+/*                                                                    */
+/**********************************************************************/
+static char *append_compact_cells(char *p, int nzc, line_buf_t *line)
+{
+  /* Append the nzc cells encoded at p (see compact_cells()) to
+   * line.  Return the end of the cells.
+   */
+  unsigned char *missing, *noecho;
+  int i, nmask, c;
+  short z16;
+  float z;
+
+  nmask = (nzc + 7) / 8;
+  missing = (unsigned char *) p;
+  noecho = (unsigned char *) p + nmask;
+  p += 2 * nmask;
+  for (i = 0; i < nzc; i++) {
+	if (noecho[i >> 3] & (1 << (i & 7)))
+	  c = NO_ECHO_C;
+	else
+	  c = (signed char) *p++;
+	if (missing[i >> 3] & (1 << (i & 7)))
+	  z = MISSING_Z;
+	else {
+	  z16 = (short) ((unsigned char) p[0] | ((unsigned char) p[1] << 8));
+	  p += 2;
+	  z = z16 / 100.0;
+	}
+	line_buf_printf(line, " %d %.2f", c, z);
+  }
+  return p;
+} /* append_compact_cells */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        content_to_entry_line                       */
+/*                                                                    */
+/**********************************************************************/
+int content_to_entry_line(char *content, int codec, GDBM_FILE gf,
+						  char *noecho, line_buf_t *line)
+{
+  /* Append the data part of a first intermediate entry line, decoded from
+   * content (see column_to_content()), to line:
+   *    r N H1 n C1 Z1 ... CN ZN ... HN n C1 Z1 ... CN ZN
+   * The cells of NOECHO heights come from noecho; if it is NULL, from the
+   * NOECHO entry of gf (when not NULL), fetched once per database.
+   * Return 1 for successful; -1, otherwise.
+   */
+  char *p, *save_p;
+  int c, ncz, i, nhinfo, h;
+  float z, height, range;
+  int q_noecho;
+  unsigned int u;
+  int height_m = 0;
+
+  if (content == NULL || line == NULL) return -1;
+  p = content;
+  if (codec == COLUMN_CODEC_COMPACT) {
+	GET_VARINT(p, u);
+	range = (int) u / 1000.0;
+	GET_VARINT(p, u);
+	nhinfo = u;
+  } else {
+	GET_UNSCALED_X(p, range, 1000.0);
+	GET_UNSCALED_X(p, nhinfo, 1000.0);
+  }
+  line_buf_printf(line, " %.2f %d", range, nhinfo);
+
+  for (h = 0; h < nhinfo; h++) {
+	save_p = NULL;
+	if (codec == COLUMN_CODEC_COMPACT) {
+	  GET_VARINT(p, u);
+	  height_m += UNZIGZAG(u);
+	  height = height_m / 1000.0;
+	  GET_VARINT(p, u);
+	  ncz = u >> 1;
+	  q_noecho = u & 1;
+	} else {
+	  GET_UNSCALED_X(p, height, 1000.0);
+	  GET_UNSCALED_X(p, ncz, 1000.0);
+	  q_noecho = 0;
+	  if (ncz < 0) { /* Use the NOECHO entry for the record. */
+		q_noecho = 1;
+		ncz *= -1;
+	  }
+	}
+	line_buf_printf(line, " %.2f %d", height, ncz);
+
+	if (q_noecho) {
+	  save_p = p;
+	  p = noecho;
+	  if (p == NULL && gf != NULL) p = get_noecho_from_db(gf);
+	  if (p == NULL) {
+		fprintf(stderr, "content_to_entry_line: No NOECHO cells.\n");
+		return -1;
+	  }
+	}
+
+	if (p && codec == COLUMN_CODEC_COMPACT)
+	  p = append_compact_cells(p, ncz, line);
+	else {
+	  for (i=0; i<ncz && p; i++) {
+		GET_UNSCALED_X(p, c, 1000.0);
+		GET_UNSCALED_X(p, z, 1000.0);
+		line_buf_printf(line, " %d %.2f", c, z);
+	  }
+	}
+	if (save_p != NULL)
+	  p = save_p;
+  } /* for */
+
+  return 1;
+} /* content_to_entry_line */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        column_to_entry_line                        */
+/*                                                                    */
+/**********************************************************************/
+int column_to_entry_line(zc_column_t *column, char *net_name,
+						 line_buf_t *content, line_buf_t *noecho,
+						 line_buf_t *line)
+{
+  /* Append the first intermediate's entry line for column (no newline)
+   * to line, as construct_entry_line() gives it after the column has been
+   * stored in a new database.  content is scratch space.  noecho holds the
+   * NOECHO cells: the first column with a NOECHO height sets them (when
+   * noecho->len is 0) and they are used for the NOECHO heights of all
+   * columns, as with the NOECHO entry of the database.
    * Return 1 for successful; -1, otherwise.
+   */
+  int n, noecho_len;
+  time_t time_sec;
+  char date_str[MAX_NAME_LEN];
+  char time_str[MAX_NAME_LEN];
+
+  if (column == NULL || net_name == NULL || content == NULL ||
+	  noecho == NULL || line == NULL) return -1;
+
+  n = column_content_max_len(column);
+  if (line_buf_grow(content, n) < 0 || line_buf_grow(noecho, n) < 0)
+	return -1;
+  column_to_content(column, COLUMN_CODEC_COMPACT, content->s,
+					noecho->len == 0 ? noecho->s : NULL, &noecho_len);
+  if (noecho->len == 0) noecho->len = noecho_len;
+
+  date_time2system_time(&column->sdate, &column->stime, &time_sec);
+  time_secs2date_time_strs(time_sec, 1, 0, date_str, time_str);
+  line_buf_printf(line, "%d %s %s %s ", (short) atoi(column->gauge_id),
+				  net_name, date_str, time_str);
+  return content_to_entry_line(content->s, COLUMN_CODEC_COMPACT, NULL,
+							   noecho->len > 0 ? noecho->s : NULL, line);
+} /* column_to_entry_line */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          construct_entry_line                      */
+/*                                                                    */
+/**********************************************************************/
+int construct_entry_line(GDBM_FILE gf, datum *key, ngID_map_t *ngID_map,
+						 line_buf_t *line)
+{
+  /* Append the first intermediate's entry line for key (no newline) to
+   * line.
+   * Return 1 for successful; -1, otherwise (key isn't a table 2 key).
    * Note: Code was cut from first2ascii.c. 
    *  entry_line's format:
    *    GaugeID GaugeNetworkName mm/dd/yyyy hh:mm r N H1 C1 Z1 ... CN ZN ...
@@ -770,81 +1326,67 @@ int construct_entry_line(GDBM_FILE gf, datum *key, ngID_list_t *ngID_list,
    *          H n C Z will be repeated for N-1 times.
    *
    */
-  char *p=NULL, *save_p = NULL, *save_content=NULL, *save_content_noecho = NULL;
-  datum content, key_noecho, content_noecho;
-  char tmp_s[MAX_NAME_LEN];
-  int tmp_i;
-  char line_prefix[MAX_STR_LEN];
-  int c, ncz, i;
-  float z, height, range;
-  int q_noecho;
-  char *content_str=NULL;
-  char *key_str;
-  int nhinfo, h;
-
-  if (gf == NULL || key == NULL || key->dptr == NULL ||
-	  entry_line == NULL) return -1;
-  key_str = key->dptr;
-
-
-  if (strcmp("HEADER", key_str) == 0 ||
-		strcmp("START TIME", key_str) == 0 ||
-		strcmp("NOECHO", key_str) == 0 ||
-		strcmp("END TIME", key_str) == 0 ||
-		/* 1 netID gaugeID **/
-		sscanf(key_str, "1 %s %d", tmp_s, &tmp_i) == 2) return -1;
-	memset(line_prefix, '\0', MAX_STR_LEN);
-	/* key_str = '2 ngID time' in binary */
-	if (get_line_prefix(key_str, ngID_list, line_prefix) < 0 || strlen(line_prefix) == 0) {
-	  return -1;
-	}
-
-	sprintf(entry_line, "%s ", line_prefix);
-	content = gdbm_fetch(gf, *key);
-	if (content.dptr) {
-	  content_str = content.dptr;
-	  p = content_str;
-	  save_p = NULL;
-	  save_content = p;
-	  GET_UNSCALED_X(p, range, 1000.0);
-	  sprintf(entry_line, "%s %.2f", entry_line, range);
-	  GET_UNSCALED_X(p, nhinfo, 1000.0);
-
-	  sprintf(entry_line, "%s %d", entry_line, nhinfo);
-	  for (h = 0; h < nhinfo; h++) {
-		save_content_noecho = NULL;
-		GET_UNSCALED_X(p, height, 1000.0);
-		sprintf(entry_line, "%s %.2f", entry_line, height);
-		GET_UNSCALED_X(p, ncz, 1000.0);
-
-		q_noecho = 0;
-		if (ncz < 0) { /* Use the NOECHO entry for the record. */
-		  q_noecho = 1;
-		  ncz *= -1;
-		}
-
-		sprintf(entry_line, "%s %d", entry_line, ncz);
-		if (q_noecho) {
-		  key_noecho.dptr = "NOECHO"; key_noecho.dsize = strlen(key_noecho.dptr) + 1;
-		  content_noecho = gdbm_fetch(gf, key_noecho);
-		  save_p = p;
-		  p = content_noecho.dptr;
-		  save_content_noecho = p;
-		}
-
-		for (i=0; i<ncz && p; i++) {
-		  GET_UNSCALED_X(p, c, 1000.0);
-		  GET_UNSCALED_X(p, z, 1000.0);
-		  sprintf(entry_line, "%s %d %.2f", entry_line, c, z);
-		}
-		if (save_content_noecho) free(save_content_noecho);
-		if (save_p != NULL)
-		  p = save_p;
-	  } /* for */
+  static pthread_mutex_t time_lock = PTHREAD_MUTEX_INITIALIZER;
+  datum content;
+  db_cache_t *cache;
+  payload_t *column;
+  short ngID;
+  time_t time_sec;
+  char date_str[MAX_NAME_LEN];
+  char time_str[MAX_NAME_LEN];
+  int line_len;
+
+  if (gf == NULL || key == NULL || key->dptr == NULL || ngID_map == NULL ||
+	  line == NULL) return -1;
+
+  /* key = '2 ngID time' in binary; all other keys are skipped. */
+  if (key->dptr[0] != '2' || key->dsize < 5 + sizeof(time_t)) return -1;
+  memcpy(&ngID, key->dptr + 2, sizeof(short));
+  memcpy(&time_sec, key->dptr + 5, sizeof(time_t));
+  if (ngID < 0 || ngID_map->prefix[ngID] == NULL) return -1;
+  cache = get_db_cache(gf);
+  if (time_sec != cache->last_time) {
+	/* gv_utils time conversions may use static storage. */
+	pthread_mutex_lock(&time_lock);
+	time_secs2date_time_strs(time_sec, 1, 0, date_str, time_str);
+	pthread_mutex_unlock(&time_lock);
+	sprintf(cache->last_date_time, "%s %s", date_str, time_str);
+	cache->last_time = time_sec;
+  }
+  line_len = line->len;
+  line_buf_printf(line, "%s %s ", ngID_map->prefix[ngID],
+				  cache->last_date_time);
 
-	  if (save_content) free(save_content);
+  content = gdbm_fetch(gf, *key);
+  if (content.dptr) {
+	/* Columns with the same content (e.g., a gauge under clear sky for
+	 * hours) are decoded once.
+	 */
+	column = payload_table_get(cache->payloads,
+				   payload_table_find(cache->payloads, content.dptr, content.dsize));
+	if (column == NULL || column->text == NULL) {
+	  cache->text.len = 0;
+	  line_buf_append(&cache->text, "", 0);
+	  if (content_to_entry_line(content.dptr, cache->codec, gf, NULL,
+								&cache->text) < 0) {
+		free(content.dptr);
+		line->len = line_len;  /* Drop the partial line. */
+		line->s[line_len] = '\0';
+		put_db_cache(cache);
+		return -1;
+	  }
+	  column = payload_table_get(cache->payloads,
+				 payload_table_add(cache->payloads, content.dptr, content.dsize,
+								   cache->text.s));
 	}
-	return 1;
+	if (column && column->text)
+	  line_buf_append(line, column->text, strlen(column->text));
+	else
+	  line_buf_append(line, cache->text.s, cache->text.len);
+	free(content.dptr);
+  }
+  put_db_cache(cache);
+  return 1;
 } /* construct_entry_line */
 
 
@@ -870,7 +1412,7 @@ void print_ngID_list(ngID_list_t *ngID_list)
 	  ngID_entry = &(tmp_ngID_list->ngID_array[i]);
 	  fprintf(stderr, "gauge ID: %4.4d netID: %s ngID: %d\n", ngID_entry->gaugeID, ngID_entry->netID, ngID_entry->ngID);
 	}
-	tmp_ngID_list = ngID_list->next;
+	tmp_ngID_list = tmp_ngID_list->next;
 
   }
 
@@ -0,0 +1,204 @@
+/*
+ * payload_table.c
+ *     In-memory content addressed table of byte strings.  See
+ *     payload_table.h.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "payload_table.h"
+
+/**********************************************************************/
+/*                                                                    */
+/*                           payload_hash                             */
+/*                                                                    */
+/**********************************************************************/
+static unsigned int payload_hash(char *data, int len)
+{
+  /* FNV-1a. */
+  unsigned int h = 2166136261u;
+  int i;
+
+  for (i = 0; i < len; i++) {
+	h ^= (unsigned char) data[i];
+	h *= 16777619u;
+  }
+  return h;
+} /* payload_hash */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            find_slot                               */
+/*                                                                    */
+/**********************************************************************/
+static int find_slot(payload_table_t *t, char *data, int len, unsigned int h)
+{
+  /* Return the slot holding data, or the empty slot where it goes. */
+  int slot, mask, id;
+  payload_t *p;
+
+  mask = t->nslots - 1;
+  for (slot = h & mask; (id = t->slots[slot]) >= 0; slot = (slot + 1) & mask) {
+	p = &t->payloads[id];
+	if (p->hash == h && p->len == len && memcmp(p->data, data, len) == 0)
+	  break;
+  }
+  return slot;
+} /* find_slot */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            grow_table                              */
+/*                                                                    */
+/**********************************************************************/
+static int grow_table(payload_table_t *t)
+{
+  /* Make room for one more payload, keeping the slots at most half full.
+   * Return 1 for successful; -1, otherwise.
+   */
+  int i, id, new_nslots, *new_slots;
+  payload_t *new_payloads;
+
+  if (t->npayloads + 1 > t->payloads_len) {
+	i = t->payloads_len > 0 ? 2 * t->payloads_len : 64;
+	new_payloads = (payload_t *) realloc(t->payloads, i * sizeof(payload_t));
+	if (new_payloads == NULL) {
+	  perror("payload_table");
+	  return -1;
+	}
+	t->payloads = new_payloads;
+	t->payloads_len = i;
+  }
+  if (2 * (t->npayloads + 1) <= t->nslots) return 1;
+
+  new_nslots = t->nslots > 0 ? 2 * t->nslots : 256;
+  new_slots = (int *) malloc(new_nslots * sizeof(int));
+  if (new_slots == NULL) {
+	perror("payload_table");
+	return -1;
+  }
+  free(t->slots);
+  t->slots = new_slots;
+  t->nslots = new_nslots;
+  for (i = 0; i < new_nslots; i++) t->slots[i] = -1;
+  for (id = 0; id < t->npayloads; id++)
+	t->slots[find_slot(t, t->payloads[id].data, t->payloads[id].len,
+					   t->payloads[id].hash)] = id;
+  return 1;
+} /* grow_table */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         payload_table_new                          */
+/*                                                                    */
+/**********************************************************************/
+payload_table_t *payload_table_new(void)
+{
+  payload_table_t *t;
+
+  t = (payload_table_t *) calloc(1, sizeof(payload_table_t));
+  if (t == NULL) {
+	perror("payload_table_new");
+	return NULL;
+  }
+  if (grow_table(t) < 0) {
+	payload_table_free(t);
+	return NULL;
+  }
+  return t;
+} /* payload_table_new */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         payload_table_find                         */
+/*                                                                    */
+/**********************************************************************/
+int payload_table_find(payload_table_t *t, char *data, int len)
+{
+  if (t == NULL || data == NULL || len < 0) return -1;
+  return t->slots[find_slot(t, data, len, payload_hash(data, len))];
+} /* payload_table_find */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         payload_table_add                          */
+/*                                                                    */
+/**********************************************************************/
+int payload_table_add(payload_table_t *t, char *data, int len, char *text)
+{
+  unsigned int h;
+  int slot, id, text_len;
+  payload_t *p;
+
+  if (t == NULL || data == NULL || len < 0) return -1;
+  h = payload_hash(data, len);
+  text_len = text ? strlen(text) + 1 : 0;
+
+  if ((id = t->slots[find_slot(t, data, len, h)]) >= 0) {
+	p = &t->payloads[id];
+	if (text && p->text == NULL &&
+		t->nbytes + text_len <= PAYLOAD_TABLE_MAX_BYTES &&
+		(p->text = (char *) malloc(text_len)) != NULL) {
+	  strcpy(p->text, text);
+	  t->nbytes += text_len;
+	}
+	return id;
+  }
+
+  if (t->nbytes + len + text_len > PAYLOAD_TABLE_MAX_BYTES) return -1;
+  if (grow_table(t) < 0) return -1;
+  p = &t->payloads[t->npayloads];
+  p->hash = h;
+  p->len = len;
+  p->data = (char *) malloc(len + text_len + 1);
+  if (p->data == NULL) {
+	perror("payload_table_add");
+	return -1;
+  }
+  memcpy(p->data, data, len);
+  p->text = NULL;
+  if (text) {
+	p->text = p->data + len;
+	strcpy(p->text, text);
+  }
+  t->nbytes += len + text_len;
+  slot = find_slot(t, data, len, h);
+  t->slots[slot] = t->npayloads;
+  return t->npayloads++;
+} /* payload_table_add */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         payload_table_get                          */
+/*                                                                    */
+/**********************************************************************/
+payload_t *payload_table_get(payload_table_t *t, int id)
+{
+  if (t == NULL || id < 0 || id >= t->npayloads) return NULL;
+  return &t->payloads[id];
+} /* payload_table_get */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         payload_table_free                         */
+/*                                                                    */
+/**********************************************************************/
+void payload_table_free(payload_table_t *t)
+{
+  int id;
+  payload_t *p;
+
+  if (t == NULL) return;
+  for (id = 0; id < t->npayloads; id++) {
+	p = &t->payloads[id];
+	/* A text added with its payload shares the payload's storage. */
+	if (p->text && p->text != p->data + p->len) free(p->text);
+	free(p->data);
+  }
+  if (t->payloads) free(t->payloads);
+  if (t->slots) free(t->slots);
+  free(t);
+} /* payload_table_free */
@@ -0,0 +1,47 @@
+/*
+ * payload_table.h
+ *     In-memory content addressed table of byte strings (payloads).
+ *
+ *     Each distinct payload is kept once and referred to by its id, the
+ *     order in which it was added (0, 1, ...).  A payload may carry a text,
+ *     e.g., its ASCII form, so that repeated payloads are decoded once.
+ *
+ *     The table stops taking new payloads once it holds
+ *     PAYLOAD_TABLE_MAX_BYTES; payloads already in it are still found.
+ */
+
+#ifndef __PAYLOAD_TABLE_H__
+#define __PAYLOAD_TABLE_H__ 1
+
+#define PAYLOAD_TABLE_MAX_BYTES (8*1024*1024)
+
+typedef struct {
+  unsigned int hash;
+  int    len;
+  char   *data;
+  char   *text;          /* NULL: none. */
+} payload_t;
+
+typedef struct {
+  payload_t *payloads;
+  int    npayloads, payloads_len;
+  int    *slots;         /* Open addressing table of ids; -1: empty. */
+  int    nslots;
+  long   nbytes;         /* Bytes of data and text held. */
+} payload_table_t;
+
+payload_table_t *payload_table_new(void);
+
+/* payload_table_find: Return the id of data[0..len-1]; -1 if not there. */
+int payload_table_find(payload_table_t *t, char *data, int len);
+
+/* payload_table_add: Add data[0..len-1] with text (may be NULL), unless it
+ * is there already.  A text given for a payload without one is kept.
+ * Return the id of the payload; -1 if the table is full or on error.
+ */
+int payload_table_add(payload_table_t *t, char *data, int len, char *text);
+
+payload_t *payload_table_get(payload_table_t *t, int id);
+void payload_table_free(payload_table_t *t);
+
+#endif
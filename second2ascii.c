@@ -0,0 +1,62 @@
+/*
+ * second2ascii
+ *     Convert the binary second ZR intermediate file (see second_bin.h) to
+ *     the ASCII second intermediate file.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "second_bin.h"
+
+/**********************************************************************/
+/*                                                                    */
+/*                               usage                                */
+/*                                                                    */
+/**********************************************************************/
+void usage(char *prog)
+{
+  fprintf(stderr, "Usage (%s): Convert the binary second ZR intermediate file\n"
+		  "\t to ASCII.\n", PROG_VERSION);
+  fprintf(stderr, "\t %s binary_file [ascii_file]\n", prog);
+  fprintf(stderr, "\t where:\n"
+		  "\t  ascii_file  Default: stdout.\n");
+  exit(-1);
+} /* usage */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             main                                   */
+/*                                                                    */
+/**********************************************************************/
+int main (int ac, char **av)
+{
+  char *infile, *outfile = NULL;
+  second_bin_t *sb;
+  FILE *fp = stdout;
+  int rc = 0;
+
+  if (ac == 2 || ac == 3) {
+	infile = av[1];
+	if (ac == 3) outfile = av[2];
+  }
+  else usage(av[0]);
+
+  if ((sb = second_bin_open_read(infile)) == NULL) exit(-1);
+  if (outfile && (fp = fopen(outfile, "w")) == NULL) {
+	perror(outfile);
+	second_bin_close(sb);
+	exit(-1);
+  }
+  if (second_bin_write_ascii(sb, fp) < 0) {
+	perror(outfile ? outfile : "stdout");
+	rc = -1;
+  }
+  if (fclose(fp) != 0) {
+	perror(outfile ? outfile : "stdout");
+	rc = -1;
+  }
+  second_bin_close(sb);
+  exit(rc);
+}
@@ -0,0 +1,1154 @@
+/*
+ * second_bin.c
+ *     Binary columnar format for the second ZR intermediate file.
+ *     See second_bin.h.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "second_bin.h"
+#include "zr.h"
+
+#define ALIGN(n)      (((n) + 7) & ~((size_t) 7))
+#define MAX_DIGITS    18      /* Of a number's mantissa. */
+#define MAX_DECIMALS  9
+#define NUM_TEXT_LEN  32
+
+static long pow10_tab[MAX_DECIMALS + 1] = {
+  1L, 10L, 100L, 1000L, 10000L, 100000L, 1000000L, 10000000L, 100000000L,
+  1000000000L
+};
+
+/**********************************************************************/
+/*                                                                    */
+/*                            grow_array                              */
+/*                                                                    */
+/**********************************************************************/
+static int grow_array(void **p, int n, int elsize)
+{
+  /* Reallocate *p for n elements.  Return 1 for successful; -1, otherwise. */
+  void *new_p;
+
+  if ((new_p = realloc(*p, (size_t) (n > 0 ? n : 1) * elsize)) == NULL) {
+	perror("second_bin");
+	return -1;
+  }
+  *p = new_p;
+  return 1;
+} /* grow_array */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           days_from_civil                          */
+/*                                                                    */
+/**********************************************************************/
+static long days_from_civil(int y, int m, int d)
+{
+  /* Days since 01/01/1970 of the (proleptic Gregorian) date. */
+  long era, yoe, doy, doe;
+
+  y -= m <= 2;
+  era = (y >= 0 ? y : y - 399) / 400;
+  yoe = y - era * 400;
+  doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+} /* days_from_civil */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           civil_from_days                          */
+/*                                                                    */
+/**********************************************************************/
+static void civil_from_days(long z, int *y, int *m, int *d)
+{
+  long era, doe, yoe, doy, mp;
+
+  z += 719468;
+  era = (z >= 0 ? z : z - 146096) / 146097;
+  doe = z - era * 146097;
+  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  mp = (5 * doy + 2) / 153;
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp + (mp < 10 ? 3 : -9);
+  *y = yoe + era * 400 + (*m <= 2);
+} /* civil_from_days */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            parse_fixed                             */
+/*                                                                    */
+/**********************************************************************/
+static int parse_fixed(char *tok, int len, long *m, int *dec)
+{
+  /* Parse the token as [-]digits[.digits] into mantissa and decimals.
+   * Return 1 for successful; -1, otherwise.
+   */
+  char *end = tok + len;
+  int neg = 0, ndigits = 0;
+  long v = 0;
+
+  *dec = -1;
+  if (tok < end && *tok == '-') {
+	neg = 1;
+	tok++;
+  }
+  if (tok >= end || *tok < '0' || *tok > '9') return -1;
+  for (; tok < end; tok++) {
+	if (*tok == '.' && *dec < 0) {
+	  *dec = 0;
+	  continue;
+	}
+	if (*tok < '0' || *tok > '9' || ++ndigits > MAX_DIGITS) return -1;
+	v = v * 10 + (*tok - '0');
+	if (*dec >= 0) (*dec)++;
+  }
+  if (*dec == 0 || *dec > MAX_DECIMALS) return -1;   /* "1." */
+  if (*dec < 0) *dec = 0;
+  *m = neg ? -v : v;
+  return 1;
+} /* parse_fixed */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             put_fixed                              */
+/*                                                                    */
+/**********************************************************************/
+static char *put_fixed(char *p, long m, int dec)
+{
+  /* Write m / 10^dec with dec decimals (0 to MAX_DECIMALS) at p, as
+   * printf's "%.<dec>f" does: at most NUM_TEXT_LEN chars, '\0' ended.
+   * Return the end of the text.
+   */
+  if (dec < 0) dec = 0;
+  if (dec > MAX_DECIMALS) dec = MAX_DECIMALS;
+  if (m < 0) {
+	*p++ = '-';
+	m = -m;
+  }
+  p += sprintf(p, "%ld", m / pow10_tab[dec]);
+  if (dec > 0)
+	p += sprintf(p, ".%0*ld", dec, m % pow10_tab[dec]);
+  return p;
+} /* put_fixed */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           fixed_to_float                           */
+/*                                                                    */
+/**********************************************************************/
+static float fixed_to_float(long m, int dec)
+{
+  /* The float that sscanf's "%f" reads from the text of m / 10^dec.
+   * With m and 10^dec exact in a float, the division is correctly rounded
+   * as strtof() is.
+   */
+  char buf[NUM_TEXT_LEN];
+  float num, den;
+
+  if (m > -(1L << 24) && m < (1L << 24)) {
+	num = (float) m;
+	den = (float) pow10_tab[dec];
+	return num / den;
+  }
+  *put_fixed(buf, m, dec) = '\0';
+  return strtof(buf, NULL);
+} /* fixed_to_float */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            next_token                              */
+/*                                                                    */
+/**********************************************************************/
+static char *next_token(char **p, char *end, int *len)
+{
+  char *tok;
+
+  while (*p < end && (**p == ' ' || **p == '\t' || **p == '\r')) (*p)++;
+  if (*p >= end) return NULL;
+  tok = *p;
+  while (*p < end && **p != ' ' && **p != '\t' && **p != '\r') (*p)++;
+  *len = *p - tok;
+  return tok;
+} /* next_token */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            add_number                              */
+/*                                                                    */
+/**********************************************************************/
+static int add_number(second_bin_fields_t *f, int k, char *tok, int len,
+					  int want_int)
+{
+  /* Parse the token into number k of f.  With want_int, it must be an
+   * int.  Return 1 for successful; -1, otherwise.
+   */
+  if (k >= f->num_len) {
+	f->num_len = f->num_len > 0 ? 2 * f->num_len : 1024;
+	if (grow_array((void **) &f->num, f->num_len, sizeof(long)) < 0 ||
+		grow_array((void **) &f->dec, f->num_len, sizeof(int)) < 0 ||
+		grow_array((void **) &f->tok, f->num_len, sizeof(char *)) < 0 ||
+		grow_array((void **) &f->tok_len, f->num_len, sizeof(int)) < 0)
+	  return -1;
+  }
+  if (tok == NULL || parse_fixed(tok, len, &f->num[k], &f->dec[k]) < 0)
+	return -1;
+  if (want_int && (f->dec[k] != 0 || f->num[k] < INT_MIN || f->num[k] > INT_MAX))
+	return -1;
+  f->tok[k] = tok;
+  f->tok_len[k] = len;
+  return 1;
+} /* add_number */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           parse_digits                             */
+/*                                                                    */
+/**********************************************************************/
+static int parse_digits(char *tok, int n, int *v)
+{
+  /* Set *v to the number of the n digits at tok.  (Not sscanf(): the line
+   * need not be '\0' ended, and sscanf() would scan to the end of the file
+   * in memory.)  Return 1 for successful; -1, otherwise.
+   */
+  for (*v = 0; n > 0; n--, tok++) {
+	if (*tok < '0' || *tok > '9') return -1;
+	*v = *v * 10 + (*tok - '0');
+  }
+  return 1;
+} /* parse_digits */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           parse_fields                             */
+/*                                                                    */
+/**********************************************************************/
+static int parse_fields(second_bin_fields_t *f, char *line, int len)
+{
+  /* Split the entry line into fields:
+   *   ID Net mm/dd/yyyy hh:mm r NH H1 NC C1 Z1 ... H2 NC C1 Z1 ... NR R1 ...
+   * f->num holds r, NH, then H, NC, C, Z, ... of each height, NR and the
+   * rates, in this order.
+   * Return 1 for successful; -1 if line is not an entry line.
+   */
+  char *p = line, *end = line + len, *tok;
+  int tok_len, k, h, c, n;
+
+  if ((f->id = next_token(&p, end, &f->id_len)) == NULL ||
+	  f->id_len >= SECOND_BIN_NAME_LEN || f->id[0] == COMMENT_CHAR ||
+	  (f->net = next_token(&p, end, &f->net_len)) == NULL ||
+	  f->net_len >= SECOND_BIN_NAME_LEN)
+	return -1;
+  if ((tok = next_token(&p, end, &tok_len)) == NULL || tok_len != 10 ||
+	  tok[2] != '/' || tok[5] != '/' || parse_digits(tok, 2, &f->mon) < 0 ||
+	  parse_digits(tok + 3, 2, &f->day) < 0 ||
+	  parse_digits(tok + 6, 4, &f->year) < 0 ||
+	  (tok = next_token(&p, end, &tok_len)) == NULL || tok_len != 5 ||
+	  tok[2] != ':' || parse_digits(tok, 2, &f->hour) < 0 ||
+	  parse_digits(tok + 3, 2, &f->min) < 0)
+	return -1;
+  tok = next_token(&p, end, &tok_len);
+  if (add_number(f, 0, tok, tok_len, 0) < 0) return -1;
+  tok = next_token(&p, end, &tok_len);
+  if (add_number(f, 1, tok, tok_len, 1) < 0 || f->num[1] < 0) return -1;
+  f->range = f->num[0];
+  f->range_dec = f->dec[0];
+  f->nheights = f->num[1];
+  f->ncells = 0;
+  k = 2;
+  for (h = 0; h < f->nheights; h++) {
+	tok = next_token(&p, end, &tok_len);
+	if (add_number(f, k++, tok, tok_len, 0) < 0) return -1;
+	tok = next_token(&p, end, &tok_len);
+	if (add_number(f, k, tok, tok_len, 1) < 0 || (n = f->num[k++]) < 0)
+	  return -1;
+	for (c = 0; c < n; c++) {
+	  tok = next_token(&p, end, &tok_len);
+	  if (add_number(f, k++, tok, tok_len, 1) < 0) return -1;
+	  tok = next_token(&p, end, &tok_len);
+	  if (add_number(f, k++, tok, tok_len, 0) < 0) return -1;
+	}
+	f->ncells += n;
+  }
+  tok = next_token(&p, end, &tok_len);
+  if (add_number(f, k, tok, tok_len, 1) < 0 || (n = f->num[k++]) < 0)
+	return -1;
+  f->nrates = n;
+  for (c = 0; c < n; c++) {
+	tok = next_token(&p, end, &tok_len);
+	if (add_number(f, k++, tok, tok_len, 0) < 0) return -1;
+  }
+  if (next_token(&p, end, &tok_len) != NULL) return -1;  /* More fields. */
+  return 1;
+} /* parse_fields */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           format_entry                             */
+/*                                                                    */
+/**********************************************************************/
+static int format_entry(second_bin_t *sb, int row, int h0, int c0, int r0)
+{
+  /* Write the entry in row, whose heights, cells and rates start at h0, c0
+   * and r0 of their columns, to sb->line as in the ASCII file.
+   * Return its length; -1 on error.
+   */
+  second_bin_gauge_t *g = &sb->gauges[sb->gauge[row]];
+  int nh = sb->row_nheights[row], nr = sb->row_nrates[row];
+  int h, c, nc, size, y, mon, d;
+  long days, secs;
+  char *p;
+
+  for (h = h0, nc = 0; h < h0 + nh; h++) nc += sb->height_ncells[h];
+  size = 2 * SECOND_BIN_NAME_LEN + 64 + (nh + 2*nc + nr + 1) * NUM_TEXT_LEN;
+  if (size > sb->line_size) {
+	if (grow_array((void **) &sb->line, size, 1) < 0) return -1;
+	sb->line_size = size;
+  }
+  days = sb->time[row] / 86400;
+  secs = sb->time[row] - days * 86400;
+  if (secs < 0) {
+	secs += 86400;
+	days--;
+  }
+  civil_from_days(days, &y, &mon, &d);
+  p = sb->line;
+  p += sprintf(p, "%s %s %02d/%02d/%04d %02d:%02d  ", g->id, g->net, mon, d, y,
+			   (int) (secs / 3600), (int) (secs % 3600 / 60));
+  p = put_fixed(p, sb->range[row], 2);
+  p += sprintf(p, " %d", nh);
+  for (h = h0; h < h0 + nh; h++) {
+	*p++ = ' ';
+	p = put_fixed(p, sb->height[h], 2);
+	p += sprintf(p, " %d", sb->height_ncells[h]);
+	for (nc = sb->height_ncells[h]; nc > 0; nc--, c0++) {
+	  p += sprintf(p, " %d ", sb->rtype[c0]);
+	  p = put_fixed(p, sb->z[c0], 2);
+	}
+  }
+  p += sprintf(p, " %d ", nr);
+  for (c = r0; c < r0 + nr; c++) {
+	p = put_fixed(p, sb->rate[c], sb->rate_dec[c]);
+	*p++ = ' ';
+  }
+  *p = '\0';
+  return p - sb->line;
+} /* format_entry */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             gauge_hash                             */
+/*                                                                    */
+/**********************************************************************/
+static unsigned int gauge_hash(char *id, int id_len, char *net, int net_len)
+{
+  /* FNV-1a of "id net". */
+  unsigned int h = 2166136261u;
+  int i;
+
+  for (i = 0; i < id_len; i++) h = (h ^ (unsigned char) id[i]) * 16777619u;
+  h = (h ^ ' ') * 16777619u;
+  for (i = 0; i < net_len; i++) h = (h ^ (unsigned char) net[i]) * 16777619u;
+  return h;
+} /* gauge_hash */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             find_gauge                             */
+/*                                                                    */
+/**********************************************************************/
+static int find_gauge(second_bin_t *sb, char *id, int id_len, char *net,
+					  int net_len)
+{
+  /* Return the index of gauge (id, net) in the gauge table, added if it is
+   * new; -1 on error.
+   */
+  second_bin_gauge_t *g;
+  int i, slot, mask, new_len;
+  int *new_hash;
+
+  if (2 * (sb->ngauges + 1) > sb->hash_len) {
+	new_len = sb->hash_len > 0 ? 2 * sb->hash_len : 256;
+	if ((new_hash = (int *) malloc(new_len * sizeof(int))) == NULL) {
+	  perror("second_bin");
+	  return -1;
+	}
+	for (i = 0; i < new_len; i++) new_hash[i] = -1;
+	for (i = 0; i < sb->ngauges; i++) {
+	  g = &sb->gauges[i];
+	  slot = gauge_hash(g->id, strlen(g->id), g->net, strlen(g->net)) &
+		(new_len - 1);
+	  while (new_hash[slot] >= 0) slot = (slot + 1) & (new_len - 1);
+	  new_hash[slot] = i;
+	}
+	free(sb->hash);
+	sb->hash = new_hash;
+	sb->hash_len = new_len;
+  }
+  mask = sb->hash_len - 1;
+  for (slot = gauge_hash(id, id_len, net, net_len) & mask;
+	   (i = sb->hash[slot]) >= 0; slot = (slot + 1) & mask) {
+	g = &sb->gauges[i];
+	if (strncmp(g->id, id, id_len) == 0 && g->id[id_len] == '\0' &&
+		strncmp(g->net, net, net_len) == 0 && g->net[net_len] == '\0')
+	  return i;
+  }
+  if (sb->ngauges >= sb->gauges_len) {
+	sb->gauges_len = sb->gauges_len > 0 ? 2 * sb->gauges_len : 64;
+	if (grow_array((void **) &sb->gauges, sb->gauges_len,
+				   sizeof(second_bin_gauge_t)) < 0)
+	  return -1;
+  }
+  i = sb->ngauges++;
+  g = &sb->gauges[i];
+  memset(g, '\0', sizeof(second_bin_gauge_t));
+  memcpy(g->id, id, id_len);
+  memcpy(g->net, net, net_len);
+  sb->hash[slot] = i;
+  return i;
+} /* find_gauge */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          second_bin_create                         */
+/*                                                                    */
+/**********************************************************************/
+second_bin_t *second_bin_create(char *fname)
+{
+  second_bin_t *sb;
+
+  if (fname == NULL) return NULL;
+  if ((sb = (second_bin_t *) calloc(1, sizeof(second_bin_t))) == NULL ||
+	  (sb->fname = strdup(fname)) == NULL) {
+	perror("second_bin_create");
+	free(sb);
+	return NULL;
+  }
+  sb->writing = 1;
+  return sb;
+} /* second_bin_create */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        second_bin_add_header                       */
+/*                                                                    */
+/**********************************************************************/
+int second_bin_add_header(second_bin_t *sb, char *text, int len)
+{
+  if (sb == NULL || !sb->writing || text == NULL) return -1;
+  if (sb->header_len + len + 1 > sb->header_size) {
+	sb->header_size = 2 * (sb->header_len + len + 1);
+	if (grow_array((void **) &sb->header, sb->header_size, 1) < 0)
+	  return -1;
+  }
+  memcpy(sb->header + sb->header_len, text, len);
+  sb->header_len += len;
+  sb->header[sb->header_len] = '\0';
+  return 1;
+} /* second_bin_add_header */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          columns_hold                              */
+/*                                                                    */
+/**********************************************************************/
+static int columns_hold(second_bin_fields_t *f)
+{
+  /* Return 1 if the columns can hold the fields of the entry; 0, if it
+   * must be kept as text.
+   */
+  int k = 2, h, c, n;
+
+  if (f->range_dec != 2 || f->range < INT_MIN || f->range > INT_MAX ||
+	  f->nheights > SHRT_MAX || f->year < 1 || f->mon < 1 || f->mon > 12 ||
+	  f->day < 1 || f->day > 31 || f->hour > 23 || f->min > 59)
+	return 0;
+  for (h = 0; h < f->nheights; h++) {
+	if (f->dec[k] != 2 || f->num[k] < SHRT_MIN || f->num[k] > SHRT_MAX ||
+		(n = f->num[k+1]) > SHRT_MAX)
+	  return 0;
+	for (c = 0, k += 2; c < n; c++, k += 2)
+	  if (f->num[k] < SCHAR_MIN || f->num[k] > SCHAR_MAX || f->dec[k+1] != 2 ||
+		  f->num[k+1] < SHRT_MIN || f->num[k+1] > SHRT_MAX)
+		return 0;
+  }
+  if (f->nrates > SHRT_MAX) return 0;
+  for (c = 0, k++; c < f->nrates; c++, k++)
+	if (f->num[k] < INT_MIN || f->num[k] > INT_MAX) return 0;
+  return 1;
+} /* columns_hold */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         second_bin_add_line                        */
+/*                                                                    */
+/**********************************************************************/
+int second_bin_add_line(second_bin_t *sb, char *line, int len)
+{
+  /* Add the line (not '\0' ended, without '\n') after the header.
+   * Return 1 for successful; -1, otherwise.
+   */
+  second_bin_fields_t *f;
+  int row, parsed, k, h, c, n, h0, c0, r0, out_len;
+
+  if (sb == NULL || !sb->writing || line == NULL) return -1;
+  f = &sb->fields;
+  row = sb->nrows;
+  if (row >= sb->rows_size) {
+	sb->rows_size = sb->rows_size > 0 ? 2 * sb->rows_size : 4096;
+	if (grow_array((void **) &sb->gauge, sb->rows_size, sizeof(int)) < 0 ||
+		grow_array((void **) &sb->time, sb->rows_size, sizeof(long long)) < 0 ||
+		grow_array((void **) &sb->range, sb->rows_size, sizeof(int)) < 0 ||
+		grow_array((void **) &sb->row_nheights, sb->rows_size, sizeof(short)) < 0 ||
+		grow_array((void **) &sb->row_nrates, sb->rows_size, sizeof(short)) < 0)
+	  return -1;
+  }
+  sb->gauge[row] = -1;
+  sb->time[row] = 0;
+  sb->range[row] = 0;
+  sb->row_nheights[row] = -1;
+  sb->row_nrates[row] = 0;
+  sb->nrows++;
+
+  parsed = parse_fields(f, line, len) > 0;
+  if (parsed) {
+	if ((sb->gauge[row] = find_gauge(sb, f->id, f->id_len, f->net,
+									 f->net_len)) < 0)
+	  return -1;
+	sb->time[row] = days_from_civil(f->year, f->mon, f->day) * 86400LL +
+	  f->hour * 3600 + f->min * 60;
+  }
+  if (parsed && columns_hold(f)) {
+	/* Make room. */
+	if (sb->nheights + f->nheights > sb->heights_size) {
+	  sb->heights_size = 2 * (sb->nheights + f->nheights) + 1024;
+	  if (grow_array((void **) &sb->height, sb->heights_size, sizeof(short)) < 0 ||
+		  grow_array((void **) &sb->height_ncells, sb->heights_size, sizeof(short)) < 0)
+		return -1;
+	}
+	if (sb->ncells + f->ncells > sb->cells_size) {
+	  sb->cells_size = 2 * (sb->ncells + f->ncells) + 1024;
+	  if (grow_array((void **) &sb->rtype, sb->cells_size, 1) < 0 ||
+		  grow_array((void **) &sb->z, sb->cells_size, sizeof(short)) < 0)
+		return -1;
+	}
+	if (sb->nrates + f->nrates > sb->rates_size) {
+	  sb->rates_size = 2 * (sb->nrates + f->nrates) + 1024;
+	  if (grow_array((void **) &sb->rate, sb->rates_size, sizeof(int)) < 0 ||
+		  grow_array((void **) &sb->rate_dec, sb->rates_size, 1) < 0)
+		return -1;
+	}
+	h0 = sb->nheights;
+	c0 = sb->ncells;
+	r0 = sb->nrates;
+	sb->range[row] = f->range;
+	sb->row_nheights[row] = f->nheights;
+	sb->row_nrates[row] = f->nrates;
+	k = 2;
+	for (h = 0; h < f->nheights; h++) {
+	  sb->height[sb->nheights] = f->num[k++];
+	  n = sb->height_ncells[sb->nheights++] = f->num[k++];
+	  for (c = 0; c < n; c++, sb->ncells++) {
+		sb->rtype[sb->ncells] = f->num[k++];
+		sb->z[sb->ncells] = f->num[k++];
+	  }
+	}
+	for (c = 0, k++; c < f->nrates; c++, k++, sb->nrates++) {
+	  sb->rate[sb->nrates] = f->num[k];
+	  sb->rate_dec[sb->nrates] = f->dec[k];
+	}
+	/* Keep it as text unless the columns give back the same line. */
+	out_len = format_entry(sb, row, h0, c0, r0);
+	if (out_len == len && memcmp(sb->line, line, len) == 0)
+	  return 1;
+	sb->nheights = h0;
+	sb->ncells = c0;
+	sb->nrates = r0;
+	sb->range[row] = 0;
+	sb->row_nheights[row] = -1;
+	sb->row_nrates[row] = 0;
+  }
+
+  /* As text. */
+  if (sb->raw_len + len + 1 > sb->raw_size) {
+	sb->raw_size = 2 * (sb->raw_len + len + 1);
+	if (grow_array((void **) &sb->raw, sb->raw_size, 1) < 0)
+	  return -1;
+  }
+  memcpy(sb->raw + sb->raw_len, line, len);
+  sb->raw_len += len;
+  sb->raw[sb->raw_len++] = '\0';
+  return 1;
+} /* second_bin_add_line */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             read_line                              */
+/*                                                                    */
+/**********************************************************************/
+static int read_line(FILE *fp, char **buf, int *size)
+{
+  /* Read a line of any length from fp into *buf.
+   * Return its length, with the '\n'; 0 at the end of file; -1 on error.
+   */
+  int len = 0;
+
+  for (;;) {
+	if (*size - len < 2) {
+	  *size = *size > 0 ? 2 * *size : 4096;
+	  if (grow_array((void **) buf, *size, 1) < 0) return -1;
+	}
+	if (fgets(*buf + len, *size - len, fp) == NULL) break;
+	len += strlen(*buf + len);
+	if ((*buf)[len-1] == '\n') break;
+  }
+  return ferror(fp) ? -1 : len;
+} /* read_line */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        second_bin_add_ascii                        */
+/*                                                                    */
+/**********************************************************************/
+int second_bin_add_ascii(second_bin_t *sb, FILE *fp)
+{
+  char *buf = NULL;
+  int size = 0, len, in_header = 1, rc = 1;
+
+  if (sb == NULL || fp == NULL) return -1;
+  while ((len = read_line(fp, &buf, &size)) > 0) {
+	if (in_header) {
+	  if (second_bin_add_header(sb, buf, len) < 0) rc = -1;
+	  if (strstr(buf, TABLE_START_STR) != NULL) in_header = 0;
+	}
+	else {
+	  if (buf[len-1] == '\n') len--;
+	  if (second_bin_add_line(sb, buf, len) < 0) rc = -1;
+	}
+	if (rc < 0) break;
+  }
+  if (len < 0) {
+	perror("second_bin_add_ascii");
+	rc = -1;
+  }
+  else if (rc > 0 && in_header) {
+	fprintf(stderr, "second_bin_add_ascii: '%s' not found.\n", TABLE_START_STR);
+	rc = -1;
+  }
+  free(buf);
+  return rc;
+} /* second_bin_add_ascii */
+
+/**********************************************************************/
+/*                                                                    */
+/*                                put                                 */
+/*                                                                    */
+/**********************************************************************/
+static int put(FILE *fp, void *p, size_t n)
+{
+  /* Write n bytes, padded to a multiple of 8.
+   * Return 1 for successful; -1, otherwise.
+   */
+  static char zeros[8];
+
+  if ((n > 0 && fwrite(p, 1, n, fp) != n) ||
+	  fwrite(zeros, 1, ALIGN(n) - n, fp) != ALIGN(n) - n)
+	return -1;
+  return 1;
+} /* put */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           write_file                               */
+/*                                                                    */
+/**********************************************************************/
+static int write_file(second_bin_t *sb)
+{
+  /* Write the writer's file.  Return 1 for successful; -1, otherwise. */
+  FILE *fp;
+  int counts[5];
+  int *start = NULL, *rows = NULL;
+  int i, g, rc = 1;
+
+  /* Per-gauge index: rows of each gauge, in file order. */
+  if ((start = (int *) calloc(sb->ngauges + 2, sizeof(int))) == NULL ||
+	  (rows = (int *) malloc((sb->nrows + 1) * sizeof(int))) == NULL) {
+	perror("second_bin");
+	free(start);
+	return -1;
+  }
+  for (i = 0; i < sb->nrows; i++)
+	if (sb->gauge[i] >= 0) start[sb->gauge[i] + 2]++;
+  for (g = 0; g < sb->ngauges; g++) start[g + 2] += start[g + 1];
+  for (i = 0; i < sb->nrows; i++)
+	if (sb->gauge[i] >= 0) rows[start[sb->gauge[i] + 1]++] = i;
+  /* Now start[g] is where gauge g starts. */
+
+  if ((fp = fopen(sb->fname, "w")) == NULL) {
+	perror(sb->fname);
+	free(start);
+	free(rows);
+	return -1;
+  }
+  counts[0] = sb->nrows;
+  counts[1] = sb->nheights;
+  counts[2] = sb->ncells;
+  counts[3] = sb->nrates;
+  counts[4] = sb->raw_len;
+  if (put(fp, SECOND_BIN_MAGIC, SECOND_BIN_MAGIC_LEN) < 0 ||
+	  put(fp, &sb->header_len, sizeof(int)) < 0 ||
+	  put(fp, sb->header, sb->header_len) < 0 ||
+	  put(fp, &sb->ngauges, sizeof(int)) < 0 ||
+	  put(fp, sb->gauges, sb->ngauges * sizeof(second_bin_gauge_t)) < 0 ||
+	  put(fp, counts, sizeof(counts)) < 0 ||
+	  put(fp, sb->gauge, sb->nrows * sizeof(int)) < 0 ||
+	  put(fp, sb->time, sb->nrows * sizeof(long long)) < 0 ||
+	  put(fp, sb->range, sb->nrows * sizeof(int)) < 0 ||
+	  put(fp, sb->row_nheights, sb->nrows * sizeof(short)) < 0 ||
+	  put(fp, sb->row_nrates, sb->nrows * sizeof(short)) < 0 ||
+	  put(fp, sb->height, sb->nheights * sizeof(short)) < 0 ||
+	  put(fp, sb->height_ncells, sb->nheights * sizeof(short)) < 0 ||
+	  put(fp, sb->rtype, sb->ncells) < 0 ||
+	  put(fp, sb->z, sb->ncells * sizeof(short)) < 0 ||
+	  put(fp, sb->rate, sb->nrates * sizeof(int)) < 0 ||
+	  put(fp, sb->rate_dec, sb->nrates) < 0 ||
+	  put(fp, sb->raw, sb->raw_len) < 0 ||
+	  put(fp, start, (sb->ngauges + 1) * sizeof(int)) < 0 ||
+	  put(fp, rows, sb->nrows * sizeof(int)) < 0 ||
+	  put(fp, SECOND_BIN_END_MAGIC, SECOND_BIN_MAGIC_LEN) < 0) {
+	perror(sb->fname);
+	rc = -1;
+  }
+  if (fclose(fp) != 0) {
+	perror(sb->fname);
+	rc = -1;
+  }
+  free(start);
+  free(rows);
+  return rc;
+} /* write_file */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       second_bin_is_bin_file                       */
+/*                                                                    */
+/**********************************************************************/
+int second_bin_is_bin_file(char *fname)
+{
+  /* Return 1 if fname starts with SECOND_BIN_MAGIC; 0, otherwise. */
+  FILE *fp;
+  char magic[SECOND_BIN_MAGIC_LEN];
+  int rc = 0;
+
+  if (fname == NULL || (fp = fopen(fname, "r")) == NULL) return 0;
+  if (fread(magic, 1, SECOND_BIN_MAGIC_LEN, fp) == SECOND_BIN_MAGIC_LEN &&
+	  memcmp(magic, SECOND_BIN_MAGIC, SECOND_BIN_MAGIC_LEN) == 0)
+	rc = 1;
+  fclose(fp);
+  return rc;
+} /* second_bin_is_bin_file */
+
+/**********************************************************************/
+/*                                                                    */
+/*                                take                                */
+/*                                                                    */
+/**********************************************************************/
+static void *take(second_bin_t *sb, size_t *pos, size_t n)
+{
+  /* Return the next n bytes of the file; NULL if it is too short. */
+  void *p;
+
+  if (n > sb->file->size || *pos > sb->file->size - n) return NULL;
+  p = sb->file->data + *pos;
+  *pos += ALIGN(n);
+  if (*pos > sb->file->size) *pos = sb->file->size;
+  return p;
+} /* take */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           valid_decimals                           */
+/*                                                                    */
+/**********************************************************************/
+static int valid_decimals(signed char *dec, int n)
+{
+  /* Return 1 if the n decimals dec are 0 to MAX_DECIMALS; 0, otherwise. */
+  int i;
+
+  for (i = 0; i < n; i++)
+	if (dec[i] < 0 || dec[i] > MAX_DECIMALS) return 0;
+  return 1;
+} /* valid_decimals */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         second_bin_open_read                       */
+/*                                                                    */
+/**********************************************************************/
+second_bin_t *second_bin_open_read(char *fname)
+{
+  /* Return NULL upon failure. */
+  second_bin_t *sb;
+  size_t pos = 0;
+  int *counts, *p;
+  char *magic, *raw;
+  int i, h, ok;
+
+  if ((sb = (second_bin_t *) calloc(1, sizeof(second_bin_t))) == NULL) {
+	perror("second_bin_open_read");
+	return NULL;
+  }
+  if ((sb->file = line_reader_open(fname)) == NULL) {
+	free(sb);
+	return NULL;
+  }
+  ok = (magic = (char *) take(sb, &pos, SECOND_BIN_MAGIC_LEN)) != NULL &&
+	memcmp(magic, SECOND_BIN_MAGIC, SECOND_BIN_MAGIC_LEN) == 0 &&
+	(p = (int *) take(sb, &pos, sizeof(int))) != NULL && *p >= 0 &&
+	(sb->header_len = *p,
+	 (sb->header = (char *) take(sb, &pos, sb->header_len)) != NULL) &&
+	(p = (int *) take(sb, &pos, sizeof(int))) != NULL && *p >= 0 &&
+	(sb->ngauges = *p,
+	 (sb->gauges = (second_bin_gauge_t *)
+	  take(sb, &pos, sb->ngauges * sizeof(second_bin_gauge_t))) != NULL) &&
+	(counts = (int *) take(sb, &pos, 5 * sizeof(int))) != NULL &&
+	counts[0] >= 0 && counts[1] >= 0 && counts[2] >= 0 && counts[3] >= 0 &&
+	counts[4] >= 0;
+  if (ok) {
+	sb->nrows = counts[0];
+	sb->nheights = counts[1];
+	sb->ncells = counts[2];
+	sb->nrates = counts[3];
+	sb->raw_len = counts[4];
+	ok = (sb->gauge = (int *) take(sb, &pos, sb->nrows * sizeof(int))) &&
+	  (sb->time = (long long *) take(sb, &pos, sb->nrows * sizeof(long long))) &&
+	  (sb->range = (int *) take(sb, &pos, sb->nrows * sizeof(int))) &&
+	  (sb->row_nheights = (short *) take(sb, &pos, sb->nrows * sizeof(short))) &&
+	  (sb->row_nrates = (short *) take(sb, &pos, sb->nrows * sizeof(short))) &&
+	  (sb->height = (short *) take(sb, &pos, sb->nheights * sizeof(short))) &&
+	  (sb->height_ncells = (short *) take(sb, &pos, sb->nheights * sizeof(short))) &&
+	  (sb->rtype = (signed char *) take(sb, &pos, sb->ncells)) &&
+	  (sb->z = (short *) take(sb, &pos, sb->ncells * sizeof(short))) &&
+	  (sb->rate = (int *) take(sb, &pos, sb->nrates * sizeof(int))) &&
+	  (sb->rate_dec = (signed char *) take(sb, &pos, sb->nrates)) &&
+	  valid_decimals(sb->rate_dec, sb->nrates) &&
+	  (sb->raw = (char *) take(sb, &pos, sb->raw_len)) &&
+	  (sb->gauge_start = (int *) take(sb, &pos, (sb->ngauges + 1) * sizeof(int))) &&
+	  (sb->gauge_rows = (int *) take(sb, &pos, sb->nrows * sizeof(int))) &&
+	  (magic = (char *) take(sb, &pos, SECOND_BIN_MAGIC_LEN)) != NULL &&
+	  memcmp(magic, SECOND_BIN_END_MAGIC, SECOND_BIN_MAGIC_LEN) == 0;
+  }
+  /* Where each row starts in the other columns. */
+  if (ok &&
+	  ((sb->row_height = (int *) malloc((sb->nrows + 1) * sizeof(int))) == NULL ||
+	   (sb->row_cell = (int *) malloc((sb->nrows + 1) * sizeof(int))) == NULL ||
+	   (sb->row_rate = (int *) malloc((sb->nrows + 1) * sizeof(int))) == NULL ||
+	   (sb->row_raw = (int *) malloc((sb->nrows + 1) * sizeof(int))) == NULL)) {
+	perror("second_bin_open_read");
+	second_bin_close(sb);
+	return NULL;
+  }
+  if (ok) {
+	sb->row_height[0] = sb->row_cell[0] = sb->row_rate[0] = sb->row_raw[0] = 0;
+	raw = sb->raw;
+	for (i = 0; i < sb->nrows && ok; i++) {
+	  sb->row_height[i+1] = sb->row_height[i];
+	  sb->row_cell[i+1] = sb->row_cell[i];
+	  sb->row_rate[i+1] = sb->row_rate[i] + sb->row_nrates[i];
+	  sb->row_raw[i+1] = sb->row_raw[i];
+	  if (sb->row_nheights[i] < 0) {
+		raw = (char *) memchr(sb->raw + sb->row_raw[i], '\0',
+							  sb->raw_len - sb->row_raw[i]);
+		if (raw == NULL) ok = 0;
+		else sb->row_raw[i+1] = raw - sb->raw + 1;
+		continue;
+	  }
+	  if (sb->gauge[i] < 0 || sb->gauge[i] >= sb->ngauges ||
+		  sb->row_height[i] + sb->row_nheights[i] > sb->nheights) {
+		ok = 0;
+		continue;
+	  }
+	  for (h = sb->row_height[i]; h < sb->row_height[i] + sb->row_nheights[i]; h++)
+		sb->row_cell[i+1] += sb->height_ncells[h];
+	  sb->row_height[i+1] += sb->row_nheights[i];
+	}
+	for (i = 0; i < sb->ngauges && ok; i++)
+	  ok = sb->gauge_start[i] <= sb->gauge_start[i+1];
+	ok = ok && sb->gauge_start[0] == 0 &&
+	  sb->gauge_start[sb->ngauges] <= sb->nrows &&
+	  sb->row_height[sb->nrows] == sb->nheights &&
+	  sb->row_cell[sb->nrows] == sb->ncells &&
+	  sb->row_rate[sb->nrows] == sb->nrates &&
+	  sb->row_raw[sb->nrows] == sb->raw_len;
+  }
+  if (!ok) {
+	fprintf(stderr, "%s: Not a binary second intermediate file, or damaged.\n",
+			fname);
+	second_bin_close(sb);
+	return NULL;
+  }
+  return sb;
+} /* second_bin_open_read */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        second_bin_header                           */
+/*                                                                    */
+/**********************************************************************/
+char *second_bin_header(second_bin_t *sb, int *len)
+{
+  if (sb == NULL) return NULL;
+  if (len) *len = sb->header_len;
+  return sb->header;
+} /* second_bin_header */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       second_bin_get_gauge                         */
+/*                                                                    */
+/**********************************************************************/
+second_bin_gauge_t *second_bin_get_gauge(second_bin_t *sb, int g)
+{
+  if (sb == NULL || g < 0 || g >= sb->ngauges) return NULL;
+  return &sb->gauges[g];
+} /* second_bin_get_gauge */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       second_bin_gauge_rows                        */
+/*                                                                    */
+/**********************************************************************/
+int *second_bin_gauge_rows(second_bin_t *sb, int g, int *nrows)
+{
+  /* Return the rows of gauge g, in file order, and their number. */
+  if (sb == NULL || sb->writing || g < 0 || g >= sb->ngauges) return NULL;
+  *nrows = sb->gauge_start[g+1] - sb->gauge_start[g];
+  return sb->gauge_rows + sb->gauge_start[g];
+} /* second_bin_gauge_rows */
+
+/**********************************************************************/
+/*                                                                    */
+/*                            size_rec                                */
+/*                                                                    */
+/**********************************************************************/
+static int size_rec(second_bin_rec_t *rec, int nheights, int ncells,
+					int nrates)
+{
+  if (nheights > rec->height_len) {
+	rec->height_len = 2 * nheights;
+	if (grow_array((void **) &rec->height, rec->height_len, sizeof(float)) < 0 ||
+		grow_array((void **) &rec->ncells, rec->height_len, sizeof(int)) < 0)
+	  return -1;
+  }
+  if (ncells > rec->cell_len) {
+	rec->cell_len = 2 * ncells;
+	if (grow_array((void **) &rec->rtype, rec->cell_len, sizeof(int)) < 0 ||
+		grow_array((void **) &rec->z, rec->cell_len, sizeof(float)) < 0)
+	  return -1;
+  }
+  if (nrates > rec->rate_len) {
+	rec->rate_len = 2 * nrates;
+	if (grow_array((void **) &rec->rate, rec->rate_len, sizeof(float)) < 0)
+	  return -1;
+  }
+  rec->nheights = nheights;
+  rec->nrates = nrates;
+  return 1;
+} /* size_rec */
+
+/**********************************************************************/
+/*                                                                    */
+/*                           fields_to_rec                            */
+/*                                                                    */
+/**********************************************************************/
+static int fields_to_rec(second_bin_fields_t *f, second_bin_rec_t *rec)
+{
+  /* Set the values of rec from the fields of an entry line.
+   * Return 1 for successful; -1, otherwise.
+   */
+  int h, c, n, k;
+
+  if (size_rec(rec, f->nheights, f->ncells, f->nrates) < 0) return -1;
+  rec->range = fixed_to_float(f->range, f->range_dec);
+  k = 2;
+  for (h = 0, c = 0; h < f->nheights; h++) {
+	rec->height[h] = fixed_to_float(f->num[k], f->dec[k]);
+	n = rec->ncells[h] = f->num[k+1];
+	for (k += 2; n > 0; n--, c++, k += 2) {
+	  rec->rtype[c] = f->num[k];
+	  rec->z[c] = fixed_to_float(f->num[k+1], f->dec[k+1]);
+	}
+  }
+  for (c = 0, k++; c < f->nrates; c++, k++)
+	rec->rate[c] = fixed_to_float(f->num[k], f->dec[k]);
+  return 1;
+} /* fields_to_rec */
+
+/**********************************************************************/
+/*                                                                    */
+/*                         second_bin_get_rec                         */
+/*                                                                    */
+/**********************************************************************/
+int second_bin_get_rec(second_bin_t *sb, int row, second_bin_rec_t *rec)
+{
+  second_bin_fields_t *f;
+  char *raw;
+  int h, c, i, j;
+
+  if (sb == NULL || sb->writing || rec == NULL || row < 0 || row >= sb->nrows)
+	return -1;
+  rec->gauge = sb->gauge[row];
+  rec->time_sec = (time_t) sb->time[row];
+  if (sb->row_nheights[row] >= 0) {
+	if (size_rec(rec, sb->row_nheights[row],
+				 sb->row_cell[row+1] - sb->row_cell[row],
+				 sb->row_nrates[row]) < 0)
+	  return -1;
+	rec->range = fixed_to_float(sb->range[row], 2);
+	for (h = 0, j = sb->row_height[row], i = sb->row_cell[row];
+		 h < rec->nheights; h++, j++) {
+	  rec->height[h] = fixed_to_float(sb->height[j], 2);
+	  rec->ncells[h] = sb->height_ncells[j];
+	}
+	for (c = 0; i < sb->row_cell[row+1]; c++, i++) {
+	  rec->rtype[c] = sb->rtype[i];
+	  rec->z[c] = fixed_to_float(sb->z[i], 2);
+	}
+	for (c = 0, i = sb->row_rate[row]; c < rec->nrates; c++, i++)
+	  rec->rate[c] = fixed_to_float(sb->rate[i], sb->rate_dec[i]);
+	return 1;
+  }
+
+  /* Kept as text. */
+  raw = sb->raw + sb->row_raw[row];
+  f = &rec->fields;
+  if (rec->gauge < 0 || parse_fields(f, raw, strlen(raw)) < 0)
+	return 0;
+  return fields_to_rec(f, rec);
+} /* second_bin_get_rec */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       second_bin_parse_line                        */
+/*                                                                    */
+/**********************************************************************/
+int second_bin_parse_line(char *line, int len, second_bin_rec_t *rec)
+{
+  if (rec == NULL) return -1;
+  rec->gauge = -1;
+  rec->time_sec = 0;
+  if (parse_fields(&rec->fields, line, len) < 0) return 0;
+  rec->time_sec = days_from_civil(rec->fields.year, rec->fields.mon,
+								  rec->fields.day) * 86400 +
+	rec->fields.hour * 3600 + rec->fields.min * 60;
+  return fields_to_rec(&rec->fields, rec);
+} /* second_bin_parse_line */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        second_bin_free_rec                         */
+/*                                                                    */
+/**********************************************************************/
+void second_bin_free_rec(second_bin_rec_t *rec)
+{
+  if (rec == NULL) return;
+  free(rec->height);
+  free(rec->ncells);
+  free(rec->rtype);
+  free(rec->z);
+  free(rec->rate);
+  free(rec->fields.num);
+  free(rec->fields.dec);
+  free(rec->fields.tok);
+  free(rec->fields.tok_len);
+  memset(rec, '\0', sizeof(second_bin_rec_t));
+} /* second_bin_free_rec */
+
+/**********************************************************************/
+/*                                                                    */
+/*                        second_bin_write_row                        */
+/*                                                                    */
+/**********************************************************************/
+int second_bin_write_row(second_bin_t *sb, int row, FILE *fp)
+{
+  int len;
+
+  if (sb == NULL || sb->writing || row < 0 || row >= sb->nrows) return -1;
+  if (sb->row_nheights[row] < 0)
+	return fprintf(fp, "%s\n", sb->raw + sb->row_raw[row]) < 0 ? -1 : 1;
+  if ((len = format_entry(sb, row, sb->row_height[row], sb->row_cell[row],
+						  sb->row_rate[row])) < 0)
+	return -1;
+  sb->line[len] = '\n';
+  return fwrite(sb->line, 1, len + 1, fp) == (size_t) len + 1 ? 1 : -1;
+} /* second_bin_write_row */
+
+/**********************************************************************/
+/*                                                                    */
+/*                       second_bin_write_ascii                       */
+/*                                                                    */
+/**********************************************************************/
+int second_bin_write_ascii(second_bin_t *sb, FILE *fp)
+{
+  int row;
+
+  if (sb == NULL || fp == NULL) return -1;
+  if (fwrite(sb->header, 1, sb->header_len, fp) != (size_t) sb->header_len)
+	return -1;
+  for (row = 0; row < sb->nrows; row++)
+	if (second_bin_write_row(sb, row, fp) < 0) return -1;
+  return 1;
+} /* second_bin_write_ascii */
+
+/**********************************************************************/
+/*                                                                    */
+/*                          second_bin_close                          */
+/*                                                                    */
+/**********************************************************************/
+int second_bin_close(second_bin_t *sb)
+{
+  second_bin_fields_t *f;
+  int rc = 1;
+
+  if (sb == NULL) return -1;
+  if (sb->writing) {
+	rc = write_file(sb);
+	free(sb->fname);
+	free(sb->header);
+	free(sb->gauges);
+	free(sb->gauge);
+	free(sb->time);
+	free(sb->range);
+	free(sb->row_nheights);
+	free(sb->row_nrates);
+	free(sb->height);
+	free(sb->height_ncells);
+	free(sb->rtype);
+	free(sb->z);
+	free(sb->rate);
+	free(sb->rate_dec);
+	free(sb->raw);
+  }
+  else {
+	free(sb->row_height);
+	free(sb->row_cell);
+	free(sb->row_rate);
+	free(sb->row_raw);
+	line_reader_close(sb->file);
+  }
+  free(sb->hash);
+  f = &sb->fields;
+  free(f->num);
+  free(f->dec);
+  free(f->tok);
+  free(f->tok_len);
+  free(sb->line);
+  free(sb);
+  return rc;
+} /* second_bin_close */
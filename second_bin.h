@@ -0,0 +1,178 @@
+/*
+ * second_bin.h
+ *     Binary columnar format for the second ZR intermediate file.
+ *
+ *     The ASCII second intermediate file is re-parsed, number by number, by
+ *     every program that reads it.  The binary format keeps each field of
+ *     the entry lines in a column of fixed size numbers, so a reader gets
+ *     the values of an entry without parsing text, and the entries of a
+ *     gauge from the per-gauge index.
+ *
+ *     The format holds exactly what the ASCII file does: second2ascii
+ *     gives back the ASCII file byte for byte.  An entry line that the
+ *     columns would not reproduce exactly (e.g., a rate written as "-0.00")
+ *     is kept as text, and still parsed for readers.
+ *
+ *     File layout (each item starts at a multiple of 8 bytes; zero
+ *     padding in between):
+ *         SECOND_BIN_MAGIC
+ *         int  header_len;     header text (every line up to and including
+ *                              the 'Table begins:' line)
+ *         int  ngauges;        ngauges x second_bin_gauge_t
+ *         int  nrows, nheights, ncells, nrates, raw_len
+ *         Row columns, nrows each:
+ *           int    gauge       Index in the gauge table; -1: not an entry
+ *                              (e.g., a comment line).
+ *           long long time     VOS time, as UTC seconds since 1970.
+ *           int    range       Gauge range, in 1/100 km.
+ *           short  nheights    -1: the row is kept as text.
+ *           short  nrates
+ *         Height columns, nheights each:   short height (1/100 km),
+ *                                          short ncells.
+ *         Cell columns, ncells each:       signed char rain type,
+ *                                          short Z (1/100 dBZ).
+ *         Rate columns, nrates each:       int rate, signed char decimals
+ *                                          (rate = rate / 10^decimals).
+ *         char raw[raw_len]    Text rows, each '\0' ended.
+ *         int  gauge_start[ngauges+1], gauge_rows[nrows]
+ *                              Rows of gauge g, in file order:
+ *                              gauge_rows[gauge_start[g]..gauge_start[g+1]-1].
+ *         SECOND_BIN_END_MAGIC
+ *
+ *     Numbers are in the byte order of the writing host, as in the GDBM
+ *     format.
+ */
+
+#ifndef __SECOND_BIN_H__
+#define __SECOND_BIN_H__ 1
+
+#include <stdio.h>
+#include <time.h>
+#include "line_reader.h"
+
+#define SECOND_BIN_MAGIC     "ZR2BIN01"
+#define SECOND_BIN_END_MAGIC "ZR2BEND1"
+#define SECOND_BIN_MAGIC_LEN 8
+#define SECOND_BIN_NAME_LEN  51     /* MAX_NAME_LEN of gauge_db.h. */
+#define SECOND_BIN_SCALE     100    /* Range, heights and Z are in 1/100. */
+
+typedef struct {
+  char   id[SECOND_BIN_NAME_LEN];
+  char   net[SECOND_BIN_NAME_LEN];
+} second_bin_gauge_t;
+
+/* An entry line split in fields (internal). */
+typedef struct {
+  char   *id, *net;
+  int    id_len, net_len;
+  int    mon, day, year, hour, min;
+  long   range;
+  int    range_dec;
+  int    nheights, ncells, nrates;
+  long   *num;           /* Heights, cells, rates: mantissa ... */
+  int    *dec;           /* ... and decimals. */
+  char   **tok;          /* ... and text. */
+  int    *tok_len;
+  int    num_len;
+} second_bin_fields_t;
+
+/* An entry, for readers.  The arrays belong to the record and are reused
+ * by the next second_bin_get_rec() into it.  Threads may read the rows of
+ * one second_bin_t at the same time, each into its own record.
+ */
+typedef struct {
+  int    gauge;          /* Index in the gauge table. */
+  time_t time_sec;
+  float  range;
+  int    nheights;
+  float  *height;        /* [nheights] */
+  int    *ncells;        /* [nheights] */
+  int    *rtype;         /* Cells of all heights, in order. */
+  float  *z;
+  int    nrates;
+  float  *rate;
+  int    height_len, cell_len, rate_len;  /* Allocated. */
+  second_bin_fields_t fields;             /* Scratch: rows kept as text. */
+} second_bin_rec_t;
+
+typedef struct {
+  int    writing;
+  char   *fname;
+  char   *header;
+  int    header_len, header_size;
+  second_bin_gauge_t *gauges;
+  int    ngauges, gauges_len;
+  int    *hash;          /* Writer: open addressing table of gauges. */
+  int    hash_len;
+  /* Columns: writer, malloc'ed; reader, in the file's memory. */
+  int    nrows, nheights, ncells, nrates, raw_len;
+  int    rows_size, heights_size, cells_size, rates_size, raw_size;
+  int    *gauge;
+  long long *time;
+  int    *range;
+  short  *row_nheights;
+  short  *row_nrates;
+  short  *height;
+  short  *height_ncells;
+  signed char *rtype;
+  short  *z;
+  int    *rate;
+  signed char *rate_dec;
+  char   *raw;
+  int    *gauge_start, *gauge_rows;
+  /* Reader: where each row starts in the height, cell, rate and raw
+   * columns (nrows+1 each).
+   */
+  int    *row_height, *row_cell, *row_rate, *row_raw;
+  line_reader_t *file;
+  /* Scratch. */
+  second_bin_fields_t fields;
+  char   *line;
+  int    line_size;
+} second_bin_t;
+
+int second_bin_is_bin_file(char *fname);
+
+/* Writer.  Entries are kept in memory; second_bin_close() writes the file. */
+second_bin_t *second_bin_create(char *fname);
+int second_bin_add_header(second_bin_t *sb, char *text, int len);
+int second_bin_add_line(second_bin_t *sb, char *line, int len);
+
+/* second_bin_add_ascii: Add the header and entry lines of the ASCII second
+ * intermediate file read from fp.
+ * Return 1 for successful; -1, otherwise.
+ */
+int second_bin_add_ascii(second_bin_t *sb, FILE *fp);
+
+/* Reader. */
+second_bin_t *second_bin_open_read(char *fname);
+char *second_bin_header(second_bin_t *sb, int *len);
+second_bin_gauge_t *second_bin_get_gauge(second_bin_t *sb, int g);
+int *second_bin_gauge_rows(second_bin_t *sb, int g, int *nrows);
+
+/* second_bin_get_rec: Set rec to the entry in row.
+ * Return 1 for successful; 0 if the row is not an entry; -1 on error.
+ */
+int second_bin_get_rec(second_bin_t *sb, int row, second_bin_rec_t *rec);
+
+/* second_bin_parse_line: Set rec to the entry line line[0..len-1] of the
+ * ASCII file, parsed as the writer does (time_sec too); rec->gauge is -1.
+ * Return 1 for successful; 0 if the line is not an entry (the reader
+ * skips such rows too); -1 on error.
+ */
+int second_bin_parse_line(char *line, int len, second_bin_rec_t *rec);
+void second_bin_free_rec(second_bin_rec_t *rec);
+
+/* second_bin_write_row, second_bin_write_ascii: Write row (the file) as
+ * in the ASCII second intermediate file.
+ * Return 1 for successful; -1, otherwise.
+ */
+int second_bin_write_row(second_bin_t *sb, int row, FILE *fp);
+int second_bin_write_ascii(second_bin_t *sb, FILE *fp);
+
+/* second_bin_close: Writer: write the file.  Free sb.
+ * Return 1 for successful; -1, otherwise.
+ */
+int second_bin_close(second_bin_t *sb);
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * zr_histo2ascii
+ *     Convert the binary Z-R histogram file (see zr_utils.h) to the ASCII
+ *     Z-R histogram file.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "zr_utils.h"
+
+
+/**********************************************************************/
+/*                                                                    */
+/*                               usage                                */
+/*                                                                    */
+/**********************************************************************/
+void usage(char *prog)
+{
+  fprintf(stderr, "Usage (%s): Convert the binary Z-R histogram file to ASCII.\n",
+		  PROG_VERSION);
+  fprintf(stderr, "\t %s binary_histo_file ascii_histo_file\n", prog);
+  exit(-1);
+} /* usage */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             main                                   */
+/*                                                                    */
+/**********************************************************************/
+int main (int ac, char **av)
+{
+  ZR_histo *histo;
+  int rc;
+
+  if (ac != 3) usage(av[0]);
+  if (!is_zr_histo_bin_file(av[1])) {
+	fprintf(stderr, "%s: Not a binary Z-R histogram file.\n", av[1]);
+	exit(-1);
+  }
+  if ((histo = read_zr_histo(av[1])) == NULL) exit(-1);
+  rc = write_zr_histo(histo, av[2]);
+  free_zr_histo(histo);
+  exit(rc < 0 ? -1 : 0);
+}
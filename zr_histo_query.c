@@ -0,0 +1,90 @@
+/*
+ * zr_histo_query
+ *     Write the Z-R histograms of a range of days, from the day cube
+ *     file of build_zr_histo -D (see zr_utils.h).  Two layers of the cube
+ *     are read, whatever the number of days, so any range of days (a new
+ *     date range, a rolling window) is had without rebuilding from the
+ *     second intermediate files.
+ *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "zr_utils.h"
+
+
+/**********************************************************************/
+/*                                                                    */
+/*                               usage                                */
+/*                                                                    */
+/**********************************************************************/
+void usage(char *prog)
+{
+  fprintf(stderr, "Usage (%s): Write the Z-R histograms of the days from start_date\n"
+		  "\t to stop_date (UT) of the day cube file of build_zr_histo -D.\n",
+		  PROG_VERSION);
+  fprintf(stderr, "\t %s [-B] cube_file mm/dd/yyyy mm/dd/yyyy histo_file\n", prog);
+  fprintf(stderr, "\t -B: Write histo_file in the binary histogram format.\n");
+  exit(-1);
+} /* usage */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             parse_date                             */
+/*                                                                    */
+/**********************************************************************/
+int parse_date(char *s, time_t *t)
+{
+  /* Set *t to the start (UT) of date s, mm/dd/yyyy.
+   * Return 1 for successful; -1, otherwise.
+   */
+  struct tm tm;
+
+  memset(&tm, 0, sizeof(tm));
+  if (sscanf(s, "%d/%d/%d", &tm.tm_mon, &tm.tm_mday, &tm.tm_year) != 3 ||
+	  tm.tm_mon < 1 || tm.tm_mon > 12 || tm.tm_mday < 1 || tm.tm_mday > 31) {
+	fprintf(stderr, "Invalid date: %s (mm/dd/yyyy)\n", s);
+	return -1;
+  }
+  tm.tm_year -= 1900;
+  tm.tm_mon--;
+  tm.tm_isdst = -1;
+  *t = mktime(&tm);
+  return 1;
+} /* parse_date */
+
+/**********************************************************************/
+/*                                                                    */
+/*                             main                                   */
+/*                                                                    */
+/**********************************************************************/
+int main (int ac, char **av)
+{
+  ZR_histo *histo;
+  time_t start_time, stop_time;
+  int c, rc, binary_out = 0;
+
+  putenv("TZ=UT");  /* Dates are UT, as the days of the cube. */
+  while ((c = getopt(ac, av, "B")) != -1)
+	switch (c) {
+	case 'B': binary_out = 1; break;
+	default: usage(av[0]);
+	}
+  if (ac - optind != 4) usage(av[0]);
+  if (parse_date(av[optind+1], &start_time) < 0 ||
+	  parse_date(av[optind+2], &stop_time) < 0)
+	exit(-1);
+  if (stop_time < start_time) {
+	fprintf(stderr, "The stop date is before the start date.\n");
+	exit(-1);
+  }
+  if ((histo = read_zr_histo_cube(av[optind], start_time, stop_time)) == NULL)
+	exit(-1);
+  rc = binary_out ? write_zr_histo_bin(histo, av[optind+3]) :
+	write_zr_histo(histo, av[optind+3]);
+  free_zr_histo(histo);
+  exit(rc < 0 ? -1 : 0);
+}
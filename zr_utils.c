@@ -24,6 +24,10 @@
 
 #include "zr_utils.h"
 #include "zr.h"
+#include "line_reader.h"
+
+#define FNV_OFFSET 2166136261u
+#define MAX_HISTO_BINS (1 << 24)  /* Sanity bound when reading. */
 
 /*************************************************************/
 /*                                                           */
@@ -65,19 +69,42 @@ void print_zr_histo(ZR_histo *histo)
 /*************************************************************/
 int ***new_histogram_vectors(int nrange, int nrtype, int nbin)
 {
-	/* Create 'nrange x nrtype' vectors, each of length 'nbin'.
+	/* Create 'nrange x nrtype' vectors, each of length 'nbin', set to 0.
 		 A vector will be used to contain a histogram for a particular
 		 (range , raintype) classification.
+		 The vectors are one contiguous block (see HISTO_CUBE); the
+		 pointer tables are another.
+		 Returns NULL if out of memory.
   */
 	int ***histo;
+	int **rows;
+	void *cube;
+	size_t nbytes;
 	int irange, irtype;
 	
-	histo = (int ***)calloc(nrange, sizeof(int **));
+	if (nrange < 1 || nrtype < 1 || nbin < 1) return(NULL);
+	nbytes = (size_t)nrange * nrtype * nbin * sizeof(int);
+	if (posix_memalign(&cube, HISTO_VECTORS_ALIGN, nbytes) != 0)
+	{
+		perror("new_histogram_vectors");
+		return(NULL);
+	}
+	memset(cube, 0, nbytes);
+	histo = (int ***)malloc(nrange * sizeof(int **) +
+													(size_t)nrange * nrtype * sizeof(int *));
+	if (histo == NULL)
+	{
+		perror("new_histogram_vectors");
+		free(cube);
+		return(NULL);
+	}
+	rows = (int **)(histo + nrange);
 	for (irange=0; irange<nrange; irange++)
 	{
-		histo[irange] = (int **)calloc(nrtype, sizeof(int *));
+		histo[irange] = rows + irange*nrtype;
 	  for (irtype=0; irtype<nrtype; irtype++)
-			histo[irange][irtype] = (int *)calloc(nbin, sizeof(int));
+			histo[irange][irtype] = (int *)cube +
+				HISTO_OFFSET(irange, irtype, nrtype, nbin);
 	}
 	return(histo);
 }
@@ -87,25 +114,13 @@ int ***new_histogram_vectors(int nrange, int nrtype, int nbin)
 /*                   free_histogram_vectors                  */
 /*                                                           */
 /*************************************************************/
-void free_histogram_vectors(int ***histo, int nrange, int nrtype)
+void free_histogram_vectors(int ***histo)
 {
-	/* Frees all memory allocated to the set of 'nrange' x 'nrtype'
-		 histogram arrays.
+	/* Frees the histogram arrays of new_histogram_vectors().
   */
-	int i, j;
-	
 	if (histo == NULL) return;
 	
-	for (i=0; i<nrange; i++)
-	{
-		if (histo[i] == NULL) continue;
-	  for (j=0; j<nrtype; j++)
-		{
-			if (histo[i][j] == NULL) continue;
-			free(histo[i][j]);
-		}
-		free(histo[i]);
-	}
+	free(HISTO_CUBE(histo));
 	free(histo);
 }
 
@@ -119,25 +134,442 @@ void free_zr_histo(ZR_histo *histo)
 	/*
 	 * Frees a ZR_histo structure.
 	 */
+	int irtype;
 
 	if (histo == NULL) return;
 	/*
 	 * Free the various substructures of the ZR_histo structure.
 	 */
 	if (histo->rain_type_str != NULL)
+	{
+		for (irtype=0; irtype<histo->nrtype; irtype++)
+			free(histo->rain_type_str[irtype]);
 	  free(histo->rain_type_str);
+	}
 	if (histo->range_interval != NULL)
 	  free(histo->range_interval);
 	/* Free up the Z histograms. There are nrange x nrtype of them. */
-	free_histogram_vectors(histo->z, histo->nrange, histo->nrtype);
+	free_histogram_vectors(histo->z);
 	/* Free up the R histograms. There are nrange x nrtype of them. */
-	free_histogram_vectors(histo->r, histo->nrange, histo->nrtype);
+	free_histogram_vectors(histo->r);
 	/*
 	 * Finally, free the ZR_histo structure.
 	 */
 	free(histo);
 }
 
+/*************************************************************/
+/*                                                           */
+/*                        add_vectors                        */
+/*                                                           */
+/*************************************************************/
+int *add_vectors(int *inVector, int *outVector, long nbins)
+{
+	/* Performs vector addition:
+	 *    outVector = inVector + outVector
+	 * A straight loop the compiler vectorizes; called on whole collections
+	 * of histograms (see HISTO_CUBE).
+	 *
+	 * Returns outVector.
+	 */
+	long ibin;
+
+	for (ibin=0; ibin<nbins; ibin++)
+	  outVector[ibin] = outVector[ibin] + inVector[ibin];
+
+	return(outVector);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        add_zr_histo                       */
+/*                                                           */
+/*************************************************************/
+void add_zr_histo(ZR_histo *inHisto, ZR_histo *outHisto)
+{
+	/*
+	 * Add the histograms of inHisto to those of outHisto, of the same
+	 * shape: for each raintype and range interval, add the input R vector to
+	 * the output R vector.  Similiarly, add the input Z vector to the
+	 * output Z vector.  The vectors of all raintypes and range
+	 * intervals are contiguous, and laid out alike in both histograms,
+	 * so each collection is added as one vector.
+	 */
+	long ncells;
+
+	ncells = (long)outHisto->nrange * outHisto->nrtype;
+	/* Add the R vectors, place the result in outHisto->r */
+	add_vectors(HISTO_CUBE(inHisto->r), HISTO_CUBE(outHisto->r),
+							ncells * outHisto->nRbins);
+	/* Add the Z vectors, place the result in outHisto->z */
+	add_vectors(HISTO_CUBE(inHisto->z), HISTO_CUBE(outHisto->z),
+							ncells * outHisto->nZbins);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                           fnv1a                           */
+/*                                                           */
+/*************************************************************/
+static unsigned int fnv1a(unsigned int h, void *p, size_t n)
+{
+	/* Continue the FNV-1a hash h over n bytes at p. */
+	unsigned char *c = (unsigned char *)p;
+
+	while (n-- > 0) h = (h ^ *c++) * 16777619u;
+	return(h);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                           put                             */
+/*                                                           */
+/*************************************************************/
+static int put(FILE *fp, void *p, size_t n, unsigned int *h)
+{
+	/* Write n bytes at p to fp, adding them to the hash *h.
+		 Returns 1 if successful; -1, else.
+	*/
+	*h = fnv1a(*h, p, n);
+	return(fwrite(p, 1, n, fp) == n ? 1 : -1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                           get                             */
+/*                                                           */
+/*************************************************************/
+static int get(line_reader_t *f, size_t *pos, void *p, size_t n)
+{
+	/* Copy the n bytes of the file at *pos to p, and move *pos past them.
+		 Returns 1 if successful; -1 if the file is too short.
+	*/
+	if (n > f->size || *pos > f->size - n) return(-1);
+	memcpy(p, f->data + *pos, n);
+	*pos += n;
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                         next_run                          */
+/*                                                           */
+/*************************************************************/
+static int next_run(int *v, int nbin, int i, int *end)
+{
+	/* Returns the first non-zero bin of v at or after bin i, and sets *end
+		 past the last non-zero bin of its run; nbin if there is none.
+		 Gaps of up to 2 zero bins are kept in a run: they cost less than
+		 a new run.
+	*/
+	int j, zeros;
+
+	while (i < nbin && v[i] == 0) i++;
+	if (i == nbin) return(nbin);
+	*end = i + 1;
+	for (j = i + 1, zeros = 0; j < nbin && zeros <= 2; j++)
+	{
+		if (v[j] != 0)
+		{
+			*end = j + 1;
+			zeros = 0;
+		}
+		else zeros++;
+	}
+	return(i);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                         put_runs                          */
+/*                                                           */
+/*************************************************************/
+static int put_runs(FILE *fp, int *v, int nbin, unsigned int *h)
+{
+	/* Write histogram v[nbin] as its runs of non-zero bins:
+		 nruns, then (first_bin, nbins, counts) for each.
+		 Returns 1 if successful; -1, else.
+	*/
+	int i, end, n, nruns = 0;
+
+	for (i = next_run(v, nbin, 0, &end); i < nbin;
+			 i = next_run(v, nbin, end, &end))
+		nruns++;
+	if (put(fp, &nruns, sizeof(int), h) < 0) return(-1);
+	for (i = next_run(v, nbin, 0, &end); i < nbin;
+			 i = next_run(v, nbin, end, &end))
+	{
+		n = end - i;
+		if (put(fp, &i, sizeof(int), h) < 0 ||
+				put(fp, &n, sizeof(int), h) < 0 ||
+				put(fp, v + i, n * sizeof(int), h) < 0)
+			return(-1);
+	}
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        put_header                         */
+/*                                                           */
+/*************************************************************/
+static int put_header(FILE *fp, ZR_histo *histo, char *magic)
+{
+	/* Write 'magic' and the header of 'histo', then their checksum, as in
+		 the binary Z-R histogram file (see zr_utils.h).
+		 Returns 1 if successful; -1, else.
+	*/
+	char str[HISTO_STR_LEN];
+	long long t;
+	unsigned int h = FNV_OFFSET, sum;
+	int irtype;
+
+#define PUT(p, n) if (put(fp, (p), (n), &h) < 0) return(-1)
+	PUT(magic, ZR_HISTO_BIN_MAGIC_LEN);
+	memset(str, '\0', sizeof(str));
+	memcpy(str, histo->site_name, strnlen(histo->site_name, HISTO_STR_LEN-1));
+	PUT(str, HISTO_STR_LEN);
+	t = histo->start_time;
+	PUT(&t, sizeof(t));
+	t = histo->stop_time;
+	PUT(&t, sizeof(t));
+	PUT(&histo->radar_lat, sizeof(float));
+	PUT(&histo->radar_lon, sizeof(float));
+	PUT(&histo->nrange, sizeof(int));
+	PUT(&histo->nrtype, sizeof(int));
+	PUT(&histo->nZbins, sizeof(int));
+	PUT(&histo->nRbins, sizeof(int));
+	PUT(&histo->z_low, sizeof(float));
+	PUT(&histo->z_hi, sizeof(float));
+	PUT(&histo->z_res, sizeof(float));
+	PUT(&histo->r_low, sizeof(float));
+	PUT(&histo->r_hi, sizeof(float));
+	PUT(&histo->r_res, sizeof(float));
+	PUT(histo->range_interval, histo->nrange * sizeof(float));
+	for (irtype=0; irtype<histo->nrtype; irtype++)
+	{
+		memset(str, '\0', sizeof(str));
+		strncpy(str, histo->rain_type_str[irtype], HISTO_STR_LEN-1);
+		PUT(str, HISTO_STR_LEN);
+	}
+	sum = h;
+	PUT(&sum, sizeof(unsigned int));
+#undef PUT
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        get_header                         */
+/*                                                           */
+/*************************************************************/
+static int get_header(line_reader_t *f, size_t *pos, ZR_histo *histo,
+											char *magic, char *infile)
+{
+	/* Read the header written by put_header, at *pos of 'infile', into
+		 'histo' (range_interval and rain_type_str allocated), and check
+		 it starts with 'magic' and its checksum.
+		 Returns 1 if successful; 0 if it is not such a header; -1 if
+		 error (reported).
+	*/
+	char file_magic[ZR_HISTO_BIN_MAGIC_LEN], str[HISTO_STR_LEN];
+	long long t;
+	unsigned int sum, file_sum;
+	size_t start = *pos;
+	int irtype;
+
+#define GET(p, n) if (get(f, pos, (p), (n)) < 0) goto FORMAT_ERROR
+	GET(file_magic, ZR_HISTO_BIN_MAGIC_LEN);
+	if (memcmp(file_magic, magic, ZR_HISTO_BIN_MAGIC_LEN) != 0)
+		goto FORMAT_ERROR;
+	GET(histo->site_name, HISTO_STR_LEN);
+	histo->site_name[HISTO_STR_LEN-1] = '\0';
+	GET(&t, sizeof(t));
+	histo->start_time = (time_t)t;
+	GET(&t, sizeof(t));
+	histo->stop_time = (time_t)t;
+	GET(&histo->radar_lat, sizeof(float));
+	GET(&histo->radar_lon, sizeof(float));
+	GET(&histo->nrange, sizeof(int));
+	GET(&histo->nrtype, sizeof(int));
+	GET(&histo->nZbins, sizeof(int));
+	GET(&histo->nRbins, sizeof(int));
+	GET(&histo->z_low, sizeof(float));
+	GET(&histo->z_hi, sizeof(float));
+	GET(&histo->z_res, sizeof(float));
+	GET(&histo->r_low, sizeof(float));
+	GET(&histo->r_hi, sizeof(float));
+	GET(&histo->r_res, sizeof(float));
+	if (histo->nrange < 1 || histo->nrange > MAX_HISTO_BINS ||
+			histo->nrtype < 1 || histo->nrtype > MAX_HISTO_BINS ||
+			histo->nZbins < 1 || histo->nZbins > MAX_HISTO_BINS ||
+			histo->nRbins < 1 || histo->nRbins > MAX_HISTO_BINS)
+		goto FORMAT_ERROR;
+	histo->range_interval = (float *)malloc(histo->nrange * sizeof(float));
+	histo->rain_type_str = (char **)calloc(histo->nrtype, sizeof(char *));
+	if (histo->range_interval == NULL || histo->rain_type_str == NULL)
+	{
+		perror(infile);
+		return(-1);
+	}
+	GET(histo->range_interval, histo->nrange * sizeof(float));
+	for (irtype=0; irtype<histo->nrtype; irtype++)
+	{
+		GET(str, HISTO_STR_LEN);
+		str[HISTO_STR_LEN-1] = '\0';
+		if ((histo->rain_type_str[irtype] = (char *) strdup(str)) == NULL)
+		{
+			perror(infile);
+			return(-1);
+		}
+	}
+	sum = fnv1a(FNV_OFFSET, f->data + start, *pos - start);
+	GET(&file_sum, sizeof(unsigned int));
+#undef GET
+	if (file_sum != sum)
+	{
+		fprintf(stderr, "%s: Bad header checksum.\n", infile);
+		return(-1);
+	}
+	return(1);
+
+ FORMAT_ERROR:
+	return(0);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                     zr_histo_checksum                     */
+/*                                                           */
+/*************************************************************/
+unsigned int zr_histo_checksum(ZR_histo *histo)
+{
+	/* FNV-1a of what the Z-R tables of 'histo' depend on: the shape,
+		 range intervals, rain types and histograms (not the times).
+	*/
+	unsigned int h = FNV_OFFSET;
+	int irtype;
+
+	h = fnv1a(h, &histo->nrange, sizeof(int));
+	h = fnv1a(h, &histo->nrtype, sizeof(int));
+	h = fnv1a(h, &histo->nZbins, sizeof(int));
+	h = fnv1a(h, &histo->nRbins, sizeof(int));
+	h = fnv1a(h, &histo->z_low, sizeof(float));
+	h = fnv1a(h, &histo->z_res, sizeof(float));
+	h = fnv1a(h, &histo->r_res, sizeof(float));
+	h = fnv1a(h, histo->range_interval, histo->nrange * sizeof(float));
+	for (irtype=0; irtype<histo->nrtype; irtype++)
+		h = fnv1a(h, histo->rain_type_str[irtype],
+							strlen(histo->rain_type_str[irtype]) + 1);
+	h = fnv1a(h, HISTO_CUBE(histo->z),
+						(size_t)histo->nrange * histo->nrtype * histo->nZbins * sizeof(int));
+	h = fnv1a(h, HISTO_CUBE(histo->r),
+						(size_t)histo->nrange * histo->nrtype * histo->nRbins * sizeof(int));
+	return(h);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                    is_zr_histo_bin_file                   */
+/*                                                           */
+/*************************************************************/
+int is_zr_histo_bin_file(char *fname)
+{
+	/* Returns 1 if fname starts with ZR_HISTO_BIN_MAGIC; 0, else. */
+	FILE *fp;
+	char magic[ZR_HISTO_BIN_MAGIC_LEN];
+	int rc = 0;
+
+	if (fname == NULL || (fp = fopen(fname, "r")) == NULL) return(0);
+	if (fread(magic, 1, ZR_HISTO_BIN_MAGIC_LEN, fp) == ZR_HISTO_BIN_MAGIC_LEN &&
+			memcmp(magic, ZR_HISTO_BIN_MAGIC, ZR_HISTO_BIN_MAGIC_LEN) == 0)
+		rc = 1;
+	fclose(fp);
+	return(rc);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                      read_zr_histo_bin                    */
+/*                                                           */
+/*************************************************************/
+static ZR_histo *read_zr_histo_bin(char *infile)
+{
+	/* 
+		 Read Z and R histograms from a binary file (see zr_utils.h), mapped
+		 into memory.  Checks the checksums and bounds.
+		 Returns NULL if error.
+	*/
+	line_reader_t *f;
+	ZR_histo *histo;
+	char magic[ZR_HISTO_BIN_MAGIC_LEN];
+	unsigned int sum, file_sum;
+	size_t pos = 0, start;
+	int icube, ihisto, nbin, nruns, irun, first, n;
+	int *v;
+
+	if ((f = line_reader_open(infile)) == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n", infile);
+		return(NULL);
+	}
+	if ((histo = (ZR_histo *)calloc(1, sizeof(ZR_histo))) == NULL)
+	{
+		perror("read_zr_histo");
+		line_reader_close(f);
+		return(NULL);
+	}
+#define GET(p, n) if (get(f, &pos, (p), (n)) < 0) goto FORMAT_ERROR
+	if ((n = get_header(f, &pos, histo, ZR_HISTO_BIN_MAGIC, infile)) < 0)
+		goto ERROR;
+	if (n == 0) goto FORMAT_ERROR;
+
+	histo->z = new_histogram_vectors(histo->nrange, histo->nrtype,
+																	 histo->nZbins);
+	histo->r = new_histogram_vectors(histo->nrange, histo->nrtype,
+																	 histo->nRbins);
+	if (histo->z == NULL || histo->r == NULL) goto ERROR;
+	start = pos;
+	for (icube=0; icube<2; icube++)
+	{
+		nbin = icube == 0 ? histo->nZbins : histo->nRbins;
+		v = icube == 0 ? HISTO_CUBE(histo->z) : HISTO_CUBE(histo->r);
+		for (ihisto=0; ihisto<histo->nrange*histo->nrtype; ihisto++, v += nbin)
+		{
+			GET(&nruns, sizeof(int));
+			if (nruns < 0 || nruns > nbin) goto FORMAT_ERROR;
+			for (irun=0; irun<nruns; irun++)
+			{
+				GET(&first, sizeof(int));
+				GET(&n, sizeof(int));
+				if (first < 0 || n < 1 || n > nbin - first) goto FORMAT_ERROR;
+				GET(v + first, n * sizeof(int));
+			}
+		}
+	}
+	sum = fnv1a(FNV_OFFSET, f->data + start, pos - start);
+	GET(&file_sum, sizeof(unsigned int));
+	if (file_sum != sum)
+	{
+		fprintf(stderr, "%s: Bad histograms checksum.\n", infile);
+		goto ERROR;
+	}
+	GET(magic, ZR_HISTO_BIN_MAGIC_LEN);
+	if (memcmp(magic, ZR_HISTO_BIN_END_MAGIC, ZR_HISTO_BIN_MAGIC_LEN) != 0 ||
+			pos != f->size)
+		goto FORMAT_ERROR;
+#undef GET
+	line_reader_close(f);
+	return(histo);
+
+ FORMAT_ERROR:
+	fprintf(stderr, "%s: Not a valid binary ZR histogram file.\n", infile);
+ ERROR:
+	line_reader_close(f);
+	free_zr_histo(histo);
+	return(NULL);
+}
+
 /*************************************************************/
 /*                                                           */
 /*                         read_zr_histo                     */
@@ -157,8 +589,14 @@ ZR_histo *read_zr_histo(char *infile)
 	ZR_histo *histo;
 	FILE *fp;
 
-	putenv("TZ=UT"); /* No localtime conversion. */
+	/* No localtime conversion.  Set once, so that the threads of
+	 * merge_zr_histo do not change the environment under mktime().
+	 */
+	if ((s = getenv("TZ")) == NULL || strcmp(s, "UT") != 0)
+		putenv("TZ=UT");
 
+	if (is_zr_histo_bin_file(infile))
+		return(read_zr_histo_bin(infile));
 	fp = fopen(infile, "r");
 	if (fp == NULL) 
 	{
@@ -243,6 +681,12 @@ ZR_histo *read_zr_histo(char *infile)
 	/* Allocate the 3D array of Z_histograms. */
 	histo->z = (int ***) new_histogram_vectors(histo->nrange, histo->nrtype,
 																						 histo->nZbins);
+	if (histo->r == NULL || histo->z == NULL) {
+		fprintf(stderr, "Can't allocate the histograms of %s.\n", infile);
+		fclose(fp);
+		free_zr_histo(histo);
+		return NULL;
+	}
 	
 
 	/* Read each of the '2*nrange*nrtype' histograms from the file. */
@@ -416,4 +860,754 @@ int write_zr_histo(ZR_histo *histo, char *outfile)
 	return(0);
 }
 
+/*************************************************************/
+/*                                                           */
+/*                     write_zr_histo_bin                    */
+/*                                                           */
+/*************************************************************/
+int write_zr_histo_bin(ZR_histo *histo, char *outfile)
+{
+	/* 
+		 Write the Z and R histograms to a binary file (see zr_utils.h);
+		 read_zr_histo reads it back.
+		 Returns 0 if successful; -1, else (as write_zr_histo).
+	*/
+	FILE *fp;
+	unsigned int h = FNV_OFFSET, sum;
+	int icube, ihisto, nbin;
+	int *v;
+
+	fp = fopen(outfile, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n", outfile);
+		return(-1);
+	}
+	if (put_header(fp, histo, ZR_HISTO_BIN_MAGIC) < 0) goto ERROR;
+
+#define PUT(p, n) if (put(fp, (p), (n), &h) < 0) goto ERROR
+	h = FNV_OFFSET;
+	for (icube=0; icube<2; icube++)
+	{
+		nbin = icube == 0 ? histo->nZbins : histo->nRbins;
+		v = icube == 0 ? HISTO_CUBE(histo->z) : HISTO_CUBE(histo->r);
+		for (ihisto=0; ihisto<histo->nrange*histo->nrtype; ihisto++, v += nbin)
+			if (put_runs(fp, v, nbin, &h) < 0) goto ERROR;
+	}
+	sum = h;
+	PUT(&sum, sizeof(unsigned int));
+	PUT(ZR_HISTO_BIN_END_MAGIC, ZR_HISTO_BIN_MAGIC_LEN);
+#undef PUT
+	if (fclose(fp) != 0)
+	{
+		perror(outfile);
+		return(-1);
+	}
+	return(0);
+
+ ERROR:
+	perror(outfile);
+	fclose(fp);
+	return(-1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                     new_zr_histo_days                     */
+/*                                                           */
+/*************************************************************/
+ZR_histo_days *new_zr_histo_days(ZR_histo *histo)
+{
+	/* Create an empty set of day histograms of the dimensions of
+		 'histo'.  Returns NULL if out of memory.
+	*/
+	ZR_histo_days *days;
+
+	if ((days = (ZR_histo_days *)calloc(1, sizeof(ZR_histo_days))) == NULL)
+	{
+		perror("new_zr_histo_days");
+		return(NULL);
+	}
+	days->nrange = histo->nrange;
+	days->nrtype = histo->nrtype;
+	days->nZbins = histo->nZbins;
+	days->nRbins = histo->nRbins;
+	return(days);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                     free_zr_histo_days                    */
+/*                                                           */
+/*************************************************************/
+void free_zr_histo_days(ZR_histo_days *days)
+{
+	int d;
+
+	if (days == NULL) return;
+	for (d=0; d<days->ndays; d++)
+	{
+		free_histogram_vectors(days->z[d]);
+		free_histogram_vectors(days->r[d]);
+	}
+	free(days->z);
+	free(days->r);
+	free(days);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                        zr_histo_day                       */
+/*                                                           */
+/*************************************************************/
+int zr_histo_day(ZR_histo_days *days, long day)
+{
+	/* Returns the index d of 'day' (see ZR_HISTO_DAY) in 'days': its
+		 histograms are days->z[d] and days->r[d], allocated if new.
+		 The days before or after those in 'days' are added.  The index
+		 of the other days changes if 'day' comes first.
+		 Returns -1 if out of memory.
+	*/
+	int ****z, ****r;
+	long first, last;
+	int n, shift, d;
+
+	first = days->ndays == 0 || day < days->first_day ? day : days->first_day;
+	last = days->ndays == 0 || day >= days->first_day + days->ndays ?
+		day : days->first_day + days->ndays - 1;
+	if (last - first + 1 != days->ndays)
+	{
+		n = last - first + 1;
+		shift = days->ndays == 0 ? 0 : days->first_day - first;
+		z = (int ****)realloc(days->z, n * sizeof(int ***));
+		if (z) days->z = z;
+		r = (int ****)realloc(days->r, n * sizeof(int ***));
+		if (r) days->r = r;
+		if (z == NULL || r == NULL)
+		{
+			perror("zr_histo_day");
+			return(-1);
+		}
+		memmove(days->z + shift, days->z, days->ndays * sizeof(int ***));
+		memmove(days->r + shift, days->r, days->ndays * sizeof(int ***));
+		for (d=0; d<n; d++)
+			if (d < shift || d >= shift + days->ndays)
+				days->z[d] = days->r[d] = NULL;
+		days->first_day = first;
+		days->ndays = n;
+	}
+	d = day - days->first_day;
+	if (days->z[d] == NULL)
+	{
+		days->z[d] = new_histogram_vectors(days->nrange, days->nrtype,
+																			 days->nZbins);
+		days->r[d] = new_histogram_vectors(days->nrange, days->nrtype,
+																			 days->nRbins);
+		if (days->z[d] == NULL || days->r[d] == NULL) return(-1);
+	}
+	return(d);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                     add_zr_histo_days                     */
+/*                                                           */
+/*************************************************************/
+int add_zr_histo_days(ZR_histo_days *from, ZR_histo_days *to)
+{
+	/* Add the histograms of each day of 'from' to those of the same day
+		 of 'to'.  Returns 1 if successful; -1 if out of memory.
+	*/
+	long i, nz, nr;
+	int d, dto;
+	int *v, *w;
+
+	nz = (long)from->nrange * from->nrtype * from->nZbins;
+	nr = (long)from->nrange * from->nrtype * from->nRbins;
+	for (d=0; d<from->ndays; d++)
+	{
+		if (from->z[d] == NULL) continue;
+		if ((dto = zr_histo_day(to, from->first_day + d)) < 0) return(-1);
+		v = HISTO_CUBE(from->z[d]);
+		w = HISTO_CUBE(to->z[dto]);
+		for (i=0; i<nz; i++) w[i] += v[i];
+		v = HISTO_CUBE(from->r[d]);
+		w = HISTO_CUBE(to->r[dto]);
+		for (i=0; i<nr; i++) w[i] += v[i];
+	}
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                    write_zr_histo_cube                    */
+/*                                                           */
+/*************************************************************/
+int write_zr_histo_cube(ZR_histo *histo, ZR_histo_days *days, char *outfile)
+{
+	/* 
+		 Write the histograms of each day of 'days', with the header of
+		 'histo', to a day cube file (see zr_utils.h): the running sums
+		 of the days, one layer per day.
+		 Returns 0 if successful; -1, else (as write_zr_histo).
+	*/
+	FILE *fp;
+	long long first_day;
+	long i, nz, nr, size;
+	int d, ***zsum = NULL, ***rsum = NULL;
+	int *v, *w;
+	unsigned int h = FNV_OFFSET;   /* Not written: the layers have none. */
+	static char pad[ZR_HISTO_CUBE_ALIGN];
+
+	fp = fopen(outfile, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n", outfile);
+		return(-1);
+	}
+	if (put_header(fp, histo, ZR_HISTO_CUBE_MAGIC) < 0) goto ERROR;
+	first_day = days->first_day;
+	if (put(fp, &first_day, sizeof(first_day), &h) < 0 ||
+			put(fp, &days->ndays, sizeof(int), &h) < 0)
+		goto ERROR;
+	size = ftell(fp);
+	if (size % ZR_HISTO_CUBE_ALIGN != 0 &&
+			put(fp, pad, ZR_HISTO_CUBE_ALIGN - size % ZR_HISTO_CUBE_ALIGN, &h) < 0)
+		goto ERROR;
+
+	zsum = new_histogram_vectors(days->nrange, days->nrtype, days->nZbins);
+	rsum = new_histogram_vectors(days->nrange, days->nrtype, days->nRbins);
+	if (zsum == NULL || rsum == NULL) goto ERROR;
+	nz = (long)days->nrange * days->nrtype * days->nZbins;
+	nr = (long)days->nrange * days->nrtype * days->nRbins;
+	for (d=0; d<days->ndays; d++)
+	{
+		if (days->z[d])
+		{
+			v = HISTO_CUBE(days->z[d]);
+			w = HISTO_CUBE(zsum);
+			for (i=0; i<nz; i++) w[i] += v[i];
+			v = HISTO_CUBE(days->r[d]);
+			w = HISTO_CUBE(rsum);
+			for (i=0; i<nr; i++) w[i] += v[i];
+		}
+		if (fwrite(HISTO_CUBE(zsum), sizeof(int), nz, fp) != nz ||
+				fwrite(HISTO_CUBE(rsum), sizeof(int), nr, fp) != nr)
+			goto ERROR;
+	}
+	if (fwrite(ZR_HISTO_CUBE_END_MAGIC, 1, ZR_HISTO_BIN_MAGIC_LEN, fp) !=
+			ZR_HISTO_BIN_MAGIC_LEN)
+		goto ERROR;
+	free_histogram_vectors(zsum);
+	free_histogram_vectors(rsum);
+	if (fclose(fp) != 0)
+	{
+		perror(outfile);
+		return(-1);
+	}
+	return(0);
+
+ ERROR:
+	perror(outfile);
+	free_histogram_vectors(zsum);
+	free_histogram_vectors(rsum);
+	fclose(fp);
+	return(-1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                     read_zr_histo_cube                    */
+/*                                                           */
+/*************************************************************/
+ZR_histo *read_zr_histo_cube(char *cubefile, time_t start_time,
+														 time_t stop_time)
+{
+	/* 
+		 Read the Z and R histograms of the days from that of 'start_time'
+		 to that of 'stop_time' (UT) from the day cube file 'cubefile' (see
+		 zr_utils.h), mapped into memory: the difference of two layers.
+		 Days outside the cube have no entries.  The start and stop times
+		 of the histograms are those of the first and last day.
+		 Returns NULL if error.
+	*/
+	line_reader_t *f;
+	ZR_histo *histo;
+	char magic[ZR_HISTO_BIN_MAGIC_LEN];
+	long long first_day;
+	long i, n, nz, nr, layer;
+	size_t pos = 0;
+	int ndays, d0, d1, icube;
+	int *v, *hi, *lo;
+
+	if ((f = line_reader_open(cubefile)) == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n", cubefile);
+		return(NULL);
+	}
+	if ((histo = (ZR_histo *)calloc(1, sizeof(ZR_histo))) == NULL)
+	{
+		perror("read_zr_histo_cube");
+		line_reader_close(f);
+		return(NULL);
+	}
+	if ((n = get_header(f, &pos, histo, ZR_HISTO_CUBE_MAGIC, cubefile)) < 0)
+		goto ERROR;
+	if (n == 0) goto FORMAT_ERROR;
+	if (get(f, &pos, &first_day, sizeof(first_day)) < 0 ||
+			get(f, &pos, &ndays, sizeof(int)) < 0 || ndays < 0)
+		goto FORMAT_ERROR;
+	if (pos % ZR_HISTO_CUBE_ALIGN != 0)
+		pos += ZR_HISTO_CUBE_ALIGN - pos % ZR_HISTO_CUBE_ALIGN;
+	nz = (long)histo->nrange * histo->nrtype * histo->nZbins;
+	nr = (long)histo->nrange * histo->nrtype * histo->nRbins;
+	layer = (nz + nr) * sizeof(int);
+	if (pos + ZR_HISTO_BIN_MAGIC_LEN > f->size ||
+			(f->size - pos - ZR_HISTO_BIN_MAGIC_LEN) / layer != ndays ||
+			(f->size - pos - ZR_HISTO_BIN_MAGIC_LEN) % layer != 0)
+		goto FORMAT_ERROR;
+	memcpy(magic, f->data + f->size - ZR_HISTO_BIN_MAGIC_LEN,
+				 ZR_HISTO_BIN_MAGIC_LEN);
+	if (memcmp(magic, ZR_HISTO_CUBE_END_MAGIC, ZR_HISTO_BIN_MAGIC_LEN) != 0)
+		goto FORMAT_ERROR;
+
+	histo->z = new_histogram_vectors(histo->nrange, histo->nrtype,
+																	 histo->nZbins);
+	histo->r = new_histogram_vectors(histo->nrange, histo->nrtype,
+																	 histo->nRbins);
+	if (histo->z == NULL || histo->r == NULL) goto ERROR;
+	/*
+	 * Layer d1 minus layer d0-1, of the days in the cube.
+	 */
+	histo->start_time = ZR_HISTO_DAY(start_time) * 86400;
+	histo->stop_time = ZR_HISTO_DAY(stop_time) * 86400 + 86399;
+	d0 = ZR_HISTO_DAY(start_time) - first_day;
+	d1 = ZR_HISTO_DAY(stop_time) - first_day;
+	if (d0 < 0) d0 = 0;
+	if (d1 > ndays - 1) d1 = ndays - 1;
+	if (d0 <= d1)
+		for (icube=0; icube<2; icube++)
+		{
+			v = icube == 0 ? HISTO_CUBE(histo->z) : HISTO_CUBE(histo->r);
+			n = icube == 0 ? nz : nr;
+			hi = (int *)(f->data + pos + d1 * layer) + (icube == 0 ? 0 : nz);
+			lo = (int *)(f->data + pos + (d0 - 1) * layer) + (icube == 0 ? 0 : nz);
+			for (i=0; i<n; i++)
+				v[i] = d0 > 0 ? hi[i] - lo[i] : hi[i];
+		}
+	line_reader_close(f);
+	return(histo);
+
+ FORMAT_ERROR:
+	fprintf(stderr, "%s: Not a valid ZR histogram day cube file.\n", cubefile);
+ ERROR:
+	line_reader_close(f);
+	free_zr_histo(histo);
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       new_zr_sample                       */
+/*                                                           */
+/*************************************************************/
+ZR_sample *new_zr_sample(ZR_histo *histo)
+{
+	/* Create an empty sample of the entries of histograms of the
+		 dimensions of 'histo'.  Returns NULL if out of memory.
+	*/
+	ZR_sample *sample;
+
+	if ((sample = (ZR_sample *)calloc(1, sizeof(ZR_sample))) == NULL)
+	{
+		perror("new_zr_sample");
+		return(NULL);
+	}
+	sample->nrange = histo->nrange;
+	sample->nrtype = histo->nrtype;
+	sample->nZbins = histo->nZbins;
+	sample->nRbins = histo->nRbins;
+	return(sample);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       free_zr_sample                      */
+/*                                                           */
+/*************************************************************/
+void free_zr_sample(ZR_sample *sample)
+{
+	if (sample == NULL) return;
+	free(sample->gauge);
+	free(sample->hash);
+	free(sample->rec);
+	free(sample->zbin);
+	free(sample);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                      zr_sample_gauge                      */
+/*                                                           */
+/*************************************************************/
+int zr_sample_gauge(ZR_sample *sample, char *net, int net_len, char *id,
+										int id_len)
+{
+	/* Returns the index of gauge 'id' of network 'net' (id_len and
+		 net_len bytes, not necessarily '\0' ended) in the gauge names of
+		 'sample', added if new.  Returns -1 if out of memory.
+	*/
+	char name[ZR_SAMPLE_GAUGE_LEN];
+	unsigned int h;
+	int i, g, *hash;
+	void *more;
+
+	if (net_len > ZR_SAMPLE_GAUGE_LEN/2 - 1) net_len = ZR_SAMPLE_GAUGE_LEN/2 - 1;
+	if (id_len > ZR_SAMPLE_GAUGE_LEN/2 - 1) id_len = ZR_SAMPLE_GAUGE_LEN/2 - 1;
+	memset(name, '\0', sizeof(name));
+	memcpy(name, net, net_len);
+	name[net_len] = ' ';
+	memcpy(name + net_len + 1, id, id_len);
+	h = fnv1a(FNV_OFFSET, name, net_len + 1 + id_len);
+
+	if (sample->hash_len > 0)
+		for (i = h & (sample->hash_len - 1); (g = sample->hash[i]) >= 0;
+				 i = (i + 1) & (sample->hash_len - 1))
+			if (memcmp(sample->gauge[g], name, sizeof(name)) == 0)
+				return(g);
+
+	/*
+	 * A new gauge.  The table is kept at most half full.
+	 */
+	if (sample->ngauges == sample->gauges_len)
+	{
+		sample->gauges_len = sample->gauges_len ? 2 * sample->gauges_len : 64;
+		more = realloc(sample->gauge, sample->gauges_len * ZR_SAMPLE_GAUGE_LEN);
+		if (more == NULL)
+		{
+			perror("zr_sample_gauge");
+			return(-1);
+		}
+		sample->gauge = (char (*)[ZR_SAMPLE_GAUGE_LEN])more;
+	}
+	g = sample->ngauges++;
+	memcpy(sample->gauge[g], name, sizeof(name));
+	if (2 * sample->ngauges > sample->hash_len)
+	{
+		sample->hash_len = sample->hash_len ? 2 * sample->hash_len : 256;
+		if ((hash = (int *)malloc(sample->hash_len * sizeof(int))) == NULL)
+		{
+			perror("zr_sample_gauge");
+			return(-1);
+		}
+		free(sample->hash);
+		sample->hash = hash;
+		for (i=0; i<sample->hash_len; i++) hash[i] = -1;
+		for (g=0; g<sample->ngauges; g++)
+		{
+			h = fnv1a(FNV_OFFSET, sample->gauge[g], strlen(sample->gauge[g]));
+			for (i = h & (sample->hash_len - 1); hash[i] >= 0;
+					 i = (i + 1) & (sample->hash_len - 1))
+				;
+			hash[i] = g;
+		}
+		return(sample->ngauges - 1);
+	}
+	for (i = h & (sample->hash_len - 1); sample->hash[i] >= 0;
+			 i = (i + 1) & (sample->hash_len - 1))
+		;
+	sample->hash[i] = g;
+	return(g);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                     add_zr_sample_rec                     */
+/*                                                           */
+/*************************************************************/
+int add_zr_sample_rec(ZR_sample *sample, int gauge, long day, int cell,
+											int rbin, int nz, int **zbin)
+{
+	/* Add an entry of gauge 'gauge' (zr_sample_gauge) on 'day' to
+		 'sample', with R bin 'rbin' (-1: none) and 'nz' Z bins, in the
+		 histograms 'cell' (see ZR_sample_rec).  Sets *zbin to where its
+		 Z bins are to be set.
+		 Returns 1 if successful; -1 if out of memory.
+	*/
+	ZR_sample_rec *rec;
+	void *more;
+
+	if (sample->nrecs == sample->recs_len)
+	{
+		sample->recs_len = sample->recs_len ? 2 * sample->recs_len : 1024;
+		more = realloc(sample->rec, sample->recs_len * sizeof(ZR_sample_rec));
+		if (more == NULL)
+		{
+			perror("add_zr_sample_rec");
+			return(-1);
+		}
+		sample->rec = (ZR_sample_rec *)more;
+	}
+	if (sample->nzbins + nz > sample->zbins_len)
+	{
+		sample->zbins_len = 2 * sample->zbins_len + nz + 4096;
+		more = realloc(sample->zbin, sample->zbins_len * sizeof(int));
+		if (more == NULL)
+		{
+			perror("add_zr_sample_rec");
+			return(-1);
+		}
+		sample->zbin = (int *)more;
+	}
+	rec = &sample->rec[sample->nrecs++];
+	rec->gauge = gauge;
+	rec->day = (int)day;
+	rec->cell = cell;
+	rec->rbin = rbin;
+	rec->nz = nz;
+	*zbin = sample->zbin + sample->nzbins;
+	sample->nzbins += nz;
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       add_zr_samples                      */
+/*                                                           */
+/*************************************************************/
+int add_zr_samples(ZR_sample *from, ZR_sample *to, int pending_irtype)
+{
+	/* Append the entries of 'from' to those of 'to', with the gauge
+		 indices of 'to'.  The entries of 'from' whose raintype was not
+		 known (cell -1-irange) are in the histograms of raintype index
+		 'pending_irtype'.
+		 Returns 1 if successful; -1 if out of memory.
+	*/
+	ZR_sample_rec *rec;
+	char *name;
+	int i, g, *zbin, *dst, *gauge;
+
+	if ((gauge = (int *)malloc((from->ngauges + 1) * sizeof(int))) == NULL)
+	{
+		perror("add_zr_samples");
+		return(-1);
+	}
+	for (g=0; g<from->ngauges; g++)
+	{
+		name = from->gauge[g];
+		i = strchr(name, ' ') - name;
+		if ((gauge[g] = zr_sample_gauge(to, name, i, name + i + 1,
+																		strlen(name + i + 1))) < 0)
+		{
+			free(gauge);
+			return(-1);
+		}
+	}
+	for (i=0, zbin=from->zbin; i<from->nrecs; zbin += from->rec[i].nz, i++)
+	{
+		rec = &from->rec[i];
+		if (add_zr_sample_rec(to, gauge[rec->gauge], rec->day,
+													rec->cell >= 0 ? rec->cell :
+													(-1 - rec->cell) * to->nrtype + pending_irtype,
+													rec->rbin, rec->nz, &dst) < 0)
+		{
+			free(gauge);
+			return(-1);
+		}
+		if (rec->nz > 0) memcpy(dst, zbin, rec->nz * sizeof(int));
+	}
+	free(gauge);
+	return(1);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                      write_zr_sample                      */
+/*                                                           */
+/*************************************************************/
+int write_zr_sample(ZR_histo *histo, ZR_sample *sample, char *outfile)
+{
+	/* 
+		 Write the entries of 'sample', with the header of 'histo', to a
+		 sample file (see zr_utils.h).
+		 Returns 0 if successful; -1, else (as write_zr_histo).
+	*/
+	FILE *fp;
+	int nzbins;
+	unsigned int h = FNV_OFFSET;   /* Not written: the entries have none. */
+
+	if (sample->nzbins > 0x7fffffffL)
+	{
+		fprintf(stderr, "%s: Too many entries for a sample file.\n", outfile);
+		return(-1);
+	}
+	nzbins = (int)sample->nzbins;
+	fp = fopen(outfile, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n", outfile);
+		return(-1);
+	}
+	if (put_header(fp, histo, ZR_SAMPLE_MAGIC) < 0 ||
+			put(fp, &sample->ngauges, sizeof(int), &h) < 0 ||
+			put(fp, &sample->nrecs, sizeof(int), &h) < 0 ||
+			put(fp, &nzbins, sizeof(int), &h) < 0 ||
+			fwrite(sample->gauge, ZR_SAMPLE_GAUGE_LEN, sample->ngauges, fp) !=
+			sample->ngauges ||
+			fwrite(sample->rec, sizeof(ZR_sample_rec), sample->nrecs, fp) !=
+			sample->nrecs ||
+			fwrite(sample->zbin, sizeof(int), nzbins, fp) != nzbins ||
+			fwrite(ZR_SAMPLE_END_MAGIC, 1, ZR_HISTO_BIN_MAGIC_LEN, fp) !=
+			ZR_HISTO_BIN_MAGIC_LEN)
+	{
+		perror(outfile);
+		fclose(fp);
+		return(-1);
+	}
+	if (fclose(fp) != 0)
+	{
+		perror(outfile);
+		return(-1);
+	}
+	return(0);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                       read_zr_sample                      */
+/*                                                           */
+/*************************************************************/
+ZR_sample *read_zr_sample(char *infile)
+{
+	/* 
+		 Read the entries of the sample file 'infile' (see zr_utils.h).
+		 The bins and gauges of every entry are checked, so that they
+		 can be used as indices.
+		 Returns NULL if error.
+	*/
+	line_reader_t *f;
+	ZR_histo header;
+	ZR_sample *sample = NULL;
+	ZR_sample_rec *rec;
+	char magic[ZR_HISTO_BIN_MAGIC_LEN];
+	size_t pos = 0;
+	long nz;
+	int i, j, rc, nzbins;
+
+	if ((f = line_reader_open(infile)) == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n", infile);
+		return(NULL);
+	}
+	memset(&header, 0, sizeof(header));
+	if ((rc = get_header(f, &pos, &header, ZR_SAMPLE_MAGIC, infile)) < 0)
+		goto ERROR;
+	if (rc == 0) goto FORMAT_ERROR;
+	if ((sample = new_zr_sample(&header)) == NULL) goto ERROR;
+	if (get(f, &pos, &sample->ngauges, sizeof(int)) < 0 ||
+			get(f, &pos, &sample->nrecs, sizeof(int)) < 0 ||
+			get(f, &pos, &nzbins, sizeof(int)) < 0 ||
+			sample->ngauges < 0 || sample->nrecs < 0 || nzbins < 0 ||
+			(f->size - pos) / ZR_SAMPLE_GAUGE_LEN < sample->ngauges)
+		goto FORMAT_ERROR;
+	sample->nzbins = nzbins;
+	sample->gauges_len = sample->ngauges;
+	sample->recs_len = sample->nrecs;
+	sample->zbins_len = sample->nzbins;
+	sample->gauge = (char (*)[ZR_SAMPLE_GAUGE_LEN])
+		malloc(sample->ngauges * ZR_SAMPLE_GAUGE_LEN + 1);
+	sample->rec = (ZR_sample_rec *)
+		malloc(sample->nrecs * sizeof(ZR_sample_rec) + 1);
+	sample->zbin = (int *)malloc(sample->nzbins * sizeof(int) + 1);
+	if (sample->gauge == NULL || sample->rec == NULL || sample->zbin == NULL)
+	{
+		perror(infile);
+		goto ERROR;
+	}
+	if (get(f, &pos, sample->gauge, sample->ngauges * ZR_SAMPLE_GAUGE_LEN) < 0 ||
+			get(f, &pos, sample->rec, sample->nrecs * sizeof(ZR_sample_rec)) < 0 ||
+			get(f, &pos, sample->zbin, sample->nzbins * sizeof(int)) < 0 ||
+			get(f, &pos, magic, ZR_HISTO_BIN_MAGIC_LEN) < 0 || pos != f->size ||
+			memcmp(magic, ZR_SAMPLE_END_MAGIC, ZR_HISTO_BIN_MAGIC_LEN) != 0)
+		goto FORMAT_ERROR;
 
+	/*
+	 * Check the entries.
+	 */
+	for (i=0; i<sample->ngauges; i++)
+	{
+		sample->gauge[i][ZR_SAMPLE_GAUGE_LEN-1] = '\0';
+		if (strchr(sample->gauge[i], ' ') == NULL) goto FORMAT_ERROR;
+	}
+	for (i=0, nz=0; i<sample->nrecs; i++)
+	{
+		rec = &sample->rec[i];
+		if (rec->gauge < 0 || rec->gauge >= sample->ngauges ||
+				rec->cell < 0 || rec->cell >= sample->nrange * sample->nrtype ||
+				rec->rbin < -1 || rec->rbin >= sample->nRbins ||
+				rec->nz < 0 || rec->nz > sample->nzbins - nz)
+			goto FORMAT_ERROR;
+		for (j=0; j<rec->nz; j++)
+			if (sample->zbin[nz + j] < 0 || sample->zbin[nz + j] >= sample->nZbins)
+				goto FORMAT_ERROR;
+		nz += rec->nz;
+	}
+	if (nz != sample->nzbins) goto FORMAT_ERROR;
+	line_reader_close(f);
+	free(header.range_interval);
+	for (i=0; i<header.nrtype && header.rain_type_str; i++)
+		free(header.rain_type_str[i]);
+	free(header.rain_type_str);
+	return(sample);
+
+ FORMAT_ERROR:
+	fprintf(stderr, "%s: Not a valid ZR sample file.\n", infile);
+ ERROR:
+	line_reader_close(f);
+	free(header.range_interval);
+	for (i=0; i<header.nrtype && header.rain_type_str; i++)
+		free(header.rain_type_str[i]);
+	free(header.rain_type_str);
+	free_zr_sample(sample);
+	return(NULL);
+}
+
+/*************************************************************/
+/*                                                           */
+/*                      read_infile_list                     */
+/*                                                           */
+/*************************************************************/
+char **read_infile_list(char *list_file, char **infile, int *nInfiles)
+{
+	/*
+	 * Append the file names in list_file, one per line, to the
+	 * array infile of *nInfiles names.  Blank lines and lines
+	 * beginning with '#' are skipped.
+	 *
+	 * Returns the reallocated array; NULL if error.
+	 */
+	FILE *fp;
+	char line[1024], name[1024];
+	char **more;
+
+	if ((fp = fopen(list_file, "r")) == NULL)
+	{
+		perror(list_file);
+		return(NULL);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (sscanf(line, "%1023s", name) != 1 || name[0] == '#') continue;
+		more = (char **)realloc(infile, (*nInfiles + 1) * sizeof(char *));
+		if (more == NULL || (more[*nInfiles] = strdup(name)) == NULL)
+		{
+			perror("read_infile_list");
+			fclose(fp);
+			return(NULL);
+		}
+		infile = more;
+		(*nInfiles)++;
+	}
+	fclose(fp);
+	return(infile);
+}
@@ -45,6 +45,119 @@ typedef struct
 																	r[nrange][nrtype][nRbins]      */
 } ZR_histo;
 
+/* The histograms of a collection from new_histogram_vectors() are one
+	 contiguous block, HISTO_VECTORS_ALIGN aligned, in (range, raintype, bin)
+	 order: HISTO_CUBE(v) is its start, and histogram v[irange][irtype]
+	 starts at HISTO_CUBE(v) + HISTO_OFFSET(irange, irtype, nrtype, nbin).
+	 Whole collections can then be scanned or added in one loop over
+	 nrange*nrtype*nbin bins.
+*/
+#define HISTO_VECTORS_ALIGN 64
+#define HISTO_CUBE(v) ((v)[0][0])
+#define HISTO_OFFSET(irange, irtype, nrtype, nbin) \
+	(((long)(irange)*(nrtype) + (irtype))*(nbin))
+
+/* Binary Z-R histogram file (write_zr_histo_bin; read_zr_histo reads
+	 either format).  Only the non-zero bins are kept, in runs, so a file is
+	 a small fraction of the ASCII one, and it is read from memory (mmap).
+	 Numbers are in the byte order of the writing host, as in the other
+	 binary formats of this package.
+	   ZR_HISTO_BIN_MAGIC
+	   Header (what compatibilityCheck compares, and the times):
+	     char      site_name[HISTO_STR_LEN]
+	     long long start_time, stop_time
+	     float     radar_lat, radar_lon
+	     int       nrange, nrtype, nZbins, nRbins
+	     float     z_low, z_hi, z_res, r_low, r_hi, r_res
+	     float     range_interval[nrange]
+	     char      rain_type_str[nrtype][HISTO_STR_LEN]
+	     unsigned  header checksum: FNV-1a of the magic and header.
+	   Histograms, the Z ones then the R ones, each in HISTO_CUBE order:
+	     int       nruns
+	     nruns x   (int first_bin, int nbins, int count[nbins])
+	   unsigned    histograms checksum: FNV-1a of the histograms.
+	   ZR_HISTO_BIN_END_MAGIC
+*/
+#define ZR_HISTO_BIN_MAGIC     "ZRHBIN01"
+#define ZR_HISTO_BIN_END_MAGIC "ZRHBEND1"
+#define ZR_HISTO_BIN_MAGIC_LEN 8
+
+/* Day cube of Z-R histograms (build_zr_histo -D; zr_histo_query).  The
+	 histograms of consecutive days as running sums: layer d holds the sums
+	 of days 0 to d, so the histograms of days d0 to d1 are layer d1 minus
+	 layer d0-1, two layers read whatever the number of days between.
+	   ZR_HISTO_CUBE_MAGIC
+	   Header, as in the binary Z-R histogram file, and its checksum.
+	   long long first_day     UT day (see ZR_HISTO_DAY) of layer 0.
+	   int       ndays
+	   Zero padding to a multiple of ZR_HISTO_CUBE_ALIGN bytes.
+	   ndays x   int z[nrange*nrtype*nZbins], int r[nrange*nrtype*nRbins]
+	             (a layer, each in HISTO_CUBE order).
+	   ZR_HISTO_CUBE_END_MAGIC
+*/
+#define ZR_HISTO_CUBE_MAGIC     "ZRHCUB01"
+#define ZR_HISTO_CUBE_END_MAGIC "ZRHCEND1"
+#define ZR_HISTO_CUBE_ALIGN 64
+/* UT day (days since 01/01/1970) of time t. */
+#define ZR_HISTO_DAY(t) \
+	((long)((t) >= 0 ? (t) / 86400 : ((t) - 86399) / 86400))
+
+/* The histograms of consecutive days (new_zr_histo_days, zr_histo_day). */
+typedef struct
+{
+	long first_day;              /* Day (ZR_HISTO_DAY) of z[0] and r[0]. */
+	int ndays;
+	int nrange, nrtype, nZbins, nRbins;  /* Of every day's histograms. */
+	int ****z, ****r;            /* z[d], r[d]: the Z and R histograms of
+																	day first_day + d, as those of a
+																	ZR_histo; NULL if none. */
+} ZR_histo_days;
+
+/* Sample file of the entries of Z-R histograms (build_zr_histo -S;
+	 build_pmm_zr_table -b).  Each entry (gauge-VOS record) added to the
+	 histograms, with the bins it added to, so that the histograms of
+	 any resample of the entries, or of the gauge-days, are had without
+	 rereading the intermediate files.  The bins of all the entries add
+	 up to the histograms.
+	   ZR_SAMPLE_MAGIC
+	   Header, as in the binary Z-R histogram file, and its checksum.
+	   int       ngauges, nrecs, nzbins
+	   ngauges x char gauge[ZR_SAMPLE_GAUGE_LEN]    "network gauge_id"
+	   nrecs x   ZR_sample_rec
+	   nzbins x  int zbin     The Z bins of the entries, in order.
+	   ZR_SAMPLE_END_MAGIC
+*/
+#define ZR_SAMPLE_MAGIC     "ZRSMPL01"
+#define ZR_SAMPLE_END_MAGIC "ZRSMEND1"
+#define ZR_SAMPLE_GAUGE_LEN 104
+
+typedef struct
+{
+	int gauge;                   /* Index in the gauge names. */
+	int day;                     /* UT day of the VOS (ZR_HISTO_DAY). */
+	int cell;                    /* Histograms of its bins: irange*nrtype +
+																	irtype (as in HISTO_CUBE).  While
+																	building, -1-irange: raintype not
+																	known yet (see add_zr_samples). */
+	int rbin;                    /* Bin of its R; -1: none. */
+	int nz;                      /* Number of its Z bins. */
+} ZR_sample_rec;
+
+/* The entries of a sample file (new_zr_sample, add_zr_sample_rec). */
+typedef struct
+{
+	int nrange, nrtype, nZbins, nRbins;  /* Of the histograms. */
+	char (*gauge)[ZR_SAMPLE_GAUGE_LEN];
+	int ngauges, gauges_len;
+	int *hash;                   /* Open addressing table of the gauges;
+																	-1: empty. */
+	int hash_len;
+	ZR_sample_rec *rec;
+	int nrecs, recs_len;
+	int *zbin;
+	long nzbins, zbins_len;
+} ZR_sample;
+
 
 
 
@@ -53,9 +166,31 @@ typedef struct
  */
 void print_zr_histo(ZR_histo *histo);
 int ***new_histogram_vectors(int nrange, int nrtype, int nbin);
-void free_histogram_vectors(int ***histo, int nrange, int nrtype);
+void free_histogram_vectors(int ***histo);
 void free_zr_histo(ZR_histo *histo);
+int *add_vectors(int *inVector, int *outVector, long nbins);
+void add_zr_histo(ZR_histo *inHisto, ZR_histo *outHisto);
 ZR_histo *read_zr_histo(char *infile);
 int write_zr_histo(ZR_histo *histo, char *outfile);
+int is_zr_histo_bin_file(char *fname);
+int write_zr_histo_bin(ZR_histo *histo, char *outfile);
+unsigned int zr_histo_checksum(ZR_histo *histo);
+ZR_histo_days *new_zr_histo_days(ZR_histo *histo);
+void free_zr_histo_days(ZR_histo_days *days);
+int zr_histo_day(ZR_histo_days *days, long day);
+int add_zr_histo_days(ZR_histo_days *from, ZR_histo_days *to);
+int write_zr_histo_cube(ZR_histo *histo, ZR_histo_days *days, char *outfile);
+ZR_histo *read_zr_histo_cube(char *cubefile, time_t start_time,
+														 time_t stop_time);
+ZR_sample *new_zr_sample(ZR_histo *histo);
+void free_zr_sample(ZR_sample *sample);
+int zr_sample_gauge(ZR_sample *sample, char *net, int net_len, char *id,
+										int id_len);
+int add_zr_sample_rec(ZR_sample *sample, int gauge, long day, int cell,
+											int rbin, int nz, int **zbin);
+int add_zr_samples(ZR_sample *from, ZR_sample *to, int pending_irtype);
+int write_zr_sample(ZR_histo *histo, ZR_sample *sample, char *outfile);
+ZR_sample *read_zr_sample(char *infile);
+char **read_infile_list(char *list_file, char **infile, int *nInfiles);
 
 